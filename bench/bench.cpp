@@ -0,0 +1,531 @@
+/*
+Benchmarks GQL's common operations over synthetic graphs of
+several sizes. Each (graph, size) case runs in its own child
+process, and each of its operations is reported as one JSON
+object per line, giving latency percentiles, SQL calls per
+operation and the case's peak RSS. Given a baseline report, any
+operation whose median latency regressed past the tolerance
+makes this exit nonzero.
+
+Usage:
+  bench.out [--sizes 1000,10000] [--graphs power_law,grid,cpg]
+            [--output bench.jsonl] [--baseline old.jsonl]
+            [--tolerance 1.5] [--seed 1]
+*/
+
+#include "../src/gql.hpp"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// Below this many microseconds, medians are too noisy to
+/// compare against a baseline
+#define NOISE_FLOOR_US 50.0
+
+/// A generated graph, ready to be loaded
+struct Graph {
+  std::string name;
+  std::vector<std::string> labels;
+  std::vector<std::pair<uint64_t, uint64_t>> edges;
+  std::vector<std::string> edge_labels;
+};
+
+/// The timings (in microseconds) of one operation
+struct Sample {
+  std::string op;
+  std::vector<double> us;
+  uint64_t sql_calls = 0;
+
+  /// The rows written per run, for operations which load rows
+  uint64_t rows = 0;
+};
+
+////////////////////////////////////////////////////////////////
+// Generators: vertex ids are 1-based positions in `labels`
+
+/// Preferential attachment, with `_m` out-edges per vertex
+Graph power_law(const uint64_t &_n, std::mt19937_64 &_rng,
+                const uint64_t &_m = 3) {
+  Graph g;
+  g.name = "power_law";
+  g.labels.assign(_n, "node");
+
+  // Each endpoint appears once per incident edge, so uniform
+  // picks from it are proportional to degree
+  std::vector<uint64_t> ends = {1};
+  for (uint64_t v = 2; v <= _n; ++v) {
+    for (uint64_t i = 0; i < std::min(_m, v - 1); ++i) {
+      const uint64_t to = ends[_rng() % ends.size()];
+      g.edges.push_back({v, to});
+      g.edge_labels.push_back("link");
+      ends.push_back(to);
+    }
+    ends.push_back(v);
+  }
+  return g;
+}
+
+/// A square grid, with edges to the right and downwards
+Graph grid(const uint64_t &_n) {
+  Graph g;
+  g.name = "grid";
+  const uint64_t side =
+      std::max<uint64_t>(1, (uint64_t)std::sqrt((double)_n));
+  g.labels.assign(side * side, "cell");
+  for (uint64_t r = 0; r < side; ++r) {
+    for (uint64_t c = 0; c < side; ++c) {
+      const uint64_t v = r * side + c + 1;
+      if (c + 1 < side) {
+        g.edges.push_back({v, v + 1});
+        g.edge_labels.push_back("right");
+      }
+      if (r + 1 < side) {
+        g.edges.push_back({v, v + side});
+        g.edge_labels.push_back("down");
+      }
+    }
+  }
+  return g;
+}
+
+/// Methods of AST children, each with a CFG through its
+/// statements and calls into other methods
+Graph cpg(const uint64_t &_n, std::mt19937_64 &_rng) {
+  Graph g;
+  g.name = "cpg";
+  const uint64_t per_method = 16;
+  std::vector<uint64_t> methods;
+  while (g.labels.size() < _n) {
+    const uint64_t method = g.labels.size() + 1;
+    methods.push_back(method);
+    g.labels.push_back("METHOD");
+
+    uint64_t prev = method;
+    for (uint64_t i = 1; i < per_method && g.labels.size() < _n;
+         ++i) {
+      const uint64_t v = g.labels.size() + 1;
+      const uint64_t kind = _rng() % 4;
+      g.labels.push_back(kind == 0   ? "CALL"
+                         : kind == 1 ? "IDENTIFIER"
+                         : kind == 2 ? "LITERAL"
+                                     : "STATEMENT");
+      g.edges.push_back({method, v});
+      g.edge_labels.push_back("AST");
+      g.edges.push_back({prev, v});
+      g.edge_labels.push_back("CFG");
+      prev = v;
+    }
+  }
+
+  for (uint64_t v = 1; v <= g.labels.size(); ++v) {
+    if (g.labels[v - 1] == "CALL") {
+      g.edges.push_back({v, methods[_rng() % methods.size()]});
+      g.edge_labels.push_back("CALLS");
+    }
+  }
+  return g;
+}
+
+////////////////////////////////////////////////////////////////
+// Measurement
+
+/// The peak resident set size of this process, in kilobytes.
+/// This never goes down, so each case runs in a fresh process.
+uint64_t peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (uint64_t)usage.ru_maxrss;
+}
+
+/// Time `_fn` once per element of `_args`
+Sample
+measure(const std::string &_op, GQL &_g,
+        const std::vector<uint64_t> &_args,
+        const std::function<void(const uint64_t &)> &_fn) {
+  Sample out;
+  out.op = _op;
+  const uint64_t calls = _g.sql_call_counter;
+  for (const auto &arg : _args) {
+    const auto start = std::chrono::steady_clock::now();
+    _fn(arg);
+    const auto stop = std::chrono::steady_clock::now();
+    out.us.push_back(
+        std::chrono::duration<double, std::micro>(stop - start)
+            .count());
+  }
+  out.sql_calls = _g.sql_call_counter - calls;
+  return out;
+}
+
+/// The `_p`th percentile of some sorted timings
+double percentile(const std::vector<double> &_sorted,
+                  const double &_p) {
+  if (_sorted.empty()) {
+    return 0.0;
+  }
+  // Nearest rank
+  const size_t rank =
+      (size_t)std::ceil(_p / 100.0 * (double)_sorted.size());
+  return _sorted[std::min(_sorted.size(), std::max<size_t>(
+                                              rank, 1)) -
+                 1];
+}
+
+/// `_k` pseudorandom vertex ids in [1, _n]
+std::vector<uint64_t> pick(const uint64_t &_n, const size_t &_k,
+                           std::mt19937_64 &_rng) {
+  std::vector<uint64_t> out;
+  for (size_t i = 0; i < _k; ++i) {
+    out.push_back(_rng() % _n + 1);
+  }
+  return out;
+}
+
+/// One line of the report
+std::string report(const Graph &_graph, const uint64_t &_n,
+                   const Sample &_s) {
+  std::vector<double> sorted = _s.us;
+  std::sort(sorted.begin(), sorted.end());
+  double total = 0.0;
+  for (const auto &us : sorted) {
+    total += us;
+  }
+  const double count = std::max<double>(1.0, sorted.size());
+
+  std::ostringstream out;
+  out << "{\"graph\": \"" << _graph.name << "\""
+      << ", \"n\": " << _n
+      << ", \"vertices\": " << _graph.labels.size()
+      << ", \"edges\": " << _graph.edges.size()
+      << ", \"op\": \"" << _s.op << "\""
+      << ", \"samples\": " << sorted.size()
+      << ", \"mean_us\": " << total / count
+      << ", \"p50_us\": " << percentile(sorted, 50)
+      << ", \"p90_us\": " << percentile(sorted, 90)
+      << ", \"p99_us\": " << percentile(sorted, 99)
+      << ", \"max_us\": " << percentile(sorted, 100)
+      << ", \"sql_calls_per_op\": "
+      << (double)_s.sql_calls / count;
+  if (_s.rows != 0 && total > 0.0) {
+    out << ", \"rows_per_s\": "
+        << (double)_s.rows * count / total * 1e6;
+  }
+  out
+      << ", \"peak_rss_kb\": " << peak_rss_kb() << "}";
+  return out.str();
+}
+
+////////////////////////////////////////////////////////////////
+
+/// Run every operation over one synthetic graph
+std::vector<Sample> run(const Graph &_graph,
+                        std::mt19937_64 &_rng) {
+  std::vector<Sample> out;
+  GQL g;
+  const uint64_t n = _graph.labels.size();
+  const auto time =
+      [&](const std::string &_op,
+          const std::vector<uint64_t> &_args,
+          const std::function<void(const uint64_t &)> &_fn) {
+        out.push_back(measure(_op, g, _args, _fn));
+      };
+
+  // Ingest, as one deferred load: the indices are dropped
+  // before the first write and rebuilt once, by the final flush
+  time("ingest", {0}, [&](const uint64_t &) {
+    auto loader = g.bulk(true);
+    for (uint64_t i = 0; i < n; ++i) {
+      loader.vertex(i + 1, _graph.labels[i],
+                    {{"bucket", std::to_string(i % 10)}});
+    }
+    for (size_t i = 0; i < _graph.edges.size(); ++i) {
+      loader.edge(_graph.edges[i].first, _graph.edges[i].second,
+                  _graph.edge_labels[i]);
+    }
+    loader.flush();
+  });
+  out.back().rows = n + _graph.edges.size();
+  g.commit();
+
+  // Single writes
+  uint64_t next = n;
+  time("add_vertex", pick(n, 200, _rng),
+       [&](const uint64_t &_i) {
+         g.add_vertex(++next).label("extra").tag(
+             "bucket", std::to_string(_i % 10));
+       });
+  const auto targets = pick(n, 200, _rng);
+  time("add_edge", pick(n, 200, _rng), [&](const uint64_t &_i) {
+    g.add_edge(_i, targets[_i % targets.size()]).label("extra");
+  });
+  g.commit();
+
+  // Reads
+  time("k_hop_3", pick(n, 100, _rng), [&](const uint64_t &_i) {
+    g.v()
+        .with_id(_i)
+        .out()
+        .target()
+        .out()
+        .target()
+        .out()
+        .target()
+        .count();
+  });
+  time("traverse", pick(n, 10, _rng), [&](const uint64_t &_i) {
+    g.v().with_id(_i).traverse().count();
+  });
+  time("tag_filter", pick(10, 20, _rng),
+       [&](const uint64_t &_i) {
+         const auto bucket = std::to_string(_i - 1);
+         g.v().with_tag("bucket", bucket).count();
+       });
+  time("label_filter", pick(n, 20, _rng),
+       [&](const uint64_t &_i) {
+         g.v().with_label(_graph.labels[_i - 1]).out().count();
+       });
+  time("degree_filter", pick(4, 10, _rng),
+       [&](const uint64_t &_i) {
+         g.v().with_out_degree(_i - 1).count();
+       });
+  time("exists", pick(n, 200, _rng), [&](const uint64_t &_i) {
+    g.v().with_id(_i).out().exists();
+  });
+
+  // Export
+  const auto dot = [](const uint64_t &_i) {
+    return "/tmp/gql_bench_" + std::to_string(_i) + ".dot";
+  };
+  time("graphviz", {1, 2, 3},
+       [&](const uint64_t &_i) { g.graphviz(dot(_i)); });
+  for (const uint64_t i : {1, 2, 3}) {
+    std::filesystem::remove(dot(i));
+  }
+
+  // Erasure
+  time("erase", pick(n, 50, _rng),
+       [&](const uint64_t &_i) { g.v().with_id(_i).erase(); });
+  g.commit();
+
+  return out;
+}
+
+/**
+ * Generate and run one (graph, size) case in a child process,
+ * so that the peak RSS it reports is its own rather than the
+ * largest of every case so far.
+ * @returns The report lines of the case, or nothing if the
+ * child failed
+ */
+std::optional<std::vector<std::string>>
+run_case(const std::string &_name, const uint64_t &_n,
+         const uint64_t &_seed) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return std::nullopt;
+  }
+  std::cout << std::flush;
+  const pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return std::nullopt;
+  }
+
+  if (pid == 0) {
+    close(fds[0]);
+    int status = 0;
+    try {
+      std::mt19937_64 rng(_seed);
+      const Graph graph =
+          _name == "power_law" ? power_law(_n, rng)
+          : _name == "grid"    ? grid(_n)
+                               : cpg(_n, rng);
+      std::string text;
+      for (const auto &sample : run(graph, rng)) {
+        text += report(graph, _n, sample) + '\n';
+      }
+      for (size_t done = 0; done < text.size();) {
+        const ssize_t wrote = write(fds[1], text.data() + done,
+                                    text.size() - done);
+        if (wrote <= 0) {
+          status = 1;
+          break;
+        }
+        done += (size_t)wrote;
+      }
+    } catch (const std::exception &_e) {
+      std::cerr << _e.what() << '\n';
+      status = 1;
+    }
+    close(fds[1]);
+    _exit(status);
+  }
+
+  close(fds[1]);
+  std::string text;
+  char buffer[4096];
+  ssize_t got;
+  while ((got = read(fds[0], buffer, sizeof(buffer))) > 0) {
+    text.append(buffer, (size_t)got);
+  }
+  close(fds[0]);
+  int status = 0;
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+    return std::nullopt;
+  }
+
+  std::vector<std::string> out;
+  std::stringstream ss(text);
+  for (std::string line; std::getline(ss, line);) {
+    out.push_back(line);
+  }
+  return out;
+}
+
+/// Split a comma-separated argument
+std::vector<std::string> split(const std::string &_what) {
+  std::vector<std::string> out;
+  std::stringstream ss(_what);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) {
+      out.push_back(item);
+    }
+  }
+  return out;
+}
+
+/// Read a string or number field from one report line
+std::string field(const std::string &_line,
+                  const std::string &_key) {
+  const std::string needle = "\"" + _key + "\": ";
+  const size_t at = _line.find(needle);
+  if (at == std::string::npos) {
+    return "";
+  }
+  size_t start = at + needle.size(), stop;
+  if (_line[start] == '"') {
+    ++start;
+    stop = _line.find('"', start);
+  } else {
+    stop = _line.find_first_of(",}", start);
+  }
+  return _line.substr(start, stop - start);
+}
+
+/// The identity of a report line within a run
+std::string key_of(const std::string &_line) {
+  return field(_line, "graph") + "/" + field(_line, "n") + "/" +
+         field(_line, "op");
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<std::string> sizes = {"1000", "10000"};
+  std::vector<std::string> graphs = {"power_law", "grid",
+                                     "cpg"};
+  std::string output, baseline;
+  double tolerance = 1.5;
+  uint64_t seed = 1;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string flag = argv[i], value = argv[i + 1];
+    if (flag == "--sizes") {
+      sizes = split(value);
+    } else if (flag == "--graphs") {
+      graphs = split(value);
+    } else if (flag == "--output") {
+      output = value;
+    } else if (flag == "--baseline") {
+      baseline = value;
+    } else if (flag == "--tolerance") {
+      tolerance = std::stod(value);
+    } else if (flag == "--seed") {
+      seed = std::stoull(value);
+    } else {
+      std::cerr << "Unknown flag " << flag << '\n';
+      return 2;
+    }
+  }
+
+  for (const auto &name : graphs) {
+    if (name != "power_law" && name != "grid" &&
+        name != "cpg") {
+      std::cerr << "Unknown graph " << name << '\n';
+      return 2;
+    }
+  }
+
+  std::vector<std::string> lines;
+  for (const auto &size : sizes) {
+    const uint64_t n = std::stoull(size);
+    for (const auto &name : graphs) {
+      const auto got = run_case(name, n, seed);
+      if (!got.has_value()) {
+        std::cerr << "Case " << name << "/" << n << " failed\n";
+        return 2;
+      }
+      for (const auto &line : *got) {
+        lines.push_back(line);
+        std::cout << line << '\n' << std::flush;
+      }
+    }
+  }
+
+  if (!output.empty()) {
+    std::ofstream file(output);
+    for (const auto &line : lines) {
+      file << line << '\n';
+    }
+  }
+
+  // Compare medians against an earlier run
+  if (!baseline.empty()) {
+    std::ifstream file(baseline);
+    if (!file.is_open()) {
+      std::cerr << "Cannot read baseline " << baseline << '\n';
+      return 2;
+    }
+    std::map<std::string, double> before;
+    std::string line;
+    while (std::getline(file, line)) {
+      if (!field(line, "p50_us").empty()) {
+        before[key_of(line)] = std::stod(field(line, "p50_us"));
+      }
+    }
+
+    bool regressed = false;
+    for (const auto &l : lines) {
+      const auto it = before.find(key_of(l));
+      const double now = std::stod(field(l, "p50_us"));
+      if (it != before.end() && now > NOISE_FLOOR_US &&
+          now > it->second * tolerance) {
+        std::cerr << "Regression: " << key_of(l) << " p50 "
+                  << it->second << " us -> " << now << " us\n";
+        regressed = true;
+      }
+    }
+    if (regressed) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -6,6 +6,7 @@ Jordan Dehmel, '24 - '25
 
 #include "../src/gql.hpp"
 #include <cassert>
+#include <chrono>
 #include <cstring>
 #include <fstream>
 #include <functional>
@@ -65,6 +66,37 @@ using OpType =
 struct Settings {
   // If present, script. Else, stdin
   std::optional<std::string> input_path;
+
+  // If true, the whole script is compiled up front and run
+  // without echoing results
+  bool batch = false;
+
+  // In batch mode, commit every this many statements (zero
+  // commits only at the end)
+  uint64_t commit_every = 0;
+};
+
+// Running totals, as printed by `stats()`
+struct Stats {
+  size_t statements = 0, bulk_loaded = 0;
+  uint64_t sql_calls = 0;
+  double milliseconds = 0.0;
+};
+
+// A labelled `G.add_vertex()` with only `label` and `tag`
+// calls chained onto it, which can go through a bulk load
+struct BulkVertex {
+  std::string graph, label;
+  std::map<std::string, std::string> tags;
+};
+
+// A statement of a batch script, lexed once
+struct Statement {
+  // Its tokens, ending with `;`
+  std::vector<std::string> tokens;
+
+  // Set iff it can be bulk-loaded
+  std::optional<BulkVertex> bulk;
 };
 
 // Lex TEXT
@@ -138,12 +170,86 @@ lex_file(const std::filesystem::path &_fp) {
   return lex(text);
 }
 
+// True iff TOKEN is a string literal
+bool is_literal(const std::string &_token) {
+  return _token.size() >= 2 &&
+         (_token.front() == '\'' || _token.front() == '"');
+}
+
+// Recognize a statement of the form `G.add_vertex().label(...)`
+// followed by any `label` and `tag` calls
+std::optional<BulkVertex>
+compile_bulk(const std::vector<std::string> &_tokens) {
+  const auto at = [&](const size_t &_i) -> std::string {
+    return _i < _tokens.size() ? _tokens[_i] : "";
+  };
+  const auto unquote = [](const std::string &_literal) {
+    return _literal.substr(1, _literal.size() - 2);
+  };
+
+  if (at(1) != "." || at(2) != "add_vertex" || at(3) != "(" ||
+      at(4) != ")" || is_literal(at(0))) {
+    return {};
+  }
+
+  BulkVertex out;
+  out.graph = at(0);
+  bool has_label = false;
+  size_t i = 5;
+  while (at(i) == ".") {
+    if (at(i + 1) == "label" && at(i + 2) == "(" &&
+        is_literal(at(i + 3)) && at(i + 4) == ")") {
+      out.label = unquote(at(i + 3));
+      has_label = true;
+      i += 5;
+    } else if (at(i + 1) == "tag" && at(i + 2) == "(" &&
+               is_literal(at(i + 3)) && at(i + 4) == "," &&
+               is_literal(at(i + 5)) && at(i + 6) == ")") {
+      out.tags[unquote(at(i + 3))] = unquote(at(i + 5));
+      i += 7;
+    } else {
+      return {};
+    }
+  }
+
+  if (!has_label || at(i) != ";" || i + 1 != _tokens.size()) {
+    return {};
+  }
+  return out;
+}
+
+// Split lexed TOKENS into statements
+std::vector<Statement>
+compile_script(const std::vector<std::string> &_tokens) {
+  std::vector<Statement> out;
+  Statement cur;
+  for (const auto &token : _tokens) {
+    if (token == ";" && cur.tokens.empty()) {
+      continue;
+    }
+    cur.tokens.push_back(token);
+    if (token == ";") {
+      cur.bulk = compile_bulk(cur.tokens);
+      out.push_back(std::move(cur));
+      cur = Statement();
+    }
+  }
+
+  if (!cur.tokens.empty()) {
+    throw std::runtime_error("Script ends with an "
+                             "unterminated statement");
+  }
+  return out;
+}
+
 void print_help() {
   std::cout << "GQL CLI\n\n"
-            << " Flag    | Meaning\n"
-            << "---------|-----------------------\n"
-            << " --help  | Show help text (this)\n"
-            << " --input | Execute from a script\n\n"
+            << " Flag           | Meaning\n"
+            << "----------------|---------------------------\n"
+            << " --help         | Show help text (this)\n"
+            << " --input        | Execute from a script\n"
+            << " --batch        | Compile and run all at once\n"
+            << " --commit-every | Commit every N statements\n\n"
             << "Part of GQL, licensed under MIT licence. "
                "Jordan Dehmel, 2024-2025.\n"
             << "GQL " << GQL_MAJOR_VERSION << "."
@@ -223,11 +329,54 @@ int main(int c, char *v[]) {
       }
       settings.input_path = v[i + 1];
       ++i;
+    } else if (strcmp(v[i], "--batch") == 0) {
+      settings.batch = true;
+    } else if (strcmp(v[i], "--commit-every") == 0) {
+      if (i + 1 >= c) {
+        return 1;
+      }
+      try {
+        settings.commit_every = std::stoull(v[i + 1]);
+      } catch (...) {
+        return 1;
+      }
+      settings.batch = true;
+      ++i;
     }
   }
 
-  bool is_running = true;
+  bool is_running = true, timer_on = false;
   std::map<std::string, VarType> variables;
+  Stats stats;
+
+  // The SQL calls made so far by every graph variable
+  const auto sql_calls = [&]() -> uint64_t {
+    uint64_t out = 0;
+    for (const auto &p : variables) {
+      if (std::holds_alternative<std::shared_ptr<GQL>>(
+              p.second)) {
+        out += std::get<std::shared_ptr<GQL>>(p.second)
+                   ->sql_call_counter;
+      }
+    }
+    return out;
+  };
+
+  // Commit (or roll back) every graph variable
+  const auto end_transactions = [&](const bool &_commit) {
+    for (const auto &p : variables) {
+      if (std::holds_alternative<std::shared_ptr<GQL>>(
+              p.second)) {
+        const auto &g =
+            std::get<std::shared_ptr<GQL>>(p.second);
+        if (_commit) {
+          g->commit();
+        } else {
+          g->rollback();
+        }
+      }
+    }
+  };
 
   // Maps function names to their lambda definitions
   const std::map<std::string, OpType> operations = {
@@ -316,6 +465,45 @@ int main(int c, char *v[]) {
             return {};
           },
       },
+      {
+          "timer",
+          [&](OptVarType _what,
+              std::vector<VarType> _args) -> OptVarType {
+            // Toggle per-statement reports
+            assert(!_what.has_value() && _args.size() == 1);
+            assert_holds_alt(_args.at(0), std::string);
+            timer_on =
+                (std::get<std::string>(_args.at(0)) == "on");
+            return {};
+          },
+      },
+      {
+          "stats",
+          [&](OptVarType _what,
+              std::vector<VarType> _args) -> OptVarType {
+            assert(!_what.has_value() && _args.empty());
+            std::cout << "Statements: " << stats.statements
+                      << " (" << stats.bulk_loaded
+                      << " bulk-loaded)\n"
+                      << "Run time:   " << stats.milliseconds
+                      << " ms\n"
+                      << "SQL calls:  " << stats.sql_calls
+                      << '\n';
+            for (const auto &p : variables) {
+              if (std::holds_alternative<std::shared_ptr<GQL>>(
+                      p.second)) {
+                const auto &g =
+                    std::get<std::shared_ptr<GQL>>(p.second);
+                std::cout << "Graph `" << p.first << "`: "
+                          << g->sql_call_counter
+                          << " SQL calls, "
+                          << g->stmt_cache_hits
+                          << " cached statement reuses\n";
+              }
+            }
+            return {};
+          },
+      },
       {
           "v",
           [&](OptVarType _what,
@@ -567,7 +755,7 @@ int main(int c, char *v[]) {
           [&](OptVarType _what,
               std::vector<VarType> _args) -> OptVarType {
             assert(_args.empty() && _what.has_value());
-            std::list<uint64_t> to_convert;
+            std::vector<uint64_t> to_convert;
             if (std::holds_alternative<GQL::Vertices>(
                     _what.value())) {
               to_convert =
@@ -749,15 +937,124 @@ int main(int c, char *v[]) {
     return out;
   };
 
+  // Add a run of N statements to the totals, and report it if
+  // the timer was on throughout
+  const auto account =
+      [&](const std::chrono::steady_clock::time_point &_start,
+          const uint64_t &_calls, const bool &_was_on,
+          const size_t &_n, const bool &_bulk) {
+        const double ms =
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - _start)
+                .count();
+        const uint64_t now = sql_calls();
+        const uint64_t calls = now > _calls ? now - _calls : 0;
+
+        stats.statements += _n;
+        stats.bulk_loaded += _bulk ? _n : 0;
+        stats.milliseconds += ms;
+        stats.sql_calls += calls;
+
+        if (_was_on && timer_on) {
+          std::cout << "Run Time: " << ms << " ms, " << calls
+                    << " SQL calls";
+          if (_bulk) {
+            std::cout << " (" << _n << " statements, bulk)";
+          }
+          std::cout << '\n';
+        }
+      };
+
+  // Run one statement, keeping track of its time and SQL calls
+  const auto run_stmt = [&](const std::vector<std::string> &inp,
+                            uint &pos) -> OptVarType {
+    const auto start = std::chrono::steady_clock::now();
+    const auto calls = sql_calls();
+    const bool was_on = timer_on;
+    const auto out = do_stmt(inp, pos);
+    account(start, calls, was_on, 1, false);
+    return out;
+  };
+
+  // Run a compiled script within one transaction per graph,
+  // committing every `commit_every` statements. Consecutive
+  // bulk-loadable statements on one graph share a bulk load.
+  // On failure, everything since the last commit is rolled
+  // back.
+  const auto run_batch = [&](const std::vector<Statement>
+                                 &_stmts) {
+    const auto n_max = settings.commit_every;
+    size_t since_commit = 0;
+    try {
+      for (size_t i = 0; i < _stmts.size() && is_running;) {
+        const auto start = std::chrono::steady_clock::now();
+        const auto calls = sql_calls();
+        const bool was_on = timer_on;
+        const auto &bulk = _stmts[i].bulk;
+
+        size_t n = 1;
+        if (bulk.has_value() &&
+            variables.contains(bulk->graph) &&
+            std::holds_alternative<std::shared_ptr<GQL>>(
+                variables.at(bulk->graph))) {
+          while (i + n < _stmts.size() &&
+                 (n_max == 0 || since_commit + n < n_max) &&
+                 _stmts[i + n].bulk.has_value() &&
+                 _stmts[i + n].bulk->graph == bulk->graph) {
+            ++n;
+          }
+
+          const auto g = std::get<std::shared_ptr<GQL>>(
+              variables.at(bulk->graph));
+          auto loader = g->bulk();
+          const uint64_t first = g->reserve_vertex_ids(n);
+          for (size_t j = 0; j < n; ++j) {
+            const auto &row = _stmts[i + j].bulk.value();
+            loader.vertex(first + j, row.label, row.tags);
+          }
+          loader.flush();
+          account(start, calls, was_on, n, true);
+        } else {
+          uint pos = 0;
+          do_stmt(_stmts[i].tokens, pos);
+          assert(_stmts[i].tokens[pos] == ";");
+          account(start, calls, was_on, 1, false);
+        }
+
+        i += n;
+        since_commit += n;
+        if (n_max != 0 && since_commit >= n_max) {
+          end_transactions(true);
+          since_commit = 0;
+        }
+      }
+    } catch (...) {
+      end_transactions(false);
+      throw;
+    }
+    end_transactions(true);
+  };
+
   // Call the parser
   try {
-    if (settings.input_path.has_value()) {
+    if (settings.batch) {
+      // Compile the whole script (or stdin) first
+      std::vector<std::string> inp;
+      if (settings.input_path.has_value()) {
+        inp = lex_file(settings.input_path.value());
+      } else {
+        inp = lex(std::string(
+            std::istreambuf_iterator<char>(std::cin),
+            std::istreambuf_iterator<char>()));
+      }
+      run_batch(compile_script(inp));
+    } else if (settings.input_path.has_value()) {
       // From file
       uint pos = 0;
       const std::vector<std::string> inp =
           lex_file(settings.input_path.value());
       while (pos < inp.size() && is_running) {
-        const auto result = do_stmt(inp, pos);
+        const auto result = run_stmt(inp, pos);
         assert(inp[pos] == ";");
         ++pos;
         if (result.has_value()) {
@@ -795,7 +1092,7 @@ int main(int c, char *v[]) {
               break;
             }
 
-            const auto result = do_stmt(accumulator, pos);
+            const auto result = run_stmt(accumulator, pos);
             assert(accumulator[pos] == ";");
             ++pos;
             if (result.has_value()) {
@@ -55,28 +55,44 @@ static_assert(__cplusplus > 201100L, "Invalid C++ std.");
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <exception>
 #include <filesystem>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <sqlite3.h>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 /// The major (MAJ.xxx.xxx) version of GQL
 const static uint GQL_MAJOR_VERSION = 000;
 
 /// The minor (xxx.MIN.xxx) version of GQL
-const static uint GQL_MINOR_VERSION = 003;
+const static uint GQL_MINOR_VERSION = 006;
 
 /// The patch (xxx.xxx.PAT) version of GQL
-const static uint GQL_PATCH_VERSION = 003;
+const static uint GQL_PATCH_VERSION = 6;
 
 /**
  * @var GQL_VERSION
@@ -183,9 +199,9 @@ std::string __gql_format_str(const std::string &_format,
  * @var GQL_BOUNCE_THRESH
  * @brief After this many characters, the query "bounces". This
  * ensures that SQLite will not experience parser overflows.
- * "Bouncing" replaces the existing query with its ids, leading
- * to a less complicated (although not necessarily shorter)
- * query. This must remain preprocessor defined, since we may
+ * "Bouncing" materializes the existing query's ids into a
+ * temporary table and replaces the query with a short lookup
+ * into it. This must remain preprocessor defined, since we may
  * want to change this via the command line at compile time.
  * Defaults to 128.
  */
@@ -193,6 +209,99 @@ std::string __gql_format_str(const std::string &_format,
 #define GQL_BOUNCE_THRESH 128
 #endif
 
+/**
+ * @var GQL_FLAT_TERMS
+ * @brief Chained filters, joins and intersections over the
+ * nodes (or edges) table are combined into one WHERE clause,
+ * which SQLite can plan against its indices in one pass. After
+ * this many conditions, such a query bounces instead. Defaults
+ * to 32.
+ */
+#ifndef GQL_FLAT_TERMS
+#define GQL_FLAT_TERMS 32
+#endif
+
+/**
+ * @var GQL_FLAT_DEPTH
+ * @brief A combined WHERE clause also bounces once its
+ * parentheses nest deeper than this. Each nested subquery
+ * takes several entries of SQLite's fixed-size parser stack,
+ * so this bounds traversals such as `.out().target()` chains.
+ * Defaults to 6.
+ */
+#ifndef GQL_FLAT_DEPTH
+#define GQL_FLAT_DEPTH 6
+#endif
+
+/**
+ * @var GQL_STMT_CACHE_SIZE
+ * @brief The number of prepared statements each GQL instance
+ * keeps alive. Statements are keyed by their SQL text, so a
+ * query shape which is used repeatedly is only parsed and
+ * planned once. When full, the least-recently used statement
+ * is finalized. Defaults to 64.
+ */
+#ifndef GQL_STMT_CACHE_SIZE
+#define GQL_STMT_CACHE_SIZE 64
+#endif
+
+/**
+ * @var GQL_RESULT_CACHE_SIZE
+ * @brief The number of query results each GQL instance keeps
+ * once `cache_results` is enabled. When full, the
+ * least-recently used result is dropped. Defaults to 64.
+ */
+#ifndef GQL_RESULT_CACHE_SIZE
+#define GQL_RESULT_CACHE_SIZE 64
+#endif
+
+/**
+ * @var GQL_BULK_BATCH_SIZE
+ * @brief The number of rows a `GQL::Bulk` loader buffers before
+ * it writes them to the database on its own. Defaults to 8192.
+ */
+#ifndef GQL_BULK_BATCH_SIZE
+#define GQL_BULK_BATCH_SIZE 8192
+#endif
+
+/**
+ * @var GQL_BUSY_TIMEOUT_MS
+ * @brief How long a read-only GQL handle waits on a locked
+ * database before a query fails. Only needed when the writer
+ * does not use WAL. Defaults to 5000.
+ */
+#ifndef GQL_BUSY_TIMEOUT_MS
+#define GQL_BUSY_TIMEOUT_MS 5000
+#endif
+
+/**
+ * @var GQL_PATTERN_SAMPLE
+ * @brief The most rows counted when estimating the size of each
+ * variable of a `GQL::Pattern`, to choose the order in which
+ * they are joined. Defaults to 8192.
+ */
+#ifndef GQL_PATTERN_SAMPLE
+#define GQL_PATTERN_SAMPLE 8192
+#endif
+
+/**
+ * @var GQL_WRITER_BATCH
+ * @brief The number of writes a `GQL::Writer` runs before it
+ * commits them together. Defaults to 1024.
+ */
+#ifndef GQL_WRITER_BATCH
+#define GQL_WRITER_BATCH 1024
+#endif
+
+/**
+ * @var GQL_WRITER_INTERVAL_MS
+ * @brief The longest a `GQL::Writer` holds a write before
+ * committing it. Defaults to 10.
+ */
+#ifndef GQL_WRITER_INTERVAL_MS
+#define GQL_WRITER_INTERVAL_MS 10
+#endif
+
 /**
  * @brief Encodes a string in hex to avoid SQLite JSON issues.
  * Anything encoded this way will not collide.
@@ -200,11 +309,15 @@ std::string __gql_format_str(const std::string &_format,
  * @returns The hexidecimal encoding of the given string
  */
 inline std::string hex_encode(const std::string &_what) {
-  const static std::string to_hex = "0123456789ABCDEF";
-  std::string out;
-  for (const char &c : _what) {
-    out.push_back(to_hex.at((c >> 4) & 0b1111));
-    out.push_back(to_hex.at(c & 0b1111));
+  const static char to_hex[] = "0123456789ABCDEF";
+
+  // Writing into a sized buffer (rather than pushing back)
+  // leaves a branch-free loop which compilers can vectorize
+  std::string out(_what.size() * 2, '\0');
+  for (size_t i = 0; i < _what.size(); ++i) {
+    const auto c = (uint8_t)_what[i];
+    out[2 * i] = to_hex[c >> 4];
+    out[2 * i + 1] = to_hex[c & 0b1111];
   }
   return out;
 }
@@ -215,27 +328,42 @@ inline std::string hex_encode(const std::string &_what) {
  * @returns The string such that hex_encode(returned) == _what
  */
 inline std::string hex_decode(const std::string &_what) {
-  // Map lookup via `.at` ensures we cannot decode non-hex
-  // strings
-  const static std::map<char, uint8_t> char_to_hex = {
-      {'0', 0},  {'1', 1},  {'2', 2},  {'3', 3},
-      {'4', 4},  {'5', 5},  {'6', 6},  {'7', 7},
-      {'8', 8},  {'9', 9},  {'A', 10}, {'B', 11},
-      {'C', 12}, {'D', 13}, {'E', 14}, {'F', 15}};
+  // Maps each byte to its nibble, or to 0xFF if it is not an
+  // (uppercase) hex digit. This ensures we cannot decode
+  // non-hex strings.
+  const static auto from_hex = []() {
+    std::vector<uint8_t> out(256, 0xFF);
+    for (uint8_t i = 0; i < 10; ++i) {
+      out['0' + i] = i;
+    }
+    for (uint8_t i = 0; i < 6; ++i) {
+      out['A' + i] = 10 + i;
+    }
+    return out;
+  }();
 
   if (_what == "NULL") {
     return _what;
   }
 
-  std::string out;
-  for (size_t i = 0; i < _what.size(); i += 2) {
-    const char a = _what.at(i);
-    const char b = _what.at(i + 1);
-    uint8_t first = char_to_hex.at(a);
-    uint8_t second = char_to_hex.at(b);
-    out.push_back((first << 4) | second);
+  if (_what.size() % 2 != 0) {
+    throw std::runtime_error(
+        "Cannot hex decode a string of odd length.");
+  }
+
+  std::string out(_what.size() / 2, '\0');
+  uint8_t invalid = 0;
+  for (size_t i = 0; i < out.size(); ++i) {
+    const uint8_t first = from_hex[(uint8_t)_what[2 * i]];
+    const uint8_t second = from_hex[(uint8_t)_what[2 * i + 1]];
+    invalid |= (first | second) & 0xF0;
+    out[i] = (char)((first << 4) | (second & 0b1111));
   }
 
+  if (invalid != 0) {
+    throw std::runtime_error(
+        "Cannot hex decode a non-hex string.");
+  }
   return out;
 }
 
@@ -254,6 +382,75 @@ inline std::string hex_decode(const std::string &_what) {
  */
 class GQL {
 public:
+  /**
+   * @class GQL::Param
+   * @brief A value bound to a single `?` placeholder of a
+   * query. Labels and tags are held in their decoded form and
+   * are only encoded when the statement is bound, so the SQL
+   * text of a query depends on its shape but never on its
+   * values.
+   */
+  class Param {
+  public:
+    /// How a parameter is bound to its placeholder
+    enum Kind : uint8_t {
+      /// A SQLite integer (ids, counts, limits)
+      INTEGER,
+      /// Text which is bound exactly as given
+      TEXT,
+      /// A label, encoded for storage when bound
+      LABEL,
+      /// A tag key, bound as the argument of a tag accessor
+      KEY,
+      /// A tag value, encoded for storage when bound
+      VALUE,
+      /// A tag key, bound as it is stored (e.g. in a tag table)
+      KEY_NAME,
+      /// A numeric slot of a plan (`number` is the slot), which
+      /// each run of the plan replaces with an INTEGER
+      SLOT,
+    };
+
+    /// How this parameter is to be bound
+    Kind kind;
+
+    /// The value of an INTEGER parameter
+    int64_t number = 0;
+
+    /// The (decoded) value of any non-INTEGER parameter
+    std::string text;
+
+    /// Keeps a bounced set (which this may refer to) alive for
+    /// as long as any query holds this parameter
+    std::shared_ptr<void> hold;
+
+    /**
+     * @brief Construct an INTEGER parameter
+     * @param _number The value to bind
+     */
+    Param(const uint64_t &_number)
+        : kind(INTEGER), number((int64_t)_number) {
+    }
+
+    /**
+     * @brief Construct a signed INTEGER parameter, or a SLOT
+     * @param _kind INTEGER or SLOT
+     * @param _number The value to bind, or the slot number
+     */
+    Param(const Kind &_kind, const int64_t &_number)
+        : kind(_kind), number(_number) {
+    }
+
+    /**
+     * @brief Construct a textual parameter
+     * @param _kind How the text should be encoded when bound
+     * @param _text The decoded text to bind
+     */
+    Param(const Kind &_kind, const std::string &_text)
+        : kind(_kind), text(_text) {
+    }
+  };
+
   /**
    * @class GQL::Result
    * @brief The result of a completed GQL query
@@ -268,36 +465,63 @@ public:
 
     /**
      * @brief Merge rows. Every row in this must have some
-     * row in the other for which the ids match.
+     * row in the other for which the keys match. This runs in
+     * time linear in the sizes of both results.
      * @param _other The result to merge with
+     * @param _key The header of the column to match rows by
      */
-    inline void merge_rows(const Result &_other) {
-      const auto other_indices = _other["id"];
-      std::map<int, int> to_other;
-      for (uint i = 0; i < size(); ++i) {
-        to_other[i] = std::distance(
-            other_indices.begin(),
-            std::find(
-                other_indices.begin(),
-                other_indices.end(), operator[]("id")[i]));
+    inline void merge_rows(const Result &_other,
+                           const std::string &_key = "id") {
+      const auto at_other = _other.index(_key);
+      const auto key = empty() ? 0 : index_of(_key);
+      std::vector<size_t> to_other;
+      to_other.reserve(size());
+      for (const auto &row : body) {
+        const auto it = at_other.find(row[key]);
+        if (it == at_other.end()) {
+          throw std::runtime_error(__gql_format_str(
+              "No row to merge with {} '{}'.", _key, row[key]));
+        }
+        to_other.push_back(it->second);
       }
 
-      // For each column in other which is not in this
-      for (const auto &col : _other.headers) {
-        if (std::find(headers.begin(), headers.end(), col) !=
-            headers.end()) {
-          continue;
+      // Each column in other which is not in this
+      std::vector<size_t> cols;
+      for (size_t i = 0; i < _other.headers.size(); ++i) {
+        if (std::find(headers.begin(), headers.end(),
+                      _other.headers[i]) == headers.end()) {
+          cols.push_back(i);
+          headers.push_back(_other.headers[i]);
         }
-
-        // Append header
-        const auto col_vals = _other[col];
-        headers.push_back(col);
-        for (uint i = 0; i < size(); ++i) {
-          body[i].push_back(col_vals.at(to_other[i]));
+      }
+      for (size_t i = 0; i < size(); ++i) {
+        const auto &from = _other.body[to_other[i]];
+        for (const auto &col : cols) {
+          body[i].push_back(from[col]);
         }
       }
     }
 
+    /**
+     * @brief Hash the values of a column, for lookups which
+     * take constant time
+     * @param _col The column header value
+     * @returns The index of the first row holding each value
+     */
+    inline std::unordered_map<std::string, size_t>
+    index(const std::string &_col = "id") const {
+      std::unordered_map<std::string, size_t> out;
+      if (empty()) {
+        return out;
+      }
+      const auto col = index_of(_col);
+      out.reserve(size());
+      for (size_t i = 0; i < size(); ++i) {
+        out.emplace(body[i][col], i);
+      }
+      return out;
+    }
+
     /**
      * @brief Get row
      * @param _i The index of the row to get
@@ -398,279 +622,735 @@ public:
     }
   };
 
-  // Unit forward declaration
-  class Edges;
-
   /**
-   * @class GQL::Vertices
-   * @brief A class representing zero or more vertices in the
-   * graph
+   * @class Trace
+   * @brief What one SQL statement did, as passed to a hook
+   * given to `GQL::trace`
    */
-  class Vertices {
-  protected:
-    /// A pointer to the owner of this instance: Vertices
-    /// cannot be instantiated without one
-    GQL *const owner;
+  class Trace {
+  public:
+    /// The SQL text, which depends only on the query's shape
+    std::string sql;
 
-    /// The SQL command which can be "collapsed" to resolve
-    /// the query
-    std::string cmd;
+    /// The (decoded) values bound to its placeholders, in order
+    std::vector<std::string> values;
 
-    /**
-     * @brief Construct a Vertices object from some SQL
-     * query. Bounces may happen herein.
-     * @param _owner The GQL instance which is authoritative
-     * over this object.
-     * @param _cmd The command representing the query this
-     * object has been constructed around
-     */
-    Vertices(GQL *const _owner, const std::string &_cmd);
+    /// The number of rows the statement returned
+    uint64_t rows = 0;
 
-    friend class GQL;
+    /// Time spent parsing and planning (zero when cached)
+    std::chrono::nanoseconds prepare{0};
 
-  public:
-    /**
-     * @brief Copy from another instance FROM THE SAME OWNER
-     * @param _other The object to copy from
-     * @returns This object
-     */
-    Vertices &operator=(const Vertices &_other) {
-      assert(owner == _other.owner);
-      cmd = _other.cmd;
-      return *this;
-    }
+    /// Time spent inside SQLite, stepping the statement
+    std::chrono::nanoseconds step{0};
+
+    /// Time spent copying rows out of SQLite
+    std::chrono::nanoseconds read{0};
+
+    /// Whether a cached prepared statement was reused
+    bool cached = false;
+
+    /// Whether this materialized a bounced set
+    bool bounce = false;
 
     /**
-     * @brief Copy from another instance FROM THE SAME OWNER
-     * @param _other The object to copy from
+     * @brief The total time taken by the statement
+     * @returns The sum of the prepare, step and read times
      */
-    inline Vertices(const Vertices &_other)
-        : owner(_other.owner), cmd(_other.cmd) {
+    inline std::chrono::nanoseconds total() const noexcept {
+      return prepare + step + read;
     }
+  };
 
-    /**
-     * @brief Select some sized subset
-     * @param _n The size of the selected group
-     * @returns A sized subset
-     */
-    Vertices limit(const uint64_t &_n) const;
+  /**
+   * @class QueryStats
+   * @brief Totals over every run of one query shape, as kept
+   * by `GQL::collect_stats`
+   */
+  class QueryStats {
+  public:
+    /// The SQL text shared by every run
+    std::string sql;
 
-    /**
-     * @brief Gets the subset of items with the given label
-     * @param _label The desired label
-     * @returns All items contained herein which have the
-     * given label
-     */
-    Vertices with_label(const std::string &_label) const;
+    /// The number of runs
+    uint64_t calls = 0;
 
-    /**
-     * @brief Select all vertices where the given tag key is
-     * associated with the given value
-     * @param _key The key to check the tags for
-     * @param _value The value which must be associated
-     * @returns Some subset of this where the given key
-     * yields the given value
-     */
-    Vertices with_tag(const std::string &_key,
-                      const std::string &_value) const;
+    /// The number of rows returned over every run
+    uint64_t rows = 0;
 
-    /**
-     * @brief Select all vertices with the given id
-     * @param _id The ID to find
-     * @returns Zero or one node with the given ID
-     */
-    Vertices with_id(const uint64_t &_id) const;
+    /// The number of runs which reused a prepared statement
+    uint64_t cached = 0;
 
-    /**
-     * @brief Select all vertices for which the given lambda
-     * returns true
-     * @param _fn The predicate to use to distinguish groups
-     * @returns The set of vertices for which _fn returns true
-     */
-    Vertices
-    where(const std::function<bool(const Vertices &)> &_fn);
+    /// The number of runs which materialized a bounced set
+    uint64_t bounces = 0;
 
-    /**
-     * @brief Select all vertices which are in this, the passed
-     * set, or both
-     * @param _other The other set
-     * @returns Any nodes which are in either or both
-     */
-    Vertices join(const Vertices &_other) const;
+    /// The time taken over every run
+    std::chrono::nanoseconds total{0};
+
+    /// The time taken by the slowest run
+    std::chrono::nanoseconds worst{0};
+  };
+
+  // Unit forward declaration
+  class Cursor;
+
+  /**
+   * @class Table
+   * @brief A columnar query result. Columns which only hold
+   * integers are kept as `int64_t`s, and all text shares one
+   * buffer, so reading a table allocates per column rather than
+   * per cell. Cells are viewed without copying; a
+   * row-of-strings `Result` can be built on demand.
+   */
+  class Table {
+  public:
+    /// The headers of the table
+    std::vector<std::string> headers;
 
     /**
-     * @brief Select all vertices which are in both this and
-     * the passed set
-     * @param _other The other set
-     * @returns The subset of this set which is also in _other
+     * @brief Return the number of rows in the table
+     * @returns The number of rows
      */
-    Vertices intersection(const Vertices &_other) const;
+    inline size_t size() const noexcept {
+      return rows;
+    }
 
     /**
-     * @brief Select all vertices which are in the universe set
-     * but not this set
-     * @param _universe The "universe" to exclude all of our
-     * nodes from
-     * @return That group, minus this group
+     * @brief Returns true iff the table has no rows
+     * @returns The emptiness of the table
      */
-    Vertices complement(const Vertices &_universe) const;
+    inline bool empty() const noexcept {
+      return rows == 0;
+    }
 
     /**
-     * @brief Select all vertices which are in this set but not
-     * the given subgroup
-     * @param _subgroup Any vertices herein will not be output
-     * @returns This group, minus that group
+     * @brief Returns the index of the given column (given
+     * that it exists)
+     * @param _what The header to find the index of
+     * @returns The index such that headers.at(index) ==
+     * _what
      */
-    Vertices excluding(const Vertices &_subgroup) const;
+    inline size_t index_of(const std::string &_what) const {
+      auto it =
+          std::find(headers.begin(), headers.end(), _what);
+      if (it == headers.end()) {
+        throw std::runtime_error(__gql_format_str(
+            "Header value '{}' is not present in "
+            "results.",
+            _what));
+      }
+      return std::distance(headers.begin(), it);
+    }
 
     /**
-     * @brief Select the label from all nodes in this set
-     * @returns The labels of all vertices in this set
+     * @brief Returns true iff every value in the given column
+     * is an integer (this is true of any column of an empty
+     * table)
+     * @param _col The index of the column
+     * @returns Whether the column is stored as integers
      */
-    Result label() const;
+    inline bool is_integer(const size_t &_col) const {
+      return cols.at(_col).integer;
+    }
 
     /**
-     * @brief Select the value associated with the given key
-     * for all vertices in this set
-     * @param _key The single key to fetch
-     * @returns The values associated with that key for ecah
-     * node
+     * @brief View an integer column. No conversion or copy is
+     * done.
+     * @param _col The index of the column
+     * @returns The values of each row at the given column
      */
-    Result tag(const std::string &_key) const;
+    inline const std::vector<int64_t> &
+    integers(const size_t &_col) const {
+      if (!is_integer(_col)) {
+        throw std::runtime_error(__gql_format_str(
+            "Column '{}' does not hold integers.",
+            headers.at(_col)));
+      }
+      return cols[_col].ints;
+    }
 
     /**
-     * @brief Select the value associated with the given keys
-     * for all vertices in this set
-     * @param _keys The set of keys to fetch
-     * @returns The associated values for every node
+     * @brief View an integer column. No conversion or copy is
+     * done.
+     * @param _col The column header value
+     * @returns The values of each row at the given column
      */
-    Result tag(const std::list<std::string> &_keys) const;
+    inline const std::vector<int64_t> &
+    integers(const std::string &_col) const {
+      return integers(index_of(_col));
+    }
 
     /**
-     * @brief Get the set of all keys
-     * @returns All keys that have values for these edges
+     * @brief View a cell of a text column. The view is valid
+     * for as long as the table is.
+     * @param _row The index of the row
+     * @param _col The index of the column
+     * @returns A view of the cell's text
      */
-    std::list<std::string> keys() const;
+    inline std::string_view text(const size_t &_row,
+                                 const size_t &_col) const {
+      if (is_integer(_col)) {
+        throw std::runtime_error(__gql_format_str(
+            "Column '{}' does not hold text.",
+            headers.at(_col)));
+      }
+      const auto &span = cols[_col].spans.at(_row);
+      return std::string_view(arena).substr(span.first,
+                                            span.second);
+    }
 
     /**
-     * @brief Select the id of all vertices in this set
-     * @returns All IDs within this set
+     * @brief View every cell of a text column
+     * @param _col The column header value
+     * @returns Views of the values of each row at the given
+     * column
      */
-    std::list<uint64_t> id() const;
+    inline std::vector<std::string_view>
+    text(const std::string &_col) const {
+      const auto ind = index_of(_col);
+      std::vector<std::string_view> out;
+      out.reserve(rows);
+      for (size_t i = 0; i < rows; ++i) {
+        out.push_back(text(i, ind));
+      }
+      return out;
+    }
 
     /**
-     * @brief Returns whether this set is empty
+     * @brief Get a copy of any cell as text, as `Result` would
+     * hold it
+     * @param _row The index of the row
+     * @param _col The index of the column
+     * @returns The cell as a string
      */
-    bool empty() const;
+    inline std::string at(const size_t &_row,
+                          const size_t &_col) const {
+      if (is_integer(_col)) {
+        return std::to_string(cols[_col].ints.at(_row));
+      }
+      return std::string(text(_row, _col));
+    }
 
     /**
-     * @brief Returns whether this set is non-empty
+     * @brief Hash the values of a column, as `Result::index`
+     * does
+     * @param _col The column header value
+     * @returns The index of the first row holding each value
      */
-    bool exists() const;
+    inline std::unordered_map<std::string, size_t>
+    index(const std::string &_col = "id") const {
+      const auto col = index_of(_col);
+      std::unordered_map<std::string, size_t> out;
+      out.reserve(rows);
+      for (size_t i = 0; i < rows; ++i) {
+        out.emplace(at(i, col), i);
+      }
+      return out;
+    }
 
     /**
-     * @brief Set the label associated with all the nodes herein
-     * @param _label The label to set
-     * @returns These nodes after the operation is performed
+     * @brief Merge rows, as `Result::merge_rows` does. Integer
+     * keys are matched without being converted to text.
+     * @param _other The table to merge with
+     * @param _key The header of the column to match rows by
      */
-    Vertices label(const std::string &_label);
+    inline void merge_rows(const Table &_other,
+                           const std::string &_key = "id") {
+      const auto key = empty() ? 0 : index_of(_key);
+      const auto other_key =
+          empty() ? 0 : _other.index_of(_key);
+      const auto missing = [&](const size_t &_row) {
+        return std::runtime_error(
+            __gql_format_str("No row to merge with {} '{}'.",
+                             _key, at(_row, key)));
+      };
+
+      std::vector<size_t> to_other(rows);
+      if (empty()) {
+        // Only the headers are merged
+      } else if (is_integer(key) &&
+                 _other.is_integer(other_key)) {
+        std::unordered_map<int64_t, size_t> at_other;
+        at_other.reserve(_other.rows);
+        const auto &theirs = _other.cols[other_key].ints;
+        for (size_t i = 0; i < theirs.size(); ++i) {
+          at_other.emplace(theirs[i], i);
+        }
+        const auto &ours = cols[key].ints;
+        for (size_t i = 0; i < rows; ++i) {
+          const auto it = at_other.find(ours[i]);
+          if (it == at_other.end()) {
+            throw missing(i);
+          }
+          to_other[i] = it->second;
+        }
+      } else {
+        const auto at_other = _other.index(_key);
+        for (size_t i = 0; i < rows; ++i) {
+          const auto it = at_other.find(at(i, key));
+          if (it == at_other.end()) {
+            throw missing(i);
+          }
+          to_other[i] = it->second;
+        }
+      }
+
+      // Each column in other which is not in this
+      for (size_t c = 0; c < _other.headers.size(); ++c) {
+        if (std::find(headers.begin(), headers.end(),
+                      _other.headers[c]) != headers.end()) {
+          continue;
+        }
+        const auto &from = _other.cols[c];
+        Column col;
+        col.integer = from.integer;
+        if (from.integer) {
+          col.ints.reserve(rows);
+          for (const auto &row : to_other) {
+            col.ints.push_back(from.ints[row]);
+          }
+        } else {
+          col.spans.reserve(rows);
+          for (const auto &row : to_other) {
+            const auto &span = from.spans[row];
+            col.spans.emplace_back(arena.size(), span.second);
+            arena.append(_other.arena, span.first, span.second);
+          }
+        }
+        headers.push_back(_other.headers[c]);
+        cols.push_back(std::move(col));
+      }
+    }
 
     /**
-     * @brief Set some key-value pair for all items herein
-     * @param _key The key to associate
-     * @param _value The value to associate
-     * @returns This set after association
+     * @brief Build the equivalent row-of-strings result
+     * @returns This as a `Result`
      */
-    Vertices tag(const std::string &_key,
-                 const std::string &_value);
+    inline operator Result() const {
+      Result out;
+      if (empty()) {
+        return out;
+      }
+      out.headers = headers;
+      out.body.reserve(rows);
+      for (size_t row = 0; row < rows; ++row) {
+        std::vector<std::string> cells;
+        cells.reserve(headers.size());
+        for (size_t col = 0; col < headers.size(); ++col) {
+          cells.push_back(at(row, col));
+        }
+        out.body.push_back(std::move(cells));
+      }
+      return out;
+    }
 
-    /// Erase these nodes from the database. This will also
-    /// erase any and all edges which reference the deleted
-    /// nodes as either source or target.
-    void erase();
+    friend class GQL;
+    friend class Cursor;
+
+  protected:
+    /// The storage of a single column
+    struct Column {
+      /// Whether every value so far was an integer
+      bool integer = true;
+
+      /// The values, if this is an integer column
+      std::vector<int64_t> ints;
+
+      /// (offset, length) of each value in the arena, if this
+      /// is a text column
+      std::vector<std::pair<size_t, size_t>> spans;
+    };
+
+    /// The columns, in the order of the headers
+    std::vector<Column> cols;
+
+    /// The text of every text cell
+    std::string arena;
+
+    /// The number of rows
+    size_t rows = 0;
 
     /**
-     * @brief Run some function given this set, then
-     * continue on. For instance,
-     * ```cpp
-     * a.lemma([](auto self){
-     *    self.tag("foo", "fizz"); }
-     * ).erase();
-     * ```
-     * would execute a tag, then erase on the same node.
-     * @param _fn The function to call with this set as an
-     * argument
-     * @returns This set after the function has been run
+     * @brief Append a text cell to a column, converting it to
+     * a text column if needed
+     * @param _col The index of the column
+     * @param _what The text of the cell
      */
-    Vertices lemma(const std::function<void(Vertices)> _fn);
+    inline void push_text(const size_t &_col,
+                          const std::string_view &_what) {
+      auto &col = cols[_col];
+      if (col.integer) {
+        col.integer = false;
+        col.spans.reserve(col.ints.size() + 1);
+        for (const auto &i : col.ints) {
+          const auto as_text = std::to_string(i);
+          col.spans.emplace_back(arena.size(), as_text.size());
+          arena += as_text;
+        }
+        col.ints.clear();
+        col.ints.shrink_to_fit();
+      }
+      col.spans.emplace_back(arena.size(), _what.size());
+      arena.append(_what.data(), _what.size());
+    }
 
     /**
-     * @brief Add edges from each node in this set to each node
-     * in the passed set (cartesian product).
-     * @param _to The target nodes
-     * @returns The edges which were added
+     * @brief Append an integer cell to a column
+     * @param _col The index of the column
+     * @param _what The value of the cell
      */
-    Edges add_edge(const Vertices &_to) const;
+    inline void push_integer(const size_t &_col,
+                             const int64_t &_what) {
+      if (cols[_col].integer) {
+        cols[_col].ints.push_back(_what);
+      } else {
+        push_text(_col, std::to_string(_what));
+      }
+    }
 
     /**
-     * @brief Get all edges leading into these vertices
-     * @returns The edges leading into these nodes
+     * @brief Append the current row of a statement which is
+     * positioned on a row
+     * @param _stmt The statement to read from
+     * @param _decode Which columns hold encoded text which must
+     * be decoded (missing entries are false)
      */
-    Edges in() const;
+    inline void append(sqlite3_stmt *_stmt,
+                       const std::vector<bool> &_decode) {
+      for (size_t i = 0; i < cols.size(); ++i) {
+        switch (sqlite3_column_type(_stmt, (int)i)) {
+        case SQLITE_INTEGER:
+          push_integer(i, sqlite3_column_int64(_stmt, (int)i));
+          break;
+        case SQLITE_NULL:
+          push_text(i, "NULL");
+          break;
+        default: {
+          const std::string_view text(
+              (const char *)sqlite3_column_text(_stmt, (int)i),
+              sqlite3_column_bytes(_stmt, (int)i));
+          if (i < _decode.size() && _decode[i]) {
+            push_text(i, hex_decode(std::string(text)));
+          } else {
+            push_text(i, text);
+          }
+          break;
+        }
+        }
+      }
+      ++rows;
+    }
+  };
 
+  /**
+   * @class Cursor
+   * @brief A forward-only view over the rows of a query, which
+   * are read from SQLite one at a time as the cursor advances
+   * rather than being buffered. A cursor owns its own prepared
+   * statement, so other queries may run while it is open, but
+   * it must be destroyed before the GQL object it came from.
+   */
+  class Cursor {
+  public:
     /**
-     * @brief Get all edges leading out of these vertices
-     * @returns The edges leading out of these nodes
+     * @class Row
+     * @brief The row a cursor is positioned on. It is only
+     * valid until the cursor advances.
      */
-    Edges out() const;
+    class Row {
+    public:
+      /**
+       * @brief Return the number of columns in the row
+       * @returns The width of the row
+       */
+      inline size_t size() const noexcept {
+        return cursor->names.size();
+      }
+
+      /**
+       * @brief Returns true iff the given cell is an integer
+       * @param _col The index of the column
+       * @returns Whether the cell is an integer
+       */
+      inline bool is_integer(const size_t &_col) const {
+        return sqlite3_column_type(cursor->stmt, (int)_col) ==
+               SQLITE_INTEGER;
+      }
+
+      /**
+       * @brief Returns true iff the given cell is NULL
+       * @param _col The index of the column
+       * @returns Whether the cell is NULL
+       */
+      inline bool is_null(const size_t &_col) const {
+        return sqlite3_column_type(cursor->stmt, (int)_col) ==
+               SQLITE_NULL;
+      }
+
+      /**
+       * @brief Read a cell as an integer, without creating a
+       * string
+       * @param _col The index of the column
+       * @returns The value of the cell
+       */
+      inline int64_t integer(const size_t &_col) const {
+        return sqlite3_column_int64(cursor->stmt, (int)_col);
+      }
+
+      /**
+       * @brief Get a cell as text, as `Result` would hold it
+       * @param _col The index of the column
+       * @returns The (decoded) value of the cell
+       */
+      inline std::string operator[](const size_t &_col) const {
+        const auto text =
+            sqlite3_column_text(cursor->stmt, (int)_col);
+        if (text == nullptr) {
+          return "NULL";
+        }
+        std::string out(
+            (const char *)text,
+            sqlite3_column_bytes(cursor->stmt, (int)_col));
+        if (_col < cursor->decode.size() &&
+            cursor->decode[_col]) {
+          return hex_decode(out);
+        }
+        return out;
+      }
+
+      friend class Cursor;
+
+    protected:
+      Row(const Cursor *const _cursor) : cursor(_cursor) {}
+
+      /// The cursor this is a row of
+      const Cursor *cursor;
+    };
 
     /**
-     * @brief Gets only the vertices with the given in-degree
-     * @param _count The desired in-degree
-     * @returns All vertices in this set with the given
-     * in-degree
+     * @class iterator
+     * @brief An input iterator which advances its cursor
      */
-    Vertices with_in_degree(const uint64_t &_count) const;
+    class iterator {
+    public:
+      /**
+       * @brief Get the row the cursor is positioned on
+       * @returns The current row
+       */
+      inline Row operator*() const {
+        return Row(cursor);
+      }
+
+      /**
+       * @brief Advance the cursor to the next row
+       * @returns This iterator
+       */
+      inline iterator &operator++() {
+        cursor->advance();
+        return *this;
+      }
+
+      /**
+       * @brief Iterators are only ever compared to the end,
+       * which they equal once their cursor is done
+       * @param _other The iterator to compare with
+       * @returns True iff both are at the same position
+       */
+      inline bool operator==(const iterator &_other) const {
+        return at_end() == _other.at_end() &&
+               (at_end() || cursor == _other.cursor);
+      }
+
+      /**
+       * @brief Inequality of iterators
+       * @param _other The iterator to compare with
+       * @returns True iff they are at different positions
+       */
+      inline bool operator!=(const iterator &_other) const {
+        return !(*this == _other);
+      }
+
+      friend class Cursor;
+
+    protected:
+      iterator(Cursor *const _cursor) : cursor(_cursor) {}
+
+      /**
+       * @brief Check if this is at the end of iteration
+       * @returns True iff there is no current row
+       */
+      inline bool at_end() const noexcept {
+        return cursor == nullptr || cursor->finished;
+      }
+
+      /// The cursor being iterated, or nullptr for the end
+      Cursor *cursor;
+    };
+
+    Cursor(const Cursor &_other) = delete;
+    Cursor &operator=(const Cursor &_other) = delete;
 
     /**
-     * @brief Gets only the vertices with the given out-degree
-     * @param _count The desired out-degree
-     * @returns All vertices in this set with the given
-     * out-degree
+     * @brief Take over another cursor's statement. The other
+     * cursor is left done.
+     * @param _other The cursor to move from
      */
-    Vertices with_out_degree(const uint64_t &_count) const;
+    Cursor(Cursor &&_other) noexcept;
+
+    /// Finalize the statement
+    ~Cursor();
 
     /**
-     * @brief Gets the in-degrees of the given nodes
-     * @returns The in-degrees of the nodes
+     * @brief Get the column headers
+     * @returns The titles of every column
      */
-    Result in_degree() const;
+    inline const std::vector<std::string> &
+    headers() const noexcept {
+      return names;
+    }
 
     /**
-     * @brief Gets the out-degrees of the given nodes
-     * @returns The out-degrees of the nodes
+     * @brief Begin iteration, fetching the first row if it has
+     * not been fetched already
+     * @returns An iterator at the current row
      */
-    Result out_degree() const;
+    iterator begin();
 
     /**
-     * @brief Break into a std::list where each entry is a
-     * single vertex. This is useful for foreach operations.
-     * @returns An itemized version of this set where each entry
-     * is a single node.
+     * @brief The end of iteration
+     * @returns An iterator which is past the last row
      */
-    std::list<Vertices> each() const;
+    inline iterator end() noexcept {
+      return iterator(nullptr);
+    }
 
-    friend class Edges;
+    /**
+     * @brief Returns true iff every row has been read
+     * @returns Whether there are no more rows
+     */
+    bool done();
+
+    /**
+     * @brief Read up to a batch of rows, starting from the
+     * current one, into a columnar table
+     * @param _batch_size The maximum number of rows to read
+     * @returns The next rows, or an empty table once the cursor
+     * is done
+     */
+    Table next(const size_t &_batch_size);
+
+    friend class GQL;
+
+  protected:
+    /**
+     * @brief Prepare and bind a single statement. No rows are
+     * read until the cursor is first used.
+     * @param _owner The GQL object to query
+     * @param _sql The SQL statement to run
+     * @param _params The values to bind to the `?` placeholders
+     * of `_sql`, in order
+     * @param _decode Which columns hold encoded text which must
+     * be decoded (missing entries are false)
+     * @param _headers The column headers, or empty to use the
+     * names SQLite gives
+     */
+    Cursor(GQL *const _owner, const std::string &_sql,
+           const std::vector<Param> &_params,
+           const std::vector<bool> &_decode,
+           const std::vector<std::string> &_headers = {});
+
+    /// Step to the next row, or set `finished`
+    void advance();
+
+    /// The statement, owned by this cursor
+    sqlite3_stmt *stmt = nullptr;
+
+    /// The SQL text of the statement, for error reporting
+    std::string sql_text;
+
+    /// The column headers
+    std::vector<std::string> names;
+
+    /// Which columns hold encoded text
+    std::vector<bool> decode;
+
+    /// Whether the first row has been fetched
+    bool started = false;
+
+    /// Whether every row has been read
+    bool finished = false;
+
+    /// The owner, for reporting once every row is read
+    std::shared_ptr<GQL *> handle;
+
+    /// The statement's timings, or nullptr if not traced
+    std::unique_ptr<Trace> trace;
+
+    /// Report the trace (if any) to the owner (if alive)
+    void report() noexcept;
+  };
+
+  /// The order in which a traversal explores the graph
+  enum Order : uint8_t {
+    /// Breadth-first: Shallow vertices are expanded first
+    BFS,
+    /// Depth-first: Deep vertices are expanded first
+    DFS,
   };
 
+  /// A traversal depth meaning "no limit"
+  constexpr static uint64_t NO_LIMIT = UINT64_MAX;
+
   /**
-   * @class GQL::Edges
-   * @brief A class representing zero or more edges in a GQL
+   * The layout in which labels and tags are stored. This is
+   * kept in the database's `user_version`.
+   */
+  enum Format : uint8_t {
+    /// Hex-encoded labels, tag keys and tag values (up to GQL
+    /// 0.4)
+    HEX = 0,
+    /// Raw UTF-8 labels, tag keys and tag values
+    RAW = 1,
+    /// Labels and tag keys as integer ids into the `gql_dict`
+    /// table, and raw UTF-8 tag values
+    DICT = 2,
+  };
+
+  /**
+   * @class Record
+   * @brief A decoded copy of a single vertex or edge, as read
+   * by a single scan of its set. Unlike a `Vertices` or `Edges`
+   * object, reading a record's fields runs no queries.
+   */
+  class Record {
+  public:
+    /// The id of the vertex or edge
+    uint64_t id = 0;
+
+    /// The label
+    std::string label;
+
+    /// All tags, as key-value pairs
+    std::map<std::string, std::string> tags;
+
+    /// The source of an edge (zero for vertices)
+    uint64_t source = 0;
+
+    /// The target of an edge (zero for vertices)
+    uint64_t target = 0;
+  };
+
+  // Unit forward declaration
+  class Edges;
+
+  /**
+   * @class GQL::Vertices
+   * @brief A class representing zero or more vertices in the
    * graph
    */
-  class Edges {
+  class Vertices {
   protected:
-    /// A pointer to the owner of this instance: Edges
+    /// A pointer to the owner of this instance: Vertices
     /// cannot be instantiated without one
     GQL *const owner;
 
@@ -678,15 +1358,87 @@ public:
     /// the query
     std::string cmd;
 
+    /// The values bound to the placeholders of `cmd`, in the
+    /// order in which the placeholders appear
+    std::vector<Param> params;
+
+    /// Whether `cmd` selects straight from the nodes table
+    /// by `cond`, so that chained filters can extend a single
+    /// WHERE clause rather than nest another query
+    bool flat;
+
+    /// The WHERE condition of a flat query (empty for every
+    /// vertex)
+    std::string cond;
+
+    /// The number of conditions combined into `cond`
+    uint64_t terms;
+
     /**
-     * @brief Construct an Edges object from some SQL
+     * @brief Construct a Vertices object from some SQL
      * query. Bounces may happen herein.
      * @param _owner The GQL instance which is authoritative
      * over this object.
      * @param _cmd The command representing the query this
      * object has been constructed around
+     * @param _params The values bound to the placeholders of
+     * `_cmd`
+     */
+    Vertices(GQL *const _owner, const std::string &_cmd,
+             const std::vector<Param> &_params = {});
+
+    /**
+     * @brief Construct a flat query over the nodes table.
+     * Bounces once too many conditions have been combined.
+     * @param _owner The GQL instance which is authoritative
+     * over the result
+     * @param _cond The WHERE condition (empty for all rows)
+     * @param _params The values bound to its placeholders
+     * @param _terms The number of conditions in `_cond`
+     * @returns The flat query
+     */
+    static Vertices
+    selecting(GQL *const _owner, const std::string &_cond,
+              const std::vector<Param> &_params,
+              const uint64_t &_terms);
+
+    /**
+     * @brief Materializes this query's ids, replacing it with
+     * a flat lookup into them
+     */
+    void bounce_now();
+
+    /**
+     * @brief Any query as a condition on the nodes table
+     * @returns `cond` for a flat query, otherwise an id lookup
+     * into `cmd`
+     */
+    std::string as_cond() const;
+
+    /**
+     * @brief An SQL query which selects the ids herein
+     * @returns The query, with `params` as its placeholders
+     */
+    std::string ids() const;
+
+    /**
+     * @brief The number of conditions this query contributes
+     * when combined into another one
+     * @returns `terms` for a flat query, otherwise 1
+     */
+    uint64_t weight() const;
+
+    /**
+     * @brief Adds a condition to this query, extending its
+     * WHERE clause
+     * @param _cond The condition to AND with this query
+     * @param _params The values bound to its placeholders
+     * @param _terms The number of conditions in `_cond`
+     * @returns All items herein which meet the condition
      */
-    Edges(GQL *const _owner, const std::string &_cmd);
+    Vertices narrow(const std::string &_cond,
+                    const std::vector<Param> &_params,
+                    const uint64_t &_terms = 1) const;
 
     friend class GQL;
 
@@ -696,9 +1448,13 @@ public:
      * @param _other The object to copy from
      * @returns This object
      */
-    Edges &operator=(const Edges &_other) {
+    Vertices &operator=(const Vertices &_other) {
       assert(owner == _other.owner);
       cmd = _other.cmd;
+      params = _other.params;
+      flat = _other.flat;
+      cond = _other.cond;
+      terms = _other.terms;
       return *this;
     }
 
@@ -706,32 +1462,19 @@ public:
      * @brief Copy from another instance FROM THE SAME OWNER
      * @param _other The object to copy from
      */
-    inline Edges(const Edges &_other)
-        : owner(_other.owner), cmd(_other.cmd) {
+    inline Vertices(const Vertices &_other)
+        : owner(_other.owner), cmd(_other.cmd),
+          params(_other.params), flat(_other.flat),
+          cond(_other.cond), terms(_other.terms) {
     }
 
     /**
-     * @brief Select some sized subset
+     * @brief Select some sized subset: those with the lowest
+     * ids
      * @param _n The size of the selected group
      * @returns A sized subset
      */
-    Edges limit(const uint64_t &_n) const;
-
-    /**
-     * @brief Select all edges with their source in the given
-     * set. This is equivalent to `_source.out()`.
-     * @param _source A set of vertices
-     * @returns All edges leading out from _source
-     */
-    Edges with_source(const GQL::Vertices &_source) const;
-
-    /**
-     * @brief Select all edges with their target in the given
-     * set. This is equivalent to `_source.in()`.
-     * @param _source A set of vertices
-     * @returns All edges leading into _source
-     */
-    Edges with_target(const GQL::Vertices &_source) const;
+    Vertices limit(const uint64_t &_n) const;
 
     /**
      * @brief Gets the subset of items with the given label
@@ -739,7 +1482,7 @@ public:
      * @returns All items contained herein which have the
      * given label
      */
-    Edges with_label(const std::string &_label) const;
+    Vertices with_label(const std::string &_label) const;
 
     /**
      * @brief Select all vertices where the given tag key is
@@ -749,108 +1492,165 @@ public:
      * @returns Some subset of this where the given key
      * yields the given value
      */
-    Edges with_tag(const std::string &_key,
-                   const std::string &_value) const;
+    Vertices with_tag(const std::string &_key,
+                      const std::string &_value) const;
 
     /**
-     * @brief Get all edges which have the given id
+     * @brief Select all vertices with the given id
      * @param _id The ID to find
-     * @returns Zero or one edge with this ID
+     * @returns Zero or one node with the given ID
      */
-    Edges with_id(const uint64_t &_id) const;
+    Vertices with_id(const uint64_t &_id) const;
 
     /**
      * @brief Select all vertices for which the given lambda
      * returns true
-     * @param _fn The fn to run all edges through
-     * @returns A set of edges where _fn returned true
+     * @param _fn The predicate to use to distinguish groups
+     * @returns The set of vertices for which _fn returns true
      */
-    Edges where(const std::function<bool(const Edges &)> &_fn);
+    Vertices
+    where(const std::function<bool(const Vertices &)> &_fn);
 
     /**
-     * @brief Return all values which are in either this set or
-     * the passed one or both
+     * @brief Select all vertices whose records satisfy the
+     * given predicate. Every vertex is read in one scan and the
+     * matches are collected into a single set, so this runs a
+     * constant number of queries (plus any `_fn` runs itself).
+     * `_fn` must not modify the graph.
+     * @param _fn The predicate to run each vertex's record
+     * through
+     * @returns The set of vertices for which _fn returns true
+     */
+    Vertices filter(
+        const std::function<bool(const Record &)> &_fn) const;
+
+    /**
+     * @brief Select all vertices which are in this, the passed
+     * set, or both
      * @param _other The other set
-     * @returns This set, inclusively unioned with the other
+     * @returns Any nodes which are in either or both
      */
-    Edges join(const Edges &_other) const;
+    Vertices join(const Vertices &_other) const;
 
     /**
-     * @brief Return all values which are in both this set and
-     * the other
-     * @param _other The other set, which all returned values
-     * must also be in
-     * @returns The set of edges in both this and the other
+     * @brief Select all vertices which are in both this and
+     * the passed set
+     * @param _other The other set
+     * @returns The subset of this set which is also in _other
      */
-    Edges intersection(const Edges &_other) const;
+    Vertices intersection(const Vertices &_other) const;
 
     /**
-     * @brief Return all values which are in the passed set but
-     * not in this set
-     * @param _universe The set of all edges, from which this
-     * set will be excluded
-     * @returns All edges in _universe, minus any that are in
-     * this
+     * @brief Select all vertices which are in the universe set
+     * but not this set
+     * @param _universe The "universe" to exclude all of our
+     * nodes from
+     * @return That group, minus this group
      */
-    Edges complement(const Edges &_universe) const;
+    Vertices complement(const Vertices &_universe) const;
 
     /**
-     * @brief Return all values which are in this set but not in
-     * the given set
-     * @param _other The other set, which none of the returned
-     * values shall be in
-     * @returns Any edges in this which are not in _other
+     * @brief Select all vertices which are in this set but not
+     * the given subgroup
+     * @param _subgroup Any vertices herein will not be output
+     * @returns This group, minus that group
      */
-    Edges excluding(const Edges &_other) const;
+    Vertices excluding(const Vertices &_subgroup) const;
 
     /**
-     * @brief Get the label of all edges in this set
-     * @returns The labels of all edges in this set
+     * @brief Select the label from all nodes in this set
+     * @returns The labels of all vertices in this set
      */
     Result label() const;
 
     /**
-     * @brief Get the values associated with the given key
-     * @param _key The tag key to check
-     * @returns A SQL result representing the output
+     * @brief Select the value associated with the given key
+     * for all vertices in this set
+     * @param _key The single key to fetch
+     * @returns The values associated with that key for ecah
+     * node
      */
     Result tag(const std::string &_key) const;
 
     /**
-     * @brief Get the values associated with the given keys
+     * @brief Select the value associated with the given keys
+     * for all vertices in this set
      * @param _keys The set of keys to fetch
-     * @returns The values associated with those keys
+     * @returns The associated values for every node
      */
     Result tag(const std::list<std::string> &_keys) const;
 
     /**
-     * @brief Get all keys which have values
-     * @returns The set of all keys
+     * @brief Select the value associated with the given keys
+     * for all vertices in this set, as a columnar table. "id"
+     * and "label" select those columns.
+     * @param _keys The set of keys to fetch
+     * @returns The associated values for every node
+     */
+    Table table(const std::list<std::string> &_keys) const;
+
+    /**
+     * @brief Select the same table as `table`, without copying
+     * it out of the result cache (see `GQL::cache_results`)
+     * @param _keys The set of keys to fetch
+     * @returns The associated values for every node, shared
+     * with the cache
+     */
+    std::shared_ptr<const Table>
+    shared(const std::list<std::string> &_keys) const;
+
+    /**
+     * @brief Stream the values associated with the given keys,
+     * as `table` would select them, one row at a time
+     * @param _keys The set of keys to fetch
+     * @returns A cursor over the selected rows
+     */
+    Cursor stream(const std::list<std::string> &_keys) const;
+
+    /**
+     * @brief Get the set of all keys
+     * @returns All keys that have values for these edges
      */
     std::list<std::string> keys() const;
 
     /**
-     * @brief Select the id of all edges in this set
-     * @returns All the IDs
+     * @brief Select the id of all vertices in this set
+     * @returns All IDs within this set, in ascending order
+     */
+    std::vector<uint64_t> id() const;
+
+    /**
+     * @brief Count the vertices in this set, without reading
+     * their ids
+     * @returns The number of vertices herein
+     */
+    uint64_t count() const;
+
+    /**
+     * @brief Find the smallest id in this set, without sorting
+     * or reading the others
+     * @returns The smallest id, or nothing if this is empty
      */
-    std::list<uint64_t> id() const;
+    std::optional<uint64_t> first() const;
 
     /**
-     * @brief Returns whether this set is empty
+     * @brief Returns whether this set is empty. This stops at
+     * the first match.
      */
     bool empty() const;
 
     /**
-     * @brief Returns whether this set is non-empty
+     * @brief Returns whether this set is non-empty. This stops
+     * at the first match.
      */
     bool exists() const;
 
     /**
-     * @brief Set the label of these edges
-     * @param _label The label to SET for all these edges
-     * @returns These edges, after having their labels set
+     * @brief Set the label associated with all the nodes herein
+     * @param _label The label to set
+     * @returns These nodes after the operation is performed
      */
-    Edges label(const std::string &_label);
+    Vertices label(const std::string &_label);
 
     /**
      * @brief Set some key-value pair for all items herein
@@ -858,8 +1658,13 @@ public:
      * @param _value The value to associate
      * @returns This set after association
      */
-    Edges tag(const std::string &_key,
-              const std::string &_value);
+    Vertices tag(const std::string &_key,
+                 const std::string &_value);
+
+    /// Erase these nodes from the database. This will also
+    /// erase any and all edges which reference the deleted
+    /// nodes as either source or target.
+    void erase();
 
     /**
      * @brief Run some function given this set, then
@@ -874,954 +1679,7609 @@ public:
      * argument
      * @returns This set after the function has been run
      */
-    Edges lemma(const std::function<void(Edges)> _fn);
+    Vertices lemma(const std::function<void(Vertices)> _fn);
 
-    /// Erase these edges from the database.
-    void erase();
+    /**
+     * @brief Add edges from each node in this set to each node
+     * in the passed set (cartesian product).
+     * @param _to The target nodes
+     * @returns The edges which were added
+     */
+    Edges add_edge(const Vertices &_to) const;
 
     /**
-     * @brief Get any vertex in the graph from which one or
-     * more of these edges point
-     * @returns Some subset of the vertices
+     * @brief Get all edges leading into these vertices
+     * @returns The edges leading into these nodes
      */
-    Vertices source() const;
+    Edges in() const;
 
     /**
-     * @brief Get any vertex in the graph which is pointed
-     * to by one or more of these edges
-     * @returns Some subset of the vertices
+     * @brief Get all edges leading out of these vertices
+     * @returns The edges leading out of these nodes
      */
-    Vertices target() const;
+    Edges out() const;
+
+    /**
+     * @brief Get the edges with the given label leading into
+     * these vertices. This is a range scan of the `edge_in`
+     * index, which also covers the edges' sources.
+     * @param _label The label of the edges to follow
+     * @returns The edges with this label leading into these
+     * nodes
+     */
+    Edges in(const std::string &_label) const;
+
+    /**
+     * @brief Get the edges with the given label leading out of
+     * these vertices. This is a range scan of the `edge_out`
+     * index, which also covers the edges' targets.
+     * @param _label The label of the edges to follow
+     * @returns The edges with this label leading out of these
+     * nodes
+     */
+    Edges out(const std::string &_label) const;
+
+    /**
+     * @brief Gets only the vertices with the given in-degree
+     * @param _count The desired in-degree
+     * @returns All vertices in this set with the given
+     * in-degree
+     */
+    Vertices with_in_degree(const uint64_t &_count) const;
+
+    /**
+     * @brief Gets only the vertices with the given out-degree
+     * @param _count The desired out-degree
+     * @returns All vertices in this set with the given
+     * out-degree
+     */
+    Vertices with_out_degree(const uint64_t &_count) const;
+
+    /**
+     * @brief Gets the in-degrees of the given nodes
+     * @returns The in-degrees of the nodes
+     */
+    Result in_degree() const;
+
+    /**
+     * @brief Gets the out-degrees of the given nodes
+     * @returns The out-degrees of the nodes
+     */
+    Result out_degree() const;
 
     /**
      * @brief Break into a std::list where each entry is a
-     * single edge. This is useful for foreach operations.
-     * @returns An itemized version of this set, where each
-     * entry is a single edge
+     * single vertex. This is useful for foreach operations.
+     * @returns An itemized version of this set where each entry
+     * is a single node.
      */
-    std::list<Edges> each() const;
-  };
+    std::list<Vertices> each() const;
 
-  /**
-   * @brief Initialize from a file, or create it if it DNE. If
-   * _erase, purges all nodes and edges. If not _persistent,
-   * purges after deletion.
-   * @param _filepath The SQLite3 DB file to create/load
-   * @param _erase True iff the DB should purge itself after
-   * instantiation
-   * @param _persistent False iff the DB should delete itself
-   * upon destruction.
-   */
-  GQL(const std::string &_filepath = ":memory:",
-      const bool &_erase = false,
-      const bool &_persistent = true);
+    /**
+     * @brief Select every vertex which can be reached from this
+     * set by following one or more edges from source to target.
+     * This runs as a single recursive query, rather than one
+     * query per hop. Vertices in this set are only included if
+     * they can be reached again (e.g. via a cycle).
+     * @param _max_depth The maximum number of edges to follow,
+     * or NO_LIMIT
+     * @param _order How SQLite should explore the graph. This
+     * does not change the selected set. With a depth limit,
+     * breadth-first expands each vertex once, while depth-first
+     * keeps the queue short but expands a vertex again whenever
+     * it finds a shorter path to it.
+     * @returns All reachable vertices
+     */
+    Vertices traverse(const uint64_t &_max_depth = NO_LIMIT,
+                      const Order &_order = BFS) const;
 
-  /// Closes the database, possibly purging its file
-  ~GQL();
+    /**
+     * @brief Select every vertex which can be reached from this
+     * set by following one or more of the given edges from
+     * source to target
+     * @param _edge_case Only these edges are followed
+     * @param _max_depth The maximum number of edges to follow,
+     * or NO_LIMIT
+     * @param _order How SQLite should explore the graph
+     * @returns All reachable vertices
+     */
+    Vertices traverse(const Edges &_edge_case,
+                      const uint64_t &_max_depth = NO_LIMIT,
+                      const Order &_order = BFS) const;
 
-  /**
-   * @brief Get the set of all vertices
-   * @returns A Vertices object containing all known vertices
-   */
-  Vertices v();
+    /**
+     * @brief Select every vertex in `_vertex_case` which can be
+     * reached from this set by following one or more of the
+     * given edges from source to target. Vertices outside of
+     * `_vertex_case` may still be passed through.
+     * @param _edge_case Only these edges are followed
+     * @param _vertex_case Only these vertices are selected
+     * @param _max_depth The maximum number of edges to follow,
+     * or NO_LIMIT
+     * @param _order How SQLite should explore the graph
+     * @returns All reachable vertices in `_vertex_case`
+     */
+    Vertices traverse(const Edges &_edge_case,
+                      const Vertices &_vertex_case,
+                      const uint64_t &_max_depth = NO_LIMIT,
+                      const Order &_order = BFS) const;
 
-  /**
-   * @brief Get the set of all edges
-   * @returns The set of all edges in the graph
-   */
-  Edges e();
+    /**
+     * @brief Reverse traversal: Select every vertex from which
+     * this set can be reached by following one or more edges
+     * @param _max_depth The maximum number of edges to follow,
+     * or NO_LIMIT
+     * @param _order How SQLite should explore the graph
+     * @returns All vertices which can reach this set
+     */
+    Vertices r_traverse(const uint64_t &_max_depth = NO_LIMIT,
+                        const Order &_order = BFS) const;
 
-  /**
-   * @brief Save a graphviz(.dot) representation of the
-   * database
-   * @param _filepath Where to save the graph representation
-   */
-  void graphviz(const std::filesystem::path &_filepath);
+    /**
+     * @brief Reverse traversal: Select every vertex from which
+     * this set can be reached by following one or more of the
+     * given edges
+     * @param _edge_case Only these edges are followed
+     * @param _max_depth The maximum number of edges to follow,
+     * or NO_LIMIT
+     * @param _order How SQLite should explore the graph
+     * @returns All vertices which can reach this set
+     */
+    Vertices r_traverse(const Edges &_edge_case,
+                        const uint64_t &_max_depth = NO_LIMIT,
+                        const Order &_order = BFS) const;
 
-  /// Commit the database and open a new transaction
-  void commit();
+    /**
+     * @brief Reverse traversal: Select every vertex in
+     * `_vertex_case` from which this set can be reached by
+     * following one or more of the given edges
+     * @param _edge_case Only these edges are followed
+     * @param _vertex_case Only these vertices are selected
+     * @param _max_depth The maximum number of edges to follow,
+     * or NO_LIMIT
+     * @param _order How SQLite should explore the graph
+     * @returns All vertices in `_vertex_case` which can reach
+     * this set
+     */
+    Vertices r_traverse(const Edges &_edge_case,
+                        const Vertices &_vertex_case,
+                        const uint64_t &_max_depth = NO_LIMIT,
+                        const Order &_order = BFS) const;
 
-  /// Revert to the last commit and open a new transaction
-  void rollback();
+    friend class Edges;
 
-  /**
-   * @brief Generate a new vertex and return a handle to it.
-   * If this is the only method used, it will not cause
-   * collisions.
-   * @returns The newly-generated vertex
-   */
-  Vertices add_vertex();
+  protected:
+    /**
+     * @brief Build a (possibly reversed) traversal query
+     * @param _edge_case Only these edges are followed
+     * @param _vertex_case Only these vertices are selected
+     * @param _max_depth The maximum number of edges to follow
+     * @param _order How SQLite should explore the graph
+     * @param _reverse Whether to follow edges from target to
+     * source instead
+     * @returns All selected vertices
+     */
+    Vertices traversal(const Edges &_edge_case,
+                       const Vertices &_vertex_case,
+                       const uint64_t &_max_depth,
+                       const Order &_order,
+                       const bool &_reverse) const;
 
-  /**
-   * @brief Generate a new vertex with the given id and return
-   * a handle to it. The id given should be unique in the
-   * set of vertices
-   * @param _id The ID of the vertex to generate
-   * @returns The newly-generated vertex
-   */
-  Vertices add_vertex(const uint64_t &_id);
+    /**
+     * @brief Build the query behind `table` and `stream`
+     * @param _keys The set of keys to fetch
+     * @param _params Set to the values to bind to the query
+     * @param _decode Set to which columns need decoded
+     * @returns The SQL query
+     */
+    std::string tag_query(const std::list<std::string> &_keys,
+                          std::vector<Param> &_params,
+                          std::vector<bool> &_decode) const;
+  };
 
   /**
-   * @brief Generate a new edge from the given source to the
-   * given target
-   * @param _source The source of the edge
-   * @param _target The target of the edge
-   * @returns The newly-added edge
+   * @class GQL::Edges
+   * @brief A class representing zero or more edges in a GQL
+   * graph
    */
-  Edges add_edge(const uint64_t &_source,
-                 const uint64_t &_target);
+  class Edges {
+  protected:
+    /// A pointer to the owner of this instance: Edges
+    /// cannot be instantiated without one
+    GQL *const owner;
 
-  /// Increments with each SQL query submitted (bounce or
-  /// normal resolution)
-  uint64_t sql_call_counter = 0;
+    /// The SQL command which can be "collapsed" to resolve
+    /// the query
+    std::string cmd;
 
-  /**
-   * @brief Getter for the filepath
-   * @returns The filepath (or ":memory:") used to construct
-   * this graph object
-   */
-  std::filesystem::path get_filepath() const noexcept;
+    /// The values bound to the placeholders of `cmd`, in the
+    /// order in which the placeholders appear
+    std::vector<Param> params;
+
+    /// Whether `cmd` selects straight from the edges table
+    /// by `cond`, so that chained filters can extend a single
+    /// WHERE clause rather than nest another query
+    bool flat;
+
+    /// The WHERE condition of a flat query (empty for every
+    /// edge)
+    std::string cond;
+
+    /// The number of conditions combined into `cond`
+    uint64_t terms;
+
+    /**
+     * @brief Construct an Edges object from some SQL
+     * query. Bounces may happen herein.
+     * @param _owner The GQL instance which is authoritative
+     * over this object.
+     * @param _cmd The command representing the query this
+     * object has been constructed around
+     * @param _params The values bound to the placeholders of
+     * `_cmd`
+     */
+    Edges(GQL *const _owner, const std::string &_cmd,
+          const std::vector<Param> &_params = {});
+
+    /**
+     * @brief Construct a flat query over the edges table.
+     * Bounces once too many conditions have been combined.
+     * @param _owner The GQL instance which is authoritative
+     * over the result
+     * @param _cond The WHERE condition (empty for all rows)
+     * @param _params The values bound to its placeholders
+     * @param _terms The number of conditions in `_cond`
+     * @returns The flat query
+     */
+    static Edges selecting(GQL *const _owner,
+                           const std::string &_cond,
+                           const std::vector<Param> &_params,
+                           const uint64_t &_terms);
+
+    /**
+     * @brief Materializes this query's ids, replacing it with
+     * a flat lookup into them
+     */
+    void bounce_now();
+
+    /**
+     * @brief Any query as a condition on the edges table
+     * @returns `cond` for a flat query, otherwise an id lookup
+     * into `cmd`
+     */
+    std::string as_cond() const;
+
+    /**
+     * @brief An SQL query which selects the ids herein
+     * @returns The query, with `params` as its placeholders
+     */
+    std::string ids() const;
+
+    /**
+     * @brief The number of conditions this query contributes
+     * when combined into another one
+     * @returns `terms` for a flat query, otherwise 1
+     */
+    uint64_t weight() const;
+
+    /**
+     * @brief Adds a condition to this query, extending its
+     * WHERE clause
+     * @param _cond The condition to AND with this query
+     * @param _params The values bound to its placeholders
+     * @param _terms The number of conditions in `_cond`
+     * @returns All items herein which meet the condition
+     */
+    Edges narrow(const std::string &_cond,
+                 const std::vector<Param> &_params,
+                 const uint64_t &_terms = 1) const;
+
+    friend class GQL;
+    friend class Vertices;
+
+  public:
+    /**
+     * @brief Copy from another instance FROM THE SAME OWNER
+     * @param _other The object to copy from
+     * @returns This object
+     */
+    Edges &operator=(const Edges &_other) {
+      assert(owner == _other.owner);
+      cmd = _other.cmd;
+      params = _other.params;
+      flat = _other.flat;
+      cond = _other.cond;
+      terms = _other.terms;
+      return *this;
+    }
+
+    /**
+     * @brief Copy from another instance FROM THE SAME OWNER
+     * @param _other The object to copy from
+     */
+    inline Edges(const Edges &_other)
+        : owner(_other.owner), cmd(_other.cmd),
+          params(_other.params), flat(_other.flat),
+          cond(_other.cond), terms(_other.terms) {
+    }
+
+    /**
+     * @brief Select some sized subset: those with the lowest
+     * ids
+     * @param _n The size of the selected group
+     * @returns A sized subset
+     */
+    Edges limit(const uint64_t &_n) const;
+
+    /**
+     * @brief Select all edges with their source in the given
+     * set. This is equivalent to `_source.out()`.
+     * @param _source A set of vertices
+     * @returns All edges leading out from _source
+     */
+    Edges with_source(const GQL::Vertices &_source) const;
+
+    /**
+     * @brief Select all edges with their target in the given
+     * set. This is equivalent to `_source.in()`.
+     * @param _source A set of vertices
+     * @returns All edges leading into _source
+     */
+    Edges with_target(const GQL::Vertices &_source) const;
+
+    /**
+     * @brief Gets the subset of items with the given label
+     * @param _label The desired label
+     * @returns All items contained herein which have the
+     * given label
+     */
+    Edges with_label(const std::string &_label) const;
+
+    /**
+     * @brief Select all vertices where the given tag key is
+     * associated with the given value
+     * @param _key The key to check the tags for
+     * @param _value The value which must be associated
+     * @returns Some subset of this where the given key
+     * yields the given value
+     */
+    Edges with_tag(const std::string &_key,
+                   const std::string &_value) const;
+
+    /**
+     * @brief Get all edges which have the given id
+     * @param _id The ID to find
+     * @returns Zero or one edge with this ID
+     */
+    Edges with_id(const uint64_t &_id) const;
+
+    /**
+     * @brief Select all vertices for which the given lambda
+     * returns true
+     * @param _fn The fn to run all edges through
+     * @returns A set of edges where _fn returned true
+     */
+    Edges where(const std::function<bool(const Edges &)> &_fn);
+
+    /**
+     * @brief Select all edges whose records satisfy the given
+     * predicate. Every edge is read in one scan and the matches
+     * are collected into a single set, so this runs a constant
+     * number of queries (plus any `_fn` runs itself). `_fn`
+     * must not modify the graph.
+     * @param _fn The predicate to run each edge's record
+     * through
+     * @returns A set of edges where _fn returned true
+     */
+    Edges filter(
+        const std::function<bool(const Record &)> &_fn) const;
+
+    /**
+     * @brief Return all values which are in either this set or
+     * the passed one or both
+     * @param _other The other set
+     * @returns This set, inclusively unioned with the other
+     */
+    Edges join(const Edges &_other) const;
+
+    /**
+     * @brief Return all values which are in both this set and
+     * the other
+     * @param _other The other set, which all returned values
+     * must also be in
+     * @returns The set of edges in both this and the other
+     */
+    Edges intersection(const Edges &_other) const;
+
+    /**
+     * @brief Return all values which are in the passed set but
+     * not in this set
+     * @param _universe The set of all edges, from which this
+     * set will be excluded
+     * @returns All edges in _universe, minus any that are in
+     * this
+     */
+    Edges complement(const Edges &_universe) const;
+
+    /**
+     * @brief Return all values which are in this set but not in
+     * the given set
+     * @param _other The other set, which none of the returned
+     * values shall be in
+     * @returns Any edges in this which are not in _other
+     */
+    Edges excluding(const Edges &_other) const;
+
+    /**
+     * @brief Get the label of all edges in this set
+     * @returns The labels of all edges in this set
+     */
+    Result label() const;
+
+    /**
+     * @brief Get the values associated with the given key
+     * @param _key The tag key to check
+     * @returns A SQL result representing the output
+     */
+    Result tag(const std::string &_key) const;
+
+    /**
+     * @brief Get the values associated with the given keys
+     * @param _keys The set of keys to fetch
+     * @returns The values associated with those keys
+     */
+    Result tag(const std::list<std::string> &_keys) const;
+
+    /**
+     * @brief Get the values associated with the given keys, as
+     * a columnar table. "id", "label", "source" and "target"
+     * select those columns.
+     * @param _keys The set of keys to fetch
+     * @returns The values associated with those keys
+     */
+    Table table(const std::list<std::string> &_keys) const;
+
+    /**
+     * @brief Select the same table as `table`, without copying
+     * it out of the result cache (see `GQL::cache_results`)
+     * @param _keys The set of keys to fetch
+     * @returns The values associated with those keys, shared
+     * with the cache
+     */
+    std::shared_ptr<const Table>
+    shared(const std::list<std::string> &_keys) const;
+
+    /**
+     * @brief Stream the values associated with the given keys,
+     * as `table` would select them, one row at a time
+     * @param _keys The set of keys to fetch
+     * @returns A cursor over the selected rows
+     */
+    Cursor stream(const std::list<std::string> &_keys) const;
+
+    /**
+     * @brief Get all keys which have values
+     * @returns The set of all keys
+     */
+    std::list<std::string> keys() const;
+
+    /**
+     * @brief Select the id of all edges in this set
+     * @returns All the IDs, in ascending order
+     */
+    std::vector<uint64_t> id() const;
+
+    /**
+     * @brief Count the edges in this set, without reading
+     * their ids
+     * @returns The number of edges herein
+     */
+    uint64_t count() const;
+
+    /**
+     * @brief Find the smallest id in this set, without sorting
+     * or reading the others
+     * @returns The smallest id, or nothing if this is empty
+     */
+    std::optional<uint64_t> first() const;
+
+    /**
+     * @brief Returns whether this set is empty. This stops at
+     * the first match.
+     */
+    bool empty() const;
+
+    /**
+     * @brief Returns whether this set is non-empty. This stops
+     * at the first match.
+     */
+    bool exists() const;
+
+    /**
+     * @brief Set the label of these edges
+     * @param _label The label to SET for all these edges
+     * @returns These edges, after having their labels set
+     */
+    Edges label(const std::string &_label);
+
+    /**
+     * @brief Set some key-value pair for all items herein
+     * @param _key The key to associate
+     * @param _value The value to associate
+     * @returns This set after association
+     */
+    Edges tag(const std::string &_key,
+              const std::string &_value);
+
+    /**
+     * @brief Run some function given this set, then
+     * continue on. For instance,
+     * ```cpp
+     * a.lemma([](auto self){
+     *    self.tag("foo", "fizz"); }
+     * ).erase();
+     * ```
+     * would execute a tag, then erase on the same node.
+     * @param _fn The function to call with this set as an
+     * argument
+     * @returns This set after the function has been run
+     */
+    Edges lemma(const std::function<void(Edges)> _fn);
+
+    /// Erase these edges from the database.
+    void erase();
+
+    /**
+     * @brief Get any vertex in the graph from which one or
+     * more of these edges point
+     * @returns Some subset of the vertices
+     */
+    Vertices source() const;
+
+    /**
+     * @brief Get any vertex in the graph which is pointed
+     * to by one or more of these edges
+     * @returns Some subset of the vertices
+     */
+    Vertices target() const;
+
+    /**
+     * @brief Break into a std::list where each entry is a
+     * single edge. This is useful for foreach operations.
+     * @returns An itemized version of this set, where each
+     * entry is a single edge
+     */
+    std::list<Edges> each() const;
+
+  protected:
+    /**
+     * @brief Build the query behind `table` and `stream`
+     * @param _keys The set of keys to fetch
+     * @param _params Set to the values to bind to the query
+     * @param _decode Set to which columns need decoded
+     * @returns The SQL query
+     */
+    std::string tag_query(const std::list<std::string> &_keys,
+                          std::vector<Param> &_params,
+                          std::vector<bool> &_decode) const;
+  };
+
+  /**
+   * @class GQL::Bulk
+   * @brief Buffers vertices and edges for bulk ingestion.
+   * Rows are kept in contiguous columns and written with one
+   * prepared INSERT per table when flushed, rather than one
+   * parsed statement (and one query object) per row.
+   * Obtained via `GQL::bulk`, for instance
+   * ```cpp
+   * g.bulk().vertex(1, "a").vertex(2, "b").edge(1, 2).flush();
+   * ```
+   * Rows still buffered upon destruction are flushed, but a
+   * destructor cannot throw: if that flush fails, the error is
+   * only printed and the rows are lost. Call `flush` before the
+   * loader goes out of scope to see errors.
+   */
+  class Bulk {
+  public:
+    /**
+     * @brief Buffer a vertex
+     * @param _id The ID of the vertex, which should be unique
+     * @param _label The label of the vertex
+     * @param _tags The key-value pairs to associate with it
+     * @returns This loader, for chaining
+     */
+    Bulk &vertex(const uint64_t &_id,
+                 const std::string &_label = "",
+                 const std::map<std::string, std::string>
+                     &_tags = {});
+
+    /**
+     * @brief Buffer an edge. Its ID is assigned automatically
+     * when it is written, so a failed write uses up no ids.
+     * @param _source The ID of the source vertex
+     * @param _target The ID of the target vertex
+     * @param _label The label of the edge
+     * @param _tags The key-value pairs to associate with it
+     * @returns This loader, for chaining
+     */
+    Bulk &edge(const uint64_t &_source, const uint64_t &_target,
+               const std::string &_label = "",
+               const std::map<std::string, std::string> &_tags =
+                   {});
+
+    /**
+     * @brief Buffer an edge, keeping the id of the given record
+     * (e.g. one read from another graph, or from a reserved
+     * range)
+     * @param _edge The edge, whose id should be unique
+     * @returns This loader, for chaining
+     */
+    Bulk &edge(const Record &_edge);
+
+    /**
+     * @brief Write all buffered rows to the database within the
+     * current transaction. If indices were deferred, they are
+     * rebuilt afterwards.
+     */
+    void flush();
+
+    /**
+     * @brief Get the number of rows currently buffered
+     * @returns The number of buffered vertices plus edges
+     */
+    size_t size() const noexcept;
+
+    /// Flushes any remaining rows. Failures are printed to
+    /// std::cerr rather than thrown, so call `flush` first.
+    ~Bulk();
+
+    // Loaders flush on destruction, so they are not copied
+    Bulk(const Bulk &) = delete;
+    Bulk &operator=(const Bulk &) = delete;
+
+  protected:
+    /**
+     * @brief Construct a loader
+     * @param _owner The GQL instance to load into
+     * @param _defer_indices If true, the edge and label indices
+     * are dropped before the first write and only rebuilt by
+     * `flush`
+     */
+    Bulk(GQL *const _owner, const bool &_defer_indices);
+
+    /**
+     * @class GQL::Bulk::Rows
+     * @brief Struct-of-arrays storage for one table. The label
+     * and tags of every row are packed back-to-back into `text`
+     * and delimited by `ends`.
+     */
+    struct Rows {
+      /// The id, source and target columns
+      std::vector<uint64_t> id, source, target;
+
+      /// The rows whose ids are automatic, which are only
+      /// reserved once the rows are written
+      std::vector<size_t> unnumbered;
+
+      /// Packed labels and tag objects
+      std::string text;
+
+      /// Two entries per row: the end of its label and the end
+      /// of its tags within `text`
+      std::vector<size_t> ends;
+
+      /**
+       * @brief Append the text columns of a row
+       * @param _label The (encoded) label
+       * @param _tags The JSON tag object
+       */
+      void push_text(const std::string &_label,
+                     const std::string &_tags);
+
+      /// Remove all rows
+      void clear();
+    };
+
+    /**
+     * @brief Insert the buffered rows of one table
+     * @param _sql The prepared INSERT to use, which takes the
+     * columns (id[, source, target], label, tags)
+     * @param _rows The rows to insert
+     * @param _is_edge Whether to bind source and target
+     */
+    void write(const std::string &_sql, Rows &_rows,
+               const bool &_is_edge);
+
+    /// Write everything buffered so far, without rebuilding
+    void write_all();
+
+    /// The instance which is loaded into
+    GQL *const owner;
+
+    /// Whether to drop and rebuild indices around the load
+    const bool defer_indices;
+
+    /// Whether the indices are currently dropped
+    bool indices_dropped = false;
+
+    /// Buffered vertices
+    Rows vertices;
+
+    /// Buffered edges
+    Rows edges;
+
+    friend class GQL;
+  };
+
+  /**
+   * @class GQL::Options
+   * @brief Connection tuning settings, applied as PRAGMAs when
+   * a database is opened. Empty or zero fields leave SQLite's
+   * own defaults in place.
+   */
+  class Options {
+  public:
+    /// `journal_mode`: DELETE, TRUNCATE, PERSIST, MEMORY, WAL
+    /// or OFF
+    std::string journal_mode;
+
+    /// `synchronous`: OFF, NORMAL, FULL or EXTRA
+    std::string synchronous;
+
+    /// `temp_store`: DEFAULT, FILE or MEMORY
+    std::string temp_store;
+
+    /// `mmap_size` in bytes, or -1 to leave it unchanged
+    int64_t mmap_size;
+
+    /// `cache_size`: Pages if positive, KiB if negative, or 0
+    /// to leave it unchanged
+    int64_t cache_size;
+
+    /// `page_size` in bytes (only honored by new databases),
+    /// or 0 to leave it unchanged
+    int64_t page_size;
+
+    /// The layout of labels and tags (only honored by new
+    /// databases)
+    Format format;
+
+    /// Leaves every setting at SQLite's default, and uses the
+    /// latest layout
+    Options()
+        : mmap_size(-1), cache_size(0), page_size(0),
+          format(DICT) {}
+
+    /**
+     * @brief Safe against power loss, but faster than the
+     * SQLite defaults for concurrent use: WAL with full syncs
+     * @returns The "durable" preset
+     */
+    static Options durable() {
+      Options out;
+      out.journal_mode = "WAL";
+      out.synchronous = "FULL";
+      return out;
+    }
+
+    /**
+     * @brief For loading large graphs which can be rebuilt if
+     * the machine crashes: No syncs, a 256 MiB page cache and
+     * in-memory temporary storage
+     * @returns The "bulk-load" preset
+     */
+    static Options bulk_load() {
+      Options out;
+      out.journal_mode = "WAL";
+      out.synchronous = "OFF";
+      out.temp_store = "MEMORY";
+      out.cache_size = -262144;
+      return out;
+    }
+
+    /**
+     * @brief For graphs which are mostly queried: WAL with
+     * relaxed syncs, 1 GiB of memory mapping, a 64 MiB page
+     * cache and in-memory temporary storage
+     * @returns The "read-heavy" preset
+     */
+    static Options read_heavy() {
+      Options out;
+      out.journal_mode = "WAL";
+      out.synchronous = "NORMAL";
+      out.temp_store = "MEMORY";
+      out.mmap_size = 1LL << 30;
+      out.cache_size = -65536;
+      return out;
+    }
+  };
+
+  /**
+   * @brief Initialize from a file, or create it if it DNE. If
+   * _erase, purges all nodes and edges. If not _persistent,
+   * purges after deletion.
+   * @param _filepath The SQLite3 DB file to create/load
+   * @param _erase True iff the DB should purge itself after
+   * instantiation
+   * @param _persistent False iff the DB should delete itself
+   * upon destruction.
+   * @param _options The connection settings to apply
+   */
+  GQL(const std::string &_filepath = ":memory:",
+      const bool &_erase = false,
+      const bool &_persistent = true,
+      const Options &_options = Options());
+
+  /**
+   * @brief Read back the connection settings in effect. These
+   * may differ from those requested, e.g. an in-memory
+   * database always uses the MEMORY journal.
+   * @returns The current settings
+   */
+  Options options();
+
+  /**
+   * @brief Open an existing database for reading only. Unlike
+   * a regular instance, which keeps a transaction open until
+   * it commits, each query on this handle is its own short
+   * read transaction, so it sees every commit made by the
+   * writer. Any number of these may be open alongside a single
+   * writer; with a WAL writer they never block each other.
+   * Writes throw, and `commit`/`rollback` do nothing.
+   * @param _filepath The SQLite3 DB file to load
+   * @param _options The connection settings to apply, except
+   * for `journal_mode` which only the writer may set
+   * @returns The new handle
+   */
+  static std::unique_ptr<GQL>
+  open_readonly(const std::string &_filepath,
+                const Options &_options = Options());
+
+  /// True iff this handle was made by `open_readonly`
+  bool readonly() const noexcept;
+
+  class Pool;
+  class Writer;
+  class Sharded;
+  class Pattern;
+
+  /// Closes the database, possibly purging its file
+  ~GQL();
+
+  // A GQL object exclusively owns its connection
+  GQL(const GQL &) = delete;
+  GQL &operator=(const GQL &) = delete;
+
+  /**
+   * @brief Get the set of all vertices
+   * @returns A Vertices object containing all known vertices
+   */
+  Vertices v();
+
+  /**
+   * @brief Get the set of all edges
+   * @returns The set of all edges in the graph
+   */
+  Edges e();
+
+  class Snapshot;
+
+  /**
+   * @brief Copy the graph's structure into dense, in-memory
+   * adjacency arrays for algorithms which take many hops. The
+   * snapshot does not see later changes.
+   * @param _labels Whether to also keep each edge's label
+   * @returns The snapshot of the current graph
+   */
+  Snapshot snapshot(const bool &_labels = true);
+
+  class Slots;
+  template <typename T> class Plan;
+
+  /**
+   * @brief Record the shape of a query once, so that it can be
+   * run many times with different values. `_fn` builds the
+   * query from this graph, taking each changing value from
+   * its `Slots` argument. The query's SQL is generated once,
+   * here, and every run only binds new values to the same
+   * (cached) statement. While recording, `_fn` may only build
+   * queries: Anything which would run SQL throws.
+   * ```cpp
+   * auto callees = g.plan([](GQL &g, const GQL::Slots &s) {
+   *   return g.v().with_label(s.text(0)).out().target();
+   * });
+   * auto ids = callees({"main"}).id();
+   * ```
+   * @tparam Fn The type of the recording function
+   * @param _fn Builds a `Vertices` or `Edges` from this graph
+   * and some slots
+   * @returns The recorded plan
+   */
+  template <typename Fn>
+  auto plan(const Fn &_fn)
+      -> Plan<decltype(_fn(std::declval<GQL &>(),
+                           std::declval<const Slots &>()))>;
+
+  /**
+   * @brief Save a graphviz(.dot) representation of the
+   * database, in one streaming pass over the vertices and one
+   * over the edges
+   * @param _filepath Where to save the graph representation
+   */
+  void graphviz(const std::filesystem::path &_filepath);
+
+  /**
+   * @brief Save every vertex (then every edge) as one JSON
+   * object per line, holding its type, id, label and tags
+   * @param _filepath Where to save the graph
+   */
+  void export_jsonl(const std::filesystem::path &_filepath);
+
+  /**
+   * @brief Load the vertices and edges saved by `export_jsonl`
+   * through the bulk loader, keeping every id. Edges without an
+   * `id` field are given new ones.
+   * @param _filepath The file to load
+   */
+  void import_jsonl(const std::filesystem::path &_filepath);
+
+  /**
+   * @brief Save every edge as a `source,target,label` CSV row,
+   * after a header row
+   * @param _filepath Where to save the edge list
+   */
+  void export_edge_list(const std::filesystem::path &_filepath);
+
+  /**
+   * @brief Load `source,target[,label]` CSV rows (with an
+   * optional header) through the bulk loader. Endpoints which
+   * are not yet vertices are added without a label or tags.
+   * @param _filepath The file to load
+   */
+  void import_edge_list(const std::filesystem::path &_filepath);
+
+  /**
+   * @brief Give many vertices their own value for one tag, in
+   * a single UPDATE. This is how computed results (e.g. the
+   * output of an algorithm) are written back.
+   * @param _key The tag key to set
+   * @param _values Vertex ids, each with its new value
+   */
+  void tag_vertices(
+      const std::string &_key,
+      const std::vector<std::pair<uint64_t, std::string>>
+          &_values);
+
+  /// Commit the database and open a new transaction
+  void commit();
+
+  /// Revert to the last commit and open a new transaction.
+  /// Live query sets (including bounced ones) stay valid.
+  void rollback();
+
+  /**
+   * @brief Store every tag in indexed `node_tags` and
+   * `edge_tags` tables, which are kept up to date by triggers.
+   * Once a graph is tag-indexed (which is detected when it is
+   * reopened), `with_tag`, `tag` and `keys` use these tables
+   * instead of parsing every tag object. This makes tag
+   * lookups logarithmic rather than linear in the size of the
+   * graph, at the cost of slower tag writes.
+   */
+  void index_tags();
+
+  /**
+   * @brief Returns true iff this graph stores indexed tags
+   * @returns Whether `index_tags` has been called on this graph
+   */
+  inline bool tags_indexed() const noexcept {
+    return has_tag_tables;
+  }
+
+  /**
+   * @brief Keep every vertex's in- and out-degree in an indexed
+   * `node_degree` table, which is kept up to date by triggers
+   * on `edges`. Once a graph is degree-indexed (which is
+   * detected when it is reopened), `with_in_degree`,
+   * `with_out_degree`, `in_degree` and `out_degree` read this
+   * table instead of counting edges, making degree filters
+   * index lookups at the cost of slightly slower edge writes.
+   */
+  void index_degrees();
+
+  /**
+   * @brief Returns true iff this graph stores indexed degrees
+   * @returns Whether `index_degrees` has been called on this
+   * graph
+   */
+  inline bool degrees_indexed() const noexcept {
+    return has_degree_table;
+  }
+
+  /**
+   * @brief Get the layout in which this database stores
+   * labels and tags. New databases use `DICT` unless their
+   * options ask otherwise.
+   * @returns The storage format
+   */
+  inline Format storage_format() const noexcept {
+    return format;
+  }
+
+  /**
+   * @brief Rewrite every label and tag of a `HEX` database as
+   * raw UTF-8, so that it uses the `RAW` format. Does nothing
+   * to other databases.
+   */
+  void upgrade_format();
+
+  /**
+   * @brief Generate a new vertex and return a handle to it.
+   * If this is the only method used, it will not cause
+   * collisions.
+   * @returns The newly-generated vertex
+   */
+  Vertices add_vertex();
+
+  /**
+   * @brief Generate a new vertex with the given id and return
+   * a handle to it. The id given should be unique in the
+   * set of vertices
+   * @param _id The ID of the vertex to generate
+   * @returns The newly-generated vertex
+   */
+  Vertices add_vertex(const uint64_t &_id);
+
+  /**
+   * @brief Generate a new edge from the given source to the
+   * given target
+   * @param _source The source of the edge
+   * @param _target The target of the edge
+   * @returns The newly-added edge
+   */
+  Edges add_edge(const uint64_t &_source,
+                 const uint64_t &_target);
+
+  /**
+   * @brief Reserve a contiguous range of vertex ids, which no
+   * later `add_vertex()` or reservation on this handle will
+   * give out. This takes no lock and runs no SQL, so it may be
+   * called from any thread.
+   * @param _n The number of ids to reserve
+   * @returns The first id of the range `[first, first + _n)`
+   */
+  uint64_t reserve_vertex_ids(const uint64_t &_n) noexcept;
+
+  /**
+   * @brief Reserve a contiguous range of edge ids, which no
+   * later `add_edge` or reservation on this handle will give
+   * out. This may be called from any thread.
+   * @param _n The number of ids to reserve
+   * @returns The first id of the range `[first, first + _n)`
+   */
+  uint64_t reserve_edge_ids(const uint64_t &_n) noexcept;
+
+  /**
+   * @brief Erase many vertices at once, along with every edge
+   * which references them. Ids which do not exist are ignored.
+   * @param _ids The ids of the vertices to erase
+   */
+  void erase_vertices(const std::vector<uint64_t> &_ids);
+
+  /**
+   * @brief Erase many edges at once. Ids which do not exist
+   * are ignored.
+   * @param _ids The ids of the edges to erase
+   */
+  void erase_edges(const std::vector<uint64_t> &_ids);
+
+  /**
+   * @brief Start a bulk load. This is much faster than
+   * `add_vertex` and `add_edge` when adding many rows at once.
+   * @param _defer_indices If true, indices are dropped during
+   * the load and rebuilt once by `Bulk::flush`, which is
+   * faster for very large loads
+   * @returns A loader which buffers rows until flushed
+   */
+  Bulk bulk(const bool &_defer_indices = false);
+
+  /**
+   * @brief Start a pattern to match, such as `g.match().edge(
+   * "f", "CALLS", "g").vertex("g", "EXTERN")`
+   * @returns An empty pattern
+   */
+  Pattern match();
+
+  /// Increments with each SQL query submitted (bounce or
+  /// normal resolution)
+  uint64_t sql_call_counter = 0;
+
+  /// Increments each time a query reuses a cached prepared
+  /// statement instead of being parsed again
+  uint64_t stmt_cache_hits = 0;
+
+  /// Increments each time a statement has to be prepared
+  /// (parsed and planned) by SQLite, once per statement of a
+  /// script
+  uint64_t stmt_cache_misses = 0;
+
+  /**
+   * @brief Call a hook after every SQL statement this runs.
+   * Statements are only timed while a hook is set or stats are
+   * being collected. Exceptions thrown by the hook are ignored.
+   * @param _hook Called with each finished statement, or
+   * nullptr to stop tracing
+   */
+  void trace(const std::function<void(const Trace &)> &_hook);
+
+  /**
+   * @brief Start or stop totalling statements by their SQL
+   * text. Stopping keeps the totals so far.
+   * @param _on Whether to collect statistics
+   */
+  void collect_stats(const bool &_on = true);
+
+  /**
+   * @brief Get the query shapes which took the most time
+   * since stats were first collected (or last reset)
+   * @param _n The greatest number of shapes to return
+   * @returns Totals for each shape, by descending total time
+   */
+  std::vector<QueryStats> slowest(const size_t &_n = 10) const;
+
+  /// Forget every total kept by `collect_stats`
+  void reset_stats();
+
+  /**
+   * @brief Start or stop keeping the results of read queries,
+   * keyed by their SQL and bound values. A repeated query is
+   * answered from memory until a write touches a table it
+   * reads (as found when its statement was prepared), or the
+   * transaction rolls back.
+   * On read-only handles, commits by the writer are detected
+   * with one `PRAGMA data_version` per lookup. Stopping drops
+   * every kept result.
+   * @param _on Whether to cache results
+   */
+  void cache_results(const bool &_on = true);
+
+  /**
+   * @brief Returns true iff results are being cached
+   * @returns Whether `cache_results` is enabled
+   */
+  inline bool results_cached() const noexcept {
+    return caching_results;
+  }
+
+  /// Increments each time a read query is answered from the
+  /// result cache, without running any SQL
+  uint64_t result_cache_hits = 0;
+
+  /// Increments each time a cacheable read query has to run
+  uint64_t result_cache_misses = 0;
+
+  /**
+   * @brief Getter for the filepath
+   * @returns The filepath (or ":memory:") used to construct
+   * this graph object
+   */
+  std::filesystem::path get_filepath() const noexcept;
+
+protected:
+  /**
+   * @brief Get all vertices where some SQL WHERE clause holds
+   * @param _where The SQL clause to use
+   * @returns All vertices where the SQL clause holds
+   */
+  Vertices v(const std::string &_where);
+
+  /**
+   * @brief Get all edges where some SQL WHERE clause holds
+   * @param _where The SQL clause to use
+   * @returns All edges where the SQL clause holds
+   */
+  Edges e(const std::string &_where);
+
+  /**
+   * @brief Get all vertices where some SQL WHERE clause holds
+   * @param _where The SQL clause to use
+   * @param _params The values bound to its placeholders
+   * @returns All vertices where the SQL clause holds
+   */
+  Vertices v(const std::string &_where,
+             const std::vector<Param> &_params);
+
+  /**
+   * @brief Get all edges where some SQL WHERE clause holds
+   * @param _where The SQL clause to use
+   * @param _params The values bound to its placeholders
+   * @returns All edges where the SQL clause holds
+   */
+  Edges e(const std::string &_where,
+          const std::vector<Param> &_params);
+
+  /**
+   * @brief Execute the given sql and return the results. A
+   * single statement is prepared once and then reused from the
+   * statement cache each time the same text is run again.
+   * @param _sql The SQL statement(s) to run via SQLite3
+   * @param _params The values to bind to the `?` placeholders
+   * of `_sql`, in order
+   * @returns An object containing the SQL query results
+   */
+  Result sql(const std::string &_sql,
+             const std::vector<Param> &_params = {});
+
+  /**
+   * @brief Fetch the prepared statement for the given SQL from
+   * the statement cache, preparing (and caching) it if needed
+   * @param _sql The text of a single SQL statement
+   * @returns A reset statement with no bindings, owned by the
+   * cache, or nullptr if `_sql` is not a single statement
+   */
+  sqlite3_stmt *prepare(const std::string &_sql);
+
+  /**
+   * @brief Bind a parameter to the given placeholder,
+   * encoding it according to its kind
+   * @param _stmt The statement to bind into
+   * @param _index The 1-based index of the placeholder
+   * @param _param The value to bind
+   */
+  void bind(sqlite3_stmt *_stmt, const int &_index,
+            const Param &_param);
+
+  /**
+   * @brief Step a bound statement until it is done, collecting
+   * any rows it yields. The statement is reset afterwards.
+   * @param _stmt The statement to run
+   * @param _sql The SQL text of _stmt, for error reporting
+   * @param _into The result to append rows to
+   */
+  void step(sqlite3_stmt *_stmt, const std::string &_sql,
+            Result &_into);
+
+  /**
+   * @brief Step a bound statement until it is done, collecting
+   * any rows it yields into columns. The statement is reset
+   * afterwards.
+   * @param _stmt The statement to run
+   * @param _sql The SQL text of _stmt, for error reporting
+   * @param _into The table to append rows to
+   * @param _decode Which columns hold encoded text which must
+   * be decoded (missing entries are false)
+   */
+  void step(sqlite3_stmt *_stmt, const std::string &_sql,
+            Table &_into, const std::vector<bool> &_decode);
+
+  /**
+   * @brief Reset a statement after stepping it, throwing if
+   * stepping failed
+   * @param _stmt The statement which was run
+   * @param _sql The SQL text of _stmt, for error reporting
+   * @param _res The last return code of sqlite3_step
+   */
+  void finish(sqlite3_stmt *_stmt, const std::string &_sql,
+              const int &_res);
+
+  /**
+   * @brief Bind parameters to every placeholder of a statement
+   * @param _stmt The statement to bind into
+   * @param _sql The SQL text of _stmt, for error reporting
+   * @param _params The values to bind, in order
+   */
+  void bind_all(sqlite3_stmt *_stmt, const std::string &_sql,
+                const std::vector<Param> &_params);
+
+  /**
+   * @brief Execute a single SQL statement and return the
+   * results as a columnar table
+   * @param _sql The SQL statement to run via SQLite3
+   * @param _params The values to bind to the `?` placeholders
+   * of `_sql`, in order
+   * @param _decode Which columns hold encoded text which must
+   * be decoded (missing entries are false)
+   * @param _headers If given, the titles of the columns
+   * @returns The query results
+   */
+  Table table(const std::string &_sql,
+              const std::vector<Param> &_params = {},
+              const std::vector<bool> &_decode = {},
+              const std::vector<std::string> &_headers = {});
+
+  /**
+   * @brief Execute a single SQL statement as `table` does,
+   * sharing the result with the result cache when it is on
+   * @param _sql The SQL statement to run via SQLite3
+   * @param _params The values to bind to the `?` placeholders
+   * of `_sql`, in order
+   * @param _decode Which columns hold encoded text which must
+   * be decoded (missing entries are false)
+   * @param _headers If given, the titles of the columns
+   * @returns The (immutable) query results
+   */
+  std::shared_ptr<const Table>
+  shared_table(const std::string &_sql,
+               const std::vector<Param> &_params = {},
+               const std::vector<bool> &_decode = {},
+               const std::vector<std::string> &_headers = {});
+
+  /**
+   * @brief Run a single SQL statement into a new table
+   * @param _sql The SQL statement to run via SQLite3
+   * @param _params The values to bind to its placeholders
+   * @param _decode Which columns must be decoded
+   * @param _headers If given, the titles of the columns
+   * @param _prepared Set to the statement which was run
+   * @returns The query results
+   */
+  Table run_table(const std::string &_sql,
+                  const std::vector<Param> &_params,
+                  const std::vector<bool> &_decode,
+                  const std::vector<std::string> &_headers,
+                  sqlite3_stmt *&_prepared);
+
+  /// Create any missing indices on the nodes and edges tables
+  void create_indices();
+
+  /**
+   * @brief Apply connection settings. This must happen outside
+   * of a transaction.
+   * @param _options The settings to apply
+   */
+  void apply(const Options &_options);
+
+  /// Remove the database file, along with any journal files
+  void remove_files() const;
+
+  /**
+   * @brief Encode a label, tag key or tag value for storage
+   * @param _what The decoded text
+   * @returns The text as it is stored in the database
+   */
+  std::string encode(const std::string &_what) const;
+
+  /**
+   * @brief Decode a label, tag key or tag value from storage
+   * @param _what The text as it is stored in the database
+   * @returns The decoded text
+   */
+  std::string decode(const std::string &_what) const;
+
+  /**
+   * @brief Encode a label or tag key for storage. In the
+   * `DICT` format, this is its id in the dictionary.
+   * @param _name The decoded label or key
+   * @param _add Whether to add a name which is not yet in the
+   * dictionary, rather than give an id which matches nothing
+   * @returns The text as it is stored in the database
+   */
+  std::string encode_name(const std::string &_name,
+                          const bool &_add = false);
+
+  /**
+   * @brief Decode a label or tag key from storage
+   * @param _what The text as it is stored in the database
+   * @returns The decoded label or key
+   */
+  std::string decode_name(const std::string &_what);
+
+  /**
+   * @brief Get the SQL expression for the decoded label or
+   * key held in a column. Only the `DICT` format needs a
+   * lookup; otherwise this is the column itself.
+   * @param _col The column holding a stored label or key
+   * @returns The expression
+   */
+  std::string name_sql(const std::string &_col) const;
+
+  /**
+   * @brief Find the dictionary id of a label or tag key
+   * @param _name The decoded label or key
+   * @param _add Whether to add the name if it is missing
+   * @returns Its id, or -1 if it is missing and not added
+   */
+  int64_t dict_id(const std::string &_name, const bool &_add);
+
+  /**
+   * @brief Find the label or tag key with a dictionary id
+   * @param _id The id
+   * @returns The decoded label or key
+   */
+  const std::string &dict_text(const int64_t &_id);
+
+  /**
+   * @brief Quote a string as a JSON string literal, escaped
+   * the same way as SQLite's own JSON functions do
+   * @param _what The text to quote
+   * @returns The JSON string, including quotes
+   */
+  static std::string json_string(const std::string &_what);
+
+  /**
+   * @brief Read a JSON string literal, undoing `json_string`
+   * @param _text The text holding the literal
+   * @param _i The index of the opening quote, which is moved
+   * past the closing quote
+   * @returns The unescaped (UTF-8) text
+   */
+  static std::string json_unquote(const std::string &_text,
+                                  size_t &_i);
+
+  /**
+   * @brief Read one line written by `export_jsonl`
+   * @param _line The JSON object
+   * @param _out The record to fill in
+   * @returns True if the line holds an edge, false for a vertex
+   */
+  static bool read_jsonl(const std::string &_line,
+                         Record &_out);
+
+  /**
+   * @brief Quote a CSV field if it holds a comma, quote or
+   * line break
+   * @param _what The field
+   * @returns The field as it should be written
+   */
+  static std::string csv_field(const std::string &_what);
+
+  /**
+   * @brief Read one CSV row, which may span several lines if a
+   * quoted field holds line breaks
+   * @param _in The stream to read from
+   * @param _fields The (unquoted) fields of the row
+   * @returns False once the stream is exhausted
+   */
+  static bool read_csv_row(std::istream &_in,
+                           std::vector<std::string> &_fields);
+
+  /**
+   * @brief Stream the records of a set of vertices or edges,
+   * in ascending order of id
+   * @param _cmd The query selecting the rows to read
+   * @param _params The values bound to the placeholders of
+   * `_cmd`
+   * @param _is_edge Whether `_cmd` selects from the edges table
+   * @param _fn Called with each record in turn
+   */
+  void
+  each_record(const std::string &_cmd,
+              const std::vector<Param> &_params,
+              const bool &_is_edge,
+              const std::function<void(const Record &)> &_fn);
+
+  /**
+   * @brief Check if a tag key can be looked up with a JSON
+   * path. Raw keys are used as quoted path labels, which
+   * cannot hold escapes.
+   * @param _key The decoded tag key
+   * @returns Whether `json_extract` and `json_set` may be used
+   */
+  bool path_safe(const std::string &_key) const;
+
+  /**
+   * @brief Get the SQL expression for the value of a tag in
+   * the `tags` column
+   * @param _key The decoded tag key
+   * @returns An expression with one placeholder, to be bound
+   * to `key_param(_key)`
+   */
+  std::string tag_value(const std::string &_key) const;
+
+  /**
+   * @brief How deeply the parentheses of some SQL nest
+   * @param _sql The SQL to measure
+   * @returns The greatest number of open parentheses
+   */
+  static uint64_t nesting(const std::string &_sql) noexcept;
+
+  /**
+   * @brief Get the SQL expression for the `tags` column with
+   * one more tag set
+   * @param _key The decoded tag key
+   * @returns An expression with two placeholders, to be bound
+   * to `key_param(_key)` and the value
+   */
+  std::string tag_set(const std::string &_key) const;
+
+  /**
+   * @brief Get the parameter which `tag_value` and `tag_set`
+   * bind for a key
+   * @param _key The decoded tag key
+   * @param _add Whether the key is about to be written, so
+   * must be added to the dictionary if it is missing
+   * @returns The parameter to bind
+   */
+  Param key_param(const std::string &_key,
+                  const bool &_add = false);
+
+  /**
+   * @brief Build the stored JSON object for some tags
+   * @param _tags The decoded key-value pairs
+   * @returns A JSON object suitable for the `tags` column
+   */
+  std::string
+  tags_json(const std::map<std::string, std::string> &_tags);
+
+  /**
+   * @brief Concatenate the parameters of two queries
+   * @param _l The parameters which come first
+   * @param _r The parameters which come after
+   * @returns All of _l followed by all of _r
+   */
+  static std::vector<Param>
+  concat(const std::vector<Param> &_l,
+         const std::vector<Param> &_r);
+
+  /**
+   * @brief Materialize the ids selected by a query into the
+   * `gql_bounce` temporary table. The rows are deleted once the
+   * returned parameter (and every copy of it) is destroyed.
+   * @param _cmd The query whose ids should be stored
+   * @param _params The values bound to the placeholders of
+   * `_cmd`
+   * @returns The id of the stored set, to be bound as
+   * `gql_bounce.set_id`
+   */
+  Param bounce(const std::string &_cmd,
+               const std::vector<Param> &_params);
+
+  /**
+   * @brief Store the given ids into the `gql_bounce` temporary
+   * table, as `bounce` does for the ids of a query
+   * @param _ids The ids to store
+   * @returns The id of the stored set, to be bound as
+   * `gql_bounce.set_id`
+   */
+  Param bounce(const std::vector<uint64_t> &_ids);
+
+  /**
+   * @brief Make the parameter referring to a bounced set,
+   * which deletes the set's rows once it is no longer used
+   * @param _set_id The id of the stored set
+   * @returns The parameter to bind as `gql_bounce.set_id`
+   */
+  Param bounced_set(const uint64_t &_set_id);
+
+  /// A pointer to the underlying SQLite3 instance
+  sqlite3 *db = nullptr;
+
+  /// Cached prepared statements, most-recently used first
+  std::list<std::pair<std::string, sqlite3_stmt *>> stmt_lru;
+
+  /// Maps SQL text to its position in `stmt_lru`
+  std::unordered_map<std::string, decltype(stmt_lru)::iterator>
+      stmt_index;
+
+  /// The tables read by each statement in `stmt_lru`, as
+  /// reported by the authorizer when it was prepared
+  std::unordered_map<sqlite3_stmt *, std::vector<std::string>>
+      stmt_reads;
+
+  /// While a statement is being prepared, collects the tables
+  /// which it reads
+  std::vector<std::string> *reading = nullptr;
+
+  /// The next automatically-assigned vertex id, one past the
+  /// largest when opened
+  std::atomic<uint64_t> next_node_id = 1;
+
+  /// The next automatically-assigned edge id, one past the
+  /// largest when opened
+  std::atomic<uint64_t> next_edge_id = 1;
+
+  /**
+   * @brief Raise an id counter past an id which was written
+   * explicitly, so that later automatic ids do not collide
+   * with it. Safe to call from any thread.
+   * @param _next The counter to raise
+   * @param _id The id which is now in use
+   */
+  static void advance(std::atomic<uint64_t> &_next,
+                      const uint64_t &_id) noexcept;
+
+  /**
+   * @brief Give back the most recently reserved range of ids
+   * after the rows using them failed to be written. Nothing is
+   * given back if more ids were reserved since.
+   * @param _next The counter which the range came from
+   * @param _first The first id of the range
+   * @param _n The number of ids in the range
+   */
+  static void release(std::atomic<uint64_t> &_next,
+                      const uint64_t &_first,
+                      const uint64_t &_n) noexcept;
+
+  /// The next id to give a bounced set
+  uint64_t next_bounce_id = 1;
+
+  /// Points to this until destruction, so that bounced sets
+  /// which outlive this know not to touch the database
+  std::shared_ptr<GQL *> self;
+
+  /// Whether the graph has `node_tags` and `edge_tags` tables
+  bool has_tag_tables = false;
+
+  /// Whether the graph has a `node_degree` table
+  bool has_degree_table = false;
+
+  /// Called after each statement, when set
+  std::function<void(const Trace &)> trace_hook;
+
+  /// Whether statements are totalled into `stats`
+  bool keeping_stats = false;
+
+  /// Totals for each query shape, keyed by SQL text
+  std::unordered_map<std::string, QueryStats> stats;
+
+  /**
+   * @struct Cached
+   * @brief A kept query result, with the write generations of
+   * the tables it read when it was run
+   */
+  struct Cached {
+    /// The result, if it was read by `sql`
+    std::shared_ptr<const Result> result;
+
+    /// The result, if it was read by `table`
+    std::shared_ptr<const Table> table;
+
+    /// Each table the query read, with its generation when
+    /// the query ran
+    std::vector<std::pair<std::string, uint64_t>> reads;
+  };
+
+  /// Whether read results are kept in `result_lru`
+  bool caching_results = false;
+
+  /// The write generation of each table which a kept result
+  /// has read. These are bumped by every row written,
+  /// including rows written by triggers (such as the tag and
+  /// degree tables).
+  std::vector<std::pair<std::string, uint64_t>> generations;
+
+  /// The last `PRAGMA data_version` seen by a read-only handle
+  int64_t data_version = -1;
+
+  /// Kept results, most-recently used first
+  std::list<std::pair<std::string, Cached>> result_lru;
+
+  /// Maps a query's key to its position in `result_lru`
+  std::unordered_map<std::string,
+                     decltype(result_lru)::iterator>
+      result_index;
+
+  /**
+   * @brief Called by SQLite for every row written, including
+   * rows written by triggers
+   * @param _self The GQL instance which owns the connection
+   * @param _op Unused
+   * @param _db Unused
+   * @param _table The table which was written
+   * @param _row Unused
+   */
+  static void on_update(void *_self, int _op, const char *_db,
+                        const char *_table, sqlite3_int64 _row);
+
+  /**
+   * @brief Called by SQLite for every table and column which a
+   * statement uses while it is being prepared. Records the
+   * tables read into `reading`, and allows everything.
+   * @param _self The GQL instance which owns the connection
+   * @param _action The kind of access
+   * @param _table For reads, the table which is read
+   * @returns SQLITE_OK
+   */
+  static int on_authorize(void *_self, int _action,
+                          const char *_table, const char *,
+                          const char *, const char *);
+
+  /**
+   * @brief The SQL function `gql_expand(0, id, depth)`, which is
+   * false if `id` was already expanded at a smaller depth in
+   * this run of the statement. Depth-limited traversals use it
+   * so that a vertex reached again around a cycle is not
+   * expanded once per depth.
+   * @param _ctx The function's context
+   * @param _argv A constant, the vertex id, and its depth
+   */
+  static void on_expand(sqlite3_context *_ctx, int,
+                        sqlite3_value **_argv);
+
+  /**
+   * @brief Get the write generation of a table, starting it
+   * at zero if it is not yet tracked
+   * @param _table The name of the table
+   * @returns A reference to its generation
+   */
+  uint64_t &generation(const std::string_view &_table);
+
+  /**
+   * @brief Record the tables read by a statement, along with
+   * their current generations
+   * @param _stmt The statement which was run
+   * @param _out The entry to record them in
+   * @returns False if the statement writes, in which case
+   * its result must not be kept
+   */
+  bool depend(sqlite3_stmt *_stmt, Cached &_out);
+
+  /// Make every kept result and dictionary entry stale
+  void invalidate() noexcept;
+
+  /**
+   * @brief Decide whether a query's result may be kept. Its
+   * dependencies are recorded by `depend` once it has run.
+   * @param _sql The SQL text of the query
+   * @returns False for queries which are not plain reads or
+   * which read bounced sets or the schema
+   */
+  bool cacheable(const std::string &_sql);
+
+  /**
+   * @brief Build the key of a query in the result cache
+   * @param _kind Distinguishes `sql` from `table` results
+   * @param _sql The SQL text of the query
+   * @param _params The values bound to it
+   * @param _decode Which columns are decoded
+   * @param _headers The titles given to the columns
+   * @returns The key
+   */
+  static std::string
+  cache_key(const char &_kind, const std::string &_sql,
+            const std::vector<Param> &_params,
+            const std::vector<bool> &_decode = {},
+            const std::vector<std::string> &_headers = {});
+
+  /**
+   * @brief Find a kept result which is still fresh, dropping
+   * it if it is stale
+   * @param _key The key of the query
+   * @returns The entry, or nullptr on a miss
+   */
+  const Cached *lookup(const std::string &_key);
+
+  /**
+   * @brief Keep a result, evicting the least-recently used
+   * one if the cache is full
+   * @param _key The key of the query
+   * @param _entry The result and its dependencies
+   */
+  void keep(const std::string &_key, Cached &&_entry);
+
+  /// The statement being timed, or nullptr
+  Trace *tracing = nullptr;
+
+  /// True while a bounced set is being written
+  bool bouncing = false;
+
+  /**
+   * @brief Begin timing a statement, if anything is listening
+   * @param _sql The SQL text of the statement
+   * @param _params The values bound to it
+   * @returns A trace to fill in, or nullptr
+   */
+  std::unique_ptr<Trace>
+  start_trace(const std::string &_sql,
+              const std::vector<Param> &_params) const;
+
+  /**
+   * @brief Pass a finished statement to the hook and totals
+   * @param _trace The finished statement
+   */
+  void report(const Trace &_trace) noexcept;
+
+  /**
+   * @class Timing
+   * @brief Times the statement run while this is in scope,
+   * reporting it when this leaves scope
+   */
+  class Timing {
+  public:
+    /**
+     * @brief Begin timing, if anything is listening
+     * @param _owner The instance running the statement
+     * @param _sql The SQL text of the statement
+     * @param _params The values bound to it
+     */
+    Timing(GQL *const _owner, const std::string &_sql,
+           const std::vector<Param> &_params);
+
+    /// Report the statement, and resume timing any outer one
+    ~Timing();
+
+    Timing(const Timing &) = delete;
+    Timing &operator=(const Timing &) = delete;
+
+  protected:
+    /// The instance running the statement
+    GQL *const owner;
+
+    /// The statement which was being timed before this one
+    Trace *const outer;
+
+    /// The statement, or nullptr if it is not timed
+    std::unique_ptr<Trace> trace;
+  };
+
+  /// True while a plan is being recorded, during which no SQL
+  /// may run and nothing bounces
+  bool recording = false;
+
+  /**
+   * @brief Throw if a plan is being recorded
+   * @param _sql The SQL which was about to run
+   */
+  void check_recording(const std::string &_sql) const;
+
+  /// While recording, maps each placeholder handed out by
+  /// `Slots::number` to its slot
+  std::unordered_map<uint64_t, size_t> slot_numbers;
+
+  /**
+   * @brief Make the parameter for a number given to a query
+   * builder. While recording, numeric placeholders become
+   * SLOT parameters.
+   * @param _n The number
+   * @returns The parameter to bind
+   */
+  Param integer(const uint64_t &_n) const;
+
+  /**
+   * @brief Erase a bounced set of vertices and the edges which
+   * touch them. Edges are found through the source and target
+   * indices rather than by checking every edge.
+   * @param _set The bounced set's id parameter
+   */
+  void erase_vertex_set(const Param &_set);
+
+  /// The layout of labels and tags in this database
+  Format format = RAW;
+
+  /// Whether `dict_ids` and `dict_texts` hold the whole
+  /// dictionary
+  bool dict_loaded = false;
+
+  /// Maps each label and tag key to its dictionary id
+  std::unordered_map<std::string, int64_t> dict_ids;
+
+  /// Maps each dictionary id to its label or tag key
+  std::unordered_map<int64_t, std::string> dict_texts;
+
+  /// Whether the DB should exist after destruction
+  bool persistent;
+
+  /// Whether this handle holds no transaction and never writes
+  bool is_readonly = false;
+
+  /// Selects the read-only constructor
+  struct ReadOnly {};
+
+  /**
+   * @brief Open an existing database without the schema setup
+   * or long-lived transaction of the public constructor.
+   * @param _filepath The SQLite3 DB file to load
+   * @param _options The connection settings to apply
+   */
+  GQL(const std::string &_filepath, const Options &_options,
+      ReadOnly);
+
+  /// Set up per-connection state once the schema exists
+  void open_session();
+
+  /// Find which of the optional tag and degree tables exist,
+  /// e.g. after a rollback may have dropped them
+  void detect_tables();
+
+  /// The database file managed by this object
+  std::filesystem::path filepath;
+};
+
+/**
+ * @class GQL::Pool
+ * @brief A fixed set of read-only handles upon one database,
+ * for serving queries from many threads. Each thread leases a
+ * handle, queries through it, and returns it by dropping the
+ * lease. The pool must outlive its leases.
+ */
+class GQL::Pool {
+public:
+  /// Returns its handle to the pool when destroyed
+  using Lease =
+      std::unique_ptr<GQL, std::function<void(GQL *)>>;
+
+  /**
+   * @brief Open `_size` read-only handles upon a database
+   * @param _filepath The SQLite3 DB file to load
+   * @param _size The number of handles
+   * @param _options The connection settings for every handle
+   */
+  Pool(const std::string &_filepath, const size_t &_size,
+       const Options &_options = Options::read_heavy());
+
+  // Leases point into the pool
+  Pool(const Pool &) = delete;
+  Pool &operator=(const Pool &) = delete;
+
+  /**
+   * @brief Take a handle, waiting until one is free. The
+   * handle is exclusively the caller's until the lease drops.
+   * @returns The leased handle
+   */
+  Lease acquire();
+
+  /// @returns The number of handles
+  size_t size() const noexcept;
+
+protected:
+  std::mutex lock;
+  std::condition_variable freed;
+  std::vector<std::unique_ptr<GQL>> handles;
+  std::vector<GQL *> idle;
+};
+
+/**
+ * @class GQL::Writer
+ * @brief Owns the writing handle of a database on a thread of
+ * its own. Writes are queued from any thread and run in order,
+ * and are committed in groups: once `batch` of them have run,
+ * or `interval` after the oldest uncommitted one ran. Each
+ * write's future is ready once its group is durable. Readers
+ * (e.g. a `Pool` on the same WAL database) see each group as it
+ * commits. Destroying the writer commits everything queued.
+ * ```cpp
+ * GQL::Writer w("graph.db");
+ * auto id = w.submit([](GQL &g) {
+ *   return g.add_vertex().label("FUNC").id().front();
+ * });
+ * id.get(); // Waits for the commit
+ * ```
+ */
+class GQL::Writer {
+public:
+  /**
+   * @brief Open a database for writing on a new thread
+   * @param _filepath The SQLite3 DB file to create/load
+   * @param _options The connection settings to apply
+   * @param _batch The number of writes per commit
+   * @param _interval The longest a write waits to be committed
+   */
+  Writer(const std::string &_filepath,
+         const Options &_options = Options::durable(),
+         const size_t &_batch = GQL_WRITER_BATCH,
+         const std::chrono::milliseconds &_interval =
+             std::chrono::milliseconds(GQL_WRITER_INTERVAL_MS));
+
+  /// Runs and commits every queued write, then stops
+  ~Writer();
+
+  // The thread refers to this
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+
+  /**
+   * @brief Queue a write. `_fn` runs on the writer's thread,
+   * inside a savepoint, so a write which throws is undone on
+   * its own and its future holds the exception. Whatever `_fn`
+   * returns must not refer to the writer's graph (so ids, not
+   * `Vertices` or `Edges`).
+   * @tparam Fn The type of the write
+   * @param _fn Called with the writer's graph
+   * @returns What `_fn` returns, once it has been committed
+   */
+  template <typename Fn>
+  auto submit(Fn &&_fn)
+      -> std::future<std::invoke_result_t<Fn &, GQL &>>;
+
+  /**
+   * @brief Commit as soon as every write queued before this has
+   * run, without waiting for the batch or interval
+   * @returns Ready once the commit is done
+   */
+  std::future<void> flush();
+
+  /// @returns The number of group commits so far
+  uint64_t commits() const noexcept;
+
+  /**
+   * @brief Reserve vertex ids for writes which are still to be
+   * queued, from any thread
+   * @param _n The number of ids to reserve
+   * @returns The first id of the range `[first, first + _n)`
+   */
+  uint64_t reserve_vertex_ids(const uint64_t &_n) noexcept;
+
+  /**
+   * @brief Reserve edge ids for writes which are still to be
+   * queued, from any thread
+   * @param _n The number of ids to reserve
+   * @returns The first id of the range `[first, first + _n)`
+   */
+  uint64_t reserve_edge_ids(const uint64_t &_n) noexcept;
+
+protected:
+  /**
+   * @struct Job
+   * @brief A queued write, or a flush if it has no `run`
+   */
+  struct Job {
+    /// Runs the write
+    std::function<void(GQL &)> run;
+
+    /// Readies the future once the write is committed
+    std::function<void()> done;
+
+    /// Passes an error to the future
+    std::function<void(std::exception_ptr)> fail;
+  };
+
+  /**
+   * @brief Queue a job and wake the thread
+   * @param _job The job to queue
+   */
+  void enqueue(Job &&_job);
+
+  /// The body of the writer's thread
+  void loop();
+
+  /**
+   * @brief Commit the writes which have run, and ready (or
+   * fail) their futures
+   * @param _ran The writes since the last commit, which are
+   * cleared
+   */
+  void commit(std::vector<Job> &_ran) noexcept;
+
+  /// The writing handle, used only by `thread` once it starts
+  std::unique_ptr<GQL> graph;
+
+  /// The number of writes per commit
+  const size_t batch;
+
+  /// The longest a write waits to be committed
+  const std::chrono::milliseconds interval;
+
+  /// Guards `queue` and `stopping`
+  std::mutex lock;
+
+  /// Signalled when a job is queued or the writer stops
+  std::condition_variable wake;
+
+  /// Jobs which have not yet run
+  std::deque<Job> queue;
+
+  /// Set once the writer is being destroyed
+  bool stopping = false;
+
+  /// The number of group commits so far
+  std::atomic<uint64_t> commit_count{0};
+
+  /// Runs `loop`
+  std::thread thread;
+};
+
+/**
+ * @class GQL::Sharded
+ * @brief One graph spread over several database files
+ * ("shards"), each with its own handle and so its own writer.
+ * Each vertex is stored in the shard chosen by a hash of its
+ * id, along with its out-edges, so an edge's target may live in
+ * another shard. Query sets hold one part per shard; their
+ * filters and results run on every shard at once, on a pool of
+ * worker threads, and the results are gathered. Ids are unique
+ * across all shards. Like `GQL`, this is used from one thread at
+ * a time, except for reserving ids.
+ * ```cpp
+ * GQL::Sharded g({"g.0.db", "g.1.db", "g.2.db", "g.3.db"});
+ * g.add_vertex(1).label("FUNC");
+ * g.add_vertex(2);
+ * g.add_edge(1, 2).label("CALLS");
+ * g.v().with_label("FUNC").out("CALLS").target().id(); // {2}
+ * ```
+ */
+class GQL::Sharded {
+public:
+  class Vertices;
+  class Edges;
+  class Bulk;
+
+  /**
+   * @brief Open (or create) a database for each shard.
+   * Vertices are placed by their shard's position, so a graph
+   * must be reopened with the same files in the same order.
+   * @param _filepaths The SQLite3 DB file of each shard
+   * @param _erase If true, erases any existing files
+   * @param _options The connection settings of every shard
+   * @param _threads The number of worker threads, or zero for
+   * one per shard
+   */
+  Sharded(const std::vector<std::string> &_filepaths,
+          const bool &_erase = false,
+          const Options &_options = Options(),
+          const size_t &_threads = 0);
+
+  /// Stops the workers, then commits and closes every shard
+  ~Sharded();
+
+  // The workers and every query set refer to this
+  Sharded(const Sharded &) = delete;
+  Sharded &operator=(const Sharded &) = delete;
+
+  /// @returns The number of shards
+  size_t size() const noexcept;
+
+  /**
+   * @brief Find the shard which holds a vertex and its
+   * out-edges
+   * @param _id The id of the vertex
+   * @returns The index of its shard
+   */
+  size_t shard_of(const uint64_t &_id) const noexcept;
+
+  /**
+   * @brief Get the handle of a single shard, e.g. to index its
+   * tags. Rows should only be added through this object, which
+   * keeps their ids unique and places them by hash.
+   * @param _i The index of the shard
+   * @returns The shard's handle
+   */
+  GQL &shard(const size_t &_i);
+
+  /// @returns The set of all vertices
+  Vertices v();
+
+  /// @returns The set of all edges
+  Edges e();
+
+  /**
+   * @brief Generate a new vertex with the next unused id
+   * @returns The newly-generated vertex
+   */
+  Vertices add_vertex();
+
+  /**
+   * @brief Generate a new vertex with the given id
+   * @param _id The ID of the vertex, which should be unique
+   * @returns The newly-generated vertex
+   */
+  Vertices add_vertex(const uint64_t &_id);
+
+  /**
+   * @brief Generate a new edge, stored in the shard of its
+   * source
+   * @param _source The source of the edge
+   * @param _target The target of the edge, in any shard
+   * @returns The newly-added edge
+   */
+  Edges add_edge(const uint64_t &_source,
+                 const uint64_t &_target);
+
+  /**
+   * @brief Start a bulk load. Rows are buffered by shard, and
+   * every shard is written at once.
+   * @returns A loader which buffers rows until flushed
+   */
+  Bulk bulk();
+
+  /**
+   * @brief Reserve a contiguous range of vertex ids, as
+   * `GQL::reserve_vertex_ids` does, from any thread
+   * @param _n The number of ids to reserve
+   * @returns The first id of the range `[first, first + _n)`
+   */
+  uint64_t reserve_vertex_ids(const uint64_t &_n) noexcept;
+
+  /**
+   * @brief Reserve a contiguous range of edge ids, from any
+   * thread
+   * @param _n The number of ids to reserve
+   * @returns The first id of the range `[first, first + _n)`
+   */
+  uint64_t reserve_edge_ids(const uint64_t &_n) noexcept;
+
+  /// Commit every shard. Each commits on its own, so a crash
+  /// part way through may leave some shards ahead of others.
+  void commit();
+
+  /**
+   * @brief Run a function on every shard at once, on the worker
+   * threads, and wait for them all. Each call has its shard to
+   * itself.
+   * @param _fn Called with each shard and its index
+   * @throws The first error thrown by any call, once every call
+   * has finished
+   */
+  void
+  scatter(const std::function<void(GQL &, const size_t &)> &_fn);
+
+protected:
+  /**
+   * @brief Run a function on every shard at once and gather
+   * what each returns
+   * @tparam T What `_fn` returns
+   * @param _fn Called with each shard and its index
+   * @returns The result of each shard, by index
+   */
+  template <typename T, typename Fn>
+  std::vector<T> collect(const Fn &_fn);
+
+  /**
+   * @brief Concatenate the results of every shard, in order of
+   * their "id" column
+   * @param _results One result per shard
+   * @returns The combined result
+   */
+  static Result merged(std::vector<Result> &&_results);
+
+  /// The body of each worker thread
+  void work();
+
+  /// One writing handle per shard
+  std::vector<std::unique_ptr<GQL>> shards;
+
+  /// The next automatically-assigned vertex id
+  std::atomic<uint64_t> next_node_id{1};
+
+  /// The next automatically-assigned edge id
+  std::atomic<uint64_t> next_edge_id{1};
+
+  /// Run `work`, unless there is only one shard
+  std::vector<std::thread> workers;
+
+  /// Guards `tasks` and `stopping`
+  std::mutex lock;
+
+  /// Signalled when a task is queued or the workers stop
+  std::condition_variable wake;
+
+  /// Signalled when the last task of a `scatter` finishes
+  std::condition_variable finished;
+
+  /// Tasks which no worker has taken yet
+  std::deque<std::function<void()>> tasks;
+
+  /// Set once the graph is being destroyed
+  bool stopping = false;
+};
+
+/**
+ * @class GQL::Sharded::Vertices
+ * @brief Zero or more vertices of a sharded graph, held as one
+ * `GQL::Vertices` per shard
+ */
+class GQL::Sharded::Vertices {
+public:
+  /**
+   * @brief Gets the subset of items with the given label
+   * @param _label The desired label
+   * @returns All vertices herein with the given label
+   */
+  Vertices with_label(const std::string &_label) const;
+
+  /**
+   * @brief Gets the subset where the given key is associated
+   * with the given value
+   * @param _key The key to check
+   * @param _value The value to check for
+   * @returns All vertices herein with the given tag
+   */
+  Vertices with_tag(const std::string &_key,
+                    const std::string &_value) const;
+
+  /**
+   * @brief Select all vertices with the given id
+   * @param _id The ID to find
+   * @returns Zero or one node with the given ID
+   */
+  Vertices with_id(const uint64_t &_id) const;
+
+  /**
+   * @brief Select all vertices whose records satisfy the given
+   * predicate, which is called from the worker threads
+   * @param _fn The predicate, which must be thread-safe
+   * @returns The set of vertices for which _fn returns true
+   */
+  Vertices
+  filter(const std::function<bool(const Record &)> &_fn) const;
+
+  /**
+   * @param _other The other set
+   * @returns Any nodes which are in either or both
+   */
+  Vertices join(const Vertices &_other) const;
+
+  /**
+   * @param _other The other set
+   * @returns The subset of this set which is also in _other
+   */
+  Vertices intersection(const Vertices &_other) const;
+
+  /**
+   * @param _subgroup Any vertices herein will not be output
+   * @returns This group, minus that group
+   */
+  Vertices excluding(const Vertices &_subgroup) const;
+
+  /**
+   * @brief Get all edges leading into these vertices, from any
+   * shard. This gathers the ids of these vertices first.
+   * @returns The edges leading into these nodes
+   */
+  Edges in() const;
+
+  /// @returns The edges leading out of these nodes
+  Edges out() const;
+
+  /**
+   * @brief Get the edges with the given label leading into
+   * these vertices, from any shard
+   * @param _label The label of the edges to follow
+   * @returns The edges with this label leading into these nodes
+   */
+  Edges in(const std::string &_label) const;
+
+  /**
+   * @brief Get the edges with the given label leading out of
+   * these vertices
+   * @param _label The label of the edges to follow
+   * @returns The edges with this label leading out of these
+   * nodes
+   */
+  Edges out(const std::string &_label) const;
+
+  /// @returns The labels of all vertices in this set, by id
+  Result label() const;
+
+  /**
+   * @param _key The single key to fetch
+   * @returns The values associated with that key, by id
+   */
+  Result tag(const std::string &_key) const;
+
+  /// @returns All IDs within this set, in ascending order
+  std::vector<uint64_t> id() const;
+
+  /// @returns The number of vertices herein
+  uint64_t count() const;
+
+  /// @returns Whether this set is non-empty
+  bool exists() const;
+
+  /**
+   * @brief Set the label associated with all the nodes herein
+   * @param _label The label to set
+   * @returns These nodes after the operation is performed
+   */
+  Vertices label(const std::string &_label);
+
+  /**
+   * @brief Set some key-value pair for all items herein
+   * @param _key The key to associate
+   * @param _value The value to associate
+   * @returns This set after association
+   */
+  Vertices tag(const std::string &_key, const std::string &_value);
+
+  /// Erase these nodes, along with every edge in any shard
+  /// which references them
+  void erase();
+
+  /**
+   * @param _i The index of a shard
+   * @returns The part of this set stored in that shard
+   */
+  const GQL::Vertices &part(const size_t &_i) const;
+
+protected:
+  /**
+   * @param _owner The graph these are in
+   * @param _parts The part of this set in each shard
+   */
+  Vertices(Sharded *const _owner,
+           std::vector<GQL::Vertices> &&_parts);
+
+  /**
+   * @brief Build a new set from each part of this one, on
+   * every shard at once
+   * @param _fn Called with each part and its shard's index
+   * @returns The new set
+   */
+  template <typename Fn> Vertices map(const Fn &_fn) const;
+
+  /// The graph these are in
+  Sharded *const owner;
+
+  /// The part of this set in each shard
+  std::vector<GQL::Vertices> parts;
+
+  friend class Sharded;
+  friend class Edges;
+};
+
+/**
+ * @class GQL::Sharded::Edges
+ * @brief Zero or more edges of a sharded graph, held as one
+ * `GQL::Edges` per shard. Each edge is in its source's shard.
+ */
+class GQL::Sharded::Edges {
+public:
+  /**
+   * @brief Gets the subset of items with the given label
+   * @param _label The desired label
+   * @returns All edges herein with the given label
+   */
+  Edges with_label(const std::string &_label) const;
+
+  /**
+   * @brief Gets the subset where the given key is associated
+   * with the given value
+   * @param _key The key to check
+   * @param _value The value to check for
+   * @returns All edges herein with the given tag
+   */
+  Edges with_tag(const std::string &_key,
+                 const std::string &_value) const;
+
+  /**
+   * @brief Select all edges with the given id
+   * @param _id The ID to find
+   * @returns Zero or one edge with the given ID
+   */
+  Edges with_id(const uint64_t &_id) const;
+
+  /**
+   * @brief Select all edges whose records satisfy the given
+   * predicate, which is called from the worker threads
+   * @param _fn The predicate, which must be thread-safe
+   * @returns The set of edges for which _fn returns true
+   */
+  Edges
+  filter(const std::function<bool(const Record &)> &_fn) const;
+
+  /**
+   * @param _other The other set
+   * @returns Any edges which are in either or both
+   */
+  Edges join(const Edges &_other) const;
+
+  /**
+   * @param _other The other set
+   * @returns The subset of this set which is also in _other
+   */
+  Edges intersection(const Edges &_other) const;
+
+  /**
+   * @param _other Any edges herein will not be output
+   * @returns This group, minus that group
+   */
+  Edges excluding(const Edges &_other) const;
+
+  /// @returns Every vertex from which one of these edges points
+  Vertices source() const;
+
+  /**
+   * @brief Get every vertex which one of these edges points to,
+   * in whichever shard it is stored. The target ids are
+   * gathered from every shard and sent to the shards which own
+   * them.
+   * @returns Some subset of the vertices
+   */
+  Vertices target() const;
+
+  /// @returns The labels of all edges in this set, by id
+  Result label() const;
+
+  /**
+   * @param _key The single key to fetch
+   * @returns The values associated with that key, by id
+   */
+  Result tag(const std::string &_key) const;
+
+  /// @returns All IDs within this set, in ascending order
+  std::vector<uint64_t> id() const;
+
+  /// @returns The number of edges herein
+  uint64_t count() const;
+
+  /// @returns Whether this set is non-empty
+  bool exists() const;
+
+  /**
+   * @brief Set the label associated with all the edges herein
+   * @param _label The label to set
+   * @returns These edges after the operation is performed
+   */
+  Edges label(const std::string &_label);
+
+  /**
+   * @brief Set some key-value pair for all items herein
+   * @param _key The key to associate
+   * @param _value The value to associate
+   * @returns This set after association
+   */
+  Edges tag(const std::string &_key, const std::string &_value);
+
+  /// Erase these edges from the graph
+  void erase();
+
+  /**
+   * @param _i The index of a shard
+   * @returns The part of this set stored in that shard
+   */
+  const GQL::Edges &part(const size_t &_i) const;
+
+protected:
+  /**
+   * @param _owner The graph these are in
+   * @param _parts The part of this set in each shard
+   */
+  Edges(Sharded *const _owner, std::vector<GQL::Edges> &&_parts);
+
+  /**
+   * @brief Build a new set from each part of this one, on
+   * every shard at once
+   * @param _fn Called with each part and its shard's index
+   * @returns The new set
+   */
+  template <typename Fn> Edges map(const Fn &_fn) const;
+
+  /// The graph these are in
+  Sharded *const owner;
+
+  /// The part of this set in each shard
+  std::vector<GQL::Edges> parts;
+
+  friend class Sharded;
+  friend class Vertices;
+};
+
+/**
+ * @class GQL::Sharded::Bulk
+ * @brief A bulk loader for a sharded graph. Rows are buffered
+ * by shard, and each flush loads every shard at once, each
+ * through its own `GQL::Bulk`.
+ */
+class GQL::Sharded::Bulk {
+public:
+  /**
+   * @brief Buffer a vertex
+   * @param _id The ID of the vertex, which should be unique
+   * @param _label The label of the vertex
+   * @param _tags The key-value pairs to associate with it
+   * @returns This loader, for chaining
+   */
+  Bulk &vertex(const uint64_t &_id, const std::string &_label = "",
+               const std::map<std::string, std::string> &_tags =
+                   {});
+
+  /**
+   * @brief Buffer an edge. Its ID is assigned automatically
+   * when it is flushed.
+   * @param _source The ID of the source vertex
+   * @param _target The ID of the target vertex
+   * @param _label The label of the edge
+   * @param _tags The key-value pairs to associate with it
+   * @returns This loader, for chaining
+   */
+  Bulk &edge(const uint64_t &_source, const uint64_t &_target,
+             const std::string &_label = "",
+             const std::map<std::string, std::string> &_tags = {});
+
+  /// Write all buffered rows, to every shard at once
+  void flush();
+
+  /// @returns The number of rows currently buffered
+  size_t size() const noexcept;
+
+  /// Flushes any remaining rows. Failures are printed to
+  /// std::cerr rather than thrown, so call `flush` first.
+  ~Bulk();
+
+  // Loaders flush on destruction, so they are not copied
+  Bulk(const Bulk &) = delete;
+  Bulk &operator=(const Bulk &) = delete;
+
+protected:
+  /// @param _owner The graph to load into
+  Bulk(Sharded *const _owner);
+
+  /// The graph which is loaded into
+  Sharded *const owner;
+
+  /// Buffered vertices, by shard
+  std::vector<std::vector<Record>> vertices;
+
+  /// Buffered edges, by shard
+  std::vector<std::vector<Record>> edges;
+
+  /// The number of rows buffered across all shards
+  size_t buffered = 0;
+
+  /// The number of edges buffered, each of which holds its
+  /// position in place of an id until they are flushed
+  uint64_t unnumbered = 0;
+
+  friend class Sharded;
+};
+
+/**
+ * @class GQL::Pattern
+ * @brief A subgraph shape, such as "PREDICATE -TRUE-> STATEMENT
+ * -DATA-> x", built from named vertex and edge variables and
+ * compiled into a single SQL join. Each match binds every named
+ * variable to an id. The join starts from the variable with
+ * the fewest rows (counting up to `GQL_PATTERN_SAMPLE`) and
+ * always adds the smallest one connected to those already
+ * joined; the order is fixed with `CROSS JOIN`, so SQLite does
+ * not reorder it. Each hop is then an index lookup rather than
+ * a query per step. Variables are matched independently, so
+ * two of them may bind the same vertex.
+ * ```cpp
+ * auto p = g.match()
+ *              .vertex("p", "PREDICATE")
+ *              .edge("p", "TRUE", "s")
+ *              .vertex("s", "STATEMENT")
+ *              .edge("s", "DATA", "x");
+ * for (const auto &row : p.stream()) {
+ *   row.integer(p.column("x"));
+ * }
+ * ```
+ */
+class GQL::Pattern {
+public:
+  /**
+   * @brief Declare a vertex variable which may bind any vertex
+   * @param _name The variable, which names its column
+   * @returns This pattern, for chaining
+   */
+  Pattern &vertex(const std::string &_name);
+
+  /**
+   * @brief Constrain a vertex variable to the given label,
+   * declaring it if need be
+   * @param _name The variable, which names its column
+   * @param _label The label its vertices must have
+   * @returns This pattern, for chaining
+   */
+  Pattern &vertex(const std::string &_name,
+                  const std::string &_label);
+
+  /**
+   * @brief Constrain a vertex variable to a set, declaring it
+   * if need be. Constraining a variable twice binds it to the
+   * intersection.
+   * @param _name The variable, which names its column
+   * @param _where Any set of vertices, e.g. one with tags
+   * @returns This pattern, for chaining
+   */
+  Pattern &vertex(const std::string &_name,
+                  const Vertices &_where);
+
+  /**
+   * @brief Require an edge with the given label between two
+   * vertex variables, declaring them if need be
+   * @param _source The variable of the edge's source
+   * @param _label The label the edge must have
+   * @param _target The variable of the edge's target
+   * @param _name If given, the edge's own variable, which names
+   * its column
+   * @returns This pattern, for chaining
+   */
+  Pattern &edge(const std::string &_source,
+                const std::string &_label,
+                const std::string &_target,
+                const std::string &_name = "");
+
+  /**
+   * @brief Require an edge from a set between two vertex
+   * variables, declaring them if need be
+   * @param _source The variable of the edge's source
+   * @param _where Any set of edges, e.g. `g.e()` for any edge
+   * @param _target The variable of the edge's target
+   * @param _name If given, the edge's own variable, which names
+   * its column
+   * @returns This pattern, for chaining
+   */
+  Pattern &edge(const std::string &_source, const Edges &_where,
+                const std::string &_target,
+                const std::string &_name = "");
+
+  /**
+   * @brief Stream every match, one row per match and one
+   * integer column per named variable, in the order they were
+   * declared. Rows come in no particular order.
+   * @returns A cursor over the matches
+   */
+  Cursor stream() const;
+
+  /**
+   * @brief Read every match at once, as `stream` would
+   * @returns One row per match
+   */
+  Table table() const;
+
+  /// @returns The number of matches
+  uint64_t count() const;
+
+  /**
+   * @param _name A named variable
+   * @returns The index of its column in each match
+   */
+  size_t column(const std::string &_name) const;
+
+  /**
+   * @param _name A vertex variable
+   * @returns Every vertex which it binds in some match
+   */
+  Vertices vertices(const std::string &_name) const;
+
+  /**
+   * @param _name A named edge variable
+   * @returns Every edge which it binds in some match
+   */
+  Edges edges(const std::string &_name) const;
+
+protected:
+  /**
+   * @struct Var
+   * @brief A variable and the sets which constrain it
+   */
+  struct Var {
+    /// The name of the variable, or empty for an unnamed edge
+    std::string name;
+
+    /// Whether this binds edges rather than vertices
+    bool is_edge = false;
+
+    /// The queries the bound ids must be selected by
+    std::vector<std::string> cmds;
+
+    /// The values bound to the placeholders of each query
+    std::vector<std::vector<Param>> params;
+
+    /// For an edge, the indices of its endpoint variables
+    size_t source = 0, target = 0;
+  };
+
+  /// @param _owner The graph to match in
+  Pattern(GQL *const _owner);
+
+  /**
+   * @brief Find a variable, declaring it if need be
+   * @param _name The name of the variable
+   * @param _is_edge Whether it binds edges
+   * @returns Its index in `vars`
+   */
+  size_t declare(const std::string &_name, const bool &_is_edge);
+
+  /**
+   * @brief Add an edge variable
+   * @param _source The variable of the edge's source
+   * @param _where The set its edges must be in
+   * @param _target The variable of the edge's target
+   * @param _name The edge's variable, if named
+   */
+  void add_edge(const std::string &_source, const Edges &_where,
+                const std::string &_target,
+                const std::string &_name);
+
+  /**
+   * @brief Compile the pattern into one query
+   * @param _params Filled with the values of its placeholders
+   * @param _only If given, the only variable to select (as
+   * "id")
+   * @returns A query selecting one column per named variable
+   */
+  std::string compile(std::vector<Param> &_params,
+                      const std::string &_only = "") const;
+
+  /// @returns The named variables, in the order declared
+  std::vector<std::string> names() const;
+
+  /**
+   * @param _name A named variable
+   * @returns Its index in `vars`
+   */
+  size_t column_var(const std::string &_name) const;
+
+  /// The graph to match in
+  GQL *const owner;
+
+  /// Every variable, in the order declared
+  std::vector<Var> vars;
+
+  friend class GQL;
+};
+
+/**
+ * @class GQL::Snapshot
+ * @brief A frozen copy of a graph's adjacency in compressed
+ * sparse row (CSR) form. Vertices are renumbered densely by
+ * ascending id, so vertex `i` has id `id(i)`. Edges are
+ * numbered by their position in the forward CSR (ordered by
+ * source, then id), and the reverse CSR points back into it.
+ * Neighbours of a vertex are contiguous, so a hop costs one
+ * array read instead of a SQL query. Edges whose source or
+ * target is not a vertex are left out (see `dangling_edges`).
+ * The snapshot must not outlive the GQL which made it.
+ */
+class GQL::Snapshot {
+public:
+  /// A dense vertex number
+  using Index = uint32_t;
+
+  /// A read-only view of a contiguous part of an array
+  template <typename T> class Slice {
+  public:
+    Slice(const T *_first, const T *_last)
+        : first(_first), last(_last) {}
+
+    const T *begin() const noexcept { return first; }
+    const T *end() const noexcept { return last; }
+    size_t size() const noexcept { return last - first; }
+    bool empty() const noexcept { return first == last; }
+    const T &operator[](const size_t &_i) const {
+      return first[_i];
+    }
+
+  protected:
+    const T *first, *last;
+  };
+
+  /// @returns The number of vertices
+  size_t size() const noexcept;
+
+  /// @returns The number of edges
+  size_t edge_count() const noexcept;
+
+  /// @returns The number of edges which were left out because
+  /// their source or target is not a vertex
+  size_t dangling_edges() const noexcept;
+
+  /// @returns True iff edge labels were kept
+  bool has_labels() const noexcept;
+
+  /**
+   * @brief Get a vertex's dense number
+   * @param _id The vertex id
+   * @returns Its dense number. Throws if it is not present.
+   */
+  Index index(const uint64_t &_id) const;
+
+  /**
+   * @brief Get the dense numbers of a set of vertices
+   * @param _of The vertices, from the same graph
+   * @returns Their dense numbers, ascending
+   */
+  std::vector<Index> index(const Vertices &_of) const;
+
+  /// @returns The id of dense vertex `_v`
+  uint64_t id(const Index &_v) const;
+
+  /// @returns The targets of the edges leaving `_v`
+  Slice<Index> out(const Index &_v) const;
+
+  /// @returns The sources of the edges entering `_v`
+  Slice<Index> in(const Index &_v) const;
+
+  /// @returns The number of edges leaving `_v`
+  size_t out_degree(const Index &_v) const;
+
+  /// @returns The number of edges entering `_v`
+  size_t in_degree(const Index &_v) const;
+
+  /// @returns The number of the first edge leaving `_v`; the
+  /// rest follow it in the order of `out(_v)`
+  size_t out_offset(const Index &_v) const;
+
+  /**
+   * @brief Get every edge leaving some vertices
+   * @param _from The dense vertex numbers
+   * @returns The edge numbers, ascending
+   */
+  std::vector<size_t>
+  out(const std::vector<Index> &_from) const;
+
+  /**
+   * @brief Get every edge entering some vertices
+   * @param _to The dense vertex numbers
+   * @returns The edge numbers, ascending
+   */
+  std::vector<size_t> in(const std::vector<Index> &_to) const;
+
+  /**
+   * @brief Get the distinct targets of some edges
+   * @param _edges The edge numbers
+   * @returns The dense vertex numbers, ascending
+   */
+  std::vector<Index>
+  target(const std::vector<size_t> &_edges) const;
+
+  /**
+   * @brief Get the distinct sources of some edges
+   * @param _edges The edge numbers
+   * @returns The dense vertex numbers, ascending
+   */
+  std::vector<Index>
+  source(const std::vector<size_t> &_edges) const;
+
+  /// @returns The source of edge `_e`
+  Index source(const size_t &_e) const;
+
+  /// @returns The target of edge `_e`
+  Index target(const size_t &_e) const;
+
+  /// @returns The id of edge `_e`
+  uint64_t edge_id(const size_t &_e) const;
+
+  /// @returns The label number of edge `_e`
+  uint32_t label_id(const size_t &_e) const;
+
+  /// @returns The label of edge `_e`
+  const std::string &label(const size_t &_e) const;
+
+  /// @returns Every distinct edge label, by label number
+  const std::vector<std::string> &labels() const noexcept;
+
+  /**
+   * @brief Map dense vertex numbers back into the graph
+   * @param _of The dense vertex numbers
+   * @returns The same vertices, as a query
+   */
+  Vertices vertices(const std::vector<Index> &_of) const;
+
+  /**
+   * @brief Map edge numbers back into the graph
+   * @param _of The edge numbers
+   * @returns The same edges, as a query
+   */
+  Edges edges(const std::vector<size_t> &_of) const;
 
 protected:
+  friend GQL;
+
   /**
-   * @brief Get all vertices where some SQL WHERE clause holds
-   * @param _where The SQL clause to use
-   * @returns All vertices where the SQL clause holds
+   * @brief Build the arrays from one scan of each table
+   * @param _owner The graph to copy
+   * @param _labels Whether to keep edge labels
    */
-  Vertices v(const std::string &_where);
+  Snapshot(GQL *_owner, const bool &_labels);
+
+  GQL *owner;
+  bool labelled;
+
+  /// The number of edges left out
+  size_t dangling = 0;
+
+  /// Vertex ids, ascending; the inverse of `index`
+  std::vector<uint64_t> ids;
+
+  /// Forward CSR: Edges leaving `v` are positions
+  /// `[out_offsets[v], out_offsets[v + 1])`
+  std::vector<size_t> out_offsets;
+  std::vector<Index> out_targets;
+  std::vector<uint64_t> out_ids;
+  std::vector<uint32_t> out_labels;
+
+  /// Reverse CSR: `in_edges` holds forward positions
+  std::vector<size_t> in_offsets;
+  std::vector<Index> in_sources;
+  std::vector<size_t> in_edges;
+
+  std::vector<std::string> label_names;
+};
+
+/**
+ * @class GQL::Slots
+ * @brief Stands in for the values which change between runs of
+ * a `GQL::Plan`. Slot `i` takes the `i`th value given to each
+ * run, and may be used more than once.
+ */
+class GQL::Slots {
+public:
+  /**
+   * @brief A textual slot: A label, tag key or tag value. Tag
+   * keys given this way must not contain quotes, backslashes
+   * or control characters when the plan is run.
+   * @param _i The slot number
+   * @returns A placeholder to use in its place
+   */
+  std::string text(const size_t &_i) const;
+
+  /**
+   * @brief A numeric slot: An id, count or limit. Traversal
+   * depths choose the shape of a query, so they cannot be
+   * slots.
+   * @param _i The slot number
+   * @returns A placeholder to use in its place
+   */
+  uint64_t number(const size_t &_i) const;
+
+protected:
+  friend GQL;
+
+  /// @param _owner The graph which is recording
+  Slots(GQL *_owner) : owner(_owner) {}
+
+  /// The graph which is recording
+  GQL *owner;
+
+  /// The first numeric placeholder. Only placeholders handed
+  /// out by this recording are taken to be slots.
+  const static uint64_t NUMBER_MARK = 0xFFFFFFFF00000000ULL;
+};
+
+/**
+ * @class GQL::Plan
+ * @brief A recorded query shape (see `GQL::plan`), which is
+ * run by giving it one value per slot. Runs bind values only:
+ * No SQL is generated and nothing bounces. The plan must not
+ * outlive the GQL which recorded it.
+ * @tparam T `GQL::Vertices` or `GQL::Edges`
+ */
+template <typename T> class GQL::Plan {
+public:
+  /// A value for one slot
+  class Value {
+  public:
+    Value(const std::string &_text) : text(_text) {}
+    Value(const char *_text) : text(_text) {}
+    Value(const uint64_t &_number)
+        : is_number(true), number(_number) {}
+    Value(const int &_number)
+        : is_number(true), number((uint64_t)_number) {}
+
+    bool is_number = false;
+    uint64_t number = 0;
+    std::string text;
+  };
+
+  /**
+   * @brief Run the plan
+   * @param _values One value per slot, in slot order
+   * @returns The query, with these values bound
+   */
+  T operator()(const std::vector<Value> &_values) const;
+
+  /// @returns The number of slots which each run fills
+  size_t size() const noexcept { return slot_count; }
+
+  /// @returns The SQL which every run binds values to
+  const std::string &sql() const noexcept { return cmd; }
+
+protected:
+  friend GQL;
+
+  /// Where a slot's value goes
+  struct Use {
+    size_t param;
+    size_t slot;
+    bool is_number;
+  };
+
+  Plan(GQL *_owner, const T &_recorded);
+
+  GQL *owner;
+  std::string cmd;
+  std::vector<Param> params;
+  std::vector<Use> uses;
+  size_t slot_count = 0;
+};
+
+/**
+ * @brief Prints a given GQL::Result object
+ * @param _into The output stream to insert into
+ * @param _what The result object to print
+ * @returns The stream after insertion
+ */
+std::ostream &operator<<(std::ostream &_into,
+                         const GQL::Result &_what);
+
+////////////////////////////////////////////////////////////////
+
+inline GQL::GQL(const std::string &_filepath,
+                const bool &_erase, const bool &_persistent,
+                const Options &_options)
+    : persistent(_persistent), filepath(_filepath) {
+  if (_erase) {
+    remove_files();
+  }
+
+  // Open database
+  sqlite3_open(filepath.c_str(), &db);
+  sqlite3_set_authorizer(db, &GQL::on_authorize, this);
+  sqlite3_create_function(db, "gql_expand", 3, SQLITE_UTF8,
+                          nullptr, &GQL::on_expand, nullptr,
+                          nullptr);
+  try {
+    apply(_options);
+
+    // New databases use the latest format, and existing ones
+    // keep their own
+    const bool is_new =
+        sql("SELECT name FROM sqlite_master WHERE type = "
+            "'table' AND name = 'nodes';")
+            .empty();
+    if (is_new) {
+      if (_options.format > DICT) {
+        throw std::runtime_error("Invalid storage format.");
+      }
+      format = _options.format;
+      sql(__gql_format_str("PRAGMA user_version = {};",
+                           std::to_string(format)));
+    } else {
+      const auto version = std::stoull(
+          sql("PRAGMA user_version;").body.at(0).at(0));
+      if (version > DICT) {
+        throw std::runtime_error(__gql_format_str(
+            "Unsupported storage format {}.",
+            std::to_string(version)));
+      }
+      format = (Format)version;
+    }
+  } catch (...) {
+    // The destructor will not run, so close up here
+    for (const auto &p : stmt_lru) {
+      sqlite3_finalize(p.second);
+    }
+    sqlite3_close(db);
+    throw;
+  }
+
+  // Initialize. Dictionary id 0 is the empty label.
+  const std::string label_column = format == DICT
+                                       ? "label INTEGER DEFAULT 0"
+                                       : "label TEXT DEFAULT ''";
+  if (format == DICT) {
+    sql("CREATE TABLE IF NOT EXISTS gql_dict ("
+        "id INTEGER NOT NULL, "
+        "text TEXT NOT NULL UNIQUE, "
+        "PRIMARY KEY(id)"
+        ");");
+    sql("INSERT OR IGNORE INTO gql_dict (id, text) "
+        "VALUES (0, '');");
+  }
+  sql("CREATE TABLE IF NOT EXISTS nodes ("
+      "id INTEGER NOT NULL, " +
+      label_column +
+      ", "
+      "tags TEXT DEFAULT '{}', "
+      "PRIMARY KEY(id)"
+      ");");
+  sql("CREATE TABLE IF NOT EXISTS edges ("
+      "id INTEGER NOT NULL, "
+      "source INTEGER NOT NULL, "
+      "target INTEGER NOT NULL, " +
+      label_column +
+      ", "
+      "tags TEXT DEFAULT '{}', "
+      "PRIMARY KEY(id), "
+      "FOREIGN KEY(source) REFERENCES nodes(id), "
+      "FOREIGN KEY(target) REFERENCES nodes(id)"
+      ");");
+
+  create_indices();
+  open_session();
+
+  // Continue numbering after any existing rows
+  next_node_id = std::stoull(
+      sql("SELECT COALESCE(MAX(id), 0) + 1 FROM nodes;")
+          .body.at(0)
+          .at(0));
+  next_edge_id = std::stoull(
+      sql("SELECT COALESCE(MAX(id), 0) + 1 FROM edges;")
+          .body.at(0)
+          .at(0));
+
+  sql("BEGIN;");
+}
+
+inline GQL::GQL(const std::string &_filepath,
+                const Options &_options, ReadOnly)
+    : persistent(true), is_readonly(true),
+      filepath(_filepath) {
+  if (sqlite3_open_v2(filepath.c_str(), &db,
+                      SQLITE_OPEN_READONLY, nullptr) !=
+      SQLITE_OK) {
+    const std::string msg = sqlite3_errmsg(db);
+    sqlite3_close(db);
+    throw std::runtime_error(msg);
+  }
+  sqlite3_busy_timeout(db, GQL_BUSY_TIMEOUT_MS);
+  sqlite3_set_authorizer(db, &GQL::on_authorize, this);
+  sqlite3_create_function(db, "gql_expand", 3, SQLITE_UTF8,
+                          nullptr, &GQL::on_expand, nullptr,
+                          nullptr);
+
+  try {
+    // The journal mode belongs to the writer
+    Options opts = _options;
+    opts.journal_mode.clear();
+    opts.page_size = 0;
+    apply(opts);
+
+    if (sql("SELECT name FROM sqlite_master WHERE type = "
+            "'table' AND name = 'nodes';")
+            .empty()) {
+      throw std::runtime_error(__gql_format_str(
+          "'{}' is not a GQL database.", _filepath));
+    }
+    const auto version = std::stoull(
+        sql("PRAGMA user_version;").body.at(0).at(0));
+    if (version > DICT) {
+      throw std::runtime_error(__gql_format_str(
+          "Unsupported storage format {}.",
+          std::to_string(version)));
+    }
+    format = (Format)version;
+
+    open_session();
+  } catch (...) {
+    for (const auto &p : stmt_lru) {
+      sqlite3_finalize(p.second);
+    }
+    sqlite3_close(db);
+    throw;
+  }
+}
+
+inline void GQL::open_session() {
+  // Bounced sets live outside of any transaction's schema
+  // changes, but their rows are transactional. The temporary
+  // schema stays writable on read-only handles.
+  sql("CREATE TEMP TABLE IF NOT EXISTS gql_bounce ("
+      "set_id INTEGER NOT NULL, "
+      "id INTEGER NOT NULL, "
+      "PRIMARY KEY(set_id, id)"
+      ") WITHOUT ROWID;");
+  self = std::make_shared<GQL *>(this);
+  detect_tables();
+}
+
+inline void GQL::detect_tables() {
+  has_tag_tables =
+      !sql("SELECT name FROM sqlite_master WHERE type = "
+           "'table' AND name = 'node_tags';")
+           .empty();
+  has_degree_table =
+      !sql("SELECT name FROM sqlite_master WHERE type = "
+           "'table' AND name = 'node_degree';")
+           .empty();
+}
+
+inline std::unique_ptr<GQL>
+GQL::open_readonly(const std::string &_filepath,
+                   const Options &_options) {
+  return std::unique_ptr<GQL>(
+      new GQL(_filepath, _options, ReadOnly()));
+}
+
+inline bool GQL::readonly() const noexcept {
+  return is_readonly;
+}
+
+inline GQL::Pool::Pool(const std::string &_filepath,
+                       const size_t &_size,
+                       const Options &_options) {
+  if (_size == 0) {
+    throw std::runtime_error("A pool needs at least 1 handle.");
+  }
+  for (size_t i = 0; i < _size; ++i) {
+    handles.push_back(GQL::open_readonly(_filepath, _options));
+    idle.push_back(handles.back().get());
+  }
+}
+
+inline GQL::Pool::Lease GQL::Pool::acquire() {
+  std::unique_lock<std::mutex> guard(lock);
+  freed.wait(guard, [&]() { return !idle.empty(); });
+  GQL *const out = idle.back();
+  idle.pop_back();
+
+  return Lease(out, [this](GQL *_handle) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      idle.push_back(_handle);
+    }
+    freed.notify_one();
+  });
+}
+
+inline size_t GQL::Pool::size() const noexcept {
+  return handles.size();
+}
+
+inline GQL::Writer::Writer(
+    const std::string &_filepath, const Options &_options,
+    const size_t &_batch,
+    const std::chrono::milliseconds &_interval)
+    : graph(std::make_unique<GQL>(_filepath, false, true,
+                                  _options)),
+      batch(std::max<size_t>(_batch, 1)), interval(_interval) {
+  thread = std::thread([this]() { loop(); });
+}
+
+inline GQL::Writer::~Writer() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  thread.join();
+}
+
+template <typename Fn>
+inline auto GQL::Writer::submit(Fn &&_fn)
+    -> std::future<std::invoke_result_t<Fn &, GQL &>> {
+  using R = std::invoke_result_t<Fn &, GQL &>;
+  static_assert(!std::is_same_v<std::decay_t<R>, Vertices> &&
+                    !std::is_same_v<std::decay_t<R>, Edges>,
+                "A write may not return a query upon the "
+                "writer's graph.");
+
+  const auto promise = std::make_shared<std::promise<R>>();
+  auto out = promise->get_future();
+  Job job;
+  if constexpr (std::is_void_v<R>) {
+    job.run = [fn = std::forward<Fn>(_fn)](GQL &_g) mutable {
+      fn(_g);
+    };
+    job.done = [promise]() { promise->set_value(); };
+  } else {
+    // Held until the write is committed
+    const auto value = std::make_shared<std::optional<R>>();
+    job.run = [fn = std::forward<Fn>(_fn),
+               value](GQL &_g) mutable { value->emplace(fn(_g)); };
+    job.done = [promise, value]() {
+      promise->set_value(std::move(**value));
+    };
+  }
+  job.fail = [promise](std::exception_ptr _e) {
+    promise->set_exception(_e);
+  };
+  enqueue(std::move(job));
+  return out;
+}
+
+inline std::future<void> GQL::Writer::flush() {
+  const auto promise = std::make_shared<std::promise<void>>();
+  auto out = promise->get_future();
+  Job job;
+  job.done = [promise]() { promise->set_value(); };
+  job.fail = [promise](std::exception_ptr _e) {
+    promise->set_exception(_e);
+  };
+  enqueue(std::move(job));
+  return out;
+}
+
+inline uint64_t GQL::Writer::commits() const noexcept {
+  return commit_count;
+}
+
+inline uint64_t
+GQL::Writer::reserve_vertex_ids(const uint64_t &_n) noexcept {
+  return graph->reserve_vertex_ids(_n);
+}
+
+inline uint64_t
+GQL::Writer::reserve_edge_ids(const uint64_t &_n) noexcept {
+  return graph->reserve_edge_ids(_n);
+}
+
+inline void GQL::Writer::enqueue(Job &&_job) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (stopping) {
+      throw std::runtime_error("The writer is stopping.");
+    }
+    queue.push_back(std::move(_job));
+  }
+  wake.notify_one();
+}
+
+inline void GQL::Writer::loop() {
+  using clock = std::chrono::steady_clock;
+  std::vector<Job> ran;
+  clock::time_point oldest;
+
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    // Sleep until there is work, or the oldest uncommitted
+    // write is due
+    const auto ready = [&]() {
+      return !queue.empty() || stopping;
+    };
+    if (ran.empty()) {
+      wake.wait(guard, ready);
+    } else {
+      wake.wait_until(guard, oldest + interval, ready);
+    }
+    std::deque<Job> jobs;
+    jobs.swap(queue);
+    const bool stop = stopping;
+    guard.unlock();
+
+    bool flushing = stop;
+    for (auto &job : jobs) {
+      if (!job.run) {
+        flushing = true;
+        ran.push_back(std::move(job));
+        continue;
+      }
+      if (ran.empty()) {
+        oldest = clock::now();
+      }
+
+      try {
+        graph->sql("SAVEPOINT gql_writer;");
+        job.run(*graph);
+        graph->sql("RELEASE gql_writer;");
+      } catch (...) {
+        const auto error = std::current_exception();
+        try {
+          graph->sql("ROLLBACK TO gql_writer;");
+          graph->sql("RELEASE gql_writer;");
+          graph->invalidate();
+          graph->detect_tables();
+        } catch (...) {
+          // The write's own error is the one to report
+        }
+        job.fail(error);
+        continue;
+      }
+      ran.push_back(std::move(job));
+      if (ran.size() >= batch) {
+        commit(ran);
+      }
+    }
+    if (!ran.empty() &&
+        (flushing || clock::now() >= oldest + interval)) {
+      commit(ran);
+    }
+
+    guard.lock();
+    if (stop && queue.empty()) {
+      return;
+    }
+  }
+}
+
+inline void GQL::Writer::commit(std::vector<Job> &_ran) noexcept {
+  std::exception_ptr error;
+  try {
+    graph->commit();
+    ++commit_count;
+  } catch (...) {
+    error = std::current_exception();
+    try {
+      graph->rollback();
+    } catch (...) {
+      // The commit's own error is the one to report
+    }
+  }
+  for (auto &job : _ran) {
+    if (error) {
+      job.fail(error);
+    } else {
+      job.done();
+    }
+  }
+  _ran.clear();
+}
+
+inline GQL::Sharded::Sharded(
+    const std::vector<std::string> &_filepaths,
+    const bool &_erase, const Options &_options,
+    const size_t &_threads) {
+  if (_filepaths.empty()) {
+    throw std::runtime_error(
+        "A sharded graph needs at least one shard.");
+  }
+
+  // Continue numbering after the largest id in any shard
+  for (const auto &filepath : _filepaths) {
+    shards.push_back(
+        std::make_unique<GQL>(filepath, _erase, true, _options));
+    next_node_id =
+        std::max<uint64_t>(next_node_id, shards.back()->next_node_id);
+    next_edge_id =
+        std::max<uint64_t>(next_edge_id, shards.back()->next_edge_id);
+  }
+
+  if (shards.size() > 1) {
+    const size_t n = _threads == 0 ? shards.size() : _threads;
+    for (size_t i = 0; i < n; ++i) {
+      workers.emplace_back([this]() { work(); });
+    }
+  }
+}
+
+inline GQL::Sharded::~Sharded() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+inline size_t GQL::Sharded::size() const noexcept {
+  return shards.size();
+}
+
+inline size_t
+GQL::Sharded::shard_of(const uint64_t &_id) const noexcept {
+  // Mix the bits (as splitmix64 does), so that runs of
+  // consecutive ids are spread over every shard
+  uint64_t x = _id + 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x % shards.size();
+}
+
+inline GQL &GQL::Sharded::shard(const size_t &_i) {
+  return *shards.at(_i);
+}
+
+inline GQL::Sharded::Vertices GQL::Sharded::v() {
+  std::vector<GQL::Vertices> parts;
+  for (const auto &s : shards) {
+    parts.push_back(s->v());
+  }
+  return Vertices(this, std::move(parts));
+}
+
+inline GQL::Sharded::Edges GQL::Sharded::e() {
+  std::vector<GQL::Edges> parts;
+  for (const auto &s : shards) {
+    parts.push_back(s->e());
+  }
+  return Edges(this, std::move(parts));
+}
+
+inline GQL::Sharded::Vertices GQL::Sharded::add_vertex() {
+  return add_vertex(next_node_id++);
+}
+
+inline GQL::Sharded::Vertices
+GQL::Sharded::add_vertex(const uint64_t &_id) {
+  shards[shard_of(_id)]->add_vertex(_id);
+  GQL::advance(next_node_id, _id);
+  return v().with_id(_id);
+}
+
+inline GQL::Sharded::Edges
+GQL::Sharded::add_edge(const uint64_t &_source,
+                       const uint64_t &_target) {
+  const auto id = next_edge_id++;
+  shards[shard_of(_source)]->sql(
+      "INSERT INTO edges (id, source, target, tags) "
+      "VALUES (?, ?, ?, json('{}'));",
+      {Param(id), Param(_source), Param(_target)});
+  return e().with_id(id);
+}
+
+inline GQL::Sharded::Bulk GQL::Sharded::bulk() {
+  return Bulk(this);
+}
+
+inline uint64_t
+GQL::Sharded::reserve_vertex_ids(const uint64_t &_n) noexcept {
+  return next_node_id.fetch_add(_n);
+}
+
+inline uint64_t
+GQL::Sharded::reserve_edge_ids(const uint64_t &_n) noexcept {
+  return next_edge_id.fetch_add(_n);
+}
+
+inline void GQL::Sharded::commit() {
+  scatter([](GQL &_g, const size_t &) { _g.commit(); });
+}
+
+inline void GQL::Sharded::scatter(
+    const std::function<void(GQL &, const size_t &)> &_fn) {
+  std::vector<std::exception_ptr> errors(shards.size());
+  const auto run = [&](const size_t &_i) {
+    try {
+      _fn(*shards[_i], _i);
+    } catch (...) {
+      errors[_i] = std::current_exception();
+    }
+  };
+
+  if (workers.empty()) {
+    for (size_t i = 0; i < shards.size(); ++i) {
+      run(i);
+    }
+  } else {
+    size_t left = shards.size();
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      for (size_t i = 0; i < shards.size(); ++i) {
+        tasks.push_back([&, i]() {
+          run(i);
+          std::lock_guard<std::mutex> guard(lock);
+          if (--left == 0) {
+            finished.notify_all();
+          }
+        });
+      }
+    }
+    wake.notify_all();
+
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard, [&]() { return left == 0; });
+  }
+
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+template <typename T, typename Fn>
+inline std::vector<T> GQL::Sharded::collect(const Fn &_fn) {
+  std::vector<std::optional<T>> slots(shards.size());
+  scatter([&](GQL &_g, const size_t &_i) {
+    slots[_i].emplace(_fn(_g, _i));
+  });
+
+  std::vector<T> out;
+  out.reserve(slots.size());
+  for (auto &slot : slots) {
+    out.push_back(std::move(*slot));
+  }
+  return out;
+}
+
+inline GQL::Result
+GQL::Sharded::merged(std::vector<Result> &&_results) {
+  Result out;
+  for (auto &r : _results) {
+    if (out.headers.empty()) {
+      out.headers = r.headers;
+    }
+    for (auto &row : r.body) {
+      out.body.push_back(std::move(row));
+    }
+  }
+
+  // Each part is in order already, but they interleave
+  if (!out.body.empty()) {
+    const auto key = out.index_of("id");
+    std::stable_sort(out.body.begin(), out.body.end(),
+                     [&](const auto &_l, const auto &_r) {
+                       return std::stoull(_l[key]) <
+                              std::stoull(_r[key]);
+                     });
+  }
+  return out;
+}
+
+inline void GQL::Sharded::work() {
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    wake.wait(guard,
+              [this]() { return stopping || !tasks.empty(); });
+    if (tasks.empty()) {
+      return;
+    }
+    auto task = std::move(tasks.front());
+    tasks.pop_front();
+
+    guard.unlock();
+    task();
+    guard.lock();
+  }
+}
+
+inline GQL::Sharded::Vertices::Vertices(
+    Sharded *const _owner, std::vector<GQL::Vertices> &&_parts)
+    : owner(_owner), parts(std::move(_parts)) {
+}
+
+template <typename Fn>
+inline GQL::Sharded::Vertices
+GQL::Sharded::Vertices::map(const Fn &_fn) const {
+  return Vertices(owner, owner->collect<GQL::Vertices>(
+                             [&](GQL &, const size_t &_i) {
+                               return _fn(parts[_i], _i);
+                             }));
+}
+
+inline GQL::Sharded::Vertices
+GQL::Sharded::Vertices::with_label(
+    const std::string &_label) const {
+  return map([&](const GQL::Vertices &_p, const size_t &) {
+    return _p.with_label(_label);
+  });
+}
+
+inline GQL::Sharded::Vertices GQL::Sharded::Vertices::with_tag(
+    const std::string &_key, const std::string &_value) const {
+  return map([&](const GQL::Vertices &_p, const size_t &) {
+    return _p.with_tag(_key, _value);
+  });
+}
+
+inline GQL::Sharded::Vertices
+GQL::Sharded::Vertices::with_id(const uint64_t &_id) const {
+  return map([&](const GQL::Vertices &_p, const size_t &) {
+    return _p.with_id(_id);
+  });
+}
+
+inline GQL::Sharded::Vertices GQL::Sharded::Vertices::filter(
+    const std::function<bool(const Record &)> &_fn) const {
+  return map([&](const GQL::Vertices &_p, const size_t &) {
+    return _p.filter(_fn);
+  });
+}
+
+inline GQL::Sharded::Vertices
+GQL::Sharded::Vertices::join(const Vertices &_other) const {
+  return map([&](const GQL::Vertices &_p, const size_t &_i) {
+    return _p.join(_other.parts[_i]);
+  });
+}
+
+inline GQL::Sharded::Vertices
+GQL::Sharded::Vertices::intersection(
+    const Vertices &_other) const {
+  return map([&](const GQL::Vertices &_p, const size_t &_i) {
+    return _p.intersection(_other.parts[_i]);
+  });
+}
+
+inline GQL::Sharded::Vertices
+GQL::Sharded::Vertices::excluding(
+    const Vertices &_subgroup) const {
+  return map([&](const GQL::Vertices &_p, const size_t &_i) {
+    return _p.excluding(_subgroup.parts[_i]);
+  });
+}
+
+inline GQL::Sharded::Edges GQL::Sharded::Vertices::in() const {
+  // Edges are stored with their sources, so any shard may hold
+  // an edge into these
+  const auto ids = id();
+  return Edges(owner, owner->collect<GQL::Edges>(
+                          [&](GQL &_g, const size_t &) {
+                            return _g.e("target IN (SELECT id "
+                                        "FROM gql_bounce WHERE "
+                                        "set_id = ?)",
+                                        {_g.bounce(ids)});
+                          }));
+}
+
+inline GQL::Sharded::Edges GQL::Sharded::Vertices::out() const {
+  return Edges(owner, owner->collect<GQL::Edges>(
+                          [&](GQL &, const size_t &_i) {
+                            return parts[_i].out();
+                          }));
+}
+
+inline GQL::Sharded::Edges
+GQL::Sharded::Vertices::in(const std::string &_label) const {
+  const auto ids = id();
+  return Edges(owner, owner->collect<GQL::Edges>(
+                          [&](GQL &_g, const size_t &) {
+                            return _g.e(
+                                "target IN (SELECT id FROM "
+                                "gql_bounce WHERE set_id = ?) "
+                                "AND label = ?",
+                                {_g.bounce(ids),
+                                 Param(Param::LABEL, _label)});
+                          }));
+}
+
+inline GQL::Sharded::Edges
+GQL::Sharded::Vertices::out(const std::string &_label) const {
+  return Edges(owner, owner->collect<GQL::Edges>(
+                          [&](GQL &, const size_t &_i) {
+                            return parts[_i].out(_label);
+                          }));
+}
+
+inline GQL::Result GQL::Sharded::Vertices::label() const {
+  return merged(owner->collect<Result>(
+      [&](GQL &, const size_t &_i) { return parts[_i].label(); }));
+}
+
+inline GQL::Result
+GQL::Sharded::Vertices::tag(const std::string &_key) const {
+  return merged(
+      owner->collect<Result>([&](GQL &, const size_t &_i) {
+        return parts[_i].tag(_key);
+      }));
+}
+
+inline std::vector<uint64_t> GQL::Sharded::Vertices::id() const {
+  std::vector<uint64_t> out;
+  for (const auto &ids : owner->collect<std::vector<uint64_t>>(
+           [&](GQL &, const size_t &_i) { return parts[_i].id(); })) {
+    out.insert(out.end(), ids.begin(), ids.end());
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+inline uint64_t GQL::Sharded::Vertices::count() const {
+  uint64_t out = 0;
+  for (const auto &n : owner->collect<uint64_t>(
+           [&](GQL &, const size_t &_i) {
+             return parts[_i].count();
+           })) {
+    out += n;
+  }
+  return out;
+}
+
+inline bool GQL::Sharded::Vertices::exists() const {
+  const auto found = owner->collect<bool>(
+      [&](GQL &, const size_t &_i) { return parts[_i].exists(); });
+  return std::find(found.begin(), found.end(), true) !=
+         found.end();
+}
+
+inline GQL::Sharded::Vertices
+GQL::Sharded::Vertices::label(const std::string &_label) {
+  owner->scatter([&](GQL &, const size_t &_i) {
+    parts[_i].label(_label);
+  });
+  return *this;
+}
+
+inline GQL::Sharded::Vertices
+GQL::Sharded::Vertices::tag(const std::string &_key,
+                            const std::string &_value) {
+  owner->scatter([&](GQL &, const size_t &_i) {
+    parts[_i].tag(_key, _value);
+  });
+  return *this;
+}
+
+inline void GQL::Sharded::Vertices::erase() {
+  // Edges into these may be in any shard
+  const auto ids = id();
+  owner->scatter(
+      [&](GQL &_g, const size_t &) { _g.erase_vertices(ids); });
+}
+
+inline const GQL::Vertices &
+GQL::Sharded::Vertices::part(const size_t &_i) const {
+  return parts.at(_i);
+}
+
+inline GQL::Sharded::Edges::Edges(Sharded *const _owner,
+                                  std::vector<GQL::Edges> &&_parts)
+    : owner(_owner), parts(std::move(_parts)) {
+}
+
+template <typename Fn>
+inline GQL::Sharded::Edges
+GQL::Sharded::Edges::map(const Fn &_fn) const {
+  return Edges(owner, owner->collect<GQL::Edges>(
+                          [&](GQL &, const size_t &_i) {
+                            return _fn(parts[_i], _i);
+                          }));
+}
+
+inline GQL::Sharded::Edges
+GQL::Sharded::Edges::with_label(const std::string &_label) const {
+  return map([&](const GQL::Edges &_p, const size_t &) {
+    return _p.with_label(_label);
+  });
+}
+
+inline GQL::Sharded::Edges
+GQL::Sharded::Edges::with_tag(const std::string &_key,
+                              const std::string &_value) const {
+  return map([&](const GQL::Edges &_p, const size_t &) {
+    return _p.with_tag(_key, _value);
+  });
+}
+
+inline GQL::Sharded::Edges
+GQL::Sharded::Edges::with_id(const uint64_t &_id) const {
+  return map([&](const GQL::Edges &_p, const size_t &) {
+    return _p.with_id(_id);
+  });
+}
+
+inline GQL::Sharded::Edges GQL::Sharded::Edges::filter(
+    const std::function<bool(const Record &)> &_fn) const {
+  return map([&](const GQL::Edges &_p, const size_t &) {
+    return _p.filter(_fn);
+  });
+}
+
+inline GQL::Sharded::Edges
+GQL::Sharded::Edges::join(const Edges &_other) const {
+  return map([&](const GQL::Edges &_p, const size_t &_i) {
+    return _p.join(_other.parts[_i]);
+  });
+}
+
+inline GQL::Sharded::Edges
+GQL::Sharded::Edges::intersection(const Edges &_other) const {
+  return map([&](const GQL::Edges &_p, const size_t &_i) {
+    return _p.intersection(_other.parts[_i]);
+  });
+}
+
+inline GQL::Sharded::Edges
+GQL::Sharded::Edges::excluding(const Edges &_other) const {
+  return map([&](const GQL::Edges &_p, const size_t &_i) {
+    return _p.excluding(_other.parts[_i]);
+  });
+}
+
+inline GQL::Sharded::Vertices GQL::Sharded::Edges::source() const {
+  return Vertices(owner, owner->collect<GQL::Vertices>(
+                             [&](GQL &, const size_t &_i) {
+                               return parts[_i].source();
+                             }));
+}
+
+inline GQL::Sharded::Vertices GQL::Sharded::Edges::target() const {
+  // Gather the targets from every shard, then send each to the
+  // shard which stores it
+  std::vector<std::vector<uint64_t>> owned(owner->size());
+  for (const auto &rows : owner->collect<Result>(
+           [&](GQL &_g, const size_t &_i) {
+             return _g.sql("SELECT DISTINCT target FROM (" +
+                               parts[_i].cmd + ");",
+                           parts[_i].params);
+           })) {
+    for (const auto &row : rows.body) {
+      const auto id = std::stoull(row[0]);
+      owned[owner->shard_of(id)].push_back(id);
+    }
+  }
+
+  return Vertices(owner, owner->collect<GQL::Vertices>(
+                             [&](GQL &_g, const size_t &_i) {
+                               return _g.v("id IN (SELECT id FROM "
+                                           "gql_bounce WHERE "
+                                           "set_id = ?)",
+                                           {_g.bounce(owned[_i])});
+                             }));
+}
+
+inline GQL::Result GQL::Sharded::Edges::label() const {
+  return merged(owner->collect<Result>(
+      [&](GQL &, const size_t &_i) { return parts[_i].label(); }));
+}
+
+inline GQL::Result
+GQL::Sharded::Edges::tag(const std::string &_key) const {
+  return merged(
+      owner->collect<Result>([&](GQL &, const size_t &_i) {
+        return parts[_i].tag(_key);
+      }));
+}
+
+inline std::vector<uint64_t> GQL::Sharded::Edges::id() const {
+  std::vector<uint64_t> out;
+  for (const auto &ids : owner->collect<std::vector<uint64_t>>(
+           [&](GQL &, const size_t &_i) { return parts[_i].id(); })) {
+    out.insert(out.end(), ids.begin(), ids.end());
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+inline uint64_t GQL::Sharded::Edges::count() const {
+  uint64_t out = 0;
+  for (const auto &n : owner->collect<uint64_t>(
+           [&](GQL &, const size_t &_i) {
+             return parts[_i].count();
+           })) {
+    out += n;
+  }
+  return out;
+}
+
+inline bool GQL::Sharded::Edges::exists() const {
+  const auto found = owner->collect<bool>(
+      [&](GQL &, const size_t &_i) { return parts[_i].exists(); });
+  return std::find(found.begin(), found.end(), true) !=
+         found.end();
+}
+
+inline GQL::Sharded::Edges
+GQL::Sharded::Edges::label(const std::string &_label) {
+  owner->scatter([&](GQL &, const size_t &_i) {
+    parts[_i].label(_label);
+  });
+  return *this;
+}
+
+inline GQL::Sharded::Edges
+GQL::Sharded::Edges::tag(const std::string &_key,
+                         const std::string &_value) {
+  owner->scatter([&](GQL &, const size_t &_i) {
+    parts[_i].tag(_key, _value);
+  });
+  return *this;
+}
+
+inline void GQL::Sharded::Edges::erase() {
+  owner->scatter(
+      [&](GQL &, const size_t &_i) { parts[_i].erase(); });
+}
+
+inline const GQL::Edges &
+GQL::Sharded::Edges::part(const size_t &_i) const {
+  return parts.at(_i);
+}
+
+inline GQL::Sharded::Bulk::Bulk(Sharded *const _owner)
+    : owner(_owner), vertices(_owner->size()),
+      edges(_owner->size()) {
+}
+
+inline GQL::Sharded::Bulk::~Bulk() {
+  try {
+    flush();
+  } catch (std::runtime_error &_e) {
+    std::cerr << "Failed to flush bulk load: " << _e.what()
+              << '\n';
+  }
+}
+
+inline GQL::Sharded::Bulk &GQL::Sharded::Bulk::vertex(
+    const uint64_t &_id, const std::string &_label,
+    const std::map<std::string, std::string> &_tags) {
+  Record r;
+  r.id = _id;
+  r.label = _label;
+  r.tags = _tags;
+  vertices[owner->shard_of(_id)].push_back(std::move(r));
+
+  if (++buffered >= GQL_BULK_BATCH_SIZE * owner->size()) {
+    flush();
+  }
+  return *this;
+}
+
+inline GQL::Sharded::Bulk &GQL::Sharded::Bulk::edge(
+    const uint64_t &_source, const uint64_t &_target,
+    const std::string &_label,
+    const std::map<std::string, std::string> &_tags) {
+  Record r;
+  r.id = unnumbered++;
+  r.label = _label;
+  r.tags = _tags;
+  r.source = _source;
+  r.target = _target;
+  edges[owner->shard_of(_source)].push_back(std::move(r));
+
+  if (++buffered >= GQL_BULK_BATCH_SIZE * owner->size()) {
+    flush();
+  }
+  return *this;
+}
+
+inline void GQL::Sharded::Bulk::flush() {
+  if (buffered == 0) {
+    return;
+  }
+  buffered = 0;
+
+  // Edges are numbered only now, in the order they were
+  // buffered, so that a failed flush does not use up ids
+  const uint64_t n = unnumbered;
+  const uint64_t first = owner->reserve_edge_ids(n);
+  unnumbered = 0;
+  for (auto &e : edges) {
+    for (auto &r : e) {
+      r.id += first;
+    }
+  }
+
+  // If any shard kept its edges, the range is in use
+  std::atomic<bool> kept = false;
+  try {
+    owner->scatter([&](GQL &_g, const size_t &_i) {
+      auto &v = vertices[_i];
+      auto &e = edges[_i];
+      try {
+        auto loader = _g.bulk();
+        for (const auto &r : v) {
+          loader.vertex(r.id, r.label, r.tags);
+        }
+        for (const auto &r : e) {
+          loader.edge(r);
+        }
+        loader.flush();
+        if (!e.empty()) {
+          kept = true;
+        }
+
+        // Explicit vertex ids move the manager's counter too
+        for (const auto &r : v) {
+          GQL::advance(owner->next_node_id, r.id);
+        }
+      } catch (...) {
+        v.clear();
+        e.clear();
+        throw;
+      }
+      v.clear();
+      e.clear();
+    });
+  } catch (...) {
+    if (!kept) {
+      GQL::release(owner->next_edge_id, first, n);
+    }
+    throw;
+  }
+}
+
+inline size_t GQL::Sharded::Bulk::size() const noexcept {
+  return buffered;
+}
+
+inline GQL::Pattern GQL::match() {
+  return Pattern(this);
+}
+
+inline GQL::Pattern::Pattern(GQL *const _owner) : owner(_owner) {
+}
+
+inline size_t GQL::Pattern::declare(const std::string &_name,
+                                    const bool &_is_edge) {
+  if (_name.empty()) {
+    if (!_is_edge) {
+      throw std::runtime_error("Vertex variables must be named.");
+    }
+  } else {
+    for (size_t i = 0; i < vars.size(); ++i) {
+      if (vars[i].name != _name) {
+        continue;
+      } else if (vars[i].is_edge || _is_edge) {
+        throw std::runtime_error(__gql_format_str(
+            "Pattern variable '{}' is already declared.", _name));
+      }
+      return i;
+    }
+  }
+
+  Var var;
+  var.name = _name;
+  var.is_edge = _is_edge;
+  vars.push_back(std::move(var));
+  return vars.size() - 1;
+}
+
+inline GQL::Pattern &GQL::Pattern::vertex(const std::string &_name) {
+  declare(_name, false);
+  return *this;
+}
+
+inline GQL::Pattern &
+GQL::Pattern::vertex(const std::string &_name,
+                     const std::string &_label) {
+  return vertex(_name, owner->v().with_label(_label));
+}
+
+inline GQL::Pattern &
+GQL::Pattern::vertex(const std::string &_name,
+                     const Vertices &_where) {
+  auto &var = vars[declare(_name, false)];
+  var.cmds.push_back(_where.cmd);
+  var.params.push_back(_where.params);
+  return *this;
+}
+
+inline GQL::Pattern &GQL::Pattern::edge(
+    const std::string &_source, const std::string &_label,
+    const std::string &_target, const std::string &_name) {
+  add_edge(_source, owner->e().with_label(_label), _target,
+           _name);
+  return *this;
+}
+
+inline GQL::Pattern &GQL::Pattern::edge(
+    const std::string &_source, const Edges &_where,
+    const std::string &_target, const std::string &_name) {
+  add_edge(_source, _where, _target, _name);
+  return *this;
+}
+
+inline void GQL::Pattern::add_edge(const std::string &_source,
+                                   const Edges &_where,
+                                   const std::string &_target,
+                                   const std::string &_name) {
+  const auto source = declare(_source, false);
+  const auto target = declare(_target, false);
+  auto &var = vars[declare(_name, true)];
+  var.cmds.push_back(_where.cmd);
+  var.params.push_back(_where.params);
+  var.source = source;
+  var.target = target;
+}
+
+inline std::string
+GQL::Pattern::compile(std::vector<Param> &_params,
+                      const std::string &_only) const {
+  if (vars.empty()) {
+    throw std::runtime_error("Cannot match an empty pattern.");
+  }
+
+  // Each constrained variable (and every edge) is a subquery,
+  // which SQLite flattens into its table so that its indices
+  // still apply. An unconstrained vertex is just the endpoint
+  // of an edge which mentions it, or else any vertex.
+  struct Entry {
+    size_t var;
+    std::string cmd;
+    std::vector<Param> params;
+    uint64_t size = 0;
+  };
+  std::vector<Entry> entries;
+  std::vector<bool> touched(vars.size(), false);
+  for (const auto &var : vars) {
+    if (var.is_edge) {
+      touched[var.source] = touched[var.target] = true;
+    }
+  }
+  for (size_t i = 0; i < vars.size(); ++i) {
+    if (!vars[i].cmds.empty()) {
+      entries.push_back({i, vars[i].cmds[0], vars[i].params[0]});
+    } else if (!vars[i].is_edge && !touched[i]) {
+      entries.push_back({i, "SELECT * FROM nodes", {}});
+    }
+  }
+
+  // Without statistics SQLite guesses how large each set is, so
+  // count them (up to a point) instead
+  if (entries.size() > 1) {
+    for (auto &entry : entries) {
+      auto p = entry.params;
+      p.push_back(Param((uint64_t)GQL_PATTERN_SAMPLE));
+      entry.size = owner
+                       ->table("SELECT COUNT(*) FROM (SELECT 1 "
+                               "FROM (" +
+                                   entry.cmd + ") LIMIT ?);",
+                               p)
+                       .integers(0)
+                       .at(0);
+    }
+  }
+
+  // Join greedily: start from the smallest set, then always
+  // take the smallest set which is connected to those joined
+  std::vector<std::string> id_of(vars.size());
+  std::vector<bool> placed(entries.size(), false);
+  std::vector<std::string> where;
+  std::vector<Param> where_params;
+  std::string from;
+  const auto bind = [&](const size_t &_var,
+                        const std::string &_col) {
+    if (id_of[_var].empty()) {
+      id_of[_var] = _col;
+    } else {
+      where.push_back(_col + " = " + id_of[_var]);
+    }
+  };
+  for (size_t n = 0; n < entries.size(); ++n) {
+    size_t best = entries.size();
+    bool best_connected = false;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (placed[i]) {
+        continue;
+      }
+      const auto &var = vars[entries[i].var];
+      const bool connected =
+          var.is_edge ? !id_of[var.source].empty() ||
+                            !id_of[var.target].empty()
+                      : !id_of[entries[i].var].empty();
+      if (best == entries.size() ||
+          (connected && !best_connected) ||
+          (connected == best_connected &&
+           entries[i].size < entries[best].size)) {
+        best = i;
+        best_connected = connected;
+      }
+    }
+    placed[best] = true;
+
+    const auto &entry = entries[best];
+    const auto &var = vars[entry.var];
+    const std::string alias =
+        (var.is_edge ? "gql_e" : "gql_v") +
+        std::to_string(entry.var);
+    from += (n == 0 ? "" : " CROSS JOIN ") + ("(" + entry.cmd) +
+            ") AS " + alias;
+    _params.insert(_params.end(), entry.params.begin(),
+                   entry.params.end());
+    if (var.is_edge) {
+      id_of[entry.var] = alias + ".id";
+      bind(var.source, alias + ".source");
+      bind(var.target, alias + ".target");
+    } else {
+      bind(entry.var, alias + ".id");
+    }
+
+    for (size_t j = 1; j < var.cmds.size(); ++j) {
+      where.push_back(alias + ".id IN (SELECT id FROM (" +
+                      var.cmds[j] + "))");
+      where_params.insert(where_params.end(),
+                          var.params[j].begin(),
+                          var.params[j].end());
+    }
+  }
+
+  std::string out = "SELECT ";
+  if (!_only.empty()) {
+    out += id_of[column_var(_only)] + " AS id";
+  } else {
+    bool first = true;
+    for (size_t i = 0; i < vars.size(); ++i) {
+      if (!vars[i].name.empty()) {
+        out += (first ? "" : ", ") + id_of[i];
+        first = false;
+      }
+    }
+  }
+
+  out += " FROM " + from;
+  for (size_t i = 0; i < where.size(); ++i) {
+    out += (i == 0 ? " WHERE " : " AND ") + where[i];
+  }
+  _params.insert(_params.end(), where_params.begin(),
+                 where_params.end());
+  return out;
+}
+
+inline GQL::Cursor GQL::Pattern::stream() const {
+  std::vector<Param> params;
+  const auto query = compile(params);
+  return Cursor(owner, query, params, {}, names());
+}
+
+inline GQL::Table GQL::Pattern::table() const {
+  std::vector<Param> params;
+  const auto query = compile(params);
+  return owner->table(query, params, {}, names());
+}
+
+inline uint64_t GQL::Pattern::count() const {
+  std::vector<Param> params;
+  const auto query = compile(params);
+  return owner->table("SELECT COUNT(*) FROM (" + query + ");",
+                      params)
+      .integers(0)
+      .at(0);
+}
+
+inline size_t GQL::Pattern::column(const std::string &_name) const {
+  const auto all = names();
+  const auto it = std::find(all.begin(), all.end(), _name);
+  if (_name.empty() || it == all.end()) {
+    throw std::runtime_error(__gql_format_str(
+        "Pattern variable '{}' is not declared.", _name));
+  }
+  return std::distance(all.begin(), it);
+}
+
+inline std::vector<std::string> GQL::Pattern::names() const {
+  std::vector<std::string> out;
+  for (const auto &var : vars) {
+    if (!var.name.empty()) {
+      out.push_back(var.name);
+    }
+  }
+  return out;
+}
+
+inline size_t
+GQL::Pattern::column_var(const std::string &_name) const {
+  for (size_t i = 0; i < vars.size(); ++i) {
+    if (!_name.empty() && vars[i].name == _name) {
+      return i;
+    }
+  }
+  throw std::runtime_error(__gql_format_str(
+      "Pattern variable '{}' is not declared.", _name));
+}
+
+inline GQL::Vertices
+GQL::Pattern::vertices(const std::string &_name) const {
+  if (vars[column_var(_name)].is_edge) {
+    throw std::runtime_error(__gql_format_str(
+        "Pattern variable '{}' binds edges.", _name));
+  }
+  std::vector<Param> params;
+  const auto query = compile(params, _name);
+  return owner->v("id IN (" + query + ")", params);
+}
+
+inline GQL::Edges
+GQL::Pattern::edges(const std::string &_name) const {
+  if (!vars[column_var(_name)].is_edge) {
+    throw std::runtime_error(__gql_format_str(
+        "Pattern variable '{}' binds vertices.", _name));
+  }
+  std::vector<Param> params;
+  const auto query = compile(params, _name);
+  return owner->e("id IN (" + query + ")", params);
+}
+
+inline std::string GQL::Slots::text(const size_t &_i) const {
+  return "@gql:slot:" + std::to_string(_i) + "@";
+}
+
+inline uint64_t GQL::Slots::number(const size_t &_i) const {
+  const uint64_t out = NUMBER_MARK + _i;
+  owner->slot_numbers[out] = _i;
+  return out;
+}
+
+template <typename Fn>
+inline auto GQL::plan(const Fn &_fn)
+    -> Plan<decltype(_fn(std::declval<GQL &>(),
+                         std::declval<const Slots &>()))> {
+  using T = decltype(_fn(std::declval<GQL &>(),
+                         std::declval<const Slots &>()));
+  static_assert(std::is_same<T, Vertices>::value ||
+                    std::is_same<T, Edges>::value,
+                "Plans must build Vertices or Edges.");
+
+  const Slots slots(this);
+  recording = true;
+  slot_numbers.clear();
+  try {
+    const T recorded = _fn(*this, slots);
+    recording = false;
+    slot_numbers.clear();
+    return Plan<T>(this, recorded);
+  } catch (...) {
+    recording = false;
+    slot_numbers.clear();
+    throw;
+  }
+}
+
+template <typename T>
+inline GQL::Plan<T>::Plan(GQL *_owner, const T &_recorded)
+    : owner(_owner), cmd(_recorded.cmd),
+      params(_recorded.params) {
+  // Find every placeholder among the recorded parameters
+  const std::string prefix = "@gql:slot:";
+  for (size_t i = 0; i < params.size(); ++i) {
+    const auto &p = params[i];
+    if (p.kind == Param::SLOT) {
+      uses.push_back({i, (size_t)p.number, true});
+    } else if (p.text.size() > prefix.size() + 1 &&
+               p.text.compare(0, prefix.size(), prefix) == 0 &&
+               p.text.back() == '@') {
+      uses.push_back(
+          {i,
+           std::stoull(p.text.substr(
+               prefix.size(),
+               p.text.size() - prefix.size() - 1)),
+           false});
+    }
+  }
+  for (const auto &u : uses) {
+    slot_count = std::max(slot_count, u.slot + 1);
+  }
+}
+
+template <typename T>
+inline T GQL::Plan<T>::operator()(
+    const std::vector<Value> &_values) const {
+  if (_values.size() != slot_count) {
+    throw std::runtime_error(__gql_format_str(
+        "Plan expects {} values, but got {}.",
+        std::to_string(slot_count),
+        std::to_string(_values.size())));
+  }
+
+  std::vector<Param> bound = params;
+  for (const auto &u : uses) {
+    const auto &value = _values[u.slot];
+    if (value.is_number != u.is_number) {
+      throw std::runtime_error(__gql_format_str(
+          "Slot {} expects {}.", std::to_string(u.slot),
+          std::string(u.is_number ? "a number" : "text")));
+    }
+    if (u.is_number) {
+      bound[u.param] = Param(value.number);
+    } else {
+      // The recorded SQL chose a JSON path accessor for keys
+      if (bound[u.param].kind == Param::KEY &&
+          !owner->path_safe(value.text)) {
+        throw std::runtime_error(__gql_format_str(
+            "Slot {} cannot hold the tag key '{}'.",
+            std::to_string(u.slot), value.text));
+      }
+      bound[u.param].text = value.text;
+    }
+  }
+
+  // Built short, so that the recorded query is not bounced
+  T out(owner, "", {});
+  out.cmd = cmd;
+  out.params = std::move(bound);
+  return out;
+}
+
+inline GQL::Param GQL::integer(const uint64_t &_n) const {
+  if (recording) {
+    const auto it = slot_numbers.find(_n);
+    if (it != slot_numbers.end()) {
+      return Param(Param::SLOT, (int64_t)it->second);
+    }
+  }
+  return Param(_n);
+}
+
+inline void
+GQL::check_recording(const std::string &_sql) const {
+  if (recording) {
+    std::cerr << "In SQL '" << _sql << "':\n";
+    throw std::runtime_error(
+        "Plans may only build queries, not run them.");
+  }
+}
+
+inline GQL::Snapshot GQL::snapshot(const bool &_labels) {
+  return Snapshot(this, _labels);
+}
+
+inline GQL::Snapshot::Snapshot(GQL *_owner, const bool &_labels)
+    : owner(_owner), labelled(_labels) {
+  const auto nodes = owner->table(
+      "SELECT id FROM nodes ORDER BY id", {}, {false});
+  if (!nodes.empty()) {
+    ids.assign(nodes.integers(0).begin(),
+               nodes.integers(0).end());
+  }
+  if (ids.size() > std::numeric_limits<Index>::max()) {
+    throw std::runtime_error("Too many vertices to snapshot.");
+  }
+
+  // Read every edge in forward order, counting degrees as we
+  // go, then lay the reverse CSR out with a counting sort
+  out_offsets.assign(ids.size() + 1, 0);
+  in_offsets.assign(ids.size() + 1, 0);
+  std::unordered_map<std::string, uint32_t> label_index;
+  Cursor rows(owner,
+              _labels ? "SELECT source, target, id, label FROM "
+                        "edges ORDER BY source, id"
+                      : "SELECT source, target, id FROM edges "
+                        "ORDER BY source, id",
+              {}, {false, false, false, _labels});
+  const auto find = [&](const uint64_t &_id, Index &_out) {
+    const auto it =
+        std::lower_bound(ids.begin(), ids.end(), _id);
+    _out = (Index)(it - ids.begin());
+    return it != ids.end() && *it == _id;
+  };
+  for (const auto &row : rows) {
+    Index src, tgt;
+    if (!find(row.integer(0), src) ||
+        !find(row.integer(1), tgt)) {
+      // Edges may refer to vertices which do not exist
+      ++dangling;
+      continue;
+    }
+    ++out_offsets[src + 1];
+    ++in_offsets[tgt + 1];
+    out_targets.push_back(tgt);
+    out_ids.push_back(row.integer(2));
+    if (_labels) {
+      // Dictionary ids are only looked up once each
+      const auto inserted =
+          label_index.emplace(row[3], label_names.size());
+      if (inserted.second) {
+        label_names.push_back(owner->format == DICT
+                                  ? owner->decode_name(row[3])
+                                  : row[3]);
+      }
+      out_labels.push_back(inserted.first->second);
+    }
+  }
+  for (size_t v = 0; v < ids.size(); ++v) {
+    out_offsets[v + 1] += out_offsets[v];
+    in_offsets[v + 1] += in_offsets[v];
+  }
+
+  in_sources.resize(out_targets.size());
+  in_edges.resize(out_targets.size());
+  std::vector<size_t> fill(in_offsets.begin(),
+                           in_offsets.end() - 1);
+  for (Index v = 0; v < ids.size(); ++v) {
+    for (size_t e = out_offsets[v]; e < out_offsets[v + 1];
+         ++e) {
+      const size_t slot = fill[out_targets[e]]++;
+      in_sources[slot] = v;
+      in_edges[slot] = e;
+    }
+  }
+}
+
+inline size_t GQL::Snapshot::size() const noexcept {
+  return ids.size();
+}
+
+inline size_t GQL::Snapshot::edge_count() const noexcept {
+  return out_targets.size();
+}
+
+inline size_t GQL::Snapshot::dangling_edges() const noexcept {
+  return dangling;
+}
+
+inline bool GQL::Snapshot::has_labels() const noexcept {
+  return labelled;
+}
+
+inline GQL::Snapshot::Index
+GQL::Snapshot::index(const uint64_t &_id) const {
+  const auto it = std::lower_bound(ids.begin(), ids.end(), _id);
+  if (it == ids.end() || *it != _id) {
+    throw std::runtime_error(__gql_format_str(
+        "Vertex {} is not in the snapshot.",
+        std::to_string(_id)));
+  }
+  return (Index)(it - ids.begin());
+}
+
+inline std::vector<GQL::Snapshot::Index>
+GQL::Snapshot::index(const Vertices &_of) const {
+  std::vector<Index> out;
+  for (const auto &id : _of.id()) {
+    out.push_back(index(id));
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+inline uint64_t GQL::Snapshot::id(const Index &_v) const {
+  return ids.at(_v);
+}
+
+inline GQL::Snapshot::Slice<GQL::Snapshot::Index>
+GQL::Snapshot::out(const Index &_v) const {
+  const Index *base = out_targets.data();
+  return Slice<Index>(base + out_offsets.at(_v),
+                      base + out_offsets.at(_v + 1));
+}
+
+inline GQL::Snapshot::Slice<GQL::Snapshot::Index>
+GQL::Snapshot::in(const Index &_v) const {
+  const Index *base = in_sources.data();
+  return Slice<Index>(base + in_offsets.at(_v),
+                      base + in_offsets.at(_v + 1));
+}
+
+inline size_t GQL::Snapshot::out_degree(const Index &_v) const {
+  return out_offsets.at(_v + 1) - out_offsets.at(_v);
+}
+
+inline size_t GQL::Snapshot::in_degree(const Index &_v) const {
+  return in_offsets.at(_v + 1) - in_offsets.at(_v);
+}
+
+inline size_t GQL::Snapshot::out_offset(const Index &_v) const {
+  return out_offsets.at(_v);
+}
+
+inline std::vector<size_t>
+GQL::Snapshot::out(const std::vector<Index> &_from) const {
+  std::vector<size_t> out;
+  for (const auto &v : _from) {
+    for (size_t e = out_offsets.at(v);
+         e < out_offsets.at(v + 1); ++e) {
+      out.push_back(e);
+    }
+  }
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+  return out;
+}
+
+inline std::vector<size_t>
+GQL::Snapshot::in(const std::vector<Index> &_to) const {
+  std::vector<size_t> out;
+  for (const auto &v : _to) {
+    for (size_t i = in_offsets.at(v); i < in_offsets.at(v + 1);
+         ++i) {
+      out.push_back(in_edges[i]);
+    }
+  }
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+  return out;
+}
+
+inline std::vector<GQL::Snapshot::Index>
+GQL::Snapshot::target(const std::vector<size_t> &_edges) const {
+  std::vector<Index> out;
+  for (const auto &e : _edges) {
+    out.push_back(target(e));
+  }
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+  return out;
+}
+
+inline std::vector<GQL::Snapshot::Index>
+GQL::Snapshot::source(const std::vector<size_t> &_edges) const {
+  std::vector<Index> out;
+  for (const auto &e : _edges) {
+    out.push_back(source(e));
+  }
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+  return out;
+}
+
+inline GQL::Snapshot::Index
+GQL::Snapshot::source(const size_t &_e) const {
+  if (_e >= edge_count()) {
+    throw std::runtime_error("Edge is not in the snapshot.");
+  }
+
+  // The source is whichever vertex's range holds the position
+  const auto it = std::upper_bound(out_offsets.begin(),
+                                   out_offsets.end(), _e);
+  return (Index)(it - out_offsets.begin() - 1);
+}
+
+inline GQL::Snapshot::Index
+GQL::Snapshot::target(const size_t &_e) const {
+  return out_targets.at(_e);
+}
+
+inline uint64_t GQL::Snapshot::edge_id(const size_t &_e) const {
+  return out_ids.at(_e);
+}
+
+inline uint32_t
+GQL::Snapshot::label_id(const size_t &_e) const {
+  if (!has_labels()) {
+    throw std::runtime_error(
+        "Snapshot was taken without labels.");
+  }
+  return out_labels.at(_e);
+}
+
+inline const std::string &
+GQL::Snapshot::label(const size_t &_e) const {
+  return label_names[label_id(_e)];
+}
+
+inline const std::vector<std::string> &
+GQL::Snapshot::labels() const noexcept {
+  return label_names;
+}
+
+inline GQL::Vertices
+GQL::Snapshot::vertices(const std::vector<Index> &_of) const {
+  std::vector<uint64_t> matches;
+  for (const auto &v : _of) {
+    matches.push_back(id(v));
+  }
+  return owner->v(
+      "id IN (SELECT id FROM gql_bounce WHERE set_id = ?)",
+      {owner->bounce(matches)});
+}
+
+inline GQL::Edges
+GQL::Snapshot::edges(const std::vector<size_t> &_of) const {
+  std::vector<uint64_t> matches;
+  for (const auto &e : _of) {
+    matches.push_back(edge_id(e));
+  }
+  return owner->e(
+      "id IN (SELECT id FROM gql_bounce WHERE set_id = ?)",
+      {owner->bounce(matches)});
+}
+
+inline void GQL::create_indices() {
+  // Each adjacency index covers a labelled hop in one direction
+  // (the edge id is the rowid, so it is covered too)
+  sql("CREATE INDEX IF NOT EXISTS edge_out "
+      "ON edges(source, label, target);");
+  sql("CREATE INDEX IF NOT EXISTS edge_in "
+      "ON edges(target, label, source);");
+  sql("CREATE INDEX IF NOT EXISTS edge_lbl "
+      "ON edges(label);");
+  sql("CREATE INDEX IF NOT EXISTS node_label "
+      "ON nodes(label);");
+
+  // Older databases: prefixes of the above, or of a primary key
+  sql("DROP INDEX IF EXISTS edge_src;");
+  sql("DROP INDEX IF EXISTS edge_tgt;");
+  sql("DROP INDEX IF EXISTS edge_id;");
+  sql("DROP INDEX IF EXISTS node_id;");
+}
+
+inline GQL::~GQL() {
+  *self = nullptr;
+  if (!is_readonly) {
+    sql("COMMIT;");
+  }
+
+  // Statements must be finalized before the connection closes
+  for (const auto &p : stmt_lru) {
+    sqlite3_finalize(p.second);
+  }
+  stmt_lru.clear();
+  stmt_index.clear();
+  stmt_reads.clear();
+
+  sqlite3_close(db);
+
+  if (!persistent) {
+    remove_files();
+  }
+}
+
+inline void GQL::remove_files() const {
+  for (const std::string suffix :
+       {"", "-wal", "-shm", "-journal"}) {
+    const auto path = filepath.string() + suffix;
+    if (std::filesystem::exists(path)) {
+      std::filesystem::remove_all(path);
+    }
+  }
+}
+
+inline void GQL::apply(const Options &_options) {
+  // Textual settings are formatted into the PRAGMA, so only
+  // known values are allowed
+  const auto setting =
+      [](const std::string &_name, const std::string &_value,
+         const std::list<std::string> &_allowed) {
+    std::string upper;
+    for (const char &c : _value) {
+      upper.push_back((char)std::toupper((unsigned char)c));
+    }
+    if (std::find(_allowed.begin(), _allowed.end(), upper) ==
+        _allowed.end()) {
+      throw std::runtime_error(__gql_format_str(
+          "Invalid {} '{}'.", _name, _value));
+    }
+    return upper;
+  };
+
+  // The page size must be set before anything is written
+  if (_options.page_size != 0) {
+    sql(__gql_format_str("PRAGMA page_size = {};",
+                         std::to_string(_options.page_size)));
+  }
+  if (!_options.journal_mode.empty()) {
+    sql(__gql_format_str(
+        "PRAGMA journal_mode = {};",
+        setting("journal_mode", _options.journal_mode,
+                {"DELETE", "TRUNCATE", "PERSIST", "MEMORY",
+                 "WAL", "OFF"})));
+  }
+  if (!_options.synchronous.empty()) {
+    sql(__gql_format_str(
+        "PRAGMA synchronous = {};",
+        setting("synchronous", _options.synchronous,
+                {"OFF", "NORMAL", "FULL", "EXTRA"})));
+  }
+  if (!_options.temp_store.empty()) {
+    sql(__gql_format_str(
+        "PRAGMA temp_store = {};",
+        setting("temp_store", _options.temp_store,
+                {"DEFAULT", "FILE", "MEMORY"})));
+  }
+  if (_options.mmap_size >= 0) {
+    sql(__gql_format_str("PRAGMA mmap_size = {};",
+                         std::to_string(_options.mmap_size)));
+  }
+  if (_options.cache_size != 0) {
+    sql(__gql_format_str("PRAGMA cache_size = {};",
+                         std::to_string(_options.cache_size)));
+  }
+}
+
+inline GQL::Options GQL::options() {
+  // Some settings have no value for in-memory databases
+  const auto read = [&](const std::string &_pragma) {
+    const auto res = sql("PRAGMA " + _pragma + ";");
+    return res.empty() ? std::string("0") : res.body[0][0];
+  };
+  const static std::vector<std::string> synchronous = {
+      "OFF", "NORMAL", "FULL", "EXTRA"};
+  const static std::vector<std::string> temp_store = {
+      "DEFAULT", "FILE", "MEMORY"};
+
+  Options out;
+  out.journal_mode = read("journal_mode");
+  for (auto &c : out.journal_mode) {
+    c = (char)std::toupper((unsigned char)c);
+  }
+  out.synchronous =
+      synchronous.at(std::stoull(read("synchronous")));
+  out.temp_store =
+      temp_store.at(std::stoull(read("temp_store")));
+  out.mmap_size = std::stoll(read("mmap_size"));
+  out.cache_size = std::stoll(read("cache_size"));
+  out.page_size = std::stoll(read("page_size"));
+  out.format = format;
+  return out;
+}
+
+inline void GQL::commit() {
+  if (!is_readonly) {
+    sql("COMMIT;");
+    sql("BEGIN;");
+  }
+}
+
+inline void GQL::rollback() {
+  if (!is_readonly) {
+    // Live bounced sets may outlast the transaction which
+    // stored them, so their rows are put back as they were
+    const auto bounced =
+        table("SELECT set_id, id FROM gql_bounce;");
+
+    sql("ROLLBACK;");
+    invalidate();
+    detect_tables();
+    sql("BEGIN;");
+
+    sql("DELETE FROM gql_bounce;");
+    if (bounced.size() != 0) {
+      const std::string insert =
+          "INSERT INTO gql_bounce (set_id, id) VALUES (?, ?)";
+      ++sql_call_counter;
+      const Timing timing(this, insert, {});
+      sqlite3_stmt *stmt = prepare(insert);
+      const auto &set_ids = bounced.integers(0);
+      const auto &ids = bounced.integers(1);
+      for (size_t i = 0; i < ids.size(); ++i) {
+        sqlite3_bind_int64(stmt, 1, set_ids[i]);
+        sqlite3_bind_int64(stmt, 2, ids[i]);
+        finish(stmt, insert, sqlite3_step(stmt));
+      }
+    }
+  }
+}
+
+inline void GQL::index_tags() {
+  if (has_tag_tables) {
+    return;
+  }
+
+  for (const auto &p :
+       {std::make_pair("nodes", "node_tags"),
+        std::make_pair("edges", "edge_tags")}) {
+    const std::string from = p.first, to = p.second;
+
+    sql(__gql_format_str("CREATE TABLE IF NOT EXISTS {} ("
+                         "id INTEGER NOT NULL, "
+                         "key TEXT NOT NULL, "
+                         "value TEXT, "
+                         "PRIMARY KEY(id, key)"
+                         ") WITHOUT ROWID;",
+                         to));
+    sql(__gql_format_str("CREATE INDEX IF NOT EXISTS {}_kv "
+                         "ON {}(key, value);",
+                         to, to));
+
+    // Existing tags
+    sql(__gql_format_str("INSERT OR REPLACE INTO {} "
+                         "(id, key, value) SELECT t.id, "
+                         "j.key, j.value FROM {} AS t, "
+                         "json_each(t.tags) AS j;",
+                         to, from));
+
+    // Future tags
+    sql(__gql_format_str(
+        "CREATE TRIGGER IF NOT EXISTS {}_insert AFTER INSERT "
+        "ON {} BEGIN INSERT OR REPLACE INTO {} (id, key, "
+        "value) SELECT new.id, key, value FROM "
+        "json_each(new.tags); END;",
+        to, from, to));
+    sql(__gql_format_str(
+        "CREATE TRIGGER IF NOT EXISTS {}_update AFTER UPDATE "
+        "OF tags ON {} BEGIN DELETE FROM {} WHERE id = old.id; "
+        "INSERT OR REPLACE INTO {} (id, key, value) SELECT "
+        "new.id, key, value FROM json_each(new.tags); END;",
+        to, from, to, to));
+    sql(__gql_format_str(
+        "CREATE TRIGGER IF NOT EXISTS {}_delete AFTER DELETE "
+        "ON {} BEGIN DELETE FROM {} WHERE id = old.id; END;",
+        to, from, to));
+  }
+
+  has_tag_tables = true;
+}
+
+inline void GQL::index_degrees() {
+  if (has_degree_table) {
+    return;
+  }
+
+  sql("CREATE TABLE IF NOT EXISTS node_degree ("
+      "id INTEGER NOT NULL, "
+      "in_deg INTEGER NOT NULL DEFAULT 0, "
+      "out_deg INTEGER NOT NULL DEFAULT 0, "
+      "PRIMARY KEY(id)"
+      ");");
+  sql("CREATE INDEX IF NOT EXISTS node_degree_in "
+      "ON node_degree(in_deg);");
+  sql("CREATE INDEX IF NOT EXISTS node_degree_out "
+      "ON node_degree(out_deg);");
+
+  // Existing degrees
+  sql("INSERT OR REPLACE INTO node_degree (id, in_deg, "
+      "out_deg) SELECT n.id, "
+      "(SELECT COUNT(*) FROM edges WHERE target = n.id), "
+      "(SELECT COUNT(*) FROM edges WHERE source = n.id) "
+      "FROM nodes AS n;");
+
+  // Future degrees. Edges may be written before their vertices
+  // (e.g. by a bulk load), so edges create missing rows and
+  // vertices never reset existing ones.
+  sql("CREATE TRIGGER IF NOT EXISTS node_degree_node_insert "
+      "AFTER INSERT ON nodes BEGIN INSERT OR IGNORE INTO "
+      "node_degree (id) VALUES (new.id); END;");
+  sql("CREATE TRIGGER IF NOT EXISTS node_degree_node_delete "
+      "AFTER DELETE ON nodes BEGIN DELETE FROM node_degree "
+      "WHERE id = old.id; END;");
+  sql("CREATE TRIGGER IF NOT EXISTS node_degree_edge_insert "
+      "AFTER INSERT ON edges BEGIN "
+      "INSERT INTO node_degree (id, out_deg) VALUES "
+      "(new.source, 1) ON CONFLICT(id) DO UPDATE SET "
+      "out_deg = out_deg + 1; "
+      "INSERT INTO node_degree (id, in_deg) VALUES "
+      "(new.target, 1) ON CONFLICT(id) DO UPDATE SET "
+      "in_deg = in_deg + 1; END;");
+  sql("CREATE TRIGGER IF NOT EXISTS node_degree_edge_delete "
+      "AFTER DELETE ON edges BEGIN "
+      "UPDATE node_degree SET out_deg = out_deg - 1 "
+      "WHERE id = old.source; "
+      "UPDATE node_degree SET in_deg = in_deg - 1 "
+      "WHERE id = old.target; END;");
+  sql("CREATE TRIGGER IF NOT EXISTS node_degree_edge_update "
+      "AFTER UPDATE OF source, target ON edges BEGIN "
+      "UPDATE node_degree SET out_deg = out_deg - 1 "
+      "WHERE id = old.source; "
+      "UPDATE node_degree SET in_deg = in_deg - 1 "
+      "WHERE id = old.target; "
+      "INSERT INTO node_degree (id, out_deg) VALUES "
+      "(new.source, 1) ON CONFLICT(id) DO UPDATE SET "
+      "out_deg = out_deg + 1; "
+      "INSERT INTO node_degree (id, in_deg) VALUES "
+      "(new.target, 1) ON CONFLICT(id) DO UPDATE SET "
+      "in_deg = in_deg + 1; END;");
+
+  has_degree_table = true;
+}
+
+////////////////////////////////////////////////////////////////
+
+inline GQL::Vertices::Vertices(
+    GQL *const _owner, const std::string &_cmd,
+    const std::vector<Param> &_params)
+    : owner(_owner), cmd(_cmd), params(_params), flat(false),
+      terms(0) {
+  if (_cmd.size() > GQL_BOUNCE_THRESH && !owner->recording) {
+    bounce_now();
+  }
+}
+
+inline GQL::Vertices GQL::Vertices::selecting(
+    GQL *const _owner, const std::string &_cond,
+    const std::vector<Param> &_params, const uint64_t &_terms) {
+  // Built short, so that only the checks below can bounce it
+  Vertices out(_owner, "", _params);
+  out.flat = true;
+  out.cond = _cond;
+  out.terms = _terms;
+  out.cmd = "SELECT * FROM nodes";
+  if (!_cond.empty()) {
+    out.cmd += " WHERE " + _cond;
+  }
+  if (!_owner->recording && (_terms > GQL_FLAT_TERMS ||
+                             nesting(_cond) > GQL_FLAT_DEPTH)) {
+    out.bounce_now();
+  }
+  return out;
+}
+
+inline void GQL::Vertices::bounce_now() {
+  // Perform query simplification "bounce": The next query
+  // joins against the materialized ids instead of re-running
+  // (and re-parsing) this one
+  params = {owner->bounce(cmd, params)};
+  flat = true;
+  cond = "id IN (SELECT id FROM gql_bounce WHERE set_id = ?)";
+  cmd = "SELECT * FROM nodes WHERE " + cond;
+  terms = 1;
+}
+
+inline std::string GQL::Vertices::as_cond() const {
+  return flat ? cond : "id IN (" + ids() + ")";
+}
+
+inline std::string GQL::Vertices::ids() const {
+  if (!flat) {
+    return "SELECT id FROM (" + cmd + ")";
+  }
+  return cond.empty() ? "SELECT id FROM nodes"
+                      : "SELECT id FROM nodes WHERE " + cond;
+}
+
+inline uint64_t GQL::Vertices::weight() const {
+  return flat ? terms : 1;
+}
+
+inline GQL::Vertices
+GQL::Vertices::narrow(const std::string &_cond,
+                      const std::vector<Param> &_params,
+                      const uint64_t &_terms) const {
+  // Conditions herein never have a top-level OR, so they can
+  // be extended without nesting them
+  const std::string here = as_cond();
+  return selecting(
+      owner, here.empty() ? _cond : here + " AND " + _cond,
+      concat(params, _params), weight() + _terms);
+}
+
+inline GQL::Vertices
+GQL::Vertices::limit(const uint64_t &_n) const {
+  return GQL::Vertices(
+      owner,
+      __gql_format_str("SELECT * FROM ({}) ORDER BY id LIMIT ?",
+                       cmd),
+      concat(params, {owner->integer(_n)}));
+}
+
+inline GQL::Vertices
+GQL::Vertices::with_label(const std::string &_label) const {
+  return narrow("label = ?", {Param(Param::LABEL, _label)});
+}
+
+inline GQL::Vertices
+GQL::Vertices::with_tag(const std::string &_key,
+                        const std::string &_value) const {
+  if (owner->has_tag_tables) {
+    return narrow("id IN (SELECT id FROM node_tags WHERE "
+                  "key = ? AND value = ?)",
+                  {Param(Param::KEY_NAME, _key),
+                   Param(Param::VALUE, _value)});
+  }
+
+  return narrow(owner->tag_value(_key) + " = ?",
+                {owner->key_param(_key),
+                 Param(Param::VALUE, _value)});
+}
+
+inline GQL::Vertices
+GQL::Vertices::with_id(const uint64_t &_id) const {
+  return narrow("id = ?", {owner->integer(_id)});
+}
+
+inline GQL::Vertices GQL::Vertices::where(
+    const std::function<bool(const GQL::Vertices &)> &_fn) {
+  // Collect matches into one set, rather than joining them
+  std::vector<uint64_t> matches;
+  for (const auto &id : id()) {
+    if (_fn(owner->v().with_id(id))) {
+      matches.push_back(id);
+    }
+  }
+
+  return owner->v(
+      "id IN (SELECT id FROM gql_bounce WHERE set_id = ?)",
+      {owner->bounce(matches)});
+}
+
+inline GQL::Vertices GQL::Vertices::filter(
+    const std::function<bool(const GQL::Record &)> &_fn) const {
+  std::vector<uint64_t> matches;
+  owner->each_record(cmd, params, false,
+                     [&](const Record &_r) {
+                       if (_fn(_r)) {
+                         matches.push_back(_r.id);
+                       }
+                     });
+
+  return owner->v(
+      "id IN (SELECT id FROM gql_bounce WHERE set_id = ?)",
+      {owner->bounce(matches)});
+}
+
+inline GQL::Vertices
+GQL::Vertices::join(const GQL::Vertices &_with) const {
+  const std::string a = as_cond(), b = _with.as_cond();
+  if (a.empty() || b.empty()) {
+    return selecting(owner, "", {}, 0);
+  }
+  return selecting(owner,
+                   __gql_format_str("({} OR {})", a, b),
+                   concat(params, _with.params),
+                   weight() + _with.weight());
+}
+
+inline GQL::Vertices
+GQL::Vertices::intersection(const GQL::Vertices &_with) const {
+  const std::string a = as_cond(), b = _with.as_cond();
+  if (a.empty() || b.empty()) {
+    return a.empty() ? _with : *this;
+  }
+  return selecting(owner, a + " AND " + b,
+                   concat(params, _with.params),
+                   weight() + _with.weight());
+}
+
+inline GQL::Vertices GQL::Vertices::complement(
+    const GQL::Vertices &_universe) const {
+  return _universe.excluding(*this);
+}
+
+inline GQL::Vertices
+GQL::Vertices::excluding(const GQL::Vertices &_subgroup) const {
+  const std::string a = as_cond(), b = _subgroup.as_cond();
+  if (b.empty()) {
+    return selecting(owner, "0", {}, 1);
+  }
+
+  // Rows where the condition is NULL are not in the subgroup
+  const std::string c = "(" + b + ") IS NOT TRUE";
+  return selecting(
+      owner, a.empty() ? c : a + " AND " + c,
+      concat(params, _subgroup.params),
+      weight() + _subgroup.weight());
+}
+
+inline GQL::Result GQL::Vertices::label() const {
+  auto raw = owner->sql(
+      __gql_format_str("SELECT id, label AS label FROM "
+                       "({}) ORDER BY id;",
+                       cmd),
+      params);
+
+  // Hex or dictionary decode
+  for (uint i = 0; i < raw.body.size(); ++i) {
+    raw.body.at(i).at(1) =
+        owner->decode_name(raw.body.at(i).at(1));
+  }
+  return raw;
+}
+
+inline GQL::Result
+GQL::Vertices::tag(const std::string &_key) const {
+  auto raw =
+      owner->has_tag_tables
+          ? owner->sql(
+                __gql_format_str(
+                    "SELECT s.id, t.value FROM ({}) AS s "
+                    "LEFT JOIN node_tags AS t ON t.id = s.id "
+                    "AND t.key = ? ORDER BY s.id;",
+                    cmd),
+                concat(params, {Param(Param::KEY_NAME, _key)}))
+          : owner->sql(
+                __gql_format_str(
+                    "SELECT id, {} FROM ({}) ORDER BY id;",
+                    owner->tag_value(_key), cmd),
+                concat({owner->key_param(_key)}, params));
+
+  if (!raw.empty()) {
+    raw.headers.at(1) = _key;
+    for (uint i = 0; i < raw.body.size(); ++i) {
+      raw.body.at(i).at(1) =
+          owner->decode(raw.body.at(i).at(1));
+    }
+  }
+  return raw;
+}
+
+inline GQL::Result
+GQL::Vertices::tag(const std::list<std::string> &_keys) const {
+  if (_keys.empty()) {
+    return GQL::Result{};
+  }
+  return table(_keys);
+}
+
+inline std::string
+GQL::Vertices::tag_query(const std::list<std::string> &_keys,
+                         std::vector<Param> &_params,
+                         std::vector<bool> &_decode) const {
+  std::string subcommand = "";
+  for (const auto &key : _keys) {
+    if (!subcommand.empty()) {
+      subcommand += ", ";
+    }
+
+    if (key == "id") {
+      subcommand += key;
+    } else if (key == "label") {
+      subcommand += owner->name_sql(key);
+    } else {
+      subcommand += owner->tag_value(key);
+      _params.push_back(owner->key_param(key));
+    }
+    _decode.push_back(key != "id");
+  }
+
+  if (subcommand.empty()) {
+    subcommand = "id";
+  }
+
+  _params = concat(_params, params);
+  return __gql_format_str("SELECT {} FROM ({}) ORDER BY id;",
+                          subcommand, cmd);
+}
+
+inline GQL::Table GQL::Vertices::table(
+    const std::list<std::string> &_keys) const {
+  std::vector<Param> query_params;
+  std::vector<bool> decode;
+  const auto query = tag_query(_keys, query_params, decode);
+
+  // Columns are titled by their (decoded) keys, and entries
+  // need decoded unless they are in the "id" column
+  return owner->table(query, query_params, decode,
+                      {_keys.begin(), _keys.end()});
+}
+
+inline std::shared_ptr<const GQL::Table>
+GQL::Vertices::shared(const std::list<std::string> &_keys) const {
+  std::vector<Param> query_params;
+  std::vector<bool> decode;
+  const auto query = tag_query(_keys, query_params, decode);
+  return owner->shared_table(query, query_params, decode,
+                             {_keys.begin(), _keys.end()});
+}
+
+inline GQL::Cursor GQL::Vertices::stream(
+    const std::list<std::string> &_keys) const {
+  std::vector<Param> query_params;
+  std::vector<bool> decode;
+  const auto query = tag_query(_keys, query_params, decode);
+  return Cursor(owner, query, query_params, decode,
+                {_keys.begin(), _keys.end()});
+}
+
+inline std::list<std::string> GQL::Vertices::keys() const {
+  auto res =
+      owner->has_tag_tables
+          ? owner->sql(
+                __gql_format_str(
+                    "SELECT DISTINCT key FROM node_tags WHERE "
+                    "id IN (SELECT id FROM ({}));",
+                    cmd),
+                params)
+          : owner->sql(
+                __gql_format_str(
+                    "SELECT DISTINCT key FROM ({}) JOIN "
+                    "JSON_EACH(tags);",
+                    cmd),
+                params);
+  std::list<std::string> out;
+
+  for (uint i = 0; i < res.size(); ++i) {
+    out.push_back(owner->decode_name(res.body[i][0]));
+  }
+  return out;
+}
+
+inline std::vector<uint64_t> GQL::Vertices::id() const {
+  // Ids are read as integers and never converted to text
+  const auto res = owner->shared_table(
+      __gql_format_str("SELECT id FROM ({}) ORDER BY id;", cmd),
+      params);
+  const auto &ids = res->integers(0);
+  return std::vector<uint64_t>(ids.begin(), ids.end());
+}
+
+inline uint64_t GQL::Vertices::count() const {
+  const auto res = owner->shared_table(
+      __gql_format_str("SELECT COUNT(*) FROM ({});", cmd),
+      params);
+  return (uint64_t)res->integers(0).at(0);
+}
+
+inline std::optional<uint64_t> GQL::Vertices::first() const {
+  // MIN is NULL (stored as text) for an empty set
+  const auto res = owner->shared_table(
+      __gql_format_str("SELECT MIN(id) FROM ({});", cmd),
+      params);
+  if (!res->is_integer(0)) {
+    return std::nullopt;
+  }
+  return (uint64_t)res->integers(0).at(0);
+}
+
+inline bool GQL::Vertices::empty() const {
+  return !exists();
+}
+
+inline bool GQL::Vertices::exists() const {
+  const auto res = owner->shared_table(
+      __gql_format_str(
+          "SELECT EXISTS (SELECT 1 FROM ({}) LIMIT 1);", cmd),
+      params);
+  return res->integers(0).at(0) != 0;
+}
+
+inline GQL::Vertices
+GQL::Vertices::label(const std::string &_label) {
+  owner->sql(
+      __gql_format_str("UPDATE nodes SET label = ? WHERE id IN "
+                       "(SELECT id FROM ({}))",
+                       cmd),
+      concat({Param(Param::TEXT, owner->encode_name(_label, true))},
+             params));
+
+  return *this;
+}
+
+inline GQL::Vertices
+GQL::Vertices::tag(const std::string &_key,
+                   const std::string &_value) {
+  owner->sql(
+      __gql_format_str("UPDATE nodes SET tags = {} WHERE id IN "
+                       "(SELECT id FROM ({}))",
+                       owner->tag_set(_key), cmd),
+      concat({owner->key_param(_key, true),
+              Param(Param::VALUE, _value)},
+             params));
+
+  return *this;
+}
+
+inline GQL::Vertices GQL::Vertices::lemma(
+    const std::function<void(GQL::Vertices)> _fn) {
+  _fn(*this);
+  return *this;
+}
+
+inline void GQL::Vertices::erase() {
+  // The ids are materialized once, since this query may stop
+  // matching them partway through
+  owner->erase_vertex_set(owner->bounce(cmd, params));
+}
+
+inline GQL::Edges GQL::Vertices::in() const {
+  return Edges::selecting(owner, "target IN (" + ids() + ")",
+                          params, weight() + 1);
+}
+
+inline GQL::Edges GQL::Vertices::out() const {
+  return Edges::selecting(owner, "source IN (" + ids() + ")",
+                          params, weight() + 1);
+}
+
+inline GQL::Edges
+GQL::Vertices::in(const std::string &_label) const {
+  auto p = params;
+  p.push_back(Param(Param::LABEL, _label));
+  return Edges::selecting(owner,
+                          "target IN (" + ids() + ") AND label = ?",
+                          p, weight() + 2);
+}
+
+inline GQL::Edges
+GQL::Vertices::out(const std::string &_label) const {
+  auto p = params;
+  p.push_back(Param(Param::LABEL, _label));
+  return Edges::selecting(owner,
+                          "source IN (" + ids() + ") AND label = ?",
+                          p, weight() + 2);
+}
+
+inline GQL::Vertices
+GQL::Vertices::with_in_degree(const uint64_t &_count) const {
+  if (owner->has_degree_table) {
+    return narrow("id IN (SELECT id FROM node_degree WHERE "
+                  "in_deg = ?)",
+                  {owner->integer(_count)});
+  }
+  return narrow("(SELECT COUNT(*) FROM edges WHERE "
+                "edges.target = nodes.id) = ?",
+                {owner->integer(_count)});
+}
+
+inline GQL::Vertices
+GQL::Vertices::with_out_degree(const uint64_t &_count) const {
+  if (owner->has_degree_table) {
+    return narrow("id IN (SELECT id FROM node_degree WHERE "
+                  "out_deg = ?)",
+                  {owner->integer(_count)});
+  }
+  return narrow("(SELECT COUNT(*) FROM edges WHERE "
+                "edges.source = nodes.id) = ?",
+                {owner->integer(_count)});
+}
+
+inline GQL::Result GQL::Vertices::in_degree() const {
+  if (owner->has_degree_table) {
+    return owner->sql(
+        __gql_format_str(
+            "SELECT n.id AS id, COALESCE(d.in_deg, 0) AS "
+            "in_degree FROM ({}) AS n LEFT JOIN node_degree "
+            "AS d ON d.id = n.id ORDER BY id;",
+            cmd),
+        params);
+  }
+  return owner->sql(
+      __gql_format_str(
+          "WITH n AS ({}) "
+          "SELECT t.id AS id, t.c AS in_degree FROM ("
+          "SELECT n.id AS id, COUNT(e.id) AS c "
+          "FROM n LEFT JOIN (SELECT * FROM edges) e "
+          "ON e.target = n.id "
+          "GROUP BY n.id) t "
+          "ORDER BY id;",
+          cmd),
+      params);
+}
+
+inline GQL::Result GQL::Vertices::out_degree() const {
+  if (owner->has_degree_table) {
+    return owner->sql(
+        __gql_format_str(
+            "SELECT n.id AS id, COALESCE(d.out_deg, 0) AS "
+            "out_degree FROM ({}) AS n LEFT JOIN node_degree "
+            "AS d ON d.id = n.id ORDER BY id;",
+            cmd),
+        params);
+  }
+  return owner->sql(
+      __gql_format_str(
+          "WITH n AS ({}) "
+          "SELECT t.id AS id, t.c AS out_degree FROM ("
+          "SELECT n.id AS id, COUNT(e.id) AS c "
+          "FROM n LEFT JOIN (SELECT * FROM edges) e "
+          "ON e.source = n.id "
+          "GROUP BY n.id) t "
+          "ORDER BY id;",
+          cmd),
+      params);
+}
+
+inline std::list<GQL::Vertices> GQL::Vertices::each() const {
+  std::list<GQL::Vertices> out;
+  for (const auto &id : id()) {
+    out.push_back(owner->v().with_id(id));
+  }
+  return out;
+}
+
+inline GQL::Vertices
+GQL::Vertices::traverse(const uint64_t &_max_depth,
+                        const GQL::Order &_order) const {
+  return traversal(owner->e(), owner->v(), _max_depth, _order,
+                   false);
+}
+
+inline GQL::Vertices
+GQL::Vertices::traverse(const GQL::Edges &_edge_case,
+                        const uint64_t &_max_depth,
+                        const GQL::Order &_order) const {
+  return traversal(_edge_case, owner->v(), _max_depth, _order,
+                   false);
+}
+
+inline GQL::Vertices
+GQL::Vertices::traverse(const GQL::Edges &_edge_case,
+                        const GQL::Vertices &_vertex_case,
+                        const uint64_t &_max_depth,
+                        const GQL::Order &_order) const {
+  return traversal(_edge_case, _vertex_case, _max_depth, _order,
+                   false);
+}
+
+inline GQL::Vertices
+GQL::Vertices::r_traverse(const uint64_t &_max_depth,
+                          const GQL::Order &_order) const {
+  return traversal(owner->e(), owner->v(), _max_depth, _order,
+                   true);
+}
+
+inline GQL::Vertices
+GQL::Vertices::r_traverse(const GQL::Edges &_edge_case,
+                          const uint64_t &_max_depth,
+                          const GQL::Order &_order) const {
+  return traversal(_edge_case, owner->v(), _max_depth, _order,
+                   true);
+}
+
+inline GQL::Vertices
+GQL::Vertices::r_traverse(const GQL::Edges &_edge_case,
+                          const GQL::Vertices &_vertex_case,
+                          const uint64_t &_max_depth,
+                          const GQL::Order &_order) const {
+  return traversal(_edge_case, _vertex_case, _max_depth, _order,
+                   true);
+}
+
+inline GQL::Vertices GQL::Vertices::traversal(
+    const GQL::Edges &_edge_case,
+    const GQL::Vertices &_vertex_case,
+    const uint64_t &_max_depth, const GQL::Order &_order,
+    const bool &_reverse) const {
+  assert(owner == _edge_case.owner &&
+         owner == _vertex_case.owner);
+
+  if (owner->integer(_max_depth).kind == Param::SLOT) {
+    throw std::runtime_error(
+        "Traversal depths choose the shape of a query, so they "
+        "cannot be plan slots.");
+  }
+
+  if (_max_depth == 0) {
+    return owner->v("0");
+  }
+
+  // Columns to step from and to
+  const std::string from = _reverse ? "target" : "source";
+  const std::string to = _reverse ? "source" : "target";
+
+  // The first hop seeds the recursion, so that the starting
+  // vertices are only selected if they are reached again
+  std::string reach;
+  std::vector<Param> p;
+  if (_max_depth == NO_LIMIT) {
+    // Without depths, UNION stops at cycles by itself
+    reach = __gql_format_str(
+        "reach(id) AS ("
+        "SELECT e.{} FROM ({}) e WHERE e.{} IN "
+        "(SELECT id FROM ({})) "
+        "UNION "
+        "SELECT e.{} FROM reach JOIN ({}) e "
+        "ON e.{} = reach.id)",
+        to, _edge_case.cmd, from, cmd, to, _edge_case.cmd,
+        from);
+    p = concat(concat(_edge_case.params, params),
+               _edge_case.params);
+  } else {
+    reach = __gql_format_str(
+        "reach(id, depth) AS ("
+        "SELECT e.{}, 1 FROM ({}) e WHERE e.{} IN "
+        "(SELECT id FROM ({})) "
+        "UNION "
+        "SELECT e.{}, reach.depth + 1 FROM reach JOIN ({}) e "
+        "ON e.{} = reach.id WHERE reach.depth < ? AND "
+        "gql_expand(0, reach.id, reach.depth) "
+        "ORDER BY 2 {})",
+        to, _edge_case.cmd, from, cmd, to, _edge_case.cmd, from,
+        std::string(_order == DFS ? "DESC" : "ASC"));
+
+    // Each vertex is only expanded again if it is reached at a
+    // smaller depth, which breadth-first order never does
+    const Param depth(Param::INTEGER,
+                      (int64_t)std::min<uint64_t>(_max_depth,
+                                                  INT64_MAX));
+    p = concat(concat(_edge_case.params, params),
+               concat(_edge_case.params, {depth}));
+  }
+
+  return GQL::Vertices(
+      owner,
+      __gql_format_str("WITH RECURSIVE {} SELECT * FROM ({}) "
+                       "WHERE id IN (SELECT id FROM reach)",
+                       reach, _vertex_case.cmd),
+      concat(p, _vertex_case.params));
+}
+
+inline GQL::Edges
+GQL::Vertices::add_edge(const GQL::Vertices &_other) const {
+  const auto both = concat(params, _other.params);
+  const std::string pairs = __gql_format_str(
+      "FROM ({}) l CROSS JOIN ({}) r", cmd, _other.cmd);
+
+  // Number the new edges from a reserved range, rather than
+  // letting SQLite pick ids which may already be reserved
+  const auto n = std::stoull(
+      owner->sql("SELECT COUNT(*) " + pairs + ";", both)
+          .body.at(0)
+          .at(0));
+  const auto first = owner->reserve_edge_ids(n);
+  owner->sql("INSERT INTO edges (id, source, target) "
+             "SELECT ? + ROW_NUMBER() OVER () - 1, l.id, r.id " +
+                 pairs,
+             concat({Param(first)}, both));
+
+  return GQL::Edges(
+      owner,
+      __gql_format_str("SELECT * FROM edges "
+                       "WHERE (source, target) IN "
+                       "(SELECT l.id, r.id FROM "
+                       "({}) l CROSS JOIN ({}) r)",
+                       cmd, _other.cmd),
+      both);
+}
+
+////////////////////////////////////////////////////////////////
+
+inline GQL::Edges::Edges(GQL *const _owner,
+                         const std::string &_cmd,
+                         const std::vector<Param> &_params)
+    : owner(_owner), cmd(_cmd), params(_params), flat(false),
+      terms(0) {
+  if (_cmd.size() > GQL_BOUNCE_THRESH && !owner->recording) {
+    bounce_now();
+  }
+}
+
+inline GQL::Edges GQL::Edges::selecting(
+    GQL *const _owner, const std::string &_cond,
+    const std::vector<Param> &_params, const uint64_t &_terms) {
+  // Built short, so that only the checks below can bounce it
+  Edges out(_owner, "", _params);
+  out.flat = true;
+  out.cond = _cond;
+  out.terms = _terms;
+  out.cmd = "SELECT * FROM edges";
+  if (!_cond.empty()) {
+    out.cmd += " WHERE " + _cond;
+  }
+  if (!_owner->recording && (_terms > GQL_FLAT_TERMS ||
+                             nesting(_cond) > GQL_FLAT_DEPTH)) {
+    out.bounce_now();
+  }
+  return out;
+}
+
+inline void GQL::Edges::bounce_now() {
+  // Perform query simplification "bounce": The next query
+  // joins against the materialized ids instead of re-running
+  // (and re-parsing) this one
+  params = {owner->bounce(cmd, params)};
+  flat = true;
+  cond = "id IN (SELECT id FROM gql_bounce WHERE set_id = ?)";
+  cmd = "SELECT * FROM edges WHERE " + cond;
+  terms = 1;
+}
+
+inline std::string GQL::Edges::as_cond() const {
+  return flat ? cond : "id IN (" + ids() + ")";
+}
+
+inline std::string GQL::Edges::ids() const {
+  if (!flat) {
+    return "SELECT id FROM (" + cmd + ")";
+  }
+  return cond.empty() ? "SELECT id FROM edges"
+                      : "SELECT id FROM edges WHERE " + cond;
+}
+
+inline uint64_t GQL::Edges::weight() const {
+  return flat ? terms : 1;
+}
+
+inline GQL::Edges
+GQL::Edges::narrow(const std::string &_cond,
+                   const std::vector<Param> &_params,
+                   const uint64_t &_terms) const {
+  // Conditions herein never have a top-level OR, so they can
+  // be extended without nesting them
+  const std::string here = as_cond();
+  return selecting(
+      owner, here.empty() ? _cond : here + " AND " + _cond,
+      concat(params, _params), weight() + _terms);
+}
+
+inline GQL::Edges GQL::Edges::limit(const uint64_t &_n) const {
+  return GQL::Edges(
+      owner,
+      __gql_format_str("SELECT * FROM ({}) ORDER BY id LIMIT ?",
+                       cmd),
+      concat(params, {owner->integer(_n)}));
+}
+
+inline GQL::Edges
+GQL::Edges::with_source(const GQL::Vertices &_source) const {
+  return narrow("source IN (" + _source.ids() + ")",
+                _source.params, _source.weight());
+}
+
+inline GQL::Edges
+GQL::Edges::with_target(const GQL::Vertices &_source) const {
+  return narrow("target IN (" + _source.ids() + ")",
+                _source.params, _source.weight());
+}
+
+inline GQL::Edges
+GQL::Edges::with_label(const std::string &_label) const {
+  return narrow("label = ?", {Param(Param::LABEL, _label)});
+}
+
+inline GQL::Edges
+GQL::Edges::with_tag(const std::string &_key,
+                     const std::string &_value) const {
+  if (owner->has_tag_tables) {
+    return narrow("id IN (SELECT id FROM edge_tags WHERE "
+                  "key = ? AND value = ?)",
+                  {Param(Param::KEY_NAME, _key),
+                   Param(Param::VALUE, _value)});
+  }
+
+  return narrow(owner->tag_value(_key) + " = ?",
+                {owner->key_param(_key),
+                 Param(Param::VALUE, _value)});
+}
+
+inline GQL::Edges
+GQL::Edges::with_id(const uint64_t &_id) const {
+  return narrow("id = ?", {owner->integer(_id)});
+}
+
+inline GQL::Edges GQL::Edges::where(
+    const std::function<bool(const GQL::Edges &)> &_fn) {
+  // Collect matches into one set, rather than joining them
+  std::vector<uint64_t> matches;
+  for (const auto &id : id()) {
+    if (_fn(owner->e().with_id(id))) {
+      matches.push_back(id);
+    }
+  }
+
+  return owner->e(
+      "id IN (SELECT id FROM gql_bounce WHERE set_id = ?)",
+      {owner->bounce(matches)});
+}
+
+inline GQL::Edges GQL::Edges::filter(
+    const std::function<bool(const GQL::Record &)> &_fn) const {
+  std::vector<uint64_t> matches;
+  owner->each_record(cmd, params, true,
+                     [&](const Record &_r) {
+                       if (_fn(_r)) {
+                         matches.push_back(_r.id);
+                       }
+                     });
+
+  return owner->e(
+      "id IN (SELECT id FROM gql_bounce WHERE set_id = ?)",
+      {owner->bounce(matches)});
+}
+
+inline GQL::Edges
+GQL::Edges::join(const GQL::Edges &_with) const {
+  const std::string a = as_cond(), b = _with.as_cond();
+  if (a.empty() || b.empty()) {
+    return selecting(owner, "", {}, 0);
+  }
+  return selecting(owner,
+                   __gql_format_str("({} OR {})", a, b),
+                   concat(params, _with.params),
+                   weight() + _with.weight());
+}
+
+inline GQL::Edges
+GQL::Edges::intersection(const GQL::Edges &_with) const {
+  const std::string a = as_cond(), b = _with.as_cond();
+  if (a.empty() || b.empty()) {
+    return a.empty() ? _with : *this;
+  }
+  return selecting(owner, a + " AND " + b,
+                   concat(params, _with.params),
+                   weight() + _with.weight());
+}
+
+inline GQL::Edges
+GQL::Edges::complement(const GQL::Edges &_universe) const {
+  return _universe.excluding(*this);
+}
+
+inline GQL::Edges
+GQL::Edges::excluding(const GQL::Edges &_subgroup) const {
+  const std::string a = as_cond(), b = _subgroup.as_cond();
+  if (b.empty()) {
+    return selecting(owner, "0", {}, 1);
+  }
+
+  // Rows where the condition is NULL are not in the subgroup
+  const std::string c = "(" + b + ") IS NOT TRUE";
+  return selecting(
+      owner, a.empty() ? c : a + " AND " + c,
+      concat(params, _subgroup.params),
+      weight() + _subgroup.weight());
+}
+
+inline GQL::Result GQL::Edges::label() const {
+  auto raw = owner->sql(
+      __gql_format_str(
+          "SELECT id, label FROM ({}) ORDER BY id;", cmd),
+      params);
+
+  // Hex or dictionary decode
+  for (uint i = 0; i < raw.body.size(); ++i) {
+    raw.body.at(i).at(1) =
+        owner->decode_name(raw.body.at(i).at(1));
+  }
+  return raw;
+}
 
-  /**
-   * @brief Get all edges where some SQL WHERE clause holds
-   * @param _where The SQL clause to use
-   * @returns All edges where the SQL clause holds
-   */
-  Edges e(const std::string &_where);
+inline GQL::Result
+GQL::Edges::tag(const std::string &_key) const {
+  auto raw =
+      owner->has_tag_tables
+          ? owner->sql(
+                __gql_format_str(
+                    "SELECT s.id, t.value FROM ({}) AS s "
+                    "LEFT JOIN edge_tags AS t ON t.id = s.id "
+                    "AND t.key = ? ORDER BY s.id;",
+                    cmd),
+                concat(params, {Param(Param::KEY_NAME, _key)}))
+          : owner->sql(
+                __gql_format_str(
+                    "SELECT id, {} FROM ({}) ORDER BY id;",
+                    owner->tag_value(_key), cmd),
+                concat({owner->key_param(_key)}, params));
 
-  /**
-   * @brief Execute the given sql and return the results
-   * @param _sql The SQL statement to run via SQLite3
-   * @returns An object containing the SQL query results
-   */
-  Result sql(const std::string &_sql);
+  if (!raw.empty()) {
+    raw.headers.at(1) = _key;
+    for (uint i = 0; i < raw.body.size(); ++i) {
+      raw.body.at(i).at(1) =
+          owner->decode(raw.body.at(i).at(1));
+    }
+  }
+  return raw;
+}
 
-  /// A pointer to the underlying SQLite3 instance
-  sqlite3 *db = nullptr;
+inline GQL::Result
+GQL::Edges::tag(const std::list<std::string> &_keys) const {
+  if (_keys.empty()) {
+    return GQL::Result{};
+  }
+  return table(_keys);
+}
+
+inline std::string
+GQL::Edges::tag_query(const std::list<std::string> &_keys,
+                      std::vector<Param> &_params,
+                      std::vector<bool> &_decode) const {
+  std::string subcommand = "";
+  for (const auto &key : _keys) {
+    if (!subcommand.empty()) {
+      subcommand += ", ";
+    }
 
-  /// The next automatically-assigned ID values
-  uint64_t next_node_id = 1;
+    if (key == "id" || key == "source" || key == "target") {
+      subcommand += key;
+    } else if (key == "label") {
+      subcommand += owner->name_sql(key);
+    } else {
+      subcommand += owner->tag_value(key);
+      _params.push_back(owner->key_param(key));
+    }
+    _decode.push_back(key != "id" && key != "source" &&
+                     key != "target");
+  }
 
-  /// The next automatically-assigned ID values
-  uint64_t next_edge_id = 1;
+  if (subcommand.empty()) {
+    subcommand = "id";
+  }
 
-  /// Whether the DB should exist after destruction
-  bool persistent;
+  _params = concat(_params, params);
+  return __gql_format_str("SELECT {} FROM ({}) ORDER BY id;",
+                          subcommand, cmd);
+}
 
-  /// The database file managed by this object
-  std::filesystem::path filepath;
-};
+inline GQL::Table
+GQL::Edges::table(const std::list<std::string> &_keys) const {
+  std::vector<Param> query_params;
+  std::vector<bool> decode;
+  const auto query = tag_query(_keys, query_params, decode);
+
+  // Columns are titled by their (decoded) keys, and entries
+  // need decoded unless they are in the "id", "source", or
+  // "target" columns
+  return owner->table(query, query_params, decode,
+                      {_keys.begin(), _keys.end()});
+}
 
-/**
- * @brief Prints a given GQL::Result object
- * @param _into The output stream to insert into
- * @param _what The result object to print
- * @returns The stream after insertion
- */
-std::ostream &operator<<(std::ostream &_into,
-                         const GQL::Result &_what);
+inline std::shared_ptr<const GQL::Table>
+GQL::Edges::shared(const std::list<std::string> &_keys) const {
+  std::vector<Param> query_params;
+  std::vector<bool> decode;
+  const auto query = tag_query(_keys, query_params, decode);
+  return owner->shared_table(query, query_params, decode,
+                             {_keys.begin(), _keys.end()});
+}
 
-////////////////////////////////////////////////////////////////
+inline GQL::Cursor
+GQL::Edges::stream(const std::list<std::string> &_keys) const {
+  std::vector<Param> query_params;
+  std::vector<bool> decode;
+  const auto query = tag_query(_keys, query_params, decode);
+  return Cursor(owner, query, query_params, decode,
+                {_keys.begin(), _keys.end()});
+}
 
-inline GQL::GQL(const std::string &_filepath,
-                const bool &_erase, const bool &_persistent)
-    : persistent(_persistent), filepath(_filepath) {
-  if (_erase && std::filesystem::exists(filepath)) {
-    std::filesystem::remove_all(filepath);
+inline std::list<std::string> GQL::Edges::keys() const {
+  auto res =
+      owner->has_tag_tables
+          ? owner->sql(
+                __gql_format_str(
+                    "SELECT DISTINCT key FROM edge_tags WHERE "
+                    "id IN (SELECT id FROM ({}));",
+                    cmd),
+                params)
+          : owner->sql(
+                __gql_format_str(
+                    "SELECT DISTINCT key FROM ({}) JOIN "
+                    "JSON_EACH(tags);",
+                    cmd),
+                params);
+  std::list<std::string> out;
+  for (uint i = 0; i < res.size(); ++i) {
+    out.push_back(owner->decode_name(res.body[i][0]));
   }
+  return out;
+}
 
-  // Open database
-  sqlite3_open(filepath.c_str(), &db);
+inline std::vector<uint64_t> GQL::Edges::id() const {
+  // Ids are read as integers and never converted to text
+  const auto res = owner->shared_table(
+      __gql_format_str("SELECT id FROM ({}) ORDER BY id;", cmd),
+      params);
+  const auto &ids = res->integers(0);
+  return std::vector<uint64_t>(ids.begin(), ids.end());
+}
 
-  // Initialize
-  sql("CREATE TABLE IF NOT EXISTS nodes ("
-      "id INTEGER NOT NULL, "
-      "label TEXT DEFAULT '', "
-      "tags TEXT DEFAULT '{}', "
-      "PRIMARY KEY(id)"
-      ");");
-  sql("CREATE TABLE IF NOT EXISTS edges ("
-      "id INTEGER NOT NULL, "
-      "source INTEGER NOT NULL, "
-      "target INTEGER NOT NULL, "
-      "label TEXT DEFAULT '', "
-      "tags TEXT DEFAULT '{}', "
-      "PRIMARY KEY(id), "
-      "FOREIGN KEY(source) REFERENCES nodes(id), "
-      "FOREIGN KEY(target) REFERENCES nodes(id)"
-      ");");
+inline uint64_t GQL::Edges::count() const {
+  const auto res = owner->shared_table(
+      __gql_format_str("SELECT COUNT(*) FROM ({});", cmd),
+      params);
+  return (uint64_t)res->integers(0).at(0);
+}
 
-  // Indices here
-  sql("CREATE INDEX IF NOT EXISTS edge_src "
-      "ON edges(source);");
-  sql("CREATE INDEX IF NOT EXISTS edge_tgt "
-      "ON edges(target);");
-  sql("CREATE INDEX IF NOT EXISTS edge_lbl "
-      "ON edges(label);");
-  sql("CREATE INDEX IF NOT EXISTS edge_id "
-      "ON edges(label);");
-  sql("CREATE INDEX IF NOT EXISTS node_label "
-      "ON nodes(label);");
-  sql("CREATE INDEX IF NOT EXISTS node_id "
-      "ON nodes(id);");
+inline std::optional<uint64_t> GQL::Edges::first() const {
+  // MIN is NULL (stored as text) for an empty set
+  const auto res = owner->shared_table(
+      __gql_format_str("SELECT MIN(id) FROM ({});", cmd),
+      params);
+  if (!res->is_integer(0)) {
+    return std::nullopt;
+  }
+  return (uint64_t)res->integers(0).at(0);
+}
 
-  sql("BEGIN;");
+inline bool GQL::Edges::empty() const {
+  return !exists();
 }
 
-inline GQL::~GQL() {
-  sql("COMMIT;");
-  sqlite3_close(db);
+inline bool GQL::Edges::exists() const {
+  const auto res = owner->shared_table(
+      __gql_format_str(
+          "SELECT EXISTS (SELECT 1 FROM ({}) LIMIT 1);", cmd),
+      params);
+  return res->integers(0).at(0) != 0;
+}
 
-  if (!persistent && std::filesystem::exists(filepath)) {
-    std::filesystem::remove_all(filepath);
+inline GQL::Edges GQL::Edges::label(const std::string &_label) {
+  owner->sql(
+      __gql_format_str("UPDATE edges SET label = ? WHERE id IN "
+                       "(SELECT id FROM ({}))",
+                       cmd),
+      concat({Param(Param::TEXT, owner->encode_name(_label, true))},
+             params));
+
+  return *this;
+}
+
+inline GQL::Edges GQL::Edges::tag(const std::string &_key,
+                                  const std::string &_value) {
+  owner->sql(
+      __gql_format_str("UPDATE edges SET tags = {} WHERE id IN "
+                       "(SELECT id FROM ({}))",
+                       owner->tag_set(_key), cmd),
+      concat({owner->key_param(_key, true),
+              Param(Param::VALUE, _value)},
+             params));
+
+  return *this;
+}
+
+inline GQL::Edges
+GQL::Edges::lemma(const std::function<void(GQL::Edges)> _fn) {
+  _fn(*this);
+  return *this;
+}
+
+inline void GQL::Edges::erase() {
+  owner->sql(__gql_format_str("DELETE FROM edges WHERE id IN "
+                              "(SELECT id FROM ({}))",
+                              cmd),
+             params);
+}
+
+inline GQL::Vertices GQL::Edges::source() const {
+  std::string from = "SELECT source FROM (" + cmd + ")";
+  if (flat) {
+    from = "SELECT source FROM edges";
+    if (!cond.empty()) {
+      from += " WHERE " + cond;
+    }
   }
+  return Vertices::selecting(owner, "id IN (" + from + ")",
+                             params, weight() + 1);
 }
 
-inline void GQL::commit() {
-  sql("COMMIT;");
-  sql("BEGIN;");
+inline GQL::Vertices GQL::Edges::target() const {
+  std::string from = "SELECT target FROM (" + cmd + ")";
+  if (flat) {
+    from = "SELECT target FROM edges";
+    if (!cond.empty()) {
+      from += " WHERE " + cond;
+    }
+  }
+  return Vertices::selecting(owner, "id IN (" + from + ")",
+                             params, weight() + 1);
 }
 
-inline void GQL::rollback() {
-  sql("ROLLBACK;");
-  sql("BEGIN;");
+inline std::list<GQL::Edges> GQL::Edges::each() const {
+  std::list<GQL::Edges> out;
+  for (const auto &id : id()) {
+    out.push_back(owner->e().with_id(id));
+  }
+  return out;
+}
+
+////////////////////////////////////////////////////////////////
+
+inline GQL::Vertices GQL::v() {
+  return Vertices::selecting(this, "", {}, 0);
+}
+
+inline GQL::Edges GQL::e() {
+  return Edges::selecting(this, "", {}, 0);
+}
+
+inline GQL::Vertices GQL::v(const std::string &_where) {
+  return v(_where, {});
+}
+
+inline GQL::Edges GQL::e(const std::string &_where) {
+  return e(_where, {});
+}
+
+inline GQL::Vertices
+GQL::v(const std::string &_where,
+       const std::vector<Param> &_params) {
+  return Vertices::selecting(this, "(" + _where + ")", _params,
+                             1);
+}
+
+inline GQL::Edges GQL::e(const std::string &_where,
+                         const std::vector<Param> &_params) {
+  return Edges::selecting(this, "(" + _where + ")", _params, 1);
+}
+
+inline GQL::Vertices GQL::add_vertex() {
+  return add_vertex(next_node_id++);
+}
+
+inline GQL::Vertices GQL::add_vertex(const uint64_t &_id) {
+  // Add vertex
+  sql("INSERT INTO nodes (id, tags) VALUES (?, json('{}'));",
+      {Param(_id)});
+  advance(next_node_id, _id);
+
+  // Return query
+  return v("id = ?", {Param(_id)});
+}
+
+inline GQL::Edges GQL::add_edge(const uint64_t &_source,
+                                const uint64_t &_target) {
+  // Add edge
+  const auto id = next_edge_id++;
+  sql("INSERT INTO edges (id, source, target, tags) "
+      "VALUES (?, ?, ?, json('{}'));",
+      {Param(id), Param(_source), Param(_target)});
+
+  // Return query
+  return e("id = ?", {Param(id)});
+}
+
+inline uint64_t
+GQL::reserve_vertex_ids(const uint64_t &_n) noexcept {
+  return next_node_id.fetch_add(_n);
+}
+
+inline uint64_t GQL::reserve_edge_ids(const uint64_t &_n) noexcept {
+  return next_edge_id.fetch_add(_n);
+}
+
+inline void GQL::advance(std::atomic<uint64_t> &_next,
+                         const uint64_t &_id) noexcept {
+  uint64_t cur = _next.load();
+  while (cur <= _id &&
+         !_next.compare_exchange_weak(cur, _id + 1)) {
+  }
+}
+
+inline void GQL::release(std::atomic<uint64_t> &_next,
+                         const uint64_t &_first,
+                         const uint64_t &_n) noexcept {
+  uint64_t end = _first + _n;
+  _next.compare_exchange_strong(end, _first);
 }
 
 ////////////////////////////////////////////////////////////////
 
-inline GQL::Vertices::Vertices(GQL *const _owner,
-                               const std::string &_cmd)
-    : owner(_owner), cmd(_cmd) {
-  if (_cmd.size() > GQL_BOUNCE_THRESH) {
-    // Perform query simplification "bounce"
-    auto ids = this->id();
+inline GQL::Bulk GQL::bulk(const bool &_defer_indices) {
+  return GQL::Bulk(this, _defer_indices);
+}
+
+inline GQL::Bulk::Bulk(GQL *const _owner,
+                       const bool &_defer_indices)
+    : owner(_owner), defer_indices(_defer_indices) {
+}
+
+inline GQL::Bulk::~Bulk() {
+  try {
+    flush();
+  } catch (std::runtime_error &_e) {
+    std::cerr << "Failed to flush bulk load: " << _e.what()
+              << '\n';
+  }
+}
+
+inline void
+GQL::Bulk::Rows::push_text(const std::string &_label,
+                           const std::string &_tags) {
+  text += _label;
+  ends.push_back(text.size());
+  text += _tags;
+  ends.push_back(text.size());
+}
+
+inline void GQL::Bulk::Rows::clear() {
+  id.clear();
+  unnumbered.clear();
+  source.clear();
+  target.clear();
+  text.clear();
+  ends.clear();
+}
+
+inline GQL::Bulk &GQL::Bulk::vertex(
+    const uint64_t &_id, const std::string &_label,
+    const std::map<std::string, std::string> &_tags) {
+  vertices.id.push_back(_id);
+  vertices.push_text(owner->encode_name(_label, true),
+                     owner->tags_json(_tags));
 
-    std::string bounced_cmd =
-        "SELECT * FROM nodes WHERE id IN (";
-    if (ids.empty()) {
-      bounced_cmd += ')';
+  if (size() >= GQL_BULK_BATCH_SIZE) {
+    write_all();
+  }
+  return *this;
+}
+
+inline GQL::Bulk &GQL::Bulk::edge(
+    const uint64_t &_source, const uint64_t &_target,
+    const std::string &_label,
+    const std::map<std::string, std::string> &_tags) {
+  edges.unnumbered.push_back(edges.id.size());
+  edges.id.push_back(0);
+  edges.source.push_back(_source);
+  edges.target.push_back(_target);
+  edges.push_text(owner->encode_name(_label, true),
+                  owner->tags_json(_tags));
+
+  if (size() >= GQL_BULK_BATCH_SIZE) {
+    write_all();
+  }
+  return *this;
+}
+
+inline GQL::Bulk &GQL::Bulk::edge(const Record &_edge) {
+  edges.id.push_back(_edge.id);
+  edges.source.push_back(_edge.source);
+  edges.target.push_back(_edge.target);
+  edges.push_text(owner->encode_name(_edge.label, true),
+                  owner->tags_json(_edge.tags));
+
+  if (size() >= GQL_BULK_BATCH_SIZE) {
+    write_all();
+  }
+  return *this;
+}
+
+inline size_t GQL::Bulk::size() const noexcept {
+  return vertices.id.size() + edges.id.size();
+}
+
+inline void GQL::Bulk::write(const std::string &_sql,
+                             GQL::Bulk::Rows &_rows,
+                             const bool &_is_edge) {
+  if (_rows.id.empty()) {
+    return;
+  }
+
+  ++owner->sql_call_counter;
+  const Timing timing(owner, _sql, {});
+  sqlite3_stmt *stmt = owner->prepare(_sql);
+  GQL::Result ignored;
+
+  // Automatic ids are taken now, and given back if the rows
+  // cannot be written
+  auto &next =
+      _is_edge ? owner->next_edge_id : owner->next_node_id;
+  const uint64_t n = _rows.unnumbered.size();
+  const uint64_t first = next.fetch_add(n);
+  for (uint64_t i = 0; i < n; ++i) {
+    _rows.id[_rows.unnumbered[i]] = first + i;
+  }
+
+  try {
+    size_t start = 0;
+    for (size_t i = 0; i < _rows.id.size(); ++i) {
+      const size_t label_end = _rows.ends[2 * i];
+      const size_t tags_end = _rows.ends[2 * i + 1];
+      const char *text = _rows.text.data();
+
+      int col = 1;
+      sqlite3_bind_int64(stmt, col++, (int64_t)_rows.id[i]);
+      if (_is_edge) {
+        sqlite3_bind_int64(stmt, col++,
+                           (int64_t)_rows.source[i]);
+        sqlite3_bind_int64(stmt, col++,
+                           (int64_t)_rows.target[i]);
+      }
+      sqlite3_bind_text(stmt, col++, text + start,
+                        (int)(label_end - start),
+                        SQLITE_STATIC);
+      sqlite3_bind_text(stmt, col++, text + label_end,
+                        (int)(tags_end - label_end),
+                        SQLITE_STATIC);
+      owner->step(stmt, _sql, ignored);
+
+      start = tags_end;
     }
-    for (const auto &id : ids) {
-      bounced_cmd += std::to_string(id) + ",";
+  } catch (...) {
+    release(next, first, n);
+    throw;
+  }
+
+  // Rows may carry ids which were chosen by the caller
+  advance(next,
+          *std::max_element(_rows.id.begin(), _rows.id.end()));
+  _rows.clear();
+}
+
+inline void GQL::Bulk::write_all() {
+  if (size() == 0) {
+    return;
+  }
+
+  if (defer_indices && !indices_dropped) {
+    owner->sql("DROP INDEX IF EXISTS edge_out;");
+    owner->sql("DROP INDEX IF EXISTS edge_in;");
+    owner->sql("DROP INDEX IF EXISTS edge_lbl;");
+    owner->sql("DROP INDEX IF EXISTS node_label;");
+    indices_dropped = true;
+  }
+
+  // A savepoint makes each write all-or-nothing
+  owner->sql("SAVEPOINT gql_bulk;");
+  try {
+    write("INSERT INTO nodes (id, label, tags) "
+          "VALUES (?, ?, ?);",
+          vertices, false);
+    write("INSERT INTO edges (id, source, target, label, tags) "
+          "VALUES (?, ?, ?, ?, ?);",
+          edges, true);
+  } catch (...) {
+    vertices.clear();
+    edges.clear();
+    owner->sql("ROLLBACK TO gql_bulk;");
+    owner->invalidate();
+    owner->sql("RELEASE gql_bulk;");
+    throw;
+  }
+  owner->sql("RELEASE gql_bulk;");
+}
+
+inline void GQL::Bulk::flush() {
+  write_all();
+
+  if (indices_dropped) {
+    owner->create_indices();
+    indices_dropped = false;
+  }
+}
+
+////////////////////////////////////////////////////////////////
+
+inline GQL::Cursor::Cursor(
+    GQL *const _owner, const std::string &_sql,
+    const std::vector<Param> &_params,
+    const std::vector<bool> &_decode,
+    const std::vector<std::string> &_headers)
+    : sql_text(_sql), names(_headers),
+      decode(_owner->format == HEX ? _decode
+                                   : std::vector<bool>()),
+      handle(_owner->self),
+      trace(_owner->start_trace(_sql, _params)) {
+  _owner->check_recording(_sql);
+  ++_owner->sql_call_counter;
+
+  // Cursors may be open for a long time alongside other
+  // queries, so they never share a cached statement
+  using clock = std::chrono::steady_clock;
+  const auto start = trace ? clock::now() : clock::time_point();
+  const char *tail = nullptr;
+  if (sqlite3_prepare_v3(_owner->db, _sql.c_str(),
+                         (int)_sql.size() + 1, 0, &stmt,
+                         &tail) != SQLITE_OK) {
+    std::cerr << "In SQL '" << _sql << "':\n";
+    throw std::runtime_error(sqlite3_errmsg(_owner->db));
+  }
+  if (trace) {
+    trace->prepare = clock::now() - start;
+  }
+
+  try {
+    if (stmt == nullptr || (tail != nullptr && *tail != '\0')) {
+      std::cerr << "In SQL '" << _sql << "':\n";
+      throw std::runtime_error(
+          "Only a single statement can be streamed.");
     }
-    bounced_cmd.back() = ')';
+    _owner->bind_all(stmt, _sql, _params);
+  } catch (...) {
+    sqlite3_finalize(stmt);
+    throw;
+  }
 
-    cmd = bounced_cmd;
+  if (names.empty()) {
+    const int n_cols = sqlite3_column_count(stmt);
+    for (int i = 0; i < n_cols; ++i) {
+      const char *name = sqlite3_column_name(stmt, i);
+      names.push_back(name == nullptr ? "NULL" : name);
+    }
   }
 }
 
-inline GQL::Vertices
-GQL::Vertices::limit(const uint64_t &_n) const {
-  return GQL::Vertices(
-      owner,
-      __gql_format_str("SELECT * FROM ({}) LIMIT {}", cmd, _n));
+inline GQL::Cursor::Cursor(GQL::Cursor &&_other) noexcept
+    : stmt(_other.stmt), sql_text(std::move(_other.sql_text)),
+      names(std::move(_other.names)),
+      decode(std::move(_other.decode)),
+      started(_other.started), finished(_other.finished),
+      handle(std::move(_other.handle)),
+      trace(std::move(_other.trace)) {
+  _other.stmt = nullptr;
+  _other.started = _other.finished = true;
 }
 
-inline GQL::Vertices
-GQL::Vertices::with_label(const std::string &_label) const {
-  return GQL::Vertices(
-      owner, __gql_format_str("SELECT * FROM ({}) WHERE "
-                              "label = '{}'",
-                              cmd, hex_encode(_label)));
+inline GQL::Cursor::~Cursor() {
+  report();
+  sqlite3_finalize(stmt);
 }
 
-inline GQL::Vertices
-GQL::Vertices::with_tag(const std::string &_key,
-                        const std::string &_value) const {
-  return GQL::Vertices(
-      owner, __gql_format_str(
-                 "SELECT * FROM ({}) WHERE "
-                 "json_extract(tags, '$.{}') = '{}'",
-                 cmd, hex_encode(_key), hex_encode(_value)));
+inline void GQL::Cursor::report() noexcept {
+  if (trace && handle && *handle != nullptr) {
+    (*handle)->report(*trace);
+  }
+  trace.reset();
+}
+
+inline void GQL::Cursor::advance() {
+  started = true;
+  if (finished) {
+    return;
+  }
+
+  using clock = std::chrono::steady_clock;
+  const auto start = trace ? clock::now() : clock::time_point();
+  const int res = sqlite3_step(stmt);
+  if (trace) {
+    trace->step += clock::now() - start;
+  }
+  if (res == SQLITE_ROW) {
+    if (trace) {
+      ++trace->rows;
+    }
+    return;
+  }
+
+  finished = true;
+  report();
+  if (res != SQLITE_DONE) {
+    std::cerr << "In SQL '" << sql_text << "':\n";
+    throw std::runtime_error(
+        sqlite3_errmsg(sqlite3_db_handle(stmt)));
+  }
 }
 
-inline GQL::Vertices
-GQL::Vertices::with_id(const uint64_t &_id) const {
-  return GQL::Vertices(
-      owner, __gql_format_str("SELECT * FROM ({}) WHERE "
-                              "id = {}",
-                              cmd, _id));
+inline GQL::Cursor::iterator GQL::Cursor::begin() {
+  if (!started) {
+    advance();
+  }
+  return iterator(this);
 }
 
-inline GQL::Vertices GQL::Vertices::where(
-    const std::function<bool(const GQL::Vertices &)> &_fn) {
-  // Set to empty set
-  auto out = excluding(*this);
+inline bool GQL::Cursor::done() {
+  if (!started) {
+    advance();
+  }
+  return finished;
+}
 
-  for (const auto &item : each()) {
-    if (_fn(item)) {
-      // Merge in matches
-      out = out.join(item);
+inline GQL::Table GQL::Cursor::next(const size_t &_batch_size) {
+  GQL::Table out;
+  out.headers = names;
+  out.cols.resize(names.size());
+
+  while (out.size() < _batch_size && !done()) {
+    using clock = std::chrono::steady_clock;
+    const auto start =
+        trace ? clock::now() : clock::time_point();
+    out.append(stmt, decode);
+    if (trace) {
+      trace->read += clock::now() - start;
     }
+    advance();
   }
-
   return out;
 }
 
-inline GQL::Vertices
-GQL::Vertices::join(const GQL::Vertices &_with) const {
-  return GQL::Vertices(
-      owner, __gql_format_str("{} UNION {}", cmd, _with.cmd));
-}
+////////////////////////////////////////////////////////////////
 
-inline GQL::Vertices
-GQL::Vertices::intersection(const GQL::Vertices &_with) const {
-  return GQL::Vertices(
-      owner,
-      __gql_format_str("{} INTERSECT {}", cmd, _with.cmd));
+inline GQL::Param
+GQL::bounce(const std::string &_cmd,
+            const std::vector<GQL::Param> &_params) {
+  const uint64_t set_id = next_bounce_id++;
+  bouncing = true;
+  try {
+    sql(__gql_format_str("INSERT OR IGNORE INTO gql_bounce "
+                         "(set_id, id) SELECT ?, id FROM ({})",
+                         _cmd),
+        concat({Param(set_id)}, _params));
+  } catch (...) {
+    bouncing = false;
+    throw;
+  }
+  bouncing = false;
+
+  return bounced_set(set_id);
 }
 
-inline GQL::Vertices GQL::Vertices::complement(
-    const GQL::Vertices &_universe) const {
-  return GQL::Vertices(
-      owner,
-      __gql_format_str("SELECT * FROM ({}) WHERE id NOT IN "
-                       "(SELECT id FROM ({}))",
-                       _universe.cmd, cmd));
+inline GQL::Param
+GQL::bounce(const std::vector<uint64_t> &_ids) {
+  const uint64_t set_id = next_bounce_id++;
+  const std::string insert =
+      "INSERT OR IGNORE INTO gql_bounce (set_id, id) "
+      "VALUES (?, ?)";
+
+  // One statement, stepped once per id
+  ++sql_call_counter;
+  bouncing = true;
+  const Timing timing(this, insert, {});
+  bouncing = false;
+  sqlite3_stmt *stmt = prepare(insert);
+  using clock = std::chrono::steady_clock;
+  const auto start =
+      tracing != nullptr ? clock::now() : clock::time_point();
+  for (const auto &id : _ids) {
+    sqlite3_bind_int64(stmt, 1, (int64_t)set_id);
+    sqlite3_bind_int64(stmt, 2, (int64_t)id);
+    finish(stmt, insert, sqlite3_step(stmt));
+  }
+  if (tracing != nullptr) {
+    tracing->step = clock::now() - start;
+  }
+  return bounced_set(set_id);
 }
 
-inline GQL::Vertices
-GQL::Vertices::excluding(const GQL::Vertices &_subgroup) const {
-  return GQL::Vertices(
-      owner,
-      __gql_format_str("SELECT * FROM ({}) WHERE id NOT IN "
-                       "(SELECT id FROM ({}))",
-                       cmd, _subgroup.cmd));
+inline GQL::Param GQL::bounced_set(const uint64_t &_set_id) {
+  Param out(_set_id);
+  const auto handle = self;
+  out.hold = std::shared_ptr<void>(
+      nullptr, [handle, _set_id](void *) {
+        if (*handle == nullptr) {
+          return;
+        }
+        try {
+          (*handle)->sql(
+              "DELETE FROM gql_bounce WHERE set_id = ?",
+              {Param(_set_id)});
+        } catch (std::runtime_error &) {
+          // Leftover rows are harmless: Set ids are never
+          // reused
+        }
+      });
+  return out;
 }
 
-inline GQL::Result GQL::Vertices::label() const {
-  auto raw = owner->sql(
-      __gql_format_str("SELECT id, label AS label FROM "
-                       "({}) ORDER BY id;",
-                       cmd));
+inline std::vector<GQL::Param>
+GQL::concat(const std::vector<GQL::Param> &_l,
+            const std::vector<GQL::Param> &_r) {
+  std::vector<GQL::Param> out;
+  out.reserve(_l.size() + _r.size());
+  out.insert(out.end(), _l.begin(), _l.end());
+  out.insert(out.end(), _r.begin(), _r.end());
+  return out;
+}
 
-  // Hex decode
-  for (uint i = 0; i < raw.body.size(); ++i) {
-    raw.body.at(i).at(1) = hex_decode(raw.body.at(i).at(1));
-  }
-  return raw;
+inline std::string GQL::encode(const std::string &_what) const {
+  return format == HEX ? hex_encode(_what) : _what;
 }
 
-inline GQL::Result
-GQL::Vertices::tag(const std::string &_key) const {
-  auto raw =
-      owner->sql(__gql_format_str("SELECT id, "
-                                  "json_extract(tags, '$.{}') "
-                                  "FROM ({}) ORDER BY id;",
-                                  hex_encode(_key), cmd));
+inline std::string GQL::decode(const std::string &_what) const {
+  return format == HEX ? hex_decode(_what) : _what;
+}
 
-  if (!raw.empty()) {
-    raw.headers.at(1) = _key;
-    for (uint i = 0; i < raw.body.size(); ++i) {
-      raw.body.at(i).at(1) = hex_decode(raw.body.at(i).at(1));
-    }
+inline std::string GQL::encode_name(const std::string &_name,
+                                    const bool &_add) {
+  if (format != DICT) {
+    return encode(_name);
   }
-  return raw;
+  return std::to_string(dict_id(_name, _add));
 }
 
-inline GQL::Result
-GQL::Vertices::tag(const std::list<std::string> &_keys) const {
-  if (_keys.empty()) {
-    return GQL::Result{};
+inline std::string GQL::decode_name(const std::string &_what) {
+  if (format != DICT) {
+    return decode(_what);
   }
+  return dict_text(std::stoll(_what));
+}
 
-  std::string subcommand = "";
-  for (const auto &key : _keys) {
-    if (!subcommand.empty()) {
-      subcommand += ", ";
-    }
-
-    if (key == "id" || key == "label") {
-      subcommand += key;
-    } else {
-      const auto encoded = hex_encode(key);
-      subcommand +=
-          __gql_format_str("json_extract(tags, '$.{}') AS '{}'",
-                           encoded, encoded);
-    }
+inline std::string
+GQL::name_sql(const std::string &_col) const {
+  if (format != DICT) {
+    return _col;
   }
+  return "(SELECT text FROM gql_dict WHERE id = " + _col + ")";
+}
 
-  auto raw = owner->sql(__gql_format_str(
-      "SELECT {} FROM ({}) ORDER BY id;", subcommand, cmd));
-
-  // Titles need decoded unless they are "id" or "label"
-  for (uint i = 0; i < raw.headers.size(); ++i) {
-    const auto title = raw.headers.at(i);
-    if (title != "id" && title != "label") {
-      raw.headers[i] = hex_decode(title);
+inline int64_t GQL::dict_id(const std::string &_name,
+                            const bool &_add) {
+  if (!dict_loaded) {
+    dict_ids.clear();
+    dict_texts.clear();
+    const auto all = table("SELECT id, text FROM gql_dict;");
+    for (size_t i = 0; i < all.size(); ++i) {
+      const int64_t id = all.integers(0)[i];
+      dict_ids.emplace(all.at(i, 1), id);
+      dict_texts.emplace(id, all.at(i, 1));
     }
+    dict_loaded = true;
   }
 
-  // Row entries need decoded unless they are in the "id" column
-  for (uint col = 0; col < raw.headers.size(); ++col) {
-    if (raw.headers.at(col) == "id") {
-      continue;
-    }
+  auto it = dict_ids.find(_name);
+  if (it != dict_ids.end()) {
+    return it->second;
+  }
 
-    for (uint row = 0; row < raw.body.size(); ++row) {
-      raw.body.at(row).at(col) =
-          hex_decode(raw.body.at(row).at(col));
+  // Another connection may have added it since
+  if (is_readonly) {
+    const auto res =
+        table("SELECT id FROM gql_dict WHERE text = ?;",
+              {Param(Param::TEXT, _name)});
+    if (res.empty()) {
+      return -1;
     }
+    const int64_t id = res.integers(0).at(0);
+    dict_ids.emplace(_name, id);
+    dict_texts.emplace(id, _name);
+    return id;
   }
 
-  return raw;
+  if (!_add) {
+    return -1;
+  }
+  const int64_t id =
+      table("INSERT INTO gql_dict (text) VALUES (?) "
+            "RETURNING id;",
+            {Param(Param::TEXT, _name)})
+          .integers(0)
+          .at(0);
+  dict_ids.emplace(_name, id);
+  dict_texts.emplace(id, _name);
+  return id;
 }
 
-inline std::list<std::string> GQL::Vertices::keys() const {
-  auto res = owner->sql(
-      __gql_format_str("SELECT DISTINCT key FROM ({}) JOIN "
-                       "JSON_EACH(tags);",
-                       cmd));
-  std::list<std::string> out;
-
-  for (uint i = 0; i < res.size(); ++i) {
-    out.push_back(hex_decode(res.body[i][0]));
+inline const std::string &GQL::dict_text(const int64_t &_id) {
+  if (!dict_loaded) {
+    dict_id("", false);
   }
-  return out;
+  auto it = dict_texts.find(_id);
+  if (it == dict_texts.end() && is_readonly) {
+    const auto res =
+        table("SELECT text FROM gql_dict WHERE id = ?;",
+              {Param(_id)});
+    if (!res.empty()) {
+      dict_ids.emplace(res.at(0, 0), _id);
+      it = dict_texts.emplace(_id, res.at(0, 0)).first;
+    }
+  }
+  if (it == dict_texts.end()) {
+    throw std::runtime_error(__gql_format_str(
+        "No label or key has id {}.", std::to_string(_id)));
+  }
+  return it->second;
 }
 
-inline std::list<uint64_t> GQL::Vertices::id() const {
-  std::list<uint64_t> out;
-  auto res = owner->sql(__gql_format_str(
-      "SELECT id FROM ({}) ORDER BY id;", cmd));
-  for (const auto &id : res["id"]) {
-    out.push_back(std::stoull(id));
+inline bool GQL::path_safe(const std::string &_key) const {
+  // Hex digits and dictionary ids never need quoting
+  if (format != RAW) {
+    return true;
   }
-  return out;
+  for (const char &c : _key) {
+    if (c == '"' || c == '\\' || (uint8_t)c < 0x20) {
+      return false;
+    }
+  }
+  return true;
 }
 
-inline bool GQL::Vertices::empty() const {
-  return id().empty();
+inline std::string
+GQL::tag_value(const std::string &_key) const {
+  return path_safe(_key) ? "json_extract(tags, ?)"
+                         : "(SELECT value FROM json_each(tags) "
+                           "WHERE key = ?)";
 }
 
-inline bool GQL::Vertices::exists() const {
-  return !empty();
+inline uint64_t
+GQL::nesting(const std::string &_sql) noexcept {
+  uint64_t depth = 0, deepest = 0;
+  for (const char &c : _sql) {
+    if (c == '(') {
+      deepest = std::max(deepest, ++depth);
+    } else if (c == ')' && depth > 0) {
+      --depth;
+    }
+  }
+  return deepest;
 }
 
-inline GQL::Vertices
-GQL::Vertices::label(const std::string &_label) {
-  owner->sql(__gql_format_str(
-      "UPDATE nodes SET label = '{}' WHERE id IN "
-      "(SELECT id FROM ({}))",
-      hex_encode(_label), cmd));
-
-  return *this;
+inline std::string GQL::tag_set(const std::string &_key) const {
+  return path_safe(_key)
+             ? "json_set(tags, ?, ?)"
+             : "json_patch(tags, json_object(?, ?))";
 }
 
-inline GQL::Vertices
-GQL::Vertices::tag(const std::string &_key,
-                   const std::string &_value) {
-  owner->sql(__gql_format_str(
-      "UPDATE nodes SET tags = json_set(tags, '$.{}', '{}') "
-      "WHERE id IN (SELECT id FROM ({}))",
-      hex_encode(_key), hex_encode(_value), cmd));
-
-  return *this;
+inline void GQL::erase_vertices(
+    const std::vector<uint64_t> &_ids) {
+  if (!_ids.empty()) {
+    erase_vertex_set(bounce(_ids));
+  }
 }
 
-inline GQL::Vertices GQL::Vertices::lemma(
-    const std::function<void(GQL::Vertices)> _fn) {
-  _fn(*this);
-  return *this;
+inline void
+GQL::erase_edges(const std::vector<uint64_t> &_ids) {
+  if (!_ids.empty()) {
+    sql("DELETE FROM edges WHERE id IN (SELECT id FROM "
+        "gql_bounce WHERE set_id = ?);",
+        {bounce(_ids)});
+  }
 }
 
-inline void GQL::Vertices::erase() {
-  owner->sql(__gql_format_str("DELETE FROM nodes WHERE id IN "
-                              "(SELECT id FROM ({}));",
-                              cmd));
-
-  // Erase dead edges
-  owner->sql("WITH ids AS (SELECT id FROM nodes) "
-             "DELETE FROM edges WHERE "
-             "source NOT IN ids "
-             "OR target NOT IN ids;");
+inline void GQL::erase_vertex_set(const Param &_set) {
+  // One lookup by source and one by target, each through its
+  // index, rather than checking every edge
+  sql("DELETE FROM edges WHERE source IN (SELECT id FROM "
+      "gql_bounce WHERE set_id = ?);",
+      {_set});
+  sql("DELETE FROM edges WHERE target IN (SELECT id FROM "
+      "gql_bounce WHERE set_id = ?);",
+      {_set});
+  sql("DELETE FROM nodes WHERE id IN (SELECT id FROM "
+      "gql_bounce WHERE set_id = ?);",
+      {_set});
 }
 
-inline GQL::Edges GQL::Vertices::in() const {
-  return GQL::Edges(
-      owner,
-      __gql_format_str("SELECT * FROM edges WHERE target IN "
-                       "(SELECT id FROM ({}))",
-                       cmd));
-}
+inline void GQL::tag_vertices(
+    const std::string &_key,
+    const std::vector<std::pair<uint64_t, std::string>>
+        &_values) {
+  if (_values.empty()) {
+    return;
+  }
 
-inline GQL::Edges GQL::Vertices::out() const {
-  return GQL::Edges(
-      owner,
-      __gql_format_str("SELECT * FROM edges WHERE source IN "
-                       "(SELECT id FROM ({}))",
-                       cmd));
-}
+  // Every value travels in one JSON object keyed by id, which
+  // is already encoded for storage
+  std::string batch = "{";
+  for (const auto &p : _values) {
+    if (batch.size() > 1) {
+      batch += ',';
+    }
+    batch += '"' + std::to_string(p.first) + "\":";
+    batch += json_string(encode(p.second));
+  }
+  batch += '}';
 
-inline GQL::Vertices
-GQL::Vertices::with_in_degree(const uint64_t &_count) const {
-  return GQL::Vertices(
-      owner, __gql_format_str(
-                 "WITH n AS ({}) "
-                 "SELECT id, label, tags FROM ("
-                 "SELECT n.*, COUNT(e.id) AS c "
-                 "FROM n LEFT JOIN (SELECT * FROM edges) e "
-                 "ON e.target = n.id "
-                 "GROUP BY n.id) t "
-                 "WHERE t.c = {}",
-                 cmd, _count));
+  const std::string set =
+      path_safe(_key)
+          ? "json_set(nodes.tags, ?, j.value)"
+          : "json_patch(nodes.tags, json_object(?, j.value))";
+  sql(__gql_format_str(
+          "UPDATE nodes SET tags = {} FROM json_each(?) AS j "
+          "WHERE nodes.id = CAST(j.key AS INTEGER);",
+          set),
+      {key_param(_key, true), Param(Param::TEXT, batch)});
 }
 
-inline GQL::Vertices
-GQL::Vertices::with_out_degree(const uint64_t &_count) const {
-  return GQL::Vertices(
-      owner, __gql_format_str(
-                 "WITH n AS ({}) "
-                 "SELECT id, label, tags FROM ("
-                 "SELECT n.*, COUNT(e.id) AS c "
-                 "FROM n LEFT JOIN (SELECT * FROM edges) e "
-                 "ON e.source = n.id "
-                 "GROUP BY n.id) t "
-                 "WHERE t.c = {}",
-                 cmd, _count));
+inline GQL::Param GQL::key_param(const std::string &_key,
+                                 const bool &_add) {
+  if (_add) {
+    encode_name(_key, true);
+  }
+  return path_safe(_key) ? Param(Param::KEY, _key)
+                         : Param(Param::KEY_NAME, _key);
 }
 
-inline GQL::Result GQL::Vertices::in_degree() const {
-  return owner->sql(__gql_format_str(
-      "WITH n AS ({}) "
-      "SELECT t.id AS id, t.c AS in_degree FROM ("
-      "SELECT n.id AS id, COUNT(e.id) AS c "
-      "FROM n LEFT JOIN (SELECT * FROM edges) e "
-      "ON e.target = n.id "
-      "GROUP BY n.id) t "
-      "ORDER BY id;",
-      cmd));
-}
+inline std::string GQL::json_string(const std::string &_what) {
+  const static char to_hex[] = "0123456789abcdef";
 
-inline GQL::Result GQL::Vertices::out_degree() const {
-  return owner->sql(__gql_format_str(
-      "WITH n AS ({}) "
-      "SELECT t.id AS id, t.c AS out_degree FROM ("
-      "SELECT n.id AS id, COUNT(e.id) AS c "
-      "FROM n LEFT JOIN (SELECT * FROM edges) e "
-      "ON e.source = n.id "
-      "GROUP BY n.id) t "
-      "ORDER BY id;",
-      cmd));
+  std::string out = "\"";
+  out.reserve(_what.size() + 2);
+  for (const char &c : _what) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\b':
+      out += "\\b";
+      break;
+    case '\f':
+      out += "\\f";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      if ((uint8_t)c < 0x20) {
+        out += "\\u00";
+        out += to_hex[(uint8_t)c >> 4];
+        out += to_hex[c & 0b1111];
+      } else {
+        out += c;
+      }
+      break;
+    }
+  }
+  return out + '"';
 }
 
-inline std::list<GQL::Vertices> GQL::Vertices::each() const {
-  std::list<GQL::Vertices> out;
-  for (const auto &id : id()) {
-    out.push_back(owner->v().with_id(id));
+inline std::string GQL::tags_json(
+    const std::map<std::string, std::string> &_tags) {
+  std::string out = "{";
+  for (const auto &p : _tags) {
+    if (out.size() > 1) {
+      out += ',';
+    }
+    out += json_string(encode_name(p.first, true)) + ':' +
+           json_string(encode(p.second));
   }
-  return out;
+  return out + "}";
 }
 
-inline GQL::Edges
-GQL::Vertices::add_edge(const GQL::Vertices &_other) const {
-  owner->sql("INSERT INTO edges (source, target) "
-             "SELECT l.id, r.id " +
-             __gql_format_str("FROM ({}) l CROSS JOIN ({}) r",
-                              cmd, _other.cmd));
+inline void GQL::upgrade_format() {
+  if (format != HEX) {
+    return;
+  }
 
-  return GQL::Edges(
-      owner, __gql_format_str("SELECT * FROM edges "
-                              "WHERE (source, target) IN "
-                              "(SELECT l.id, r.id FROM "
-                              "({}) l CROSS JOIN ({}) r)",
-                              cmd, _other.cmd));
+  sql("SAVEPOINT gql_upgrade;");
+  try {
+    for (const std::string name : {"nodes", "edges"}) {
+      // Page through by id, so that no statement reads the
+      // table while it is being updated
+      Param after(Param::INTEGER, INT64_MIN);
+      while (true) {
+        const auto rows = this->table(
+            __gql_format_str(
+                "SELECT t.id, t.label, j.key, j.value, j.key "
+                "IS NULL FROM (SELECT * FROM {} WHERE id > ? "
+                "ORDER BY id LIMIT ?) AS t LEFT JOIN "
+                "json_each(t.tags) AS j ORDER BY t.id",
+                name),
+            {after, Param(GQL_BULK_BATCH_SIZE)},
+            {false, true, true, true, false});
+        if (rows.empty()) {
+          break;
+        }
+
+        const auto &ids = rows.integers(0);
+        for (size_t i = 0; i < rows.size();) {
+          // Gather every tag of this row
+          std::string tags = "{";
+          size_t j = i;
+          for (; j < rows.size() && ids[j] == ids[i]; ++j) {
+            if (rows.integers(4)[j] != 0) {
+              continue;
+            }
+            if (tags.size() > 1) {
+              tags += ',';
+            }
+            tags += json_string(rows.at(j, 2)) + ':' +
+                    json_string(rows.at(j, 3));
+          }
+          tags += '}';
+
+          sql(__gql_format_str("UPDATE {} SET label = ?, tags "
+                               "= ? WHERE id = ?;",
+                               name),
+              {Param(Param::TEXT, rows.at(i, 1)),
+               Param(Param::TEXT, tags),
+               Param((uint64_t)ids[i])});
+          i = j;
+        }
+        after = Param(Param::INTEGER, ids.back());
+      }
+    }
+
+    sql(__gql_format_str("PRAGMA user_version = {};",
+                         std::to_string(RAW)));
+    format = RAW;
+    sql("RELEASE gql_upgrade;");
+  } catch (...) {
+    sql("ROLLBACK TO gql_upgrade;");
+    invalidate();
+    sql("RELEASE gql_upgrade;");
+    throw;
+  }
 }
 
-////////////////////////////////////////////////////////////////
+inline sqlite3_stmt *GQL::prepare(const std::string &_sql) {
+  check_recording(_sql);
 
-inline GQL::Edges::Edges(GQL *const _owner,
-                         const std::string &_cmd)
-    : owner(_owner), cmd(_cmd) {
-  if (_cmd.size() > GQL_BOUNCE_THRESH) {
-    // Perform query simplification "bounce"
-    auto ids = this->id();
+  // Trailing semicolons and whitespace do not change a
+  // statement, so they are not part of its key
+  size_t n = _sql.size();
+  while (n > 0 && (std::isspace((unsigned char)_sql[n - 1]) ||
+                   _sql[n - 1] == ';')) {
+    --n;
+  }
+  if (n != _sql.size()) {
+    return prepare(_sql.substr(0, n));
+  }
 
-    std::string bounced_cmd =
-        "SELECT * FROM edges WHERE id IN (";
-    if (ids.empty()) {
-      bounced_cmd += ')';
+  // Hit: Move to the front of the LRU list
+  const auto it = stmt_index.find(_sql);
+  if (it != stmt_index.end()) {
+    ++stmt_cache_hits;
+    if (tracing != nullptr) {
+      tracing->cached = true;
     }
-    for (const auto &id : ids) {
-      bounced_cmd += std::to_string(id) + ",";
-    }
-    bounced_cmd.back() = ')';
+    stmt_lru.splice(stmt_lru.begin(), stmt_lru, it->second);
+    return it->second->second;
+  }
 
-    cmd = bounced_cmd;
+  // Miss: Parse and plan
+  using clock = std::chrono::steady_clock;
+  const auto start =
+      tracing != nullptr ? clock::now() : clock::time_point();
+  sqlite3_stmt *stmt = nullptr;
+  const char *tail = nullptr;
+  std::vector<std::string> reads;
+  reading = &reads;
+  const int res = sqlite3_prepare_v3(
+      db, _sql.c_str(), (int)_sql.size() + 1,
+      SQLITE_PREPARE_PERSISTENT, &stmt, &tail);
+  reading = nullptr;
+  if (res != SQLITE_OK) {
+    std::cerr << "In SQL '" << _sql << "':\n";
+    throw std::runtime_error(sqlite3_errmsg(db));
+  }
+  if (tracing != nullptr) {
+    tracing->prepare += clock::now() - start;
   }
-}
 
-inline GQL::Edges GQL::Edges::limit(const uint64_t &_n) const {
-  return GQL::Edges(
-      owner,
-      __gql_format_str("SELECT * FROM ({}) LIMIT {}", cmd, _n));
-}
+  // Only single statements may be cached. Scripts are split
+  // and prepared again by the caller, which counts those misses
+  if (tail != nullptr && *tail != '\0') {
+    sqlite3_finalize(stmt);
+    return nullptr;
+  }
 
-inline GQL::Edges
-GQL::Edges::with_source(const GQL::Vertices &_source) const {
-  return GQL::Edges(
-      owner, __gql_format_str("SELECT * FROM ({}) WHERE "
-                              "source IN (SELECT id FROM ({}))",
-                              cmd, _source.cmd));
-}
+  if (stmt == nullptr) {
+    // Whitespace or comments only
+    return nullptr;
+  }
+  ++stmt_cache_misses;
+
+  // Evict the least-recently used statement
+  if (stmt_lru.size() >= GQL_STMT_CACHE_SIZE) {
+    stmt_reads.erase(stmt_lru.back().second);
+    sqlite3_finalize(stmt_lru.back().second);
+    stmt_index.erase(stmt_lru.back().first);
+    stmt_lru.pop_back();
+  }
 
-inline GQL::Edges
-GQL::Edges::with_target(const GQL::Vertices &_source) const {
-  return GQL::Edges(
-      owner, __gql_format_str("SELECT * FROM ({}) WHERE "
-                              "target IN (SELECT id FROM ({}))",
-                              cmd, _source.cmd));
+  stmt_lru.emplace_front(_sql, stmt);
+  stmt_index[_sql] = stmt_lru.begin();
+  stmt_reads[stmt] = std::move(reads);
+  return stmt;
 }
 
-inline GQL::Edges
-GQL::Edges::with_label(const std::string &_label) const {
-  return GQL::Edges(owner,
-                    __gql_format_str("SELECT * FROM ({}) WHERE "
-                                     "label = '{}'",
-                                     cmd, hex_encode(_label)));
-}
+inline void GQL::bind(sqlite3_stmt *_stmt, const int &_index,
+                      const GQL::Param &_param) {
+  int res = SQLITE_OK;
+  switch (_param.kind) {
+  case Param::INTEGER:
+    res = sqlite3_bind_int64(_stmt, _index, _param.number);
+    break;
+  case Param::TEXT:
+    res = sqlite3_bind_text(_stmt, _index, _param.text.c_str(),
+                            (int)_param.text.size(),
+                            SQLITE_TRANSIENT);
+    break;
+  case Param::KEY: {
+    // Raw keys are quoted, since they may hold path syntax
+    const auto path = format == HEX
+                          ? "$." + encode(_param.text)
+                          : "$.\"" + encode_name(_param.text) + '"';
+    res = sqlite3_bind_text(_stmt, _index, path.c_str(),
+                            (int)path.size(), SQLITE_TRANSIENT);
+    break;
+  }
+  case Param::KEY_NAME: {
+    const auto name = encode_name(_param.text);
+    res = sqlite3_bind_text(_stmt, _index, name.c_str(),
+                            (int)name.size(), SQLITE_TRANSIENT);
+    break;
+  }
+  case Param::LABEL:
+    if (format == DICT) {
+      res = sqlite3_bind_int64(_stmt, _index,
+                               dict_id(_param.text, false));
+      break;
+    }
+    [[fallthrough]];
+  case Param::VALUE: {
+    const auto encoded = encode(_param.text);
+    res = sqlite3_bind_text(_stmt, _index, encoded.c_str(),
+                            (int)encoded.size(),
+                            SQLITE_TRANSIENT);
+    break;
+  }
+  case Param::SLOT:
+    throw std::runtime_error(
+        "Plan slots are only given values by running the plan.");
+  }
 
-inline GQL::Edges
-GQL::Edges::with_tag(const std::string &_key,
-                     const std::string &_value) const {
-  return GQL::Edges(
-      owner, __gql_format_str(
-                 "SELECT * FROM ({}) WHERE "
-                 "json_extract(tags, '$.{}') = '{}'",
-                 cmd, hex_encode(_key), hex_encode(_value)));
+  if (res != SQLITE_OK) {
+    throw std::runtime_error(sqlite3_errmsg(db));
+  }
 }
 
-inline GQL::Edges
-GQL::Edges::with_id(const uint64_t &_id) const {
-  return GQL::Edges(owner,
-                    __gql_format_str("SELECT * FROM ({}) WHERE "
-                                     "id = {}",
-                                     cmd, _id));
-}
+inline void GQL::step(sqlite3_stmt *_stmt,
+                      const std::string &_sql,
+                      GQL::Result &_into) {
+  using clock = std::chrono::steady_clock;
+  int res;
+  clock::time_point start;
+  while (true) {
+    if (tracing != nullptr) {
+      start = clock::now();
+    }
+    res = sqlite3_step(_stmt);
+    if (tracing != nullptr) {
+      const auto stepped = clock::now();
+      tracing->step += stepped - start;
+      start = stepped;
+    }
+    if (res != SQLITE_ROW) {
+      break;
+    }
 
-inline GQL::Edges GQL::Edges::where(
-    const std::function<bool(const GQL::Edges &)> &_fn) {
-  // Set to empty set
-  auto out = excluding(*this);
+    const int n_cols = sqlite3_column_count(_stmt);
+
+    if (_into.headers.empty()) {
+      for (int i = 0; i < n_cols; ++i) {
+        const char *name = sqlite3_column_name(_stmt, i);
+        _into.headers.push_back(name == nullptr ? "NULL"
+                                                : name);
+      }
+    }
 
-  for (const auto &item : each()) {
-    if (_fn(item)) {
-      // Merge in matches
-      out = out.join(item);
+    std::vector<std::string> row;
+    row.reserve(n_cols);
+    for (int i = 0; i < n_cols; ++i) {
+      const auto text = sqlite3_column_text(_stmt, i);
+      if (text == nullptr) {
+        row.push_back("NULL");
+      } else {
+        row.emplace_back((const char *)text,
+                         sqlite3_column_bytes(_stmt, i));
+      }
+    }
+    _into.body.push_back(std::move(row));
+    if (tracing != nullptr) {
+      tracing->read += clock::now() - start;
+      ++tracing->rows;
     }
   }
 
-  return out;
+  finish(_stmt, _sql, res);
 }
 
-inline GQL::Edges
-GQL::Edges::join(const GQL::Edges &_with) const {
-  return GQL::Edges(
-      owner, __gql_format_str("{} UNION {}", cmd, _with.cmd));
-}
+inline void GQL::step(sqlite3_stmt *_stmt,
+                      const std::string &_sql,
+                      GQL::Table &_into,
+                      const std::vector<bool> &_decode) {
+  const int n_cols = sqlite3_column_count(_stmt);
+  if (_into.headers.empty()) {
+    for (int i = 0; i < n_cols; ++i) {
+      const char *name = sqlite3_column_name(_stmt, i);
+      _into.headers.push_back(name == nullptr ? "NULL" : name);
+    }
+    _into.cols.resize(n_cols);
+  }
 
-inline GQL::Edges
-GQL::Edges::intersection(const GQL::Edges &_with) const {
-  return GQL::Edges(owner, __gql_format_str("{} INTERSECT {}",
-                                            cmd, _with.cmd));
-}
+  using clock = std::chrono::steady_clock;
+  int res;
+  clock::time_point start;
+  while (true) {
+    if (tracing != nullptr) {
+      start = clock::now();
+    }
+    res = sqlite3_step(_stmt);
+    if (tracing != nullptr) {
+      const auto stepped = clock::now();
+      tracing->step += stepped - start;
+      start = stepped;
+    }
+    if (res != SQLITE_ROW) {
+      break;
+    }
 
-inline GQL::Edges
-GQL::Edges::complement(const GQL::Edges &_universe) const {
-  return GQL::Edges(
-      owner,
-      __gql_format_str("SELECT * FROM ({}) WHERE id NOT IN "
-                       "(SELECT id FROM ({}))",
-                       _universe.cmd, cmd));
-}
+    _into.append(_stmt, _decode);
+    if (tracing != nullptr) {
+      tracing->read += clock::now() - start;
+      ++tracing->rows;
+    }
+  }
 
-inline GQL::Edges
-GQL::Edges::excluding(const GQL::Edges &_subgroup) const {
-  return GQL::Edges(
-      owner,
-      __gql_format_str("SELECT * FROM ({}) WHERE id NOT IN "
-                       "(SELECT id FROM ({}))",
-                       cmd, _subgroup.cmd));
+  finish(_stmt, _sql, res);
 }
 
-inline GQL::Result GQL::Edges::label() const {
-  auto raw = owner->sql(__gql_format_str(
-      "SELECT id, label FROM ({}) ORDER BY id;", cmd));
+inline void GQL::finish(sqlite3_stmt *_stmt,
+                        const std::string &_sql,
+                        const int &_res) {
+  const std::string err_msg =
+      (_res == SQLITE_DONE) ? "" : sqlite3_errmsg(db);
+  sqlite3_reset(_stmt);
+  sqlite3_clear_bindings(_stmt);
 
-  // Hex decode
-  for (uint i = 0; i < raw.body.size(); ++i) {
-    raw.body.at(i).at(1) = hex_decode(raw.body.at(i).at(1));
+  if (_res != SQLITE_DONE) {
+    std::cerr << "In SQL '" << _sql << "':\n";
+    throw std::runtime_error(err_msg);
   }
-  return raw;
 }
 
-inline GQL::Result
-GQL::Edges::tag(const std::string &_key) const {
-  auto raw =
-      owner->sql(__gql_format_str("SELECT id, "
-                                  "json_extract(tags, '$.{}') "
-                                  "FROM ({}) ORDER BY id;",
-                                  hex_encode(_key), cmd));
-
-  if (!raw.empty()) {
-    raw.headers.at(1) = _key;
-    for (uint i = 0; i < raw.body.size(); ++i) {
-      raw.body.at(i).at(1) = hex_decode(raw.body.at(i).at(1));
+inline void
+GQL::bind_all(sqlite3_stmt *_stmt, const std::string &_sql,
+              const std::vector<Param> &_params) {
+  if ((int)_params.size() !=
+      sqlite3_bind_parameter_count(_stmt)) {
+    std::cerr << "In SQL '" << _sql << "':\n";
+    throw std::runtime_error(
+        "Mismatched number of bound parameters.");
+  }
+  try {
+    for (uint i = 0; i < _params.size(); ++i) {
+      bind(_stmt, i + 1, _params[i]);
     }
+  } catch (...) {
+    sqlite3_clear_bindings(_stmt);
+    throw;
+  }
+}
+
+inline GQL::Table
+GQL::table(const std::string &_stmt,
+           const std::vector<Param> &_params,
+           const std::vector<bool> &_decode,
+           const std::vector<std::string> &_headers) {
+  if (caching_results) {
+    return *shared_table(_stmt, _params, _decode, _headers);
+  }
+  sqlite3_stmt *prepared;
+  return run_table(_stmt, _params, _decode, _headers, prepared);
+}
+
+inline std::shared_ptr<const GQL::Table>
+GQL::shared_table(const std::string &_stmt,
+                  const std::vector<Param> &_params,
+                  const std::vector<bool> &_decode,
+                  const std::vector<std::string> &_headers) {
+  sqlite3_stmt *prepared;
+  if (!caching_results || !cacheable(_stmt)) {
+    return std::make_shared<const Table>(
+        run_table(_stmt, _params, _decode, _headers, prepared));
+  }
+
+  const auto key =
+      cache_key('T', _stmt, _params, _decode, _headers);
+  if (const auto hit = lookup(key)) {
+    return hit->table;
   }
-  return raw;
-}
 
-inline GQL::Result
-GQL::Edges::tag(const std::list<std::string> &_keys) const {
-  if (_keys.empty()) {
-    return GQL::Result{};
+  Cached entry;
+  entry.table = std::make_shared<const Table>(
+      run_table(_stmt, _params, _decode, _headers, prepared));
+  const auto out = entry.table;
+  if (depend(prepared, entry)) {
+    keep(key, std::move(entry));
   }
+  return out;
+}
 
-  std::string subcommand = "";
-  for (const auto &key : _keys) {
-    if (!subcommand.empty()) {
-      subcommand += ", ";
-    }
+inline GQL::Table
+GQL::run_table(const std::string &_stmt,
+               const std::vector<Param> &_params,
+               const std::vector<bool> &_decode,
+               const std::vector<std::string> &_headers,
+               sqlite3_stmt *&_prepared) {
+  ++sql_call_counter;
+  const Timing timing(this, _stmt, _params);
 
-    if (key == "id" || key == "label" || key == "source" ||
-        key == "target") {
-      subcommand += key;
-    } else {
-      subcommand += __gql_format_str(
-          "json_extract(tags, '$.{}')", hex_encode(key));
-    }
+  sqlite3_stmt *stmt = prepare(_stmt);
+  if (stmt == nullptr) {
+    std::cerr << "In SQL '" << _stmt << "':\n";
+    throw std::runtime_error(
+        "Only a single statement can be read into a table.");
+  }
+
+  GQL::Table out;
+  bind_all(stmt, _stmt, _params);
+  step(stmt, _stmt, out,
+       format == HEX ? _decode : std::vector<bool>());
+  if (!_headers.empty()) {
+    out.headers = _headers;
   }
+  _prepared = stmt;
+  return out;
+}
 
-  auto raw = owner->sql(__gql_format_str(
-      "SELECT {} FROM ({}) ORDER BY id;", subcommand, cmd));
+inline GQL::Result GQL::sql(const std::string &_stmt,
+                            const std::vector<Param> &_params) {
+  check_recording(_stmt);
 
-  // Titles need decoded unless they are "id", "source",
-  // "target", or "label"
-  for (uint i = 0; i < raw.headers.size(); ++i) {
-    const auto title = raw.headers.at(i);
-    if (title != "id" && title != "label" &&
-        title != "source" && title != "target") {
-      raw.headers[i] = hex_decode(title);
+  std::string key;
+  if (caching_results && cacheable(_stmt)) {
+    key = cache_key('R', _stmt, _params);
+    if (const auto hit = lookup(key)) {
+      return *hit->result;
     }
   }
 
-  // Row entries need decoded unless they are in the "id",
-  // "source", or "target" columns
-  for (uint col = 0; col < raw.headers.size(); ++col) {
-    if (raw.headers.at(col) == "id" ||
-        raw.headers.at(col) == "source" ||
-        raw.headers.at(col) == "target") {
-      continue;
-    }
+  ++sql_call_counter;
+  const Timing timing(this, _stmt, _params);
 
-    for (uint row = 0; row < raw.body.size(); ++row) {
-      raw.body.at(row).at(col) =
-          hex_decode(raw.body.at(row).at(col));
+  GQL::Result out;
+  sqlite3_stmt *stmt = prepare(_stmt);
+
+  if (stmt != nullptr) {
+    bind_all(stmt, _stmt, _params);
+    step(stmt, _stmt, out);
+    Cached entry;
+    if (!key.empty() && depend(stmt, entry)) {
+      entry.result = std::make_shared<const Result>(out);
+      keep(key, std::move(entry));
     }
+    return out;
   }
 
-  return raw;
-}
+  // Scripts of several statements cannot be cached or bound
+  if (!_params.empty()) {
+    std::cerr << "In SQL '" << _stmt << "':\n";
+    throw std::runtime_error(
+        "Cannot bind parameters to multiple statements.");
+  }
 
-inline std::list<std::string> GQL::Edges::keys() const {
-  auto res = owner->sql(
-      __gql_format_str("SELECT DISTINCT key FROM ({}) JOIN "
-                       "JSON_EACH(tags);",
-                       cmd));
-  std::list<std::string> out;
-  for (uint i = 0; i < res.size(); ++i) {
-    out.push_back(hex_decode(res.body[i][0]));
+  const char *next = _stmt.c_str();
+  while (next != nullptr && *next != '\0') {
+    const char *tail = nullptr;
+    if (sqlite3_prepare_v2(db, next, -1, &stmt, &tail) !=
+        SQLITE_OK) {
+      std::cerr << "In SQL '" << _stmt << "':\n";
+      throw std::runtime_error(sqlite3_errmsg(db));
+    }
+    if (stmt != nullptr) {
+      ++stmt_cache_misses;
+      try {
+        step(stmt, _stmt, out);
+      } catch (...) {
+        sqlite3_finalize(stmt);
+        throw;
+      }
+      sqlite3_finalize(stmt);
+    }
+    next = tail;
   }
+
   return out;
 }
 
-inline std::list<uint64_t> GQL::Edges::id() const {
-  std::list<uint64_t> out;
-  auto res = owner->sql(__gql_format_str(
-      "SELECT id FROM ({}) ORDER BY id;", cmd));
-  for (const auto &id : res["id"]) {
-    out.push_back(std::stoull(id));
+inline void GQL::cache_results(const bool &_on) {
+  if (_on == caching_results) {
+    return;
   }
-  return out;
+  caching_results = _on;
+  result_lru.clear();
+  result_index.clear();
+
+  // Writes are only watched while there is something to keep
+  sqlite3_update_hook(db, _on ? &GQL::on_update : nullptr,
+                      _on ? this : nullptr);
+  invalidate();
 }
 
-inline bool GQL::Edges::empty() const {
-  return id().empty();
+inline void GQL::on_update(void *_self, int, const char *,
+                           const char *_table, sqlite3_int64) {
+  ++((GQL *)_self)->generation(_table);
 }
 
-inline bool GQL::Edges::exists() const {
-  return !empty();
+inline int GQL::on_authorize(void *_self, int _action,
+                             const char *_table, const char *,
+                             const char *, const char *) {
+  GQL *const self = (GQL *)_self;
+  if (_action == SQLITE_READ && self->reading != nullptr &&
+      _table != nullptr) {
+    auto &reads = *self->reading;
+    if (std::find(reads.begin(), reads.end(), _table) ==
+        reads.end()) {
+      reads.emplace_back(_table);
+    }
+  }
+  return SQLITE_OK;
 }
 
-inline GQL::Edges GQL::Edges::label(const std::string &_label) {
-  owner->sql(__gql_format_str(
-      "UPDATE edges SET label = '{}' WHERE id IN "
-      "(SELECT id FROM ({}))",
-      hex_encode(_label), cmd));
+inline void GQL::on_expand(sqlite3_context *_ctx, int,
+                           sqlite3_value **_argv) {
+  // The smallest depths are kept with the constant argument,
+  // which SQLite drops when the statement is reset. If they are
+  // dropped sooner, vertices are merely expanded again.
+  using Depths = std::unordered_map<int64_t, int64_t>;
+  auto *depths = (Depths *)sqlite3_get_auxdata(_ctx, 0);
+  if (depths == nullptr) {
+    sqlite3_set_auxdata(_ctx, 0, new Depths(), [](void *_p) {
+      delete (Depths *)_p;
+    });
+    depths = (Depths *)sqlite3_get_auxdata(_ctx, 0);
+    if (depths == nullptr) {
+      sqlite3_result_int(_ctx, 1);
+      return;
+    }
+  }
 
-  return *this;
+  // Equal depths pass, so that SQLite may call this more than
+  // once for the same row
+  const int64_t depth = sqlite3_value_int64(_argv[2]);
+  auto &best =
+      depths->emplace(sqlite3_value_int64(_argv[1]), depth)
+          .first->second;
+  best = std::min(best, depth);
+  sqlite3_result_int(_ctx, depth == best);
 }
 
-inline GQL::Edges GQL::Edges::tag(const std::string &_key,
-                                  const std::string &_value) {
-  owner->sql(__gql_format_str(
-      "UPDATE edges SET tags = json_set(tags, '$.{}', '{}') "
-      "WHERE id IN (SELECT id FROM ({}))",
-      hex_encode(_key), hex_encode(_value), cmd));
-
-  return *this;
+inline uint64_t &
+GQL::generation(const std::string_view &_table) {
+  // Only a handful of tables are ever written
+  for (auto &p : generations) {
+    if (p.first == _table) {
+      return p.second;
+    }
+  }
+  generations.emplace_back(std::string(_table), 0);
+  return generations.back().second;
 }
 
-inline GQL::Edges
-GQL::Edges::lemma(const std::function<void(GQL::Edges)> _fn) {
-  _fn(*this);
-  return *this;
+inline bool GQL::depend(sqlite3_stmt *_stmt, Cached &_out) {
+  const auto it = stmt_reads.find(_stmt);
+  if (sqlite3_stmt_readonly(_stmt) == 0 ||
+      it == stmt_reads.end()) {
+    return false;
+  }
+  _out.reads.clear();
+  for (const auto &table : it->second) {
+    _out.reads.emplace_back(table, generation(table));
+  }
+  return true;
 }
 
-inline void GQL::Edges::erase() {
-  owner->sql(__gql_format_str("DELETE FROM edges WHERE id IN "
-                              "(SELECT id FROM ({}))",
-                              cmd));
-}
+inline void GQL::invalidate() noexcept {
+  for (auto &p : generations) {
+    ++p.second;
+  }
 
-inline GQL::Vertices GQL::Edges::source() const {
-  return GQL::Vertices(
-      owner, __gql_format_str("SELECT * FROM nodes WHERE id IN "
-                              "(SELECT source AS id FROM ({}))",
-                              cmd));
+  // Rolled-back names may be given new ids
+  dict_loaded = false;
 }
 
-inline GQL::Vertices GQL::Edges::target() const {
-  return GQL::Vertices(
-      owner, __gql_format_str("SELECT * FROM nodes WHERE id IN "
-                              "(SELECT target AS id FROM ({}))",
-                              cmd));
+inline bool GQL::cacheable(const std::string &_sql) {
+  // Bounced sets are never queried twice, and the schema is
+  // not watched
+  if ((_sql.rfind("SELECT", 0) != 0 &&
+       _sql.rfind("WITH", 0) != 0) ||
+      _sql.find("gql_bounce") != std::string::npos ||
+      _sql.find("sqlite_master") != std::string::npos) {
+    return false;
+  }
+  // Another connection may have committed since the last query
+  if (is_readonly) {
+    sqlite3_stmt *prepared;
+    const auto version =
+        run_table("PRAGMA data_version;", {}, {}, {}, prepared)
+            .integers(0)
+            .at(0);
+    if (version != data_version) {
+      data_version = version;
+      invalidate();
+    }
+  }
+  return true;
 }
 
-inline std::list<GQL::Edges> GQL::Edges::each() const {
-  std::list<GQL::Edges> out;
-  for (const auto &id : id()) {
-    out.push_back(owner->e().with_id(id));
+inline std::string
+GQL::cache_key(const char &_kind, const std::string &_sql,
+               const std::vector<Param> &_params,
+               const std::vector<bool> &_decode,
+               const std::vector<std::string> &_headers) {
+  // Lengths prefix each part, so no two queries share a key
+  std::string out(1, _kind);
+  const auto add = [&](const std::string &_part) {
+    out += std::to_string(_part.size());
+    out += ':';
+    out += _part;
+  };
+  add(_sql);
+  for (const auto &p : _params) {
+    out += (char)('0' + p.kind);
+    add(p.kind == Param::INTEGER ? std::to_string(p.number)
+                                 : p.text);
+  }
+  out += '|';
+  for (const auto &d : _decode) {
+    out += d ? '1' : '0';
+  }
+  for (const auto &h : _headers) {
+    add(h);
   }
   return out;
 }
 
-////////////////////////////////////////////////////////////////
+inline const GQL::Cached *GQL::lookup(const std::string &_key) {
+  const auto it = result_index.find(_key);
+  if (it != result_index.end()) {
+    const Cached &entry = it->second->second;
+    bool fresh = true;
+    for (const auto &p : entry.reads) {
+      fresh = fresh && generation(p.first) == p.second;
+    }
+    if (fresh) {
+      ++result_cache_hits;
+      result_lru.splice(result_lru.begin(), result_lru,
+                        it->second);
+      return &entry;
+    }
 
-inline GQL::Vertices GQL::v() {
-  return GQL::Vertices(this, "SELECT * FROM nodes");
+    // Stale
+    result_lru.erase(it->second);
+    result_index.erase(it);
+  }
+  ++result_cache_misses;
+  return nullptr;
 }
 
-inline GQL::Edges GQL::e() {
-  return GQL::Edges(this, "SELECT * FROM edges");
+inline void GQL::keep(const std::string &_key,
+                      Cached &&_entry) {
+  if (result_lru.size() >= GQL_RESULT_CACHE_SIZE) {
+    result_index.erase(result_lru.back().first);
+    result_lru.pop_back();
+  }
+  result_lru.emplace_front(_key, std::move(_entry));
+  result_index[_key] = result_lru.begin();
 }
 
-inline GQL::Vertices GQL::v(const std::string &_where) {
-  return GQL::Vertices(this,
-                       "SELECT * FROM nodes WHERE " + _where);
+inline void
+GQL::trace(const std::function<void(const Trace &)> &_hook) {
+  trace_hook = _hook;
 }
 
-inline GQL::Edges GQL::e(const std::string &_where) {
-  return GQL::Edges(this,
-                    "SELECT * FROM edges WHERE " + _where);
+inline void GQL::collect_stats(const bool &_on) {
+  keeping_stats = _on;
 }
 
-inline GQL::Vertices GQL::add_vertex() {
-  // Add vertex
-  const auto id = next_node_id++;
-  sql(__gql_format_str(
-          "INSERT INTO nodes (id, tags) VALUES ({}, ", id) +
-      "json('{}'));");
-
-  // Return query
-  return v(__gql_format_str("id = {}", id));
+inline std::vector<GQL::QueryStats>
+GQL::slowest(const size_t &_n) const {
+  std::vector<QueryStats> out;
+  out.reserve(stats.size());
+  for (const auto &p : stats) {
+    out.push_back(p.second);
+  }
+  std::sort(out.begin(), out.end(),
+            [](const QueryStats &_l, const QueryStats &_r) {
+              return _l.total > _r.total;
+            });
+  if (out.size() > _n) {
+    out.resize(_n);
+  }
+  return out;
 }
 
-inline GQL::Vertices GQL::add_vertex(const uint64_t &_id) {
-  // Add vertex
-  sql(__gql_format_str(
-          "INSERT INTO nodes (id, tags) VALUES ({}, ", _id) +
-      "json('{}'));");
-
-  // Return query
-  return v(__gql_format_str("id = {}", _id));
+inline void GQL::reset_stats() {
+  stats.clear();
 }
 
-inline GQL::Edges GQL::add_edge(const uint64_t &_source,
-                                const uint64_t &_target) {
-  // Add edge
-  const auto id = next_edge_id++;
-  sql(__gql_format_str(
-          "INSERT INTO edges (id, source, target, tags) "
-          "VALUES ({}, {}, {}, ",
-          id, _source, _target) +
-      "json('{}'));");
+inline std::unique_ptr<GQL::Trace>
+GQL::start_trace(const std::string &_sql,
+                 const std::vector<Param> &_params) const {
+  if (!trace_hook && !keeping_stats) {
+    return nullptr;
+  }
 
-  // Return query
-  return e(__gql_format_str("id = {}", id));
+  auto out = std::make_unique<Trace>();
+  out->sql = _sql;
+  out->bounce = bouncing;
+  out->values.reserve(_params.size());
+  for (const auto &p : _params) {
+    out->values.push_back(p.kind == Param::INTEGER
+                              ? std::to_string(p.number)
+                              : p.text);
+  }
+  return out;
 }
 
-////////////////////////////////////////////////////////////////
-
-inline GQL::Result GQL::sql(const std::string &_stmt) {
-  ++sql_call_counter;
-
-  char *err_msg = nullptr;
-  const static auto callback = [](void *out, int n_cols,
-                                  char **col_vals,
-                                  char **col_names) {
-    GQL::Result *q = (GQL::Result *)out;
-
-    if (q->headers.empty()) {
-      for (int i = 0; i < n_cols; ++i) {
-        if (col_names[i] == nullptr) {
-          q->headers.push_back("NULL");
-        } else {
-          q->headers.push_back(col_names[i]);
-        }
-      }
+inline void GQL::report(const Trace &_trace) noexcept {
+  try {
+    if (keeping_stats) {
+      auto &total = stats[_trace.sql];
+      total.sql = _trace.sql;
+      ++total.calls;
+      total.rows += _trace.rows;
+      total.cached += _trace.cached ? 1 : 0;
+      total.bounces += _trace.bounce ? 1 : 0;
+      total.total += _trace.total();
+      total.worst = std::max(total.worst, _trace.total());
     }
-
-    std::vector<std::string> row;
-    for (int i = 0; i < n_cols; ++i) {
-      if (col_vals[i] == nullptr) {
-        row.push_back("NULL");
-      } else {
-        row.push_back(col_vals[i]);
-      }
+    if (trace_hook) {
+      trace_hook(_trace);
     }
-    q->body.push_back(row);
-
-    return 0;
-  };
+  } catch (...) {
+    // Observers never change the outcome of a query
+  }
+}
 
-  GQL::Result out;
-  auto res =
-      sqlite3_exec(db, _stmt.c_str(), callback, &out, &err_msg);
+inline GQL::Timing::Timing(GQL *const _owner,
+                           const std::string &_sql,
+                           const std::vector<Param> &_params)
+    : owner(_owner), outer(_owner->tracing),
+      trace(_owner->start_trace(_sql, _params)) {
+  owner->tracing = trace.get();
+}
 
-  if (err_msg != NULL || res != SQLITE_OK) {
-    std::cerr << "In SQL '" << _stmt << "':\n";
-    throw std::runtime_error(err_msg);
+inline GQL::Timing::~Timing() {
+  owner->tracing = outer;
+  if (trace) {
+    owner->report(*trace);
   }
-
-  return out;
 }
 
 inline void
 GQL::graphviz(const std::filesystem::path &_filepath) {
-  // Note: Since this uses other functions and does not directly
-  // use SQL calls, we don't have to worry about hex encoding AT
-  // ALL!
-
   const static auto sanitize = [](std::string &_w) -> void {
     for (uint64_t i = 0; i < _w.size(); ++i) {
       switch (_w[i]) {
@@ -1836,6 +9296,20 @@ GQL::graphviz(const std::filesystem::path &_filepath) {
     }
   };
 
+  const static auto xlabel =
+      [](const std::map<std::string, std::string> &_tags) {
+        std::string tags;
+        for (const auto &p : _tags) {
+          if (!tags.empty()) {
+            tags += ",";
+          }
+          tags += "\"" + p.first + "\": \"" + p.second + "\"";
+        }
+        tags = "{" + tags + "}";
+        sanitize(tags);
+        return tags;
+      };
+
   // Open + header
   std::ofstream f(_filepath);
   if (!f.is_open()) {
@@ -1845,74 +9319,486 @@ GQL::graphviz(const std::filesystem::path &_filepath) {
   }
   f << "digraph {\n\tforcelabels=true;\n";
 
-  auto node_data =
-      v().tag(std::list<std::string>{"id", "label"});
-  auto nodes_tags = v().tag(v().keys());
-  auto edge_data = e().tag(
-      std::list<std::string>{"source", "target", "label"});
-  auto edge_tags = e().tag(e().keys());
-
-  // Nodes
-  if (!node_data.body.empty()) {
-    auto id_i = node_data.index_of("id");
-    auto label_i = node_data.index_of("label");
-
-    uint index = 0;
-    for (const auto &node : node_data.body) {
-      auto id = node[id_i];
-      auto label = node[label_i];
-      std::string tags;
-      for (const auto &key : nodes_tags.headers) {
-        if (!tags.empty()) {
-          tags += ",";
-        }
-        tags += "\"" + key + "\": \"" +
-                nodes_tags[key].at(index) + "\"";
+  // Each record is written as soon as it is read, so nothing
+  // but the current row is ever held in memory
+  each_record("SELECT * FROM nodes", {}, false,
+              [&](const Record &_r) {
+                std::string label = _r.label;
+                sanitize(label);
+                f << '\t' << _r.id << " [label=\"" << label
+                  << "\", xlabel=\"" << xlabel(_r.tags)
+                  << "\"];\n";
+              });
+
+  each_record("SELECT * FROM edges", {}, true,
+              [&](const Record &_r) {
+                std::string label = _r.label;
+                sanitize(label);
+                f << '\t' << _r.source << " -> " << _r.target
+                  << " [label=\"" << label << "\", xlabel=\""
+                  << xlabel(_r.tags) << "\"];\n";
+              });
+
+  // Footer + close
+  f << "}\n";
+  f.close();
+}
+
+inline void
+GQL::export_jsonl(const std::filesystem::path &_filepath) {
+  std::ofstream f(_filepath);
+  if (!f.is_open()) {
+    throw std::runtime_error(
+        __gql_format_str("Failed to open output file '{}'.",
+                         _filepath.string()));
+  }
+
+  const auto write = [&](const Record &_r,
+                         const bool &_is_edge) {
+    f << "{\"type\":" << (_is_edge ? "\"edge\"" : "\"vertex\"")
+      << ",\"id\":" << _r.id;
+    if (_is_edge) {
+      f << ",\"source\":" << _r.source
+        << ",\"target\":" << _r.target;
+    }
+    f << ",\"label\":" << json_string(_r.label)
+      << ",\"tags\":{";
+    bool first = true;
+    for (const auto &p : _r.tags) {
+      if (!first) {
+        f << ',';
       }
-      tags = "{" + tags + "}";
+      first = false;
+      f << json_string(p.first) << ':' << json_string(p.second);
+    }
+    f << "}}\n";
+  };
+
+  each_record("SELECT * FROM nodes", {}, false,
+              [&](const Record &_r) { write(_r, false); });
+  each_record("SELECT * FROM edges", {}, true,
+              [&](const Record &_r) { write(_r, true); });
+  f.close();
+}
+
+inline void
+GQL::import_jsonl(const std::filesystem::path &_filepath) {
+  std::ifstream f(_filepath);
+  if (!f.is_open()) {
+    throw std::runtime_error(
+        __gql_format_str("Failed to open input file '{}'.",
+                         _filepath.string()));
+  }
+
+  auto loader = bulk(true);
+  std::string line;
+  uint64_t line_number = 0;
+  Record record;
+  while (std::getline(f, line)) {
+    ++line_number;
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+
+    bool is_edge = false;
+    try {
+      is_edge = read_jsonl(line, record);
+    } catch (const std::exception &_e) {
+      throw std::runtime_error(__gql_format_str(
+          "Line {} of '{}': {}", std::to_string(line_number),
+          _filepath.string(), std::string(_e.what())));
+    }
+
+    if (is_edge && record.id == 0) {
+      loader.edge(record.source, record.target, record.label,
+                  record.tags);
+    } else if (is_edge) {
+      loader.edge(record);
+    } else {
+      loader.vertex(record.id, record.label, record.tags);
+    }
+  }
+  loader.flush();
+}
+
+inline void
+GQL::export_edge_list(const std::filesystem::path &_filepath) {
+  std::ofstream f(_filepath);
+  if (!f.is_open()) {
+    throw std::runtime_error(
+        __gql_format_str("Failed to open output file '{}'.",
+                         _filepath.string()));
+  }
 
-      sanitize(label);
-      sanitize(tags);
+  Cursor rows(this,
+              "SELECT source, target, " + name_sql("label") +
+                  " FROM edges ORDER BY id",
+              {}, {false, false, true});
+  f << "source,target,label\n";
+  for (const auto &row : rows) {
+    f << (uint64_t)row.integer(0) << ','
+      << (uint64_t)row.integer(1) << ',' << csv_field(row[2])
+      << '\n';
+  }
+  f.close();
+}
+
+inline void
+GQL::import_edge_list(const std::filesystem::path &_filepath) {
+  std::ifstream f(_filepath);
+  if (!f.is_open()) {
+    throw std::runtime_error(
+        __gql_format_str("Failed to open input file '{}'.",
+                         _filepath.string()));
+  }
 
-      f << '\t' << id << " [label=\"" << label
-        << "\", xlabel=\"" << tags << "\"];\n";
+  const static auto is_id = [](const std::string &_field) {
+    return !_field.empty() && _field.size() < 20 &&
+           std::all_of(_field.begin(), _field.end(),
+                       [](const char &_c) {
+                         return _c >= '0' && _c <= '9';
+                       });
+  };
 
-      ++index;
+  const uint64_t first_edge = next_edge_id;
+  {
+    auto loader = bulk(true);
+    std::vector<std::string> fields;
+    uint64_t row = 0;
+    while (read_csv_row(f, fields)) {
+      ++row;
+      if (fields.size() == 1 && fields[0].empty()) {
+        continue;
+      } else if (fields.size() < 2 || !is_id(fields[0]) ||
+                 !is_id(fields[1])) {
+        if (row == 1) {
+          // A header
+          continue;
+        }
+        throw std::runtime_error(__gql_format_str(
+            "Row {} of '{}' is not a 'source,target[,label]' "
+            "row.",
+            std::to_string(row), _filepath.string()));
+      }
+      loader.edge(std::stoull(fields[0]),
+                  std::stoull(fields[1]),
+                  fields.size() > 2 ? fields[2] : "");
     }
+    loader.flush();
   }
 
-  // Edges
-  if (!edge_data.body.empty()) {
-    auto source_i = edge_data.index_of("source");
-    auto target_i = edge_data.index_of("target");
-    auto label_i = edge_data.index_of("label");
+  // Add any endpoints which are not yet vertices
+  sql("INSERT OR IGNORE INTO nodes (id) SELECT source FROM "
+      "edges WHERE id >= ? UNION SELECT target FROM edges "
+      "WHERE id >= ?;",
+      {Param(first_edge), Param(first_edge)});
+  advance(next_node_id,
+          std::stoull(sql("SELECT COALESCE(MAX(id), 0) FROM "
+                          "nodes;")
+                          .body.at(0)
+                          .at(0)));
+}
+
+inline std::string GQL::json_unquote(const std::string &_text,
+                                     size_t &_i) {
+  const auto hex4 = [&](const size_t &_at) -> uint32_t {
+    if (_at + 4 > _text.size()) {
+      throw std::runtime_error("Truncated \\u escape.");
+    }
+    uint32_t out = 0;
+    for (size_t j = _at; j < _at + 4; ++j) {
+      const char c = _text[j];
+      out <<= 4;
+      if (c >= '0' && c <= '9') {
+        out |= (uint32_t)(c - '0');
+      } else if (c >= 'a' && c <= 'f') {
+        out |= (uint32_t)(c - 'a' + 10);
+      } else if (c >= 'A' && c <= 'F') {
+        out |= (uint32_t)(c - 'A' + 10);
+      } else {
+        throw std::runtime_error("Invalid \\u escape.");
+      }
+    }
+    return out;
+  };
+
+  std::string out;
+  ++_i;
+  while (_i < _text.size() && _text[_i] != '"') {
+    const char c = _text[_i++];
+    if (c != '\\') {
+      out += c;
+      continue;
+    } else if (_i >= _text.size()) {
+      break;
+    }
 
-    for (const auto &edge : edge_data.body) {
-      auto source = edge[source_i];
-      auto target = edge[target_i];
-      auto label = edge[label_i];
-      std::string tags;
-      for (const auto &item : edge_tags) {
-        if (!tags.empty()) {
-          tags += ",";
+    switch (_text[_i++]) {
+    case '"':
+      out += '"';
+      break;
+    case '\\':
+      out += '\\';
+      break;
+    case '/':
+      out += '/';
+      break;
+    case 'b':
+      out += '\b';
+      break;
+    case 'f':
+      out += '\f';
+      break;
+    case 'n':
+      out += '\n';
+      break;
+    case 'r':
+      out += '\r';
+      break;
+    case 't':
+      out += '\t';
+      break;
+    case 'u': {
+      uint32_t point = hex4(_i);
+      _i += 4;
+
+      // A surrogate pair spells one code point
+      if (point >= 0xD800 && point < 0xDC00 &&
+          _i + 6 <= _text.size() && _text[_i] == '\\' &&
+          _text[_i + 1] == 'u') {
+        const uint32_t low = hex4(_i + 2);
+        if (low >= 0xDC00 && low < 0xE000) {
+          point = 0x10000 + ((point - 0xD800) << 10) +
+                  (low - 0xDC00);
+          _i += 6;
         }
-        tags += std::string("\"") + item.at(0) +
-                std::string("\": \"") + item.at(1) +
-                std::string("\"");
       }
-      tags = "{" + tags + "}";
 
-      sanitize(label);
-      sanitize(tags);
+      // As UTF-8
+      if (point < 0x80) {
+        out += (char)point;
+      } else if (point < 0x800) {
+        out += (char)(0xC0 | (point >> 6));
+        out += (char)(0x80 | (point & 0x3F));
+      } else if (point < 0x10000) {
+        out += (char)(0xE0 | (point >> 12));
+        out += (char)(0x80 | ((point >> 6) & 0x3F));
+        out += (char)(0x80 | (point & 0x3F));
+      } else {
+        out += (char)(0xF0 | (point >> 18));
+        out += (char)(0x80 | ((point >> 12) & 0x3F));
+        out += (char)(0x80 | ((point >> 6) & 0x3F));
+        out += (char)(0x80 | (point & 0x3F));
+      }
+      break;
+    }
+    default:
+      throw std::runtime_error("Invalid escape in a string.");
+    }
+  }
+
+  if (_i >= _text.size()) {
+    throw std::runtime_error("Unterminated string.");
+  }
+  ++_i;
+  return out;
+}
+
+inline bool GQL::read_jsonl(const std::string &_line,
+                            GQL::Record &_out) {
+  size_t i = 0;
+  const auto skip = [&]() {
+    while (i < _line.size() &&
+           std::isspace((unsigned char)_line[i])) {
+      ++i;
+    }
+  };
+  const auto expect = [&](const char &_c) {
+    skip();
+    if (i >= _line.size() || _line[i] != _c) {
+      throw std::runtime_error(__gql_format_str(
+          "Expected '{}'.", std::string(1, _c)));
+    }
+    ++i;
+  };
+  const auto text = [&]() {
+    skip();
+    if (i >= _line.size() || _line[i] != '"') {
+      throw std::runtime_error("Expected a string.");
+    }
+    return json_unquote(_line, i);
+  };
+  const auto number = [&]() -> uint64_t {
+    skip();
+    const size_t start = i;
+    while (i < _line.size() && _line[i] >= '0' &&
+           _line[i] <= '9') {
+      ++i;
+    }
+    if (i == start) {
+      throw std::runtime_error("Expected an unsigned integer.");
+    }
+    return std::stoull(_line.substr(start, i - start));
+  };
+
+  const auto more = [&]() {
+    skip();
+    if (i < _line.size() && _line[i] == ',') {
+      ++i;
+      return true;
+    }
+    return false;
+  };
+
+  _out = Record();
+  std::string type;
+  expect('{');
+  do {
+    const std::string key = text();
+    expect(':');
+    if (key == "type") {
+      type = text();
+    } else if (key == "id") {
+      _out.id = number();
+    } else if (key == "source") {
+      _out.source = number();
+    } else if (key == "target") {
+      _out.target = number();
+    } else if (key == "label") {
+      _out.label = text();
+    } else if (key == "tags") {
+      expect('{');
+      skip();
+      if (i < _line.size() && _line[i] == '}') {
+        ++i;
+        continue;
+      }
+      do {
+        const std::string tag = text();
+        expect(':');
+        _out.tags[tag] = text();
+      } while (more());
+      expect('}');
+    } else {
+      throw std::runtime_error(
+          __gql_format_str("Unknown field '{}'.", key));
+    }
+  } while (more());
+  expect('}');
+  skip();
+
+  if (i != _line.size()) {
+    throw std::runtime_error("Trailing text after the object.");
+  } else if (type != "vertex" && type != "edge") {
+    throw std::runtime_error(
+        "Expected a type of \"vertex\" or \"edge\".");
+  }
+  return type == "edge";
+}
+
+inline std::string GQL::csv_field(const std::string &_what) {
+  if (_what.find_first_of(",\"\r\n") == std::string::npos) {
+    return _what;
+  }
+  std::string out = "\"";
+  for (const char &c : _what) {
+    if (c == '"') {
+      out += '"';
+    }
+    out += c;
+  }
+  return out + '"';
+}
+
+inline bool
+GQL::read_csv_row(std::istream &_in,
+                  std::vector<std::string> &_fields) {
+  _fields.clear();
+  std::string line;
+  if (!std::getline(_in, line)) {
+    return false;
+  }
+
+  std::string field;
+  bool quoted = false;
+  size_t i = 0;
+  while (true) {
+    if (i == line.size()) {
+      if (!quoted) {
+        break;
+      }
+
+      // A line break within a quoted field
+      if (!std::getline(_in, line)) {
+        throw std::runtime_error("Unterminated quoted field.");
+      }
+      field += '\n';
+      i = 0;
+      continue;
+    }
 
-      f << '\t' << source << " -> " << target << " [label=\""
-        << label << "\", xlabel=\"" << tags << "\"];\n";
+    const char c = line[i++];
+    if (quoted) {
+      if (c != '"') {
+        field += c;
+      } else if (i < line.size() && line[i] == '"') {
+        field += '"';
+        ++i;
+      } else {
+        quoted = false;
+      }
+    } else if (c == '"') {
+      quoted = true;
+    } else if (c == ',') {
+      _fields.push_back(field);
+      field.clear();
+    } else if (c != '\r') {
+      field += c;
     }
   }
+  _fields.push_back(field);
+  return true;
+}
 
-  // Footer + close
-  f << "}\n";
-  f.close();
+inline void GQL::each_record(
+    const std::string &_cmd, const std::vector<Param> &_params,
+    const bool &_is_edge,
+    const std::function<void(const Record &)> &_fn) {
+  // One row per tag (or one for an untagged row), grouped by
+  // id
+  Cursor rows(this,
+              __gql_format_str(
+                  "SELECT t.id, {}, {}, {}, j.value "
+                  "FROM ({}) AS t LEFT JOIN json_each(t.tags) "
+                  "AS j ORDER BY t.id",
+                  name_sql("t.label"),
+                  std::string(_is_edge ? "t.source, t.target"
+                                       : "0, 0"),
+                  name_sql("j.key"), _cmd),
+              _params, {false, true, false, false, true, true});
+
+  Record current;
+  bool any = false;
+  for (const auto &row : rows) {
+    const uint64_t id = row.integer(0);
+    if (!any || id != current.id) {
+      if (any) {
+        _fn(current);
+      }
+      current = Record();
+      current.id = id;
+      current.label = row[1];
+      current.source = row.integer(2);
+      current.target = row.integer(3);
+      any = true;
+    }
+    if (!row.is_null(4)) {
+      current.tags[row[4]] = row[5];
+    }
+  }
+  if (any) {
+    _fn(current);
+  }
 }
 
 inline std::ostream &operator<<(std::ostream &_strm,
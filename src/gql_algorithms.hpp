@@ -0,0 +1,741 @@
+/**
+ * @file gql_algorithms.hpp
+ *
+ * @author J Dehmel
+ *
+ * @brief Parallel graph algorithms over a `GQL::Snapshot`. Each
+ * takes a snapshot and returns one value per vertex, indexed by
+ * dense vertex number, which `to_result` or `write_tag` can
+ * then hand back to the graph. All functions are inline here.
+ */
+
+/*
+This software is available via the MIT license, which is
+transcribed below. Feel free to simply copy this header into
+your project with no acknowledgement or citation needed.
+
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+MIT License
+
+Copyright (c) 2024-2025 Jordan Dehmel
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+*/
+
+#pragma once
+
+#include "gql.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @var GQL_ALGORITHM_GRAIN
+ * @brief The number of items a worker thread claims at once.
+ * Smaller grains balance uneven work (e.g. a few high-degree
+ * vertices) better, while larger grains contend less on the
+ * shared counter. Loops over fewer items than this run on the
+ * calling thread. Defaults to 1024.
+ */
+#ifndef GQL_ALGORITHM_GRAIN
+#define GQL_ALGORITHM_GRAIN 1024
+#endif
+
+namespace gql_algorithms {
+
+/// A dense vertex number within a snapshot
+using Index = GQL::Snapshot::Index;
+
+/// The BFS depth of a vertex which was never reached
+const static int64_t UNREACHED = -1;
+
+/**
+ * @brief Call `_fn(begin, end)` upon chunks covering
+ * `[0, _n)`, spread across threads. Chunks are claimed from a
+ * shared counter, so threads which finish early keep taking
+ * work instead of idling behind a static split. The first
+ * exception thrown by any chunk is rethrown here.
+ * @tparam Fn The chunk callback's type
+ * @param _n The number of items
+ * @param _fn The callback, which must be safe to call
+ * concurrently upon disjoint chunks
+ * @param _threads The number of threads, or 0 for one per core
+ */
+template <typename Fn>
+inline void parallel_for(const size_t &_n, const Fn &_fn,
+                         size_t _threads = 0) {
+  if (_threads == 0) {
+    _threads =
+        std::max(1u, std::thread::hardware_concurrency());
+  }
+  const size_t chunks =
+      (_n + GQL_ALGORITHM_GRAIN - 1) / GQL_ALGORITHM_GRAIN;
+  _threads = std::min(_threads, chunks);
+  if (_threads <= 1) {
+    if (_n > 0) {
+      _fn((size_t)0, _n);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next(0);
+  std::exception_ptr error;
+  std::mutex error_lock;
+  const auto work = [&]() {
+    try {
+      size_t begin;
+      while ((begin = next.fetch_add(GQL_ALGORITHM_GRAIN)) <
+             _n) {
+        _fn(begin, std::min(_n, begin + GQL_ALGORITHM_GRAIN));
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> guard(error_lock);
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (size_t i = 1; i < _threads; ++i) {
+    pool.emplace_back(work);
+  }
+  work();
+  for (auto &t : pool) {
+    t.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+/**
+ * @brief Breadth-first search along out-edges. This is
+ * direction-optimizing: Small frontiers push to their
+ * neighbours (top-down), while large ones are found instead by
+ * having each unvisited vertex look for a parent among its
+ * in-edges (bottom-up), which skips most edges of a dense
+ * level.
+ * @param _s The snapshot to search
+ * @param _sources Where the search starts
+ * @param _threads The number of threads, or 0 for one per core
+ * @returns The number of hops from the nearest source, or
+ * `UNREACHED`
+ */
+inline std::vector<int64_t>
+bfs(const GQL::Snapshot &_s, const std::vector<Index> &_sources,
+    const size_t &_threads = 0) {
+  // Switch to bottom-up once the frontier's edges outnumber
+  // 1/ALPHA of the unexplored edges, and back once fewer than
+  // 1/BETA of the vertices are in the frontier
+  const size_t ALPHA = 14, BETA = 24;
+
+  const size_t n = _s.size();
+  std::vector<std::atomic<int64_t>> depth(n);
+  for (auto &d : depth) {
+    d.store(UNREACHED, std::memory_order_relaxed);
+  }
+
+  std::vector<Index> frontier;
+  for (const auto &v : _sources) {
+    if (v >= n) {
+      throw std::runtime_error(
+          "Source is not in the snapshot.");
+    }
+    if (depth[v].exchange(0) == UNREACHED) {
+      frontier.push_back(v);
+    }
+  }
+
+  size_t unexplored = _s.edge_count();
+  bool bottom_up = false;
+  std::mutex next_lock;
+  for (int64_t level = 0; !frontier.empty(); ++level) {
+    size_t frontier_edges = 0;
+    for (const auto &v : frontier) {
+      frontier_edges += _s.out_degree(v);
+    }
+    unexplored -= std::min(unexplored, frontier_edges);
+    if (!bottom_up && frontier_edges > unexplored / ALPHA) {
+      bottom_up = true;
+    } else if (bottom_up && frontier.size() < n / BETA) {
+      bottom_up = false;
+    }
+
+    std::vector<Index> next;
+    const auto gather = [&](std::vector<Index> &_local) {
+      std::lock_guard<std::mutex> guard(next_lock);
+      next.insert(next.end(), _local.begin(), _local.end());
+    };
+
+    if (bottom_up) {
+      parallel_for(
+          n,
+          [&](const size_t &_begin, const size_t &_end) {
+            std::vector<Index> local;
+            for (size_t v = _begin; v < _end; ++v) {
+              if (depth[v].load(std::memory_order_relaxed) !=
+                  UNREACHED) {
+                continue;
+              }
+              for (const auto &u : _s.in((Index)v)) {
+                if (depth[u].load(std::memory_order_relaxed) ==
+                    level) {
+                  depth[v].store(level + 1,
+                                 std::memory_order_relaxed);
+                  local.push_back((Index)v);
+                  break;
+                }
+              }
+            }
+            gather(local);
+          },
+          _threads);
+    } else {
+      parallel_for(
+          frontier.size(),
+          [&](const size_t &_begin, const size_t &_end) {
+            std::vector<Index> local;
+            for (size_t i = _begin; i < _end; ++i) {
+              for (const auto &w : _s.out(frontier[i])) {
+                int64_t expected = UNREACHED;
+                if (depth[w].compare_exchange_strong(
+                        expected, level + 1,
+                        std::memory_order_relaxed)) {
+                  local.push_back(w);
+                }
+              }
+            }
+            gather(local);
+          },
+          _threads);
+    }
+    frontier.swap(next);
+  }
+
+  std::vector<int64_t> out(n);
+  for (size_t v = 0; v < n; ++v) {
+    out[v] = depth[v].load(std::memory_order_relaxed);
+  }
+  return out;
+}
+
+/**
+ * @brief Read a numeric edge tag as one weight per edge of a
+ * snapshot, e.g. for `shortest_paths`
+ * @param _g The graph which the snapshot was taken of
+ * @param _s The snapshot
+ * @param _key The tag which holds each edge's weight
+ * @param _fallback The weight of edges without the tag
+ * @returns The weights, indexed by edge number
+ */
+inline std::vector<double>
+edge_weights(GQL &_g, const GQL::Snapshot &_s,
+             const std::string &_key,
+             const double &_fallback = 1.0) {
+  const auto table = _g.e().table({"id", _key});
+  std::unordered_map<uint64_t, double> by_id;
+  for (size_t i = 0; i < table.size(); ++i) {
+    const auto value = table.at(i, 1);
+    if (value != "NULL") {
+      by_id[table.integers(0)[i]] = std::stod(value);
+    }
+  }
+
+  std::vector<double> out(_s.edge_count(), _fallback);
+  for (size_t e = 0; e < out.size(); ++e) {
+    const auto it = by_id.find(_s.edge_id(e));
+    if (it != by_id.end()) {
+      out[e] = it->second;
+    }
+  }
+  return out;
+}
+
+/**
+ * @brief Weighted single-source shortest paths along
+ * out-edges. Rounds relax every out-edge of the vertices whose
+ * distance changed in the last round, in parallel, until no
+ * distance improves.
+ * @param _s The snapshot to search
+ * @param _source Where paths start
+ * @param _weights The non-negative weight of each edge, by
+ * edge number
+ * @param _threads The number of threads, or 0 for one per core
+ * @returns The length of the shortest path to each vertex, or
+ * infinity if there is none
+ */
+inline std::vector<double>
+shortest_paths(const GQL::Snapshot &_s, const Index &_source,
+               const std::vector<double> &_weights,
+               const size_t &_threads = 0) {
+  const double INF = std::numeric_limits<double>::infinity();
+  const size_t n = _s.size();
+  if (_weights.size() != _s.edge_count()) {
+    throw std::runtime_error("Expected one weight per edge.");
+  }
+  for (const auto &w : _weights) {
+    if (!(w >= 0.0)) {
+      throw std::runtime_error(
+          "Edge weights must be non-negative.");
+    }
+  }
+  if (_source >= n) {
+    throw std::runtime_error("Source is not in the snapshot.");
+  }
+
+  std::vector<std::atomic<double>> dist(n);
+  std::vector<std::atomic<bool>> queued(n);
+  for (size_t v = 0; v < n; ++v) {
+    dist[v].store(INF, std::memory_order_relaxed);
+    queued[v].store(false, std::memory_order_relaxed);
+  }
+  dist[_source].store(0.0);
+
+  std::vector<Index> frontier = {_source};
+  std::mutex next_lock;
+  while (!frontier.empty()) {
+    std::vector<Index> next;
+    parallel_for(
+        frontier.size(),
+        [&](const size_t &_begin, const size_t &_end) {
+          std::vector<Index> local;
+          for (size_t i = _begin; i < _end; ++i) {
+            const Index u = frontier[i];
+            // Clearing the flag must not pass the load below,
+            // or a thread which lowers dist[u] in between would
+            // still see u queued and never requeue it
+            queued[u].exchange(false);
+            const double base = dist[u].load();
+            // Out-edges are numbered contiguously, so their
+            // weights sit alongside their targets
+            const auto targets = _s.out(u);
+            const size_t offset = _s.out_offset(u);
+            for (size_t k = 0; k < targets.size(); ++k) {
+              const Index v = targets[k];
+              const double candidate =
+                  base + _weights[offset + k];
+              double current = dist[v].load();
+              while (candidate < current &&
+                     !dist[v].compare_exchange_weak(current,
+                                                   candidate)) {
+              }
+              if (candidate < current &&
+                  !queued[v].exchange(true)) {
+                local.push_back(v);
+              }
+            }
+          }
+          std::lock_guard<std::mutex> guard(next_lock);
+          next.insert(next.end(), local.begin(), local.end());
+        },
+        _threads);
+    frontier.swap(next);
+  }
+
+  std::vector<double> out(n);
+  for (size_t v = 0; v < n; ++v) {
+    out[v] = dist[v].load(std::memory_order_relaxed);
+  }
+  return out;
+}
+
+/**
+ * @brief PageRank, computed by pulling rank along in-edges so
+ * that each vertex is written by exactly one thread. The rank
+ * of vertices without out-edges is spread evenly.
+ * @param _s The snapshot to rank
+ * @param _damping The probability of following an edge
+ * @param _max_iterations The most rounds to run
+ * @param _tolerance Stop once the ranks move less than this in
+ * total (L1) during a round
+ * @param _threads The number of threads, or 0 for one per core
+ * @returns Each vertex's rank, summing to 1
+ */
+inline std::vector<double>
+pagerank(const GQL::Snapshot &_s, const double &_damping = 0.85,
+         const size_t &_max_iterations = 100,
+         const double &_tolerance = 1e-9,
+         const size_t &_threads = 0) {
+  const size_t n = _s.size();
+  if (n == 0) {
+    return {};
+  }
+
+  std::vector<double> rank(n, 1.0 / n), next(n);
+  std::vector<double> share(n);
+  std::mutex sum_lock;
+  for (size_t it = 0; it < _max_iterations; ++it) {
+    double dangling = 0.0;
+    for (size_t v = 0; v < n; ++v) {
+      const auto degree = _s.out_degree((Index)v);
+      share[v] = degree == 0 ? 0.0 : rank[v] / degree;
+      if (degree == 0) {
+        dangling += rank[v];
+      }
+    }
+
+    const double base =
+        (1.0 - _damping) / n + _damping * dangling / n;
+    double moved = 0.0;
+    parallel_for(
+        n,
+        [&](const size_t &_begin, const size_t &_end) {
+          double local = 0.0;
+          for (size_t v = _begin; v < _end; ++v) {
+            double sum = 0.0;
+            for (const auto &u : _s.in((Index)v)) {
+              sum += share[u];
+            }
+            next[v] = base + _damping * sum;
+            local += std::fabs(next[v] - rank[v]);
+          }
+          std::lock_guard<std::mutex> guard(sum_lock);
+          moved += local;
+        },
+        _threads);
+
+    rank.swap(next);
+    if (moved < _tolerance) {
+      break;
+    }
+  }
+  return rank;
+}
+
+/**
+ * @brief Weakly connected components, found by merging the
+ * endpoints of every edge in parallel within a lock-free
+ * union-find
+ * @param _s The snapshot to split
+ * @param _threads The number of threads, or 0 for one per core
+ * @returns Each vertex's component, named by the smallest
+ * vertex id within it
+ */
+inline std::vector<uint64_t>
+weak_components(const GQL::Snapshot &_s,
+                const size_t &_threads = 0) {
+  const size_t n = _s.size();
+  std::vector<std::atomic<Index>> parent(n);
+  for (size_t v = 0; v < n; ++v) {
+    parent[v].store((Index)v, std::memory_order_relaxed);
+  }
+
+  const auto find = [&](Index _v) {
+    Index p;
+    while ((p = parent[_v].load()) != _v) {
+      // Halve the path as we go
+      const Index gp = parent[p].load();
+      parent[_v].compare_exchange_weak(p, gp);
+      _v = gp;
+    }
+    return _v;
+  };
+
+  // Roots only ever hook onto smaller roots, so every root is
+  // the smallest member of its component
+  parallel_for(
+      n,
+      [&](const size_t &_begin, const size_t &_end) {
+        for (size_t v = _begin; v < _end; ++v) {
+          for (const auto &w : _s.out((Index)v)) {
+            Index a = find((Index)v), b = find(w);
+            while (a != b) {
+              if (a < b) {
+                std::swap(a, b);
+              }
+              Index expected = a;
+              if (parent[a].compare_exchange_strong(expected,
+                                                    b)) {
+                break;
+              }
+              a = find(a);
+              b = find(b);
+            }
+          }
+        }
+      },
+      _threads);
+
+  std::vector<uint64_t> out(n);
+  parallel_for(
+      n,
+      [&](const size_t &_begin, const size_t &_end) {
+        for (size_t v = _begin; v < _end; ++v) {
+          out[v] = _s.id(find((Index)v));
+        }
+      },
+      _threads);
+  return out;
+}
+
+/**
+ * @brief Strongly connected components, by Tarjan's algorithm.
+ * This runs on the calling thread: Its depth-first order does
+ * not split across cores, but it visits every edge only once.
+ * @param _s The snapshot to split
+ * @returns Each vertex's component, named by the smallest
+ * vertex id within it
+ */
+inline std::vector<uint64_t>
+strong_components(const GQL::Snapshot &_s) {
+  const size_t n = _s.size();
+  const Index NONE = std::numeric_limits<Index>::max();
+  std::vector<Index> order(n, NONE), low(n, 0);
+  std::vector<bool> on_stack(n, false);
+  std::vector<Index> stack;
+  std::vector<uint64_t> out(n, 0);
+  Index counter = 0;
+
+  // (vertex, next out-edge to look at) frames replace
+  // recursion, which large graphs would overflow
+  std::vector<std::pair<Index, size_t>> calls;
+  for (size_t root = 0; root < n; ++root) {
+    if (order[root] != NONE) {
+      continue;
+    }
+    calls.emplace_back((Index)root, 0);
+    while (!calls.empty()) {
+      auto &[v, next] = calls.back();
+      if (next == 0 && order[v] == NONE) {
+        order[v] = low[v] = counter++;
+        stack.push_back(v);
+        on_stack[v] = true;
+      }
+
+      const auto targets = _s.out(v);
+      if (next < targets.size()) {
+        const Index w = targets[next++];
+        if (order[w] == NONE) {
+          calls.emplace_back(w, 0);
+        } else if (on_stack[w]) {
+          low[v] = std::min(low[v], order[w]);
+        }
+        continue;
+      }
+
+      // Finished with v
+      const Index done = v;
+      calls.pop_back();
+      if (!calls.empty()) {
+        const Index caller = calls.back().first;
+        low[caller] = std::min(low[caller], low[done]);
+      }
+      if (low[done] == order[done]) {
+        std::vector<Index> members;
+        Index w;
+        do {
+          w = stack.back();
+          stack.pop_back();
+          on_stack[w] = false;
+          members.push_back(w);
+        } while (w != done);
+        const uint64_t name = _s.id(
+            *std::min_element(members.begin(), members.end()));
+        for (const auto &m : members) {
+          out[m] = name;
+        }
+      }
+    }
+  }
+  return out;
+}
+
+/**
+ * @brief Immediate dominators from a root, by the iterative
+ * algorithm of Cooper, Harvey and Kennedy. Vertex `d`
+ * dominates `v` if every path from the root to `v` passes
+ * through `d`, as in a control flow graph. This runs on the
+ * calling thread.
+ * @param _s The snapshot to analyze
+ * @param _root The entry vertex
+ * @returns Each vertex's immediate dominator's id, or nothing
+ * for the root and for vertices it cannot reach
+ */
+inline std::vector<std::optional<uint64_t>>
+dominators(const GQL::Snapshot &_s, const Index &_root) {
+  const size_t n = _s.size();
+  const Index NONE = std::numeric_limits<Index>::max();
+  if (_root >= n) {
+    throw std::runtime_error("Root is not in the snapshot.");
+  }
+
+  // Reverse postorder, from an iterative depth-first search
+  std::vector<Index> postorder;
+  std::vector<Index> post_number(n, NONE);
+  std::vector<bool> seen(n, false);
+  std::vector<std::pair<Index, size_t>> calls = {{_root, 0}};
+  seen[_root] = true;
+  while (!calls.empty()) {
+    auto &[v, next] = calls.back();
+    const auto targets = _s.out(v);
+    if (next < targets.size()) {
+      const Index w = targets[next++];
+      if (!seen[w]) {
+        seen[w] = true;
+        calls.emplace_back(w, 0);
+      }
+      continue;
+    }
+    post_number[v] = (Index)postorder.size();
+    postorder.push_back(v);
+    calls.pop_back();
+  }
+
+  std::vector<Index> idom(n, NONE);
+  idom[_root] = _root;
+  const auto intersect = [&](Index _a, Index _b) {
+    while (_a != _b) {
+      while (post_number[_a] < post_number[_b]) {
+        _a = idom[_a];
+      }
+      while (post_number[_b] < post_number[_a]) {
+        _b = idom[_b];
+      }
+    }
+    return _a;
+  };
+
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto it = postorder.rbegin(); it != postorder.rend();
+         ++it) {
+      const Index v = *it;
+      if (v == _root) {
+        continue;
+      }
+      Index best = NONE;
+      for (const auto &p : _s.in(v)) {
+        if (idom[p] == NONE) {
+          continue;
+        }
+        best = best == NONE ? p : intersect(p, best);
+      }
+      if (best != idom[v]) {
+        idom[v] = best;
+        changed = true;
+      }
+    }
+  }
+
+  std::vector<std::optional<uint64_t>> out(n);
+  for (size_t v = 0; v < n; ++v) {
+    if (v != _root && idom[v] != NONE) {
+      out[v] = _s.id(idom[v]);
+    }
+  }
+  return out;
+}
+
+/**
+ * @brief Format an algorithm result for storage
+ * @param _what The value
+ * @returns Its text, or nothing if there is no value
+ */
+template <typename T>
+inline std::optional<std::string> to_text(const T &_what) {
+  if constexpr (std::is_floating_point<T>::value) {
+    std::ostringstream out;
+    out.precision(std::numeric_limits<T>::max_digits10);
+    out << _what;
+    return out.str();
+  } else {
+    return std::to_string(_what);
+  }
+}
+
+/// @returns The text of an optional value, if it has one
+template <typename T>
+inline std::optional<std::string>
+to_text(const std::optional<T> &_what) {
+  return _what ? to_text(*_what) : std::nullopt;
+}
+
+/**
+ * @brief Present per-vertex values as a result with the
+ * columns "id" and `_name`, one row per vertex by ascending id
+ * @param _s The snapshot which the values came from
+ * @param _name The title of the value column
+ * @param _values One value per vertex
+ * @returns The table, with "NULL" for missing values
+ */
+template <typename T>
+inline GQL::Result to_result(const GQL::Snapshot &_s,
+                             const std::string &_name,
+                             const std::vector<T> &_values) {
+  if (_values.size() != _s.size()) {
+    throw std::runtime_error("Expected one value per vertex.");
+  }
+  GQL::Result out;
+  out.headers = {"id", _name};
+  out.body.reserve(_values.size());
+  for (size_t v = 0; v < _values.size(); ++v) {
+    const auto text = to_text(_values[v]);
+    out.body.push_back({std::to_string(_s.id((Index)v)),
+                        text ? *text : "NULL"});
+  }
+  return out;
+}
+
+/**
+ * @brief Store per-vertex values as a tag, in one UPDATE.
+ * Vertices without a value are left untouched.
+ * @param _g The graph which the snapshot was taken of
+ * @param _s The snapshot which the values came from
+ * @param _key The tag to set
+ * @param _values One value per vertex
+ */
+template <typename T>
+inline void write_tag(GQL &_g, const GQL::Snapshot &_s,
+                      const std::string &_key,
+                      const std::vector<T> &_values) {
+  if (_values.size() != _s.size()) {
+    throw std::runtime_error("Expected one value per vertex.");
+  }
+  std::vector<std::pair<uint64_t, std::string>> batch;
+  batch.reserve(_values.size());
+  for (size_t v = 0; v < _values.size(); ++v) {
+    const auto text = to_text(_values[v]);
+    if (text) {
+      batch.emplace_back(_s.id((Index)v), *text);
+    }
+  }
+  _g.tag_vertices(_key, batch);
+}
+
+} // namespace gql_algorithms
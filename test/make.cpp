@@ -18,14 +18,14 @@ public:
   add_rule(const std::string &_target,
            const std::initializer_list<std::string> &_needs) {
     // If not already present, add
-    if (g.v().with_label(_target).id().empty()) {
+    if (g.v().with_label(_target).empty()) {
       g.add_vertex().label(_target);
     }
 
     // Add dep links
     for (const auto &contributor : _needs) {
       // Ensure existence
-      if (g.v().with_label(contributor).id().empty()) {
+      if (g.v().with_label(contributor).empty()) {
         g.add_vertex().label(contributor);
       }
 
@@ -39,7 +39,7 @@ public:
   std::list<std::string> produce(const std::string &_target) {
     std::list<std::string> out;
 
-    while (!g.v().with_label(_target).id().empty()) {
+    while (!g.v().with_label(_target).empty()) {
       // Get all nodes whose in-degrees
       // are zero
       auto res = g.v().with_in_degree(0);
@@ -45,13 +45,12 @@ int main() {
 
     // Add divisibility edges
     g.v()
-        .where([&](auto v) -> bool {
-          return pow(v.id().front(), 2) <= cur;
+        .filter([&](const auto &r) -> bool {
+          return pow(r.id, 2) <= cur;
         })
-        .where(
-            [&](auto v) { return cur % v.id().front() == 0; })
-        .add_edge(g.v().where(
-            [&](auto v) { return v.id().front() == cur; }));
+        .filter([&](const auto &r) { return cur % r.id == 0; })
+        .add_edge(g.v().filter(
+            [&](const auto &r) { return r.id == cur; }));
   }
 
   // Stop timer
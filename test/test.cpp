@@ -3,13 +3,16 @@ Unit tests for GQL
 */
 
 #include "../src/gql.hpp"
+#include "../src/gql_algorithms.hpp"
 
 #include <cassert>
 #include <filesystem>
+#include <queue>
 #include <set>
 #include <stdexcept>
 #include <string>
 #include <sys/types.h>
+#include <thread>
 
 // If the two vectors do not match, cause a kernel panic
 template <typename L, typename R>
@@ -75,6 +78,44 @@ void test_merge_rows() {
     flag = true;
   }
   assert(flag);
+
+  // Lookups and merges by any column
+  const auto by_buzz = b.index("buzz");
+  assert(by_buzz.size() == 4 && by_buzz.at("buzz40") == 2);
+  GQL::Result c;
+  c.headers = {"fizz", "n"};
+  c.body = {{"fizz98", "3"}, {"fizz1", "1"}, {"fizz23", "2"}};
+  a.merge_rows(c, "fizz");
+  assert_eq(a["n"], std::vector<std::string>{"1", "2", "3"});
+
+  // Tables merge without converting integer keys to text
+  GQL g;
+  for (uint64_t i = 1; i <= 100; ++i) {
+    g.add_vertex(i).label(std::to_string(i % 7)).tag(
+        "sq", std::to_string(i * i));
+  }
+  auto labels = g.v().with_id(5).join(g.v().with_id(64)).table(
+      {"id", "label"});
+  const auto squares = g.v().table({"sq", "id"});
+  labels.merge_rows(squares);
+  assert_eq(labels.headers,
+            std::vector<std::string>{"id", "label", "sq"});
+  assert(labels.at(0, 2) == "25" && labels.at(1, 2) == "4096");
+  assert(labels.text(1, 1) == "1");
+  assert(squares.index().at("64") == 63);
+
+  auto none = g.v().with_label("x").table({"id"});
+  none.merge_rows(squares);
+  assert(none.empty() && none.headers.size() == 2);
+
+  flag = false;
+  try {
+    auto all = g.v().table({"id"});
+    all.merge_rows(labels);
+  } catch (const std::runtime_error &) {
+    flag = true;
+  }
+  assert(flag);
 }
 
 void test_limit() {
@@ -470,6 +511,337 @@ void test_bounce() {
   assert(query.id().front() == max);
 }
 
+void test_bounce_lifetime() {
+  // Exposes the raw SQL interface
+  struct Inspectable : public GQL {
+    using GQL::GQL;
+    uint64_t bounced_rows() {
+      return std::stoull(sql("SELECT COUNT(*) FROM gql_bounce")
+                             .body.at(0)
+                             .at(0));
+    }
+  };
+
+  Inspectable g("foo.db", true);
+  for (uint64_t i = 1; i <= 100; ++i) {
+    g.add_vertex(i).label(i % 3 == 0 ? "fizz" : "none");
+  }
+
+  // Filtering in C++ always bounces
+  std::string long_label(GQL_BOUNCE_THRESH, 'x');
+  auto needs_bounce = [&]() {
+    return g.v()
+        .filter([](const GQL::Record &_r) {
+          return _r.label == "fizz";
+        })
+        .join(g.v().with_label(long_label));
+  };
+
+  std::list<uint64_t> expected;
+  for (uint64_t i = 3; i <= 100; i += 3) {
+    expected.push_back(i);
+  }
+
+  {
+    auto derived = GQL::Vertices(g.v());
+    {
+      const auto bounced = needs_bounce();
+      assert(g.bounced_rows() > 0);
+      assert_eq(bounced.id(), expected);
+      derived = bounced.with_id(99);
+    }
+
+    // The derived query keeps its set alive
+    assert(g.bounced_rows() > 0);
+    assert_eq(derived.id(), std::list<uint64_t>{99});
+  }
+
+  // Every set is released once nothing refers to it
+  assert(g.bounced_rows() == 0);
+
+  // Sets outlive a rollback of the transaction which stored
+  // them, and released sets stay released
+  g.commit();
+  {
+    const auto before = needs_bounce();
+    {
+      const auto released = needs_bounce();
+      g.commit();
+    }
+    const auto bounced = needs_bounce();
+    g.add_vertex(101).label("fizz");
+    g.rollback();
+    assert_eq(before.id(), expected);
+    assert_eq(bounced.id(), expected);
+    assert_eq(bounced.with_id(99).id(),
+              std::list<uint64_t>{99});
+  }
+  assert(g.bounced_rows() == 0);
+
+  // Bounced edge sets work the same way
+  g.add_edge(1, 3).label("a");
+  g.add_edge(3, 6).label("b");
+  auto edges = g.e()
+                   .with_label("a")
+                   .join(g.e().with_label(long_label))
+                   .join(g.e().with_label(long_label));
+  assert_eq(edges.target().id(), std::list<uint64_t>{3});
+}
+
+void test_flatten() {
+  // Exposes the raw SQL interface
+  struct Inspectable : public GQL {
+    using GQL::GQL;
+    uint64_t bounced_rows() {
+      return std::stoull(sql("SELECT COUNT(*) FROM gql_bounce")
+                             .body.at(0)
+                             .at(0));
+    }
+  };
+
+  Inspectable g("foo.db", true);
+  for (uint64_t i = 1; i <= 100; ++i) {
+    g.add_vertex(i).label(i % 15 == 0  ? "fizzbuzz"
+                          : i % 3 == 0 ? "fizz"
+                          : i % 5 == 0 ? "buzz"
+                                       : "none");
+    if (i % 2 == 0) {
+      g.v().with_id(i).tag("n", std::to_string(i));
+    }
+  }
+  for (uint64_t i = 1; i < 100; ++i) {
+    g.add_edge(i, i + 1).label("next");
+  }
+
+  // Chained selections and set operations stay one query
+  const auto fizzbuzz = g.v().with_label("fizzbuzz");
+  const auto fizz = g.v().with_label("fizz").join(fizzbuzz);
+  const auto buzz = g.v().with_label("buzz").join(fizzbuzz);
+  const auto both = fizz.intersection(buzz);
+  assert_eq(both.id(),
+            std::list<uint64_t>{15, 30, 45, 60, 75, 90});
+  assert(fizz.join(buzz).id().size() == 47);
+  assert(fizz.complement(g.v()).id().size() == 67);
+
+  // Untagged vertices are not in a tag's subgroup
+  const auto thirty = g.v().with_tag("n", "30");
+  assert(g.v().excluding(thirty).id().size() == 99);
+  assert_eq(both.excluding(thirty).id(),
+            std::list<uint64_t>{15, 45, 60, 75, 90});
+
+  // Traversals and degrees
+  assert_eq(both.out().with_label("next").target().id(),
+            std::list<uint64_t>{16, 31, 46, 61, 76, 91});
+  assert_eq(g.v().with_in_degree(0).id(),
+            std::list<uint64_t>{1});
+  assert(fizz.with_out_degree(1).id().size() == 33);
+  assert_eq(g.e().with_source(both).with_target(buzz).id(),
+            std::list<uint64_t>{});
+  assert(g.e().with_target(buzz).source().id().size() == 20);
+  assert(g.bounced_rows() == 0);
+
+  // Nested queries combine with flat ones
+  assert(g.v().limit(200).with_label("fizz").id().size() == 27);
+  assert(fizz.join(g.v().limit(3)).id().size() == 35);
+  assert(fizz.intersection(g.v().limit(3)).id().size() == 1);
+}
+
+void test_terminals() {
+  GQL g;
+  for (uint64_t i = 10; i > 0; --i) {
+    g.add_vertex(i).label(i % 2 ? "odd" : "even");
+  }
+  for (uint64_t i = 1; i < 10; ++i) {
+    g.add_edge(i, i + 1).label("next");
+  }
+
+  // Counts, existence and first ids never list the set
+  assert(g.v().count() == 10);
+  assert(g.v().with_label("odd").count() == 5);
+  assert(g.v().with_label("none").count() == 0);
+  assert(g.e().count() == 9);
+  assert(g.e().with_label("none").count() == 0);
+
+  assert(g.v().with_label("even").exists());
+  assert(!g.v().with_label("even").empty());
+  assert(!g.v().with_label("none").exists());
+  assert(g.v().with_label("none").empty());
+  assert(g.e().with_source(g.v().with_id(3)).exists());
+  assert(g.e().with_source(g.v().with_id(10)).empty());
+
+  assert(g.v().with_label("even").first() == 2);
+  assert(!g.v().with_label("none").first().has_value());
+  assert(g.v().with_id(7).out().first().has_value());
+  assert(!g.e().with_label("none").first().has_value());
+
+  // Ids are listed in ascending order
+  const std::vector<uint64_t> odd = {1, 3, 5, 7, 9};
+  assert(g.v().with_label("odd").id() == odd);
+  assert(g.e().id().size() == 9);
+  assert(g.e().id().front() == *g.e().first());
+}
+
+void test_trace() {
+  GQL g;
+  for (uint64_t i = 1; i <= 10; ++i) {
+    g.add_vertex(i).label(i % 2 ? "odd" : "even");
+  }
+
+  std::vector<GQL::Trace> seen;
+  g.trace([&](const GQL::Trace &_t) { seen.push_back(_t); });
+
+  // Each statement reports its text, values and rows
+  assert(g.v().with_label("odd").id().size() == 5);
+  assert(seen.size() == 1);
+  assert(seen[0].sql.find("SELECT") != std::string::npos);
+  assert_eq(seen[0].values, std::vector<std::string>{"odd"});
+  assert(seen[0].rows == 5);
+  assert(!seen[0].bounce);
+
+  // Running the same shape again reuses its statement
+  seen.clear();
+  assert(g.v().with_label("even").id().size() == 5);
+  assert(seen.size() == 1 && seen[0].cached);
+  assert(seen[0].prepare.count() == 0);
+
+  // Bounced sets are flagged
+  seen.clear();
+  const auto some = g.v()
+                        .filter([](const GQL::Record &_r) {
+                          return _r.id < 4;
+                        })
+                        .id();
+  assert(some.size() == 3);
+  assert(std::any_of(seen.begin(), seen.end(),
+                     [](const GQL::Trace &_t) {
+                       return _t.bounce && _t.rows == 0;
+                     }));
+
+  // Cursors report once they finish
+  seen.clear();
+  auto cursor = g.v().stream({"id"});
+  while (!cursor.done()) {
+    cursor.next(3);
+  }
+  assert(seen.size() == 1 && seen[0].rows == 10);
+
+  // Hooks can be removed
+  g.trace(nullptr);
+  seen.clear();
+  g.v().id();
+  assert(seen.empty());
+
+  // Stats total every run of a shape
+  g.collect_stats();
+  for (int i = 0; i < 4; ++i) {
+    g.v().with_id(i + 1).label();
+  }
+  g.v().with_tag("x", "y").id();
+  const auto stats = g.slowest(100);
+  assert(stats.size() == 2);
+  assert(stats[0].total >= stats[1].total);
+  const auto labels =
+      std::find_if(stats.begin(), stats.end(),
+                   [](const GQL::QueryStats &_s) {
+                     return _s.calls == 4;
+                   });
+  assert(labels != stats.end());
+  assert(labels->rows == 4 && labels->cached == 3);
+  assert(labels->worst <= labels->total);
+  assert(g.slowest(1).size() == 1);
+
+  g.reset_stats();
+  assert(g.slowest().empty());
+  g.collect_stats(false);
+  g.v().id();
+  assert(g.slowest().empty());
+}
+
+void test_export() {
+  const std::string odd = "a \"quoted\", comma\nline\té\x01";
+  GQL g;
+  g.add_vertex(1).label(odd).tag(odd, odd).tag("k", "v");
+  g.add_vertex(2).label("plain");
+  g.add_vertex(5);
+  g.reserve_edge_ids(99);
+  g.add_edge(1, 2).label("next").tag("w", "3");
+  g.add_edge(2, 5).label(odd);
+
+  const auto records = [](GQL &_g, const bool &_edges) {
+    std::vector<std::string> out;
+    const auto keep = [&](const GQL::Record &_r) {
+      std::string line = std::to_string(_r.id) + "#" +
+                         std::to_string(_r.source) + ">" +
+                         std::to_string(_r.target) + ":" +
+                         _r.label;
+      for (const auto &p : _r.tags) {
+        line += "|" + p.first + "=" + p.second;
+      }
+      out.push_back(line);
+      return false;
+    };
+    if (_edges) {
+      _g.e().filter(keep);
+    } else {
+      _g.v().filter(keep);
+    }
+    return out;
+  };
+
+  // JSONL keeps every label and tag
+  g.export_jsonl("foo.jsonl");
+  {
+    GQL h;
+    h.import_jsonl("foo.jsonl");
+    assert_eq(h.v().id(), g.v().id());
+    assert_eq(records(h, false), records(g, false));
+    assert_eq(records(h, true), records(g, true));
+  }
+
+  // Malformed lines name their line number
+  {
+    std::ofstream f("foo.jsonl", std::ios::app);
+    f << "\n{\"type\":\"vertex\",\"id\":9,}\n";
+  }
+  try {
+    GQL h;
+    h.import_jsonl("foo.jsonl");
+    assert(false);
+  } catch (const std::runtime_error &_e) {
+    assert(std::string(_e.what()).find("Line 7") == 0);
+  }
+
+  // Edge lists add missing endpoints
+  g.export_edge_list("foo.csv");
+  {
+    GQL h;
+    h.add_vertex(2).label("kept");
+    h.import_edge_list("foo.csv");
+    assert_eq(h.v().id(), std::vector<uint64_t>{1, 2, 5});
+    assert(h.v().with_id(2).label()["label"][0] == "kept");
+    assert_eq(h.e().label()["label"],
+              std::vector<std::string>{"next", odd});
+    assert(h.e().with_label("next").source().first() == 1);
+  }
+
+  // Graphviz has one line per vertex and edge, each holding
+  // only its own tags
+  g.graphviz("foo.dot");
+  std::ifstream f("foo.dot");
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(f, line);) {
+    lines.push_back(line);
+  }
+  assert(lines.front() == "digraph {" && lines.back() == "}");
+  const auto edge = std::find_if(
+      lines.begin(), lines.end(), [](const std::string &_l) {
+        return _l.find("1 -> 2") != std::string::npos;
+      });
+  assert(edge != lines.end());
+  assert(edge->find("w") != std::string::npos);
+  assert(edge->find("\\\"k\\\"") == std::string::npos);
+}
+
 void test_keys() {
   GQL g("foo.db", true);
 
@@ -502,8 +874,1599 @@ void test_hex() {
   }
 }
 
+void test_stmt_cache() {
+  // Exposes the raw SQL interface
+  struct Inspectable : public GQL {
+    using GQL::GQL;
+    using GQL::sql;
+  };
+
+  Inspectable g("foo.db", true);
+
+  for (uint64_t i = 1; i <= 100; ++i) {
+    g.add_vertex(i).label("it's \"quoted\"");
+  }
+
+  // Every insert after the first reuses the same statement
+  const auto misses = g.stmt_cache_misses;
+  const auto hits = g.stmt_cache_hits;
+  for (uint64_t i = 1; i <= 100; ++i) {
+    assert(g.v().with_id(i).id().size() == 1);
+  }
+  assert(g.stmt_cache_misses - misses <= 1);
+  assert(g.stmt_cache_hits - hits >= 99);
+
+  // Scripts count one miss per statement, and are not cached
+  for (int i = 0; i < 2; ++i) {
+    const auto before = g.stmt_cache_misses;
+    g.sql("SELECT 1; SELECT 2;");
+    assert(g.stmt_cache_misses == before + 2);
+  }
+
+  // Bound values are never interpreted as SQL
+  assert(g.v().with_label("it's \"quoted\"").id().size() ==
+         100);
+  assert(g.v().with_label("' OR 1=1 --").id().empty());
+}
+
+void test_bulk() {
+  GQL g("foo.db", true);
+
+  // Chained loading
+  g.bulk()
+      .vertex(1, "first", {{"k", "v"}})
+      .vertex(2, "second")
+      .edge(1, 2, "next", {{"w", "3"}})
+      .flush();
+
+  assert_eq(g.v().id(), std::list<uint64_t>{1, 2});
+  assert(g.v().with_tag("k", "v").id().front() == 1);
+  assert(g.v().with_label("second").id().front() == 2);
+  assert_eq(g.v().with_id(1).out().target().id(),
+            std::list<uint64_t>{2});
+  assert(g.e().with_label("next").tag("w")["w"][0] == "3");
+
+  // Large load with deferred indices, in several batches
+  const uint64_t n = 3 * GQL_BULK_BATCH_SIZE;
+  {
+    auto loader = g.bulk(true);
+    for (uint64_t i = 3; i <= n; ++i) {
+      loader.vertex(i, "bulk").edge(i - 1, i, "next");
+    }
+    loader.flush();
+  }
+  assert(g.v().with_label("bulk").id().size() == n - 2);
+  assert(g.e().with_label("next").id().size() == n - 1);
+  assert(g.v().with_id(n).in().source().id().front() == n - 1);
+
+  // A failed flush leaves nothing behind
+  bool flag = false;
+  try {
+    g.bulk().vertex(n + 1).vertex(1).flush();
+  } catch (std::runtime_error &) {
+    flag = true;
+  }
+  assert(flag);
+  assert(g.v().with_id(n + 1).id().empty());
+}
+
+void test_traverse() {
+  GQL g("foo.db", true);
+
+  // 1 -> 2 -> 3 -> 4 -> 1, plus a labelled branch 2 -> 5
+  for (uint64_t i = 1; i <= 5; ++i) {
+    g.add_vertex(i).label(i % 2 == 0 ? "even" : "odd");
+  }
+  for (uint64_t i = 1; i <= 4; ++i) {
+    g.add_edge(i, i % 4 + 1).label("next");
+  }
+  g.add_edge(2, 5).label("branch");
+
+  // Unlimited traversal (the cycle re-selects the start)
+  assert_eq(g.v().with_id(1).traverse().id(),
+            std::list<uint64_t>{1, 2, 3, 4, 5});
+  assert_eq(g.v().with_id(5).traverse().id(),
+            std::list<uint64_t>{});
+
+  // Depth limits and both orders
+  assert_eq(g.v().with_id(1).traverse(1).id(),
+            std::list<uint64_t>{2});
+  assert_eq(g.v().with_id(1).traverse(2).id(),
+            std::list<uint64_t>{2, 3, 5});
+  assert_eq(g.v().with_id(1).traverse(2, GQL::DFS).id(),
+            std::list<uint64_t>{2, 3, 5});
+  assert(g.v().with_id(1).traverse(0).id().empty());
+
+  // Edge and vertex cases
+  const auto next = g.e().with_label("next");
+  assert_eq(g.v().with_id(1).traverse(next).id(),
+            std::list<uint64_t>{1, 2, 3, 4});
+  assert_eq(g.v()
+                .with_id(1)
+                .traverse(next, g.v().with_label("even"), 3)
+                .id(),
+            std::list<uint64_t>{2, 4});
+
+  // Reverse traversal
+  assert_eq(g.v().with_id(5).r_traverse().id(),
+            std::list<uint64_t>{1, 2, 3, 4});
+  assert_eq(g.v().with_id(5).r_traverse(2).id(),
+            std::list<uint64_t>{1, 2});
+  assert(g.v().with_id(5).r_traverse(next).id().empty());
+
+  // Results can be chained further
+  assert_eq(g.v().with_id(1).traverse(1).out().target().id(),
+            std::list<uint64_t>{3, 5});
+
+  // A cycle 1 -> ... -> 6 -> 1 with a shortcut 1 -> 4: vertices
+  // reached first along the long way are still counted at
+  // their shortest depth, in either order
+  GQL c;
+  for (uint64_t i = 1; i <= 6; ++i) {
+    c.add_vertex(i);
+    c.add_edge(i, i % 6 + 1);
+  }
+  c.add_edge(1, 4);
+  for (const auto order : {GQL::BFS, GQL::DFS}) {
+    assert_eq(c.v().with_id(1).traverse(2, order).id(),
+              std::list<uint64_t>{2, 3, 4, 5});
+    assert_eq(c.v().with_id(1).traverse(3, order).id(),
+              std::list<uint64_t>{2, 3, 4, 5, 6});
+    assert_eq(c.v().with_id(1).traverse(4, order).id(),
+              std::list<uint64_t>{1, 2, 3, 4, 5, 6});
+  }
+
+  // Depths are forgotten between runs of the same statement
+  assert_eq(c.v().with_id(5).traverse(4).id(),
+            std::list<uint64_t>{1, 2, 3, 4, 5, 6});
+
+  // Depths beyond INT64_MAX are not bound as negatives
+  assert_eq(c.v().with_id(1).traverse(GQL::NO_LIMIT - 1).id(),
+            c.v().with_id(1).traverse().id());
+}
+
+void test_table() {
+  GQL g("foo.db", true);
+  g.add_vertex(1).label("a").tag("k", "x");
+  g.add_vertex(2).label("b");
+  g.add_vertex(3).label("c").tag("k", "zz");
+  g.add_edge(1, 2).label("e");
+
+  const auto t = g.v().table({"id", "label", "k"});
+  assert(t.size() == 3);
+  assert(t.is_integer(0));
+  assert(!t.is_integer(1));
+  assert_eq(t.integers("id"), std::vector<int64_t>{1, 2, 3});
+  assert(t.text(0, 1) == "a");
+  assert(t.text(2, 2) == "zz");
+  assert(t.text(1, 2) == "NULL");
+  assert(t.at(1, 0) == "2");
+
+  // Integer columns have no text, and vice versa
+  bool thrown = false;
+  try {
+    t.integers("label");
+  } catch (std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  // The string view matches the row-of-strings view
+  const GQL::Result r = t;
+  assert_eq(r.headers,
+            std::vector<std::string>{"id", "label", "k"});
+  assert_eq(r["k"],
+            std::vector<std::string>{"x", "NULL", "zz"});
+  assert_eq(g.v().tag({"id", "label", "k"})["label"],
+            r["label"]);
+
+  // Edges expose their endpoints as integers
+  const auto e = g.e().table({"source", "target", "label"});
+  assert_eq(e.integers("source"), std::vector<int64_t>{1});
+  assert_eq(e.integers("target"), std::vector<int64_t>{2});
+  assert(e.text(0, 2) == "e");
+
+  // Empty tables keep their headers
+  const auto none = g.v().with_label("q").table({"id"});
+  assert(none.empty());
+  assert(none.integers("id").empty());
+  assert(((GQL::Result)none).empty());
+}
+
+void test_stream() {
+  GQL g("foo.db", true);
+  for (uint64_t i = 1; i <= 10; ++i) {
+    g.add_vertex(i).label(i % 2 == 0 ? "even" : "odd");
+  }
+  g.add_edge(1, 2).tag("w", "5");
+
+  // Row-at-a-time iteration
+  std::vector<uint64_t> ids;
+  std::vector<std::string> labels;
+  auto cursor = g.v().stream({"id", "label"});
+  assert_eq(cursor.headers(),
+            std::vector<std::string>{"id", "label"});
+  for (const auto &row : cursor) {
+    assert(row.size() == 2);
+    assert(row.is_integer(0));
+    ids.push_back(row.integer(0));
+    labels.push_back(row[1]);
+
+    // Other queries may run while a cursor is open
+    assert(g.v().with_id(row.integer(0)).label()["label"][0] ==
+           row[1]);
+  }
+  assert_eq(ids, g.v().id());
+  assert_eq(labels, g.v().label()["label"]);
+  assert(cursor.done());
+
+  // Fixed-size batches
+  auto batches = g.v().with_label("odd").stream({"id"});
+  std::vector<size_t> sizes;
+  while (!batches.done()) {
+    sizes.push_back(batches.next(2).size());
+  }
+  assert_eq(sizes, std::vector<size_t>{2, 2, 1});
+  assert(batches.next(2).empty());
+
+  // Edges, including missing tags
+  auto edges = g.e().stream({"source", "target", "w", "x"});
+  auto it = edges.begin();
+  assert(it != edges.end());
+  assert((*it).integer(0) == 1 && (*it).integer(1) == 2);
+  assert((*it)[2] == "5" && (*it)[3] == "NULL");
+  ++it;
+  assert(it == edges.end());
+
+  // Moving a cursor moves its position
+  auto first = g.v().stream({"id"});
+  assert(first.next(3).size() == 3);
+  auto second = std::move(first);
+  assert(first.done());
+  assert_eq(second.next(100).integers(0),
+            std::vector<int64_t>{4, 5, 6, 7, 8, 9, 10});
+}
+
+void test_filter() {
+  GQL g("foo.db", true);
+  for (uint64_t i = 1; i <= 20; ++i) {
+    auto v = g.add_vertex(i).label(i % 2 == 0 ? "even" : "odd");
+    if (i % 5 == 0) {
+      v.tag("five", std::to_string(i / 5)).tag("other", "x");
+    }
+  }
+  for (uint64_t i = 1; i < 20; ++i) {
+    g.add_edge(i, i + 1).label("next").tag("w",
+                                            std::to_string(i));
+  }
+
+  // Records carry ids, labels and decoded tags
+  const auto small_odd =
+      g.v().filter([](const GQL::Record &_r) {
+        return _r.id < 10 && _r.label == "odd";
+      });
+  assert_eq(small_odd.id(), std::list<uint64_t>{1, 3, 5, 7, 9});
+
+  const auto tagged = g.v().filter([](const GQL::Record &_r) {
+    return _r.tags.size() == 2 && _r.tags.at("five") != "1";
+  });
+  assert_eq(tagged.id(), std::list<uint64_t>{10, 15, 20});
+
+  // The result is an ordinary set, and filters compose
+  assert_eq(tagged.with_label("even")
+                .filter(
+                    [](const auto &_r) { return _r.id > 10; })
+                .id(),
+            std::list<uint64_t>{20});
+  assert(g.v()
+             .filter([](const auto &) { return false; })
+             .empty());
+
+  // Edges also expose their endpoints
+  const auto edges = g.e().filter([](const GQL::Record &_r) {
+    return _r.source % 4 == 0 && _r.target == _r.source + 1 &&
+           _r.tags.at("w") == std::to_string(_r.source);
+  });
+  assert_eq(edges.source().id(),
+            std::list<uint64_t>{4, 8, 12, 16});
+
+  // where() agrees with filter()
+  assert_eq(g.v()
+                .where([](const GQL::Vertices &_v) {
+                  return _v.id().front() % 7 == 0;
+                })
+                .id(),
+            std::list<uint64_t>{7, 14});
+}
+
+void test_tag_index() {
+  const auto add_vertices = [](GQL &_g, const uint64_t &_lo,
+                               const uint64_t &_hi) {
+    for (uint64_t i = _lo; i <= _hi; ++i) {
+      _g.add_vertex(i).tag("mod", std::to_string(i % 3));
+      if (i % 10 == 0) {
+        _g.v().with_id(i).tag("tens", "yes");
+      }
+    }
+  };
+  const auto add_edges = [](GQL &_g) {
+    for (uint64_t i = 1; i < 30; ++i) {
+      _g.add_edge(i, i + 1).tag("parity",
+                                std::to_string(i % 2));
+    }
+  };
+
+  GQL plain("foo.db", true);
+  add_vertices(plain, 1, 30);
+  add_edges(plain);
+  assert(!plain.tags_indexed());
+
+  // Index part of the way through, so both old and new tags
+  // are covered
+  GQL g("maker.db", true);
+  add_vertices(g, 1, 15);
+  g.index_tags();
+  assert(g.tags_indexed());
+  add_vertices(g, 16, 30);
+  add_edges(g);
+
+  // Indexed and unindexed graphs agree
+  assert_eq(g.v().with_tag("mod", "1").id(),
+            plain.v().with_tag("mod", "1").id());
+  assert_eq(g.v().with_tag("tens", "yes").id(),
+            std::list<uint64_t>{10, 20, 30});
+  assert_eq(g.v().tag("tens")["tens"],
+            plain.v().tag("tens")["tens"]);
+  assert_eq(g.e().with_tag("parity", "0").id(),
+            plain.e().with_tag("parity", "0").id());
+  assert_eq(g.e().tag("parity")["parity"],
+            plain.e().tag("parity")["parity"]);
+
+  auto keys = g.v().keys();
+  keys.sort();
+  assert_eq(keys, std::list<std::string>{"mod", "tens"});
+  assert_eq(g.v().with_id(1).keys(),
+            std::list<std::string>{"mod"});
+
+  // Overwriting and erasing keep the index up to date
+  g.v().with_id(10).tag("tens", "no");
+  assert_eq(g.v().with_tag("tens", "yes").id(),
+            std::list<uint64_t>{20, 30});
+  g.v().with_id(20).erase();
+  assert_eq(g.v().with_tag("tens", "yes").id(),
+            std::list<uint64_t>{30});
+
+  // Detected when reopened
+  g.commit();
+  GQL reopened("maker.db");
+  assert(reopened.tags_indexed());
+  assert_eq(reopened.v().with_tag("tens", "yes").id(),
+            std::list<uint64_t>{30});
+
+  // Undone by a rollback
+  GQL undone;
+  add_vertices(undone, 1, 30);
+  undone.commit();
+  undone.index_tags();
+  assert(undone.tags_indexed());
+  undone.rollback();
+  assert(!undone.tags_indexed());
+  assert_eq(undone.v().with_tag("tens", "yes").id(),
+            std::list<uint64_t>{10, 20, 30});
+}
+
+void check_odd_text(const GQL::Format &_format) {
+  GQL::Options options;
+  options.format = _format;
+  GQL g("foo.db", true, true, options);
+  assert(g.storage_format() == _format);
+
+  // Text which JSON and JSON paths would otherwise choke on
+  const std::string key = "a.b [c] $d \u00e9";
+  const std::string value = "say \"hi\"\n\ttab \u00e9";
+  g.add_vertex(1).label("l\"1").tag(key, value).tag("k", "v");
+  g.add_vertex(2).label("l2").tag(key, "other");
+  g.add_edge(1, 2).label("e").tag(key, value);
+  g.bulk().vertex(3, "l3", {{key, value}}).flush();
+
+  assert_eq(g.v().with_tag(key, value).id(),
+            std::list<uint64_t>{1, 3});
+  assert_eq(g.v().tag(key)[key],
+            std::vector<std::string>{value, "other", value});
+  assert(g.v().with_id(1).label()["label"][0] == "l\"1");
+  assert_eq(g.v().with_label("l\"1").id(),
+            std::list<uint64_t>{1});
+  assert_eq(g.e().with_tag(key, value).id(),
+            std::list<uint64_t>{1});
+
+  auto keys = g.v().with_id(1).keys();
+  keys.sort();
+  assert_eq(keys, std::list<std::string>{key, "k"});
+
+  assert_eq(g.v()
+                .filter([&](const GQL::Record &_r) {
+                  return _r.tags.count(key) != 0 &&
+                         _r.tags.at(key) == value;
+                })
+                .id(),
+            std::list<uint64_t>{1, 3});
+
+  // Keys which cannot be JSON paths are still supported
+  for (const auto &odd : {"a\"b", "a\\b", "a\nb"}) {
+    g.v().with_id(2).tag(odd, "1").tag(odd, "2");
+    assert_eq(g.v().with_id(2).tag(odd)[odd],
+              std::vector<std::string>{"2"});
+    assert_eq(g.v().with_tag(odd, "2").id(),
+              std::list<uint64_t>{2});
+  }
+  g.bulk().vertex(4, "", {{"a\"b", "3"}}).flush();
+  const std::list<std::string> quoted = {"id", "a\"b"};
+  assert_eq(g.v().tag(quoted)["a\"b"],
+            std::vector<std::string>{"NULL", "2", "NULL", "3"});
+  assert(g.v().with_id(2).keys().size() == 4);
+}
+
+void test_raw_format() {
+  check_odd_text(GQL::RAW);
+}
+
+void test_dict_format() {
+  check_odd_text(GQL::DICT);
+
+  // New graphs store labels and keys as small integers
+  {
+    GQL g("foo.db", true);
+    assert(g.storage_format() == GQL::DICT);
+    for (uint64_t i = 1; i <= 10; ++i) {
+      g.add_vertex(i).label(i % 2 ? "STATEMENT" : "AST").tag(
+          "kind", "x");
+    }
+    g.add_vertex(11);
+    g.add_edge(1, 2).label("TRUE");
+    assert(g.v().with_label("STATEMENT").count() == 5);
+    assert(g.v().with_label("").count() == 1);
+    assert(g.v().with_label("missing").empty());
+    assert(g.e().label()["label"][0] == "TRUE");
+    assert(g.snapshot().label(0) == "TRUE");
+    assert_eq(g.v().with_id(1).keys(),
+              std::list<std::string>{"kind"});
+    assert(g.v().table({"label"}).text(1, 0) == "AST");
+
+    // A rolled-back name may be reused with another id
+    g.commit();
+    g.v().with_id(3).label("gone");
+    g.rollback();
+    g.e().label("ELSE");
+    assert(g.e().with_label("ELSE").count() == 1);
+    assert(g.v().with_label("gone").empty());
+    g.commit();
+
+    // Readers resolve names added after they opened
+    auto r = GQL::open_readonly("foo.db");
+    assert(r->v().with_label("AST").count() == 5);
+    g.v().with_id(11).label("NEW");
+    g.commit();
+    assert(r->v().with_label("NEW").label()["label"][0] ==
+           "NEW");
+  }
+  sqlite3 *db = nullptr;
+  sqlite3_open("foo.db", &db);
+  sqlite3_stmt *stmt = nullptr;
+  sqlite3_prepare_v2(db,
+                     "SELECT COUNT(*) FROM nodes WHERE "
+                     "typeof(label) != 'integer';",
+                     -1, &stmt, nullptr);
+  assert(sqlite3_step(stmt) == SQLITE_ROW);
+  assert(sqlite3_column_int(stmt, 0) == 0);
+  sqlite3_finalize(stmt);
+  sqlite3_close(db);
+
+  // Names survive reopening
+  GQL g("foo.db");
+  assert(g.storage_format() == GQL::DICT);
+  assert(g.v().with_label("NEW").id().front() == 11);
+  assert(g.v().with_tag("kind", "x").count() == 10);
+}
+
+void test_hex_format() {
+  // Build a database in the old, hex-encoded layout
+  {
+    GQL::Options options;
+    options.format = GQL::RAW;
+    GQL g("foo.db", true, true, options);
+    g.add_vertex(1);
+    g.add_vertex(2);
+    g.add_edge(1, 2);
+  }
+  sqlite3 *db = nullptr;
+  sqlite3_open("foo.db", &db);
+  const std::string script =
+      "UPDATE nodes SET label = '" + hex_encode("first") +
+      "', tags = '{\"" + hex_encode("x.y") + "\":\"" +
+      hex_encode("1") + "\"}' WHERE id = 1; UPDATE edges SET " +
+      "label = '" + hex_encode("edge") + "'; PRAGMA " +
+      "user_version = 0;";
+  assert(sqlite3_exec(db, script.c_str(), nullptr, nullptr,
+                      nullptr) == SQLITE_OK);
+  sqlite3_close(db);
+
+  // Old databases stay readable and writable
+  {
+    GQL g("foo.db");
+    assert(g.storage_format() == GQL::HEX);
+    assert(g.v().with_id(1).label()["label"][0] == "first");
+    assert_eq(g.v().with_tag("x.y", "1").id(),
+              std::list<uint64_t>{1});
+    g.v().with_id(2).tag("x.y", "2").label("second");
+    g.tag_vertices("z", {{1, "3"}, {2, "4"}});
+    assert_eq(g.v().tag("z")["z"],
+              std::vector<std::string>{"3", "4"});
+    assert_eq(g.v().tag("x.y")["x.y"],
+              std::vector<std::string>{"1", "2"});
+
+    // Then they can be upgraded in place
+    g.upgrade_format();
+    assert(g.storage_format() == GQL::RAW);
+    assert_eq(g.v().label()["label"],
+              std::vector<std::string>{"first", "second"});
+    assert_eq(g.v().tag("x.y")["x.y"],
+              std::vector<std::string>{"1", "2"});
+    assert_eq(g.v().with_id(2).keys(),
+              std::list<std::string>{"x.y", "z"});
+    assert(g.e().label()["label"][0] == "edge");
+  }
+
+  GQL g("foo.db");
+  assert(g.storage_format() == GQL::RAW);
+  assert_eq(g.v().with_tag("x.y", "2").id(),
+            std::list<uint64_t>{2});
+}
+
+void test_options() {
+  // In-memory databases report their own journal
+  {
+    GQL g;
+    assert(g.options().journal_mode == "MEMORY");
+  }
+
+  // Presets are applied at open and can be read back
+  {
+    GQL g("foo.db", true, false, GQL::Options::read_heavy());
+    const auto o = g.options();
+    assert(o.journal_mode == "WAL");
+    assert(o.synchronous == "NORMAL");
+    assert(o.temp_store == "MEMORY");
+    assert(o.mmap_size == 1LL << 30);
+    assert(o.cache_size == -65536);
+    g.add_vertex(1);
+    g.commit();
+    assert(std::filesystem::exists("foo.db-wal"));
+  }
+
+  // Non-persistent databases take their journals with them
+  assert(!std::filesystem::exists("foo.db"));
+  assert(!std::filesystem::exists("foo.db-wal"));
+
+  // Page sizes apply to new files
+  {
+    GQL::Options opts = GQL::Options::bulk_load();
+    opts.page_size = 8192;
+    opts.synchronous = "off";
+    GQL g("foo.db", true, true, opts);
+    assert(g.options().page_size == 8192);
+    assert(g.options().synchronous == "OFF");
+    g.add_vertex(1);
+  }
+
+  // Settings are per-connection, so reopening with the
+  // defaults keeps the file but not the tuning
+  {
+    GQL g("foo.db");
+    assert(g.options().journal_mode == "WAL");
+    assert(g.options().page_size == 8192);
+    assert(g.options().synchronous == "FULL");
+    assert(g.v().id().size() == 1);
+  }
+
+  // Unknown values are refused before reaching SQL
+  GQL::Options bad;
+  bad.journal_mode = "WAL; DROP TABLE nodes";
+  bool threw = false;
+  try {
+    GQL g("foo.db", false, true, bad);
+  } catch (std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+}
+
+void test_readonly() {
+  GQL w("foo.db", true, true, GQL::Options::durable());
+  for (uint64_t i = 0; i < 200; ++i) {
+    w.add_vertex(i).tag("parity", std::to_string(i % 2));
+  }
+  w.commit();
+
+  // Readers see only what has been committed
+  auto r = GQL::open_readonly("foo.db");
+  assert(r->readonly() && !w.readonly());
+  assert(r->v().id().size() == 200);
+  w.add_vertex(200);
+  assert(r->v().id().size() == 200);
+  w.commit();
+  assert(r->v().id().size() == 201);
+
+  // Queries which use temporary tables still work
+  assert(r->v()
+             .where([](auto v) {
+               return v.tag("parity")["parity"][0] == "1";
+             })
+             .id()
+             .size() == 100);
+
+  // Writes do not
+  bool threw = false;
+  try {
+    r->add_vertex(500);
+  } catch (std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+  r->commit();
+  assert(r->v().id().size() == 201);
+
+  // Missing or foreign files are refused
+  threw = false;
+  try {
+    GQL::open_readonly("does_not_exist.db");
+  } catch (std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+
+  // Many threads may read through a pool while the writer
+  // keeps going
+  GQL::Pool pool("foo.db", 3);
+  assert(pool.size() == 3);
+  std::vector<std::thread> threads;
+  std::vector<size_t> seen(8);
+  for (size_t t = 0; t < seen.size(); ++t) {
+    threads.emplace_back([&, t]() {
+      for (size_t i = 0; i < 20; ++i) {
+        auto h = pool.acquire();
+        seen[t] = std::max(
+            seen[t],
+            h->v().with_tag("parity", "0").id().size());
+      }
+    });
+  }
+  for (uint64_t i = 201; i < 300; ++i) {
+    w.add_vertex(i).tag("parity", std::to_string(i % 2));
+  }
+  w.commit();
+  for (auto &t : threads) {
+    t.join();
+  }
+  for (const auto &n : seen) {
+    assert(n == 100 || n == 149);
+  }
+  assert(pool.acquire()->v().id().size() == 300);
+}
+
+void test_snapshot() {
+  GQL g;
+  for (const uint64_t id : {30, 10, 40, 20}) {
+    g.add_vertex(id);
+  }
+  g.add_edge(10, 20).label("a");
+  g.add_edge(10, 30).label("b");
+  g.add_edge(20, 30).label("a");
+  g.add_edge(30, 10).label("c");
+
+  const auto s = g.snapshot();
+  assert(s.size() == 4 && s.edge_count() == 4);
+  assert(s.has_labels());
+
+  // Dense numbers follow ascending ids
+  const auto a = s.index(10), b = s.index(20), c = s.index(30),
+             d = s.index(40);
+  assert(a == 0 && b == 1 && c == 2 && d == 3);
+  assert(s.id(c) == 30);
+
+  assert_eq(s.out(a), std::vector<uint32_t>{b, c});
+  assert_eq(s.in(c), std::vector<uint32_t>{a, b});
+  assert(s.out(d).empty() && s.in(d).empty());
+  assert(s.out_degree(a) == 2 && s.in_degree(a) == 1);
+
+  // Set navigation mirrors Vertices::out / Edges::target
+  const auto from_a = s.out(std::vector<uint32_t>{a});
+  assert_eq(s.target(from_a), std::vector<uint32_t>{b, c});
+  assert_eq(s.source(s.in(std::vector<uint32_t>{c})),
+            std::vector<uint32_t>{a, b});
+  for (const auto &e : from_a) {
+    assert(s.source(e) == a);
+  }
+  assert(s.label(from_a[0]) == "a" &&
+         s.label(from_a[1]) == "b");
+  assert(s.label_id(from_a[0]) ==
+         s.label_id(s.in(std::vector<uint32_t>{c})[1]));
+  assert(s.labels().size() == 3);
+
+  // Results map back into the graph
+  assert_eq(s.vertices(s.target(from_a)).id(),
+            g.v().with_id(10).out().target().id());
+  assert_eq(s.edges(from_a).label()["label"],
+            std::vector<std::string>{"a", "b"});
+  assert_eq(s.index(g.v().with_id(20).out().target()),
+            std::vector<uint32_t>{c});
+
+  // Later writes are not seen
+  g.add_edge(40, 10);
+  assert(s.in(d).empty() && s.out(d).empty());
+
+  bool threw = false;
+  try {
+    s.index(50);
+  } catch (std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+
+  // Labels are optional
+  const auto bare = g.snapshot(false);
+  assert(!bare.has_labels() && bare.edge_count() == 5);
+  assert_eq(bare.in(a), std::vector<uint32_t>{c, d});
+  threw = false;
+  try {
+    bare.label(0);
+  } catch (std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+  assert(GQL().snapshot().size() == 0);
+  assert(s.dangling_edges() == 0);
+
+  // Edges to or from missing vertices are left out
+  g.add_edge(20, 99).label("a");
+  g.bulk().edge(98, 10, "b").flush();
+  const auto partial = g.snapshot();
+  assert(partial.size() == 4 && partial.edge_count() == 5);
+  assert(partial.dangling_edges() == 2);
+  assert_eq(partial.out(b), std::vector<uint32_t>{c});
+  assert_eq(partial.in(a), std::vector<uint32_t>{c, d});
+}
+
+void test_algorithms() {
+  namespace ga = gql_algorithms;
+
+  // A control flow graph: 1 -> {2, 3} -> 4 -> 5 -> 4, and an
+  // unreachable 6 -> 5
+  GQL g;
+  g.bulk()
+      .vertex(1)
+      .vertex(2)
+      .vertex(3)
+      .vertex(4)
+      .vertex(5)
+      .vertex(6)
+      .edge(1, 2, "T", {{"w", "1"}})
+      .edge(1, 3, "F", {{"w", "5"}})
+      .edge(2, 4, "e", {{"w", "1"}})
+      .edge(3, 4, "e", {{"w", "0.5"}})
+      .edge(4, 5, "e")
+      .edge(5, 4, "e")
+      .edge(6, 5, "e")
+      .flush();
+  const auto s = g.snapshot();
+  const auto v = [&](const uint64_t &_id) { return s.index(_id); };
+
+  assert_eq(ga::bfs(s, {v(1)}),
+            std::vector<int64_t>{0, 1, 1, 2, 3, ga::UNREACHED});
+
+  const auto dist = ga::shortest_paths(
+      s, v(1), ga::edge_weights(g, s, "w", 1.0));
+  assert(dist[v(4)] == 2.0 && dist[v(5)] == 3.0);
+  assert(std::isinf(dist[v(6)]));
+
+  const auto idom = ga::dominators(s, v(1));
+  assert(!idom[v(1)] && !idom[v(6)]);
+  assert(*idom[v(2)] == 1 && *idom[v(3)] == 1);
+  assert(*idom[v(4)] == 1 && *idom[v(5)] == 4);
+
+  assert_eq(ga::strong_components(s),
+            std::vector<uint64_t>{1, 2, 3, 4, 4, 6});
+  assert_eq(ga::weak_components(s),
+            std::vector<uint64_t>{1, 1, 1, 1, 1, 1});
+
+  // Results go back to the graph in one UPDATE
+  const auto rank = ga::pagerank(s);
+  double total = 0.0;
+  for (const auto &r : rank) {
+    total += r;
+  }
+  assert(std::fabs(total - 1.0) < 1e-9);
+  assert(rank[v(4)] > rank[v(2)] && rank[v(2)] > rank[v(6)]);
+  ga::write_tag(g, s, "rank", rank);
+  ga::write_tag(g, s, "idom", idom);
+  assert(std::stod(g.v().with_id(4).tag("rank")["rank"][0]) ==
+         rank[v(4)]);
+  assert(g.v().with_tag("idom", "4").id().front() == 5);
+  assert(g.v().with_id(1).tag("idom")["idom"][0] == "NULL");
+  g.tag_vertices("odd\"key", {{1, "x"}, {2, "y"}});
+  assert(g.v().with_tag("odd\"key", "y").id().front() == 2);
+  const auto res = ga::to_result(s, "idom", idom);
+  assert_eq(res.headers, std::vector<std::string>{"id", "idom"});
+  assert(res.body[0][1] == "NULL" && res.body[4][1] == "4");
+
+  // A larger graph with many threads agrees with sequential
+  // references: Vertex i points to i + 1, 2i and 3i mod n
+  const uint64_t n = 20000;
+  GQL big;
+  {
+    auto loader = big.bulk();
+    for (uint64_t i = 0; i < n; ++i) {
+      loader.vertex(i);
+    }
+    for (uint64_t i = 0; i < n / 2; ++i) {
+      loader.edge(i, i + 1, "", {{"w", std::to_string(i % 7)}});
+      loader.edge(i, (2 * i) % n, "", {{"w", "3"}});
+      loader.edge(i, (3 * i) % n, "", {{"w", "11"}});
+    }
+    loader.flush();
+  }
+  const auto bs = big.snapshot(false);
+
+  std::vector<int64_t> expected(n, ga::UNREACHED);
+  std::vector<ga::Index> queue = {0};
+  expected[0] = 0;
+  for (size_t i = 0; i < queue.size(); ++i) {
+    for (const auto &w : bs.out(queue[i])) {
+      if (expected[w] == ga::UNREACHED) {
+        expected[w] = expected[queue[i]] + 1;
+        queue.push_back(w);
+      }
+    }
+  }
+  assert_eq(ga::bfs(bs, {0}, 4), expected);
+  assert_eq(ga::bfs(bs, {0}, 1), expected);
+
+  const auto weights = ga::edge_weights(big, bs, "w");
+  const auto par = ga::shortest_paths(bs, 0, weights, 4);
+  assert_eq(par, ga::shortest_paths(bs, 0, weights, 1));
+  std::vector<double> best(n, INFINITY);
+  std::priority_queue<std::pair<double, ga::Index>,
+                      std::vector<std::pair<double, ga::Index>>,
+                      std::greater<>>
+      heap;
+  heap.push({best[0] = 0.0, 0});
+  while (!heap.empty()) {
+    const auto [d, u] = heap.top();
+    heap.pop();
+    if (d > best[u]) {
+      continue;
+    }
+    const auto targets = bs.out(u);
+    for (size_t k = 0; k < targets.size(); ++k) {
+      const double c = d + weights[bs.out_offset(u) + k];
+      if (c < best[targets[k]]) {
+        heap.push({best[targets[k]] = c, targets[k]});
+      }
+    }
+  }
+  assert_eq(par, best);
+
+  assert_eq(ga::weak_components(bs, 4),
+            ga::weak_components(bs, 1));
+  const auto pr4 = ga::pagerank(bs, 0.85, 50, 1e-12, 4);
+  const auto pr1 = ga::pagerank(bs, 0.85, 50, 1e-12, 1);
+  for (size_t i = 0; i < n; ++i) {
+    assert(std::fabs(pr4[i] - pr1[i]) < 1e-12);
+  }
+}
+
+void test_degree_index() {
+  // A hub 1 -> {2..20}, a chain 2 -> 3 -> ... -> 20 and a
+  // self-loop on 20
+  const auto build = [](GQL &_g) {
+    for (uint64_t i = 1; i <= 20; ++i) {
+      _g.add_vertex(i);
+    }
+    for (uint64_t i = 2; i <= 20; ++i) {
+      _g.add_edge(1, i);
+      _g.add_edge(i, i == 20 ? 20 : i + 1);
+    }
+  };
+  const auto agree = [](GQL &_a, GQL &_b) {
+    assert(_a.v().in_degree().body == _b.v().in_degree().body);
+    assert(_a.v().out_degree().body ==
+           _b.v().out_degree().body);
+    for (uint64_t d = 0; d < 22; ++d) {
+      assert_eq(_a.v().with_in_degree(d).id(),
+                _b.v().with_in_degree(d).id());
+      assert_eq(_a.v().with_out_degree(d).id(),
+                _b.v().with_out_degree(d).id());
+    }
+  };
+
+  GQL plain("foo.db", true);
+  build(plain);
+
+  // Index part of the way through, so both old and new edges
+  // are counted
+  GQL g("maker.db", true);
+  for (uint64_t i = 1; i <= 20; ++i) {
+    g.add_vertex(i);
+  }
+  for (uint64_t i = 2; i <= 10; ++i) {
+    g.add_edge(1, i);
+    g.add_edge(i, i + 1);
+  }
+  assert(!g.degrees_indexed());
+  g.index_degrees();
+  assert(g.degrees_indexed());
+  for (uint64_t i = 11; i <= 20; ++i) {
+    g.add_edge(1, i);
+    g.add_edge(i, i == 20 ? 20 : i + 1);
+  }
+  agree(g, plain);
+  assert_eq(g.v().with_in_degree(0).id(),
+            std::list<uint64_t>{1});
+  assert_eq(g.v().with_out_degree(19).id(),
+            std::list<uint64_t>{1});
+  assert(g.v().with_id(20).in_degree().body[0][1] == "3");
+
+  // Erasing edges and vertices keeps the counts up to date
+  for (GQL *h : {&g, &plain}) {
+    h->v().with_id(1).out().with_id(1).erase();
+    h->v().with_id(5).erase();
+    h->v().with_id(20).out().erase();
+  }
+  agree(g, plain);
+
+  // Edges loaded before their vertices are counted too
+  for (GQL *h : {&g, &plain}) {
+    h->bulk().edge(30, 31).vertex(31).vertex(30).flush();
+  }
+  agree(g, plain);
+
+  // Detected when reopened
+  g.commit();
+  GQL reopened("maker.db");
+  assert(reopened.degrees_indexed());
+  assert(!plain.degrees_indexed());
+
+  // Undone by a rollback
+  plain.commit();
+  plain.index_degrees();
+  assert(plain.degrees_indexed());
+  plain.rollback();
+  assert(!plain.degrees_indexed());
+  assert(plain.v().with_in_degree(0).count() ==
+         g.v().with_in_degree(0).count());
+}
+
+void test_erase() {
+  GQL g;
+  for (uint64_t i = 1; i <= 6; ++i) {
+    g.add_vertex(i);
+  }
+  for (uint64_t i = 1; i < 6; ++i) {
+    g.add_edge(i, i + 1);
+  }
+  g.add_edge(6, 1);
+  g.add_edge(3, 3);
+
+  // Only edges touching the erased vertex go
+  g.v().with_id(3).erase();
+  assert_eq(g.v().id(), std::list<uint64_t>{1, 2, 4, 5, 6});
+  assert(g.e().id().size() == 4);
+  assert(g.v().with_id(2).out().id().empty());
+  assert(g.v().with_id(4).in().id().empty());
+
+  // Sets are materialized before erasing, so erasing edges
+  // does not change which vertices are erased: Only 4 has no
+  // in-edges here, even though 5 has none once 4 is gone
+  g.v().with_in_degree(0).erase();
+  assert_eq(g.v().id(), std::list<uint64_t>{1, 2, 5, 6});
+
+  // Bulk erasure by id, ignoring unknown ids
+  g.erase_vertices({1, 99});
+  assert_eq(g.v().id(), std::list<uint64_t>{2, 5, 6});
+  assert(g.e().id().size() == 1);
+  g.add_edge(2, 6);
+  g.add_edge(6, 2);
+  const auto edges = g.v().with_id(2).out().id();
+  g.erase_edges({edges.begin(), edges.end()});
+  assert(g.v().with_id(2).out().id().empty());
+  assert(g.v().with_id(2).in().id().size() == 1);
+  g.erase_vertices({});
+  g.erase_edges({12345});
+  assert(g.e().id().size() == 2);
+}
+
+void test_plan() {
+  GQL g;
+  for (uint64_t i = 1; i <= 10; ++i) {
+    g.add_vertex(i).label(i % 2 ? "odd" : "even");
+    g.v().with_id(i).tag("n", std::to_string(i));
+  }
+  for (uint64_t i = 1; i < 10; ++i) {
+    g.add_edge(i, i + 1).label(i % 3 ? "step" : "jump");
+  }
+
+  // Text slots
+  auto succ = g.plan([](GQL &_g, const GQL::Slots &_s) {
+    return _g.v().with_label(_s.text(0)).out().target();
+  });
+  assert(succ.size() == 1);
+  for (const std::string label : {"odd", "even", "none"}) {
+    assert_eq(succ({label}).id(),
+              g.v().with_label(label).out().target().id());
+  }
+
+  // Runs bind values to one cached statement, without bouncing
+  succ({"odd"}).id();
+  const auto calls = g.sql_call_counter;
+  const auto hits = g.stmt_cache_hits;
+  for (int i = 0; i < 5; ++i) {
+    succ({i % 2 ? "odd" : "even"}).id();
+  }
+  assert(g.sql_call_counter == calls + 5);
+  assert(g.stmt_cache_hits == hits + 5);
+
+  // Number slots, slots used twice, Edges and tags
+  auto hop = g.plan([](GQL &_g, const GQL::Slots &_s) {
+    return _g.v()
+        .with_id(_s.number(0))
+        .out()
+        .with_label(_s.text(1))
+        .target()
+        .limit(_s.number(2));
+  });
+  assert(hop.size() == 3);
+  assert_eq(hop({3, "jump", 5}).id(), std::list<uint64_t>{4});
+  assert(hop({3, "step", 5}).id().empty());
+  auto tagged = g.plan([](GQL &_g, const GQL::Slots &_s) {
+    return _g.e()
+        .with_label(_s.text(0))
+        .source()
+        .with_tag(_s.text(1), _s.text(2))
+        .out();
+  });
+  assert_eq(tagged({"jump", "n", "6"}).id(),
+            g.v().with_id(6).out().id());
+  assert_eq(tagged({"jump", "n", "6"}).target().id(),
+            std::list<uint64_t>{7});
+
+  // Bad runs
+  const auto throws = [](const std::function<void()> &_fn) {
+    try {
+      _fn();
+    } catch (std::runtime_error &) {
+      return true;
+    }
+    return false;
+  };
+  assert(throws([&]() { succ({}); }));
+  assert(throws([&]() { succ({5}); }));
+  assert(throws([&]() { hop({"3", "jump", 5}); }));
+
+  // Dictionary ids fit any key into the recorded JSON path,
+  // but raw keys with quotes do not
+  assert(tagged({"jump", "a\"b", "6"}).id().empty());
+  GQL::Options raw;
+  raw.format = GQL::RAW;
+  GQL r(":memory:", false, true, raw);
+  auto keyed = r.plan([](GQL &_g, const GQL::Slots &_s) {
+    return _g.v().with_tag(_s.text(0), "1");
+  });
+  assert(throws([&]() { keyed({"a\"b"}); }));
+
+  // Only recorded slots are slots: constants that look like
+  // one stay constants, and depths cannot be slots
+  auto constant = g.plan([](GQL &_g, const GQL::Slots &) {
+    return _g.v()
+        .with_id(0xFFFFFFFF00000001)
+        .traverse(GQL::NO_LIMIT);
+  });
+  assert(constant.size() == 0);
+  assert(constant({}).id().empty());
+  auto reach = g.plan([](GQL &_g, const GQL::Slots &_s) {
+    return _g.v().with_id(_s.number(0)).traverse();
+  });
+  assert_eq(reach({8}).id(), g.v().with_id(8).traverse().id());
+  assert(throws([&]() {
+    g.plan([](GQL &_g, const GQL::Slots &_s) {
+      return _g.v().with_id(1).traverse(_s.number(0));
+    });
+  }));
+
+  // Recording cannot run queries, and recovers afterwards
+  assert(throws([&]() {
+    g.plan([](GQL &_g, const GQL::Slots &_s) {
+      _g.v().with_label(_s.text(0)).id();
+      return _g.v();
+    });
+  }));
+  assert(g.v().id().size() == 10);
+}
+
+void test_result_cache() {
+  GQL g;
+  for (uint64_t i = 1; i <= 20; ++i) {
+    g.add_vertex(i).label(i % 2 ? "odd" : "even");
+  }
+  g.add_edge(1, 2);
+  g.commit();
+  g.cache_results();
+  assert(g.results_cached());
+
+  // Repeated reads run no SQL
+  assert(g.v().with_label("odd").id().size() == 10);
+  auto calls = g.sql_call_counter;
+  assert(g.v().with_label("odd").id().size() == 10);
+  assert(g.v().with_label("odd").count() == 10);
+  assert(g.v().with_label("odd").count() == 10);
+  assert(g.sql_call_counter == calls + 1);
+  assert(g.result_cache_hits == 2);
+
+  // Shared tables are not copied
+  const auto a = g.v().shared({"id", "label"});
+  const auto b = g.v().shared({"id", "label"});
+  assert(a == b && a->size() == 20);
+  assert(a->headers == (std::vector<std::string>{"id", "label"}));
+  assert(g.v().table({"id", "label"}).text(1, 1) == "even");
+
+  // Edge writes leave vertex-only results alone
+  g.add_edge(3, 4);
+  calls = g.sql_call_counter;
+  assert(g.v().shared({"id", "label"}) == a);
+  assert(g.sql_call_counter == calls);
+  assert(g.e().count() == 2);
+
+  // Every vertex write is seen
+  g.v().with_id(1).label("even");
+  assert(g.v().with_label("odd").count() == 9);
+  assert(g.v().shared({"id", "label"}) != a);
+  g.v().with_id(3).tag("x", "y");
+  assert(g.v().with_tag("x", "y").label().size() == 1);
+  g.v().with_id(5).tag("x", "y");
+  assert(g.v().with_tag("x", "y").label().size() == 2);
+  g.add_vertex(21).label("odd");
+  assert(g.v().with_label("odd").count() == 10);
+  g.v().with_id(21).erase();
+  assert(g.v().with_label("odd").count() == 9);
+  g.e().with_id(1).erase();
+  assert(g.e().count() == 1);
+
+  // As is a rollback
+  assert(g.v().count() == 20);
+  g.rollback();
+  assert(g.v().count() == 20 && g.e().count() == 1);
+  assert(g.v().with_label("odd").count() == 10);
+  assert(g.v().with_tag("x", "y").empty());
+
+  // Tables written by triggers are tracked like any other
+  {
+    GQL d;
+    d.add_vertex(1);
+    d.add_vertex(2);
+    d.index_degrees();
+    d.cache_results();
+    assert(d.v().with_in_degree(0).count() == 2);
+    d.add_edge(1, 2);
+    assert(d.v().with_in_degree(0).count() == 1);
+    assert(d.v().with_out_degree(1).id() ==
+           std::vector<uint64_t>{1});
+    d.e().erase();
+    assert(d.v().with_in_degree(0).count() == 2);
+    assert(d.v().with_out_degree(1).empty());
+  }
+
+  // Stopping drops the cache
+  g.cache_results(false);
+  calls = g.sql_call_counter;
+  g.v().count();
+  g.v().count();
+  assert(g.sql_call_counter == calls + 2);
+
+  // Read-only handles see the writer's commits
+  GQL w("foo.db", true, true, GQL::Options::durable());
+  w.add_vertex(1);
+  w.commit();
+  auto r = GQL::open_readonly("foo.db");
+  r->cache_results();
+  assert(r->v().count() == 1);
+  assert(r->v().count() == 1 && r->result_cache_hits == 1);
+  w.add_vertex(2);
+  w.commit();
+  assert(r->v().count() == 2);
+}
+
+void test_writer() {
+  {
+    GQL erase("foo.db", true);
+  }
+
+  {
+    GQL::Writer w("foo.db", GQL::Options::durable(), 64,
+                  std::chrono::milliseconds(1000));
+
+    // Writes from many threads are committed in groups
+    std::vector<std::thread> threads;
+    std::vector<std::future<uint64_t>> ids(200);
+    for (size_t t = 0; t < 4; ++t) {
+      threads.emplace_back([&, t]() {
+        for (size_t i = t; i < ids.size(); i += 4) {
+          ids[i] = w.submit([i](GQL &_g) {
+            return _g.add_vertex(i + 1).id().front();
+          });
+        }
+      });
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+    w.flush().get();
+    for (size_t i = 0; i < ids.size(); ++i) {
+      assert(ids[i].get() == i + 1);
+    }
+    assert(w.commits() >= 1 && w.commits() <= 5);
+
+    // Readers see what has been committed
+    GQL::Pool pool("foo.db", 2);
+    assert(pool.acquire()->v().count() == 200);
+
+    // A failed write is undone on its own
+    auto bad = w.submit([](GQL &_g) {
+      _g.v().with_id(1).label("bad");
+      throw std::runtime_error("Failed write");
+    });
+    auto good = w.submit(
+        [](GQL &_g) { _g.v().with_id(2).label("good"); });
+    bool threw = false;
+    try {
+      bad.get();
+    } catch (const std::runtime_error &) {
+      threw = true;
+    }
+    assert(threw);
+    good.get();
+    auto r = pool.acquire();
+    assert(r->v().with_label("bad").empty());
+    assert(r->v().with_label("good").count() == 1);
+
+    // Queued writes are committed when the writer stops
+    for (uint64_t i = 201; i <= 250; ++i) {
+      w.submit([i](GQL &_g) { _g.add_vertex(i); });
+    }
+  }
+  assert(GQL::open_readonly("foo.db")->v().count() == 250);
+}
+
 ////////////////////////////////////////////////////////////////
 
+void test_adjacency() {
+  std::string hop;
+  {
+    GQL g("foo.db", true);
+    for (uint64_t i = 1; i <= 6; ++i) {
+      g.add_vertex(i);
+    }
+    g.add_edge(1, 2).label("TRUE");
+    g.add_edge(1, 3).label("FALSE");
+    g.add_edge(1, 4).label("TRUE");
+    g.add_edge(5, 1).label("TRUE");
+    g.add_edge(6, 1).label("FALSE");
+
+    // Labelled hops agree with filtering the unlabelled ones
+    const auto v = g.v().with_id(1);
+    assert_eq(v.out("TRUE").target().id(),
+              std::list<uint64_t>{2, 4});
+    assert_eq(v.out("TRUE").id(),
+              v.out().with_label("TRUE").id());
+    assert_eq(v.in("FALSE").source().id(),
+              std::list<uint64_t>{6});
+    assert(v.out("none").id().empty());
+
+    g.trace([&](const GQL::Trace &_t) { hop = _t.sql; });
+    v.out("TRUE").target().id();
+    g.trace(nullptr);
+    g.commit();
+  }
+
+  // Leave behind an index from an older version
+  sqlite3 *db = nullptr;
+  sqlite3_open("foo.db", &db);
+  assert(sqlite3_exec(db, "CREATE INDEX edge_src ON edges(source);",
+                      nullptr, nullptr, nullptr) == SQLITE_OK);
+  sqlite3_close(db);
+  { GQL g("foo.db"); }
+
+  // Only the composite indices remain on edges
+  sqlite3_open("foo.db", &db);
+  sqlite3_stmt *stmt = nullptr;
+  sqlite3_prepare_v2(db,
+                     "SELECT group_concat(name, ' ') FROM (SELECT "
+                     "name FROM sqlite_master WHERE type = 'index' "
+                     "AND tbl_name = 'edges' AND sql IS NOT NULL "
+                     "ORDER BY name);",
+                     -1, &stmt, nullptr);
+  assert(sqlite3_step(stmt) == SQLITE_ROW);
+  assert(std::string((const char *)sqlite3_column_text(stmt, 0)) ==
+         "edge_in edge_lbl edge_out");
+  sqlite3_finalize(stmt);
+
+  // A labelled hop is answered from one index, without
+  // touching the edges table
+  const std::string explain = "EXPLAIN QUERY PLAN " + hop;
+  sqlite3_prepare_v2(db, explain.c_str(), -1, &stmt, nullptr);
+  bool covered = false;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    covered |= std::string((const char *)sqlite3_column_text(
+                               stmt, 3))
+                   .find("COVERING INDEX edge_out") !=
+               std::string::npos;
+  }
+  sqlite3_finalize(stmt);
+  sqlite3_close(db);
+  assert(covered);
+}
+
+void test_reserve_ids() {
+  {
+    GQL g("foo.db", true);
+    g.add_vertex();
+    g.add_vertex();
+    g.add_vertex(7);
+    g.add_edge(1, 2);
+    g.commit();
+  }
+
+  // Numbering continues after the rows already stored
+  GQL g("foo.db");
+  assert(g.add_vertex().id().front() == 8);
+  assert(g.add_edge(7, 8).id().front() == 2);
+
+  // Reserved ranges are never given out again
+  const auto first = g.reserve_vertex_ids(10);
+  assert(first == 9);
+  assert(g.add_vertex().id().front() == 19);
+  g.bulk().vertex(first, "a").vertex(first + 9, "b").flush();
+  const auto edges = g.reserve_edge_ids(5);
+  assert(edges == 3);
+  assert(g.add_edge(9, 18).id().front() == edges + 5);
+  assert(g.v()
+             .with_id(9)
+             .add_edge(g.v().with_label("b"))
+             .id()
+             .back() == edges + 6);
+  assert(g.reserve_edge_ids(0) == edges + 7);
+
+  // Threads reserve disjoint ranges without locking
+  std::vector<uint64_t> starts(8);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < starts.size(); ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < 1000; ++i) {
+        starts[t] = g.reserve_vertex_ids(3);
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  assert(g.reserve_vertex_ids(1) == 20 + 8 * 1000 * 3);
+  std::sort(starts.begin(), starts.end());
+  assert(std::adjacent_find(starts.begin(), starts.end()) ==
+         starts.end());
+
+  // Explicit ids move the counters past them at once
+  GQL h;
+  h.add_vertex(1);
+  assert(h.add_vertex().id().front() == 2);
+  h.bulk().vertex(5).flush();
+  assert(h.add_vertex().id().front() == 6);
+  GQL::Record r;
+  r.id = 10;
+  r.source = 1;
+  r.target = 2;
+  h.bulk().edge(r).flush();
+  assert(h.add_edge(2, 1).id().front() == 11);
+  {
+    std::ofstream csv("foo.csv");
+    csv << "6,40\n";
+  }
+  h.import_edge_list("foo.csv");
+  assert(h.add_vertex().id().front() == 41);
+
+  // Automatic edge ids are only used up by successful writes
+  const auto next = h.add_edge(1, 2).id().front() + 1;
+  bool threw = false;
+  try {
+    h.bulk().edge(1, 2).edge(r).flush();
+  } catch (std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+  assert(h.add_edge(1, 2).id().front() == next);
+}
+
+void test_sharded() {
+  const std::vector<std::string> files = {
+      "foo.shard0.db", "foo.shard1.db", "foo.shard2.db"};
+
+  // The same graph, sharded and not
+  GQL plain("foo.db", true);
+  {
+    GQL::Sharded g(files, true);
+    assert(g.size() == 3);
+    for (uint64_t i = 1; i <= 30; ++i) {
+      g.add_vertex(i).label(i % 3 ? "other" : "three");
+      plain.add_vertex(i).label(i % 3 ? "other" : "three");
+    }
+    auto loader = g.bulk();
+    auto plain_loader = plain.bulk();
+    for (uint64_t i = 1; i < 30; ++i) {
+      loader.edge(i, i + 1, "next");
+      plain_loader.edge(i, i + 1, "next");
+      if (2 * i <= 30) {
+        loader.edge(i, 2 * i, "double", {{"from", "x"}});
+        plain_loader.edge(i, 2 * i, "double", {{"from", "x"}});
+      }
+    }
+    loader.flush();
+    plain_loader.flush();
+
+    // Every shard holds part of the graph
+    for (size_t i = 0; i < g.size(); ++i) {
+      assert(g.shard(i).v().count() > 0);
+      for (const auto &id : g.shard(i).v().id()) {
+        assert(g.shard_of(id) == i);
+      }
+    }
+
+    // Queries agree, including hops across shards
+    assert(g.v().count() == 30 && g.e().count() == 44);
+    assert_eq(g.e().id(), plain.e().id());
+    assert_eq(g.v().with_label("three").out("next").target().id(),
+              plain.v().with_label("three").out("next").target().id());
+    assert_eq(g.v().with_label("three").in("double").source().id(),
+              plain.v().with_label("three").in("double").source().id());
+    assert_eq(g.v().with_id(12).in().source().id(),
+              std::vector<uint64_t>{6, 11});
+    assert_eq(g.e().with_tag("from", "x").target().id(),
+              plain.e().with_tag("from", "x").target().id());
+    assert_eq(g.v()
+                  .filter([](const GQL::Record &_r) {
+                    return _r.id > 25;
+                  })
+                  .join(g.v().with_id(1))
+                  .id(),
+              std::vector<uint64_t>{1, 26, 27, 28, 29, 30});
+    assert(g.v().with_id(9).label().body ==
+           plain.v().with_id(9).label().body);
+    assert(g.v().label().body == plain.v().label().body);
+
+    // Erasing a vertex erases the edges into it from any shard
+    g.v().with_id(10).erase();
+    plain.v().with_id(10).erase();
+    assert_eq(g.e().id(), plain.e().id());
+    assert(!g.v().with_id(10).exists());
+    g.commit();
+  }
+
+  // Ids continue after the largest in any shard
+  GQL::Sharded g(files);
+  assert(g.add_vertex().id() == std::vector<uint64_t>{31});
+  assert(g.add_edge(31, 1).id() ==
+         std::vector<uint64_t>{plain.e().id().back() + 1});
+  assert(g.v().with_id(31).out().target().id() ==
+         std::vector<uint64_t>{1});
+
+  // And after explicit ids in the same session
+  g.add_vertex(40);
+  g.add_vertex(35);
+  assert(g.add_vertex().id() == std::vector<uint64_t>{41});
+  g.bulk().vertex(50).vertex(45).flush();
+  assert(g.add_vertex().id() == std::vector<uint64_t>{51});
+  assert(g.v().count() == 36);
+
+  // A failed flush uses up no edge ids
+  const auto next = g.add_edge(40, 1).id().front() + 1;
+  bool threw = false;
+  try {
+    g.bulk().vertex(40).edge(40, 1).flush();
+  } catch (std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+  assert(g.add_edge(40, 1).id().front() == next);
+}
+
+void test_pattern() {
+  GQL g;
+  for (uint64_t i = 1; i <= 12; ++i) {
+    g.add_vertex(i).label(i <= 3 ? "PREDICATE"
+                                 : (i <= 8 ? "STATEMENT" : "X"));
+  }
+  g.v().with_id(2).tag("tainted", "yes");
+  for (uint64_t i = 1; i <= 3; ++i) {
+    g.add_edge(i, i + 3).label("TRUE");
+    g.add_edge(i, i + 4).label(i == 2 ? "TRUE" : "FALSE");
+  }
+  for (uint64_t i = 4; i <= 8; ++i) {
+    g.add_edge(i, i + 4 > 12 ? 12 : i + 4).label("DATA");
+  }
+  g.add_edge(9, 9).label("SELF");
+
+  // The same matches as nested loops over each step
+  std::set<std::vector<uint64_t>> expected;
+  for (const auto &p : g.v().with_label("PREDICATE").id()) {
+    for (const auto &t : g.v().with_id(p).out("TRUE").id()) {
+      const auto s = g.e().with_id(t).target();
+      if (!s.with_label("STATEMENT").exists()) {
+        continue;
+      }
+      for (const auto &x : s.out("DATA").target().id()) {
+        expected.insert({p, s.id().front(), t, x});
+      }
+    }
+  }
+  auto p = g.match()
+               .vertex("p", "PREDICATE")
+               .edge("p", "TRUE", "s", "t")
+               .vertex("s", "STATEMENT")
+               .edge("s", "DATA", "x");
+  std::set<std::vector<uint64_t>> found;
+  for (const auto &row : p.stream()) {
+    assert(row.size() == 4);
+    found.insert({(uint64_t)row.integer(0),
+                  (uint64_t)row.integer(1),
+                  (uint64_t)row.integer(2),
+                  (uint64_t)row.integer(3)});
+  }
+  assert(found == expected && found.size() == 4);
+  assert(p.count() == 4 && p.table().size() == 4);
+  assert(p.column("t") == 2 && p.column("x") == 3);
+
+  // Bound variables continue as ordinary sets
+  assert_eq(p.vertices("x").id(), std::vector<uint64_t>{8, 9, 10});
+  assert(p.edges("t").count() == 4);
+  assert_eq(p.vertices("x").in("DATA").source().id(),
+            std::vector<uint64_t>{4, 5, 6});
+
+  // Any set constrains a variable, and constraints intersect
+  auto tainted = g.match()
+                     .vertex("p", g.v().with_tag("tainted", "yes"))
+                     .vertex("p", "PREDICATE")
+                     .edge("p", g.e(), "s");
+  assert_eq(tainted.vertices("s").id(), std::vector<uint64_t>{5, 6});
+
+  // Self-loops, and variables joined only by their edges
+  assert(g.match().edge("a", "SELF", "a").count() == 1);
+  assert(g.match().edge("a", "DATA", "b").edge("b", "SELF", "b")
+             .count() == 1);
+  assert(g.match().vertex("a", "X").vertex("b", "X").count() ==
+         16);
+
+  // Mistakes are reported
+  bool threw = false;
+  try {
+    g.match().edge("a", "TRUE", "b", "a");
+  } catch (std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+  threw = false;
+  try {
+    p.vertices("t");
+  } catch (std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+}
+
 int main() {
   bool did_fail = false;
   const static auto run_test = [&](auto _fn) {
@@ -560,6 +2523,90 @@ int main() {
   std::cout << "test_bounce();\n";
   run_test(test_bounce);
 
+  std::cout << "test_bounce_lifetime();\n";
+  run_test(test_bounce_lifetime);
+
+  std::cout << "test_flatten();\n";
+  run_test(test_flatten);
+
+  std::cout << "test_terminals();\n";
+  run_test(test_terminals);
+
+  std::cout << "test_trace();\n";
+  run_test(test_trace);
+
+  std::cout << "test_export();\n";
+  run_test(test_export);
+
+  std::cout << "test_stmt_cache();\n";
+  run_test(test_stmt_cache);
+
+  std::cout << "test_bulk();\n";
+  run_test(test_bulk);
+
+  std::cout << "test_traverse();\n";
+  run_test(test_traverse);
+
+  std::cout << "test_table();\n";
+  run_test(test_table);
+
+  std::cout << "test_stream();\n";
+  run_test(test_stream);
+
+  std::cout << "test_filter();\n";
+  run_test(test_filter);
+
+  std::cout << "test_tag_index();\n";
+  run_test(test_tag_index);
+
+  std::cout << "test_raw_format();\n";
+  run_test(test_raw_format);
+
+  std::cout << "test_dict_format();\n";
+  run_test(test_dict_format);
+
+  std::cout << "test_hex_format();\n";
+  run_test(test_hex_format);
+
+  std::cout << "test_options();\n";
+  run_test(test_options);
+
+  std::cout << "test_readonly();\n";
+  run_test(test_readonly);
+
+  std::cout << "test_snapshot();\n";
+  run_test(test_snapshot);
+
+  std::cout << "test_algorithms();\n";
+  run_test(test_algorithms);
+
+  std::cout << "test_degree_index();\n";
+  run_test(test_degree_index);
+
+  std::cout << "test_adjacency();\n";
+  run_test(test_adjacency);
+
+  std::cout << "test_reserve_ids();\n";
+  run_test(test_reserve_ids);
+
+  std::cout << "test_sharded();\n";
+  run_test(test_sharded);
+
+  std::cout << "test_pattern();\n";
+  run_test(test_pattern);
+
+  std::cout << "test_erase();\n";
+  run_test(test_erase);
+
+  std::cout << "test_plan();\n";
+  run_test(test_plan);
+
+  std::cout << "test_result_cache();\n";
+  run_test(test_result_cache);
+
+  std::cout << "test_writer();\n";
+  run_test(test_writer);
+
   // Clean up
   for (const auto &entry :
        std::filesystem::directory_iterator{"."}) {